@@ -21,6 +21,7 @@
 
 #include <vector>
 #include "common/array.h"
+#include "common/cpu_features.h"
 
 namespace {
 
@@ -155,6 +156,10 @@ ArrayMap<Array<Bitboard, 128>, Square> Bitboard::lance_attacks_bb_;
 Array<Bitboard, 20224> Bitboard::bishop_attacks_bb_;
 Array<Bitboard, 512000> Bitboard::rook_attacks_bb_;
 ArrayMap<uint64_t, Square> Bitboard::eight_neighborhoods_magics_;
+Bitboard::SlidingAttackMethod Bitboard::sliding_attack_method_ = Bitboard::kMagic;
+ArrayMap<Bitboard::PextMask, Square> Bitboard::pext_masks_;
+Array<Bitboard, 20224> Bitboard::bishop_pext_attacks_bb_;
+ArrayMap<Array<Bitboard, 128>, Square> Bitboard::rank_attacks_bb_;
 
 Bitboard Bitboard::FileFill(Bitboard x) {
   // Kogge-Stone Algorithm
@@ -359,6 +364,36 @@ void Bitboard::Init() {
   assert(bishop_ptr == bishop_attacks_bb_.end());
   assert(rook_ptr == rook_attacks_bb_.end());
 
+  // 6-2. PEXT命令用のマスクとテーブル
+  Bitboard* bishop_pext_ptr = bishop_pext_attacks_bb_.begin();
+  for (Square sq : Square::all_squares()) {
+    const auto& m = magic_numbers_[sq];
+    const Bitboard rank_mask = m.rook_mask & rank_bb(sq.rank());
+    auto& p = pext_masks_[sq];
+    p.bishop_mask[0] = m.bishop_mask.extract64<0>();
+    p.bishop_mask[1] = m.bishop_mask.extract64<1>();
+    p.rank_mask[0]   = rank_mask.extract64<0>();
+    p.rank_mask[1]   = rank_mask.extract64<1>();
+    p.bishop_ptr     = bishop_pext_ptr;
+    p.bishop_shift   = bitop::popcnt64(p.bishop_mask[0]);
+    p.rank_shift     = bitop::popcnt64(p.rank_mask[0]);
+
+    // PEXT命令で取り出すビットの順序は、ComputeOccupancy()が駒を配置する順序と同じになるので、
+    // i番目の配置パターンのインデックスは、i自身となる
+    // bishop_pext_attacks_bb_
+    for (int i = 0, n = 1 << m.bishop_mask.count(); i < n; ++i) {
+      Bitboard occ = ComputeOccupancy(m.bishop_mask, i);
+      *bishop_pext_ptr++ = ComputeSlidingAttacks(sq, occ, slides[kBishop]);
+    }
+
+    // rank_attacks_bb_
+    for (int i = 0, n = 1 << rank_mask.count(); i < n; ++i) {
+      Bitboard occ = ComputeOccupancy(rank_mask, i);
+      rank_attacks_bb_[sq][i] = ComputeSlidingAttacks(sq, occ, {kDeltaE, kDeltaW});
+    }
+  }
+  assert(bishop_pext_ptr == bishop_pext_attacks_bb_.end());
+
   // 7. line_bb_ and between_bb_
   for (Square i : Square::all_squares())
     for (Square j : Square::all_squares())
@@ -424,6 +459,25 @@ void Bitboard::Init() {
           eight_neighborhoods_magics_[Square(9 + (i - 45))];
     }
   }
+
+  // 12. 実行中のCPUで最も高速な、角・飛車の利きを求める方法を選択する
+  set_sliding_attack_method(GetBestSlidingAttackMethod());
+}
+
+bool Bitboard::set_sliding_attack_method(const SlidingAttackMethod method) {
+  if (method == kPext && !cpu_features::HasBmi2()) {
+    return false;
+  }
+  sliding_attack_method_ = method;
+  return true;
+}
+
+Bitboard::SlidingAttackMethod Bitboard::GetBestSlidingAttackMethod() {
+  return cpu_features::HasFastPext() ? kPext : kMagic;
+}
+
+const char* Bitboard::GetSlidingAttackMethodName(const SlidingAttackMethod method) {
+  return method == kPext ? "PEXT" : "Magic";
 }
 
 namespace {
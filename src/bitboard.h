@@ -24,6 +24,7 @@
 #include <smmintrin.h> // SSE 4.1
 #include "common/array.h"
 #include "common/arraymap.h"
+#include "common/bitop.h"
 #include "piece.h"
 #include "square.h"
 
@@ -31,6 +32,8 @@
  * ビットボードを実装したクラスです.
  *
  * Bitboardクラスは、内部的にはMagic Bitboardを用いて実装されています。
+ * ただし、PEXT命令が高速に実行できるCPUでは、Init()の呼び出し時に、角と飛車の利きの計算を
+ * PEXT命令を用いた方法に切り替えます（詳しくは、SlidingAttackMethodを参照）。
  *
  * なお、Bitboardクラス内部のビットの位置と、実際の将棋盤との対応は、以下のとおりです。
  * <pre>
@@ -70,6 +73,24 @@
  */
 class Bitboard {
  public:
+  /**
+   * 角・飛車の利きを求める方法です.
+   */
+  enum SlidingAttackMethod {
+    /**
+     * Magic Bitboard（乗算とシフトで、テーブルのインデックスを求める）.
+     * 飛車の利きのテーブルは、512000要素（約8MB）になります。
+     */
+    kMagic,
+    /**
+     * BMI2のPEXT命令で、テーブルのインデックスを求める.
+     * 角の利きは、空きのない密なテーブル（20224要素）を参照します。
+     * 飛車の利きは、縦方向（香車の利きのテーブルを流用）と横方向（マスごとに128要素）に分けて
+     * 参照するので、テーブルの合計サイズは約330KBで済み、キャッシュを汚しにくくなります。
+     */
+    kPext,
+  };
+
 
   // コンストラクタ
   explicit Bitboard(__m128i xmm = _mm_setzero_si128())
@@ -130,6 +151,29 @@ class Bitboard {
   // 各種テーブルの初期化用
   static void Init();
 
+  /**
+   * 現在使用している、角・飛車の利きを求める方法を返します.
+   */
+  static SlidingAttackMethod sliding_attack_method() {
+    return sliding_attack_method_;
+  }
+
+  /**
+   * 角・飛車の利きを求める方法を変更します（ベンチマーク用）.
+   * CPUがPEXT命令に対応していないのにkPextが指定された場合は、何もせずにfalseを返します。
+   */
+  static bool set_sliding_attack_method(SlidingAttackMethod method);
+
+  /**
+   * 実行中のCPUで最も高速な、角・飛車の利きを求める方法を返します.
+   */
+  static SlidingAttackMethod GetBestSlidingAttackMethod();
+
+  /**
+   * 角・飛車の利きを求める方法の名前を返します.
+   */
+  static const char* GetSlidingAttackMethodName(SlidingAttackMethod method);
+
   /**
    * ビットが立っている段をすべて1で埋めるための関数です.
    */
@@ -182,6 +226,19 @@ class Bitboard {
     int rook_shift;
   };
 
+  /**
+   * PEXT命令で角・飛車の利きを求めるためのマスクです.
+   * PEXT命令は64ビット単位でしか使えないので、ビットボードの上位・下位64ビットそれぞれについて、
+   * マスクを用意しておきます。
+   */
+  struct PextMask {
+    uint64_t bishop_mask[2];
+    uint64_t rank_mask[2];
+    const Bitboard* bishop_ptr;
+    int bishop_shift; // 下位64ビットのマスクのビット数（上位64ビットから取り出したビットのシフト量）
+    int rank_shift;   // 同上
+  };
+
   uint64_t uint64() const;
 
   // マスク
@@ -208,6 +265,12 @@ class Bitboard {
   static Array<Bitboard, 512000> rook_attacks_bb_;
   static ArrayMap<uint64_t, Square> eight_neighborhoods_magics_;
 
+  // PEXT命令用のテーブル
+  static SlidingAttackMethod sliding_attack_method_;
+  static ArrayMap<PextMask, Square> pext_masks_;
+  static Array<Bitboard, 20224> bishop_pext_attacks_bb_;
+  static ArrayMap<Array<Bitboard, 128>, Square> rank_attacks_bb_;
+
   // メンバ変数はXMMレジスタ１個分
   __m128i xmm_;
 };
@@ -370,6 +433,12 @@ inline Bitboard Bitboard::lance_attacks_bb(Square s, Bitboard occ, Color c) {
 }
 
 inline Bitboard Bitboard::bishop_attacks_bb(Square s, Bitboard occ) {
+  if (sliding_attack_method_ == kPext) {
+    const PextMask& p = pext_masks_[s];
+    uint64_t index = bitop::pext64(occ.extract64<0>(), p.bishop_mask[0])
+                  | (bitop::pext64(occ.extract64<1>(), p.bishop_mask[1]) << p.bishop_shift);
+    return p.bishop_ptr[index];
+  }
   uint64_t index = (occ & magic_numbers_[s].bishop_mask).uint64();
   index  *= magic_numbers_[s].bishop_magic;
   index >>= magic_numbers_[s].bishop_shift;
@@ -377,6 +446,15 @@ inline Bitboard Bitboard::bishop_attacks_bb(Square s, Bitboard occ) {
 }
 
 inline Bitboard Bitboard::rook_attacks_bb(Square s, Bitboard occ) {
+  if (sliding_attack_method_ == kPext) {
+    // 縦方向の利きは、香車の利きのテーブル（上下両方向の利きが入っている）を流用する
+    uint64_t file_index = (occ & magic_numbers_[s].lance_premask).uint64() >> magic_numbers_[s].lance_shift;
+    // 横方向の利きは、PEXT命令で求めたインデックスで参照する
+    const PextMask& p = pext_masks_[s];
+    uint64_t rank_index = bitop::pext64(occ.extract64<0>(), p.rank_mask[0])
+                       | (bitop::pext64(occ.extract64<1>(), p.rank_mask[1]) << p.rank_shift);
+    return lance_attacks_bb_[s][file_index] | rank_attacks_bb_[s][rank_index];
+  }
   uint64_t index = (occ & magic_numbers_[s].rook_mask).uint64();
   index  *= magic_numbers_[s].rook_magic;
   index >>= magic_numbers_[s].rook_shift;
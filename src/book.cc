@@ -395,8 +395,7 @@ void Book::SearchAllBookMoves() {
   const int kMaxBookPly = 50; // 初手から最大50手まで定跡として登録する
 
   // 棋譜DBを準備する
-  std::ifstream game_db_file(GameDatabase::kDefaultDatabaseFile);
-  GameDatabase game_db(game_db_file);
+  GameDatabase game_db;
   game_db.set_title_matches_only(true);
 
   // 棋譜DBから棋譜を全て読み込む
@@ -561,8 +560,7 @@ Book Book::CreateBook() {
 
   // 2. 対局データを読み込む準備をする
   const int kMaxBookPly = 50; // 初手から最大50手まで定跡として登録する
-  std::ifstream game_db_file(GameDatabase::kDefaultDatabaseFile);
-  GameDatabase game_db(game_db_file);
+  GameDatabase game_db;
   game_db.set_title_matches_only(true);
   struct MapKey {
     bool operator==(const MapKey& rhs) const {
@@ -20,26 +20,45 @@
 #include "cli.h"
 
 #include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cinttypes>
+#include <condition_variable>
 #include <fstream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <thread>
 #include <vector>
 #include <unordered_map>
+#include <poll.h>
+#include "common/aligned_memory.h"
 #include "common/array.h"
+#include "common/math.h"
 #include "common/simple_timer.h"
 #include "book.h"
 #include "cluster.h"
 #include "consultation.h"
+#include "evaluation.h"
 #include "gamedb.h"
 #include "learning.h"
 #include "mate1ply.h"
+#include "material.h"
 #include "mate3.h"
 #include "movegen.h"
 #include "move_probability.h"
+#include "optimizer.h"
+#include "perft.h"
 #include "position.h"
+#include "process.h"
 #include "progress.h"
 #include "search.h"
+#include "swap.h"
 #include "thinking.h"
 #include "usi.h"
 #include "usi_protocol.h"
+#include "worker_protocol.h"
 
 #if !defined(MINIMUM)
 
@@ -48,7 +67,15 @@ namespace {
 void BenchmarkSearch();
 void BenchmarkMoveGeneration(int num_calls);
 void BenchmarkMateSearch(int num_calls, int ply);
+void BenchmarkOptimizer(int num_iterations);
+void BenchmarkExtendedBoard(int num_games);
+void BenchmarkSlidingAttacks(int num_iterations);
+void BenchmarkStaticExchange(int num_iterations);
+void BenchmarkPipeIo(int num_workers, int num_lines);
+void SimulateCluster(int search_time);
 void CreateBook(const char* output_file_name);
+void ConvertGameDatabase(const char* input_file_name,
+                         const char* output_file_name);
 void ComputeStatsOfGameDatabase(const char* event_name);
 void ComputeAllPossibleQuietMoves();
 void ComputePlayerRatings();
@@ -71,15 +98,54 @@ void Cli::ExecuteCommand(int argc, char* argv[]) {
   } else if (command == "--bench-movegen") {
     int num_tries = argc >= 3 ? std::atoi(argv[2]) : 1;
     BenchmarkMoveGeneration(num_tries);
+    Perft::BenchmarkGenerators(num_tries);
+  } else if (command == "--perft") {
+    int depth = argc >= 3 ? std::atoi(argv[2]) : 1;
+    if (depth < 1) {
+      std::printf("CLI: Invalid perft depth. (depth=%d)\n", depth);
+      return;
+    }
+    // 局面は、"startpos"またはSFEN文字列（空白区切りで複数の引数に分かれていてもよい）で指定する
+    std::string sfen;
+    for (int i = 3; i < argc; ++i) {
+      if (!sfen.empty()) sfen += " ";
+      sfen += argv[i];
+    }
+    if (sfen.compare(0, 5, "sfen ") == 0) {
+      sfen = sfen.substr(5);
+    }
+    Position pos = sfen.empty() || sfen == "startpos"
+                 ? Position::CreateStartPosition()
+                 : Position::FromSfen(sfen);
+    Perft::Divide(pos, depth);
   } else if (command == "--bench-mate1") {
     int num_tries = argc >= 3 ? std::atoi(argv[2]) : 1;
     BenchmarkMateSearch(num_tries, 1);
   } else if (command == "--bench-mate3") {
     int num_tries = argc >= 3 ? std::atoi(argv[2]) : 1;
     BenchmarkMateSearch(num_tries, 3);
+  } else if (command == "--bench-optimizer") {
+    int num_iterations = argc >= 3 ? std::atoi(argv[2]) : 10;
+    BenchmarkOptimizer(num_iterations);
+  } else if (command == "--bench-extended-board") {
+    int num_games = argc >= 3 ? std::atoi(argv[2]) : 1000;
+    BenchmarkExtendedBoard(num_games);
+  } else if (command == "--bench-see") {
+    int num_iterations = argc >= 3 ? std::atoi(argv[2]) : 100;
+    BenchmarkStaticExchange(num_iterations);
+  } else if (command == "--bench-pipe") {
+    int num_workers = argc >= 3 ? std::atoi(argv[2]) : 32;
+    int num_lines = argc >= 4 ? std::atoi(argv[3]) : 5000;
+    BenchmarkPipeIo(std::max(num_workers, 1), std::max(num_lines, 1));
+  } else if (command == "--bench-attacks") {
+    int num_iterations = argc >= 3 ? std::atoi(argv[2]) : 100;
+    BenchmarkSlidingAttacks(num_iterations);
   } else if (command == "--cluster") {
     Cluster cluster;
     cluster.Start();
+  } else if (command == "--cluster-simulation") {
+    int search_time = argc >= 3 ? std::atoi(argv[2]) : 10;
+    SimulateCluster(std::max(search_time, 1));
   } else if (command == "--compute-all-quiets") {
     ComputeAllPossibleQuietMoves();
   } else if (command == "--consultation") {
@@ -88,11 +154,24 @@ void Cli::ExecuteCommand(int argc, char* argv[]) {
   } else if (command == "--create-book") {
     const char* output_file_name = argc >= 3 ? argv[2] : "book.bin";
     CreateBook(output_file_name);
+  } else if (command == "--convert-db") {
+    const char* input_file_name = argc >= 3 ? argv[2] : GameDatabase::kDefaultDatabaseFile;
+    const char* output_file_name = argc >= 4 ? argv[3] : GameDatabase::kDefaultBinaryDatabaseFile;
+    ConvertGameDatabase(input_file_name, output_file_name);
   } else if (command == "--db-stats") {
     const char* event_name = argc >= 3 ? argv[2] : nullptr;
     ComputeStatsOfGameDatabase(event_name);
   } else if (command == "--learn") {
-    Learning::LearnEvaluationParameters();
+    const bool resume = argc >= 3 && std::string(argv[2]) == "resume";
+    Learning::LearnEvaluationParameters(resume);
+  } else if (command == "--learn-distributed" && argc >= 3) {
+    const int num_workers = std::max(1, std::atoi(argv[2]));
+    const bool resume = argc >= 4 && std::string(argv[3]) == "resume";
+    Learning::LearnEvaluationParametersDistributed(argv[0], num_workers, resume);
+  } else if (command == "--learn-worker" && argc >= 5) {
+    const bool resume = argc >= 6 && std::string(argv[5]) == "resume";
+    Learning::RunLearningWorker(std::atoi(argv[2]), std::atoi(argv[3]),
+                                std::max(1, std::atoi(argv[4])), resume);
   } else if (command == "--learn-progress") {
     Progress::LearnParameters();
   } else if (command == "--learn-probability") {
@@ -161,7 +240,21 @@ void BenchmarkMoveGeneration(const int num_calls) {
     for (ExtMove* it = stack.begin(); it != end; ++it) {
       std::printf("%s ", it->move.ToSfen().c_str());
     }
-    std::printf("\n\n");
+    std::printf("\n");
+
+    // 生成した合法手について、局面を進めて戻す処理（MakeMove/UnmakeMove）の速度も計測する
+    end = RemoveIllegalMoves(pos, stack.begin(), end);
+    timer = SimpleTimer();
+    for (int i = 0; i < num_calls; ++i) {
+      for (ExtMove* it = stack.begin(); it != end; ++it) {
+        pos.MakeMove(it->move);
+        pos.UnmakeMove(it->move);
+      }
+    }
+    elapsed = std::max(timer.GetElapsedSeconds(), 0.001);
+    const double num_moves = double(num_calls) * (end - stack.begin());
+    std::printf("MakeMove/UnmakeMove: Moves=%.0f, Time=%.3fsec, Speed=%.0fKmoves/sec.\n\n",
+                num_moves, elapsed, (num_moves / elapsed) / 1000);
   }
 }
 
@@ -227,6 +320,719 @@ void BenchmarkMateSearch(const int num_calls, const int ply) {
   }
 }
 
+/**
+ * 学習時のパラメータ更新処理のベンチマークを行います.
+ *
+ * 評価関数パラメータと同じ大きさの配列について、従来の実装（要素ごとにPackクラスで計算するループ）と、
+ * Optimizerクラスの各命令セット版とで、１回の更新にかかる時間を比較します。
+ * あわせて、従来の実装との計算結果の差（最大誤差）も表示します。
+ *
+ * @param num_iterations パラメータ更新を繰り返す回数
+ */
+void BenchmarkOptimizer(const int num_iterations) {
+  typedef ExtendedParamsBase Params;
+  constexpr double kStepRate = 5.0, kDecay = 0.99, kEpsilon = 1e-4, kL1Penalty = 0.03;
+  constexpr double kMomentum = 0.95, kL2Penalty = 5.0;
+  const size_t size = sizeof(Params) / sizeof(double);
+  std::printf("Start Optimizer Benchmark! (%d parameters, %d iterations)\n\n",
+              static_cast<int>(size), num_iterations);
+
+  // 1. 乱数で勾配とパラメータの初期値を作る（Paramsは32バイトのアラインメントを要求するので、MakeAligned()で確保する）
+  AlignedPtr<Params> gradient = MakeAligned<Params>(), initial_weights = MakeAligned<Params>();
+  AlignedPtr<Params> weights = MakeAligned<Params>(), expected = MakeAligned<Params>();
+  std::mt19937 mt(20160606);
+  std::uniform_real_distribution<double> dis(-1.0, 1.0);
+  double* g = reinterpret_cast<double*>(gradient->begin());
+  double* w0 = reinterpret_cast<double*>(initial_weights->begin());
+  for (size_t i = 0; i < size; ++i) {
+    g[i] = dis(mt);
+    w0[i] = 100.0 * dis(mt);
+  }
+  double* w = reinterpret_cast<double*>(weights->begin());
+  double* w_expected = reinterpret_cast<double*>(expected->begin());
+
+  // 計測結果を表示する
+  double baseline = 0.0;
+  auto print_result = [&](const char* name, double elapsed) {
+    if (baseline == 0.0) {
+      baseline = elapsed;
+    }
+    double max_error = 0.0;
+    for (size_t i = 0; i < size; ++i) {
+      max_error = std::max(max_error, std::abs(w[i] - w_expected[i]));
+    }
+    std::printf("%-24s Time=%8.2fms/update Speedup=%5.2fx MaxError=%g\n",
+                name, 1000.0 * elapsed / num_iterations, baseline / elapsed,
+                max_error);
+  };
+
+  // 2. RMSprop + FOBOS（L1正則化）
+  {
+    std::printf("RMSprop:\n");
+    AlignedPtr<Params> state = MakeAligned<Params>();
+    std::vector<double> state_double(size);
+    std::vector<float> state_float(size);
+
+    // a. 従来の実装
+    *weights = *initial_weights;
+    state->Clear();
+    SimpleTimer timer;
+    for (int n = 0; n < num_iterations; ++n) {
+#pragma omp parallel for schedule(static)
+      for (size_t i = 0; i < gradient->size(); ++i) {
+        auto& v = *(weights->begin() + i);
+        auto& a = *(state->begin() + i);
+        auto g = *(gradient->begin() + i);
+        a = a * kDecay + (g * g);
+        const Pack<double, 4> eta = kStepRate / (a + kEpsilon).apply(std::sqrt);
+        v -= eta * g;
+        auto ramp = [](double x) -> double {
+          return std::max(x, 0.0);
+        };
+        v = v.apply(math::sign) * (v.apply(std::abs) - eta * kL1Penalty).apply(ramp);
+      }
+    }
+    double elapsed = timer.GetElapsedSeconds();
+    *expected = *weights;
+    print_result("Legacy (Pack)", elapsed);
+
+    // b. Optimizerクラスの実装（使用可能な命令セットごとに計測する）
+    Optimizer::RmsPropConfig config = {kStepRate, kDecay, kEpsilon, kL1Penalty};
+    const Optimizer::InstructionSet best = Optimizer::GetBestInstructionSet();
+    for (int isa = Optimizer::kScalar; isa <= best; ++isa) {
+      Optimizer::set_instruction_set(static_cast<Optimizer::InstructionSet>(isa));
+      const std::string name = Optimizer::GetInstructionSetName(
+          static_cast<Optimizer::InstructionSet>(isa));
+      // 累積値をdouble型で保持する場合
+      *weights = *initial_weights;
+      std::fill(state_double.begin(), state_double.end(), 0.0);
+      timer = SimpleTimer();
+      for (int n = 0; n < num_iterations; ++n) {
+        Optimizer::UpdateRmsProp(config, g, state_double.data(), w, size);
+      }
+      print_result((name + " (double)").c_str(), timer.GetElapsedSeconds());
+      // 累積値をfloat型で保持する場合
+      *weights = *initial_weights;
+      std::fill(state_float.begin(), state_float.end(), 0.0f);
+      timer = SimpleTimer();
+      for (int n = 0; n < num_iterations; ++n) {
+        Optimizer::UpdateRmsProp(config, g, state_float.data(), w, size);
+      }
+      print_result((name + " (float)").c_str(), timer.GetElapsedSeconds());
+    }
+    std::printf("\n");
+  }
+
+  // 3. AdaDelta + Momentum + FOBOS（L1正則化及びL2正則化）
+  {
+    std::printf("AdaDelta:\n");
+    const double initial_delta = 1e-4;
+    std::vector<double> r(size), s(size), v(size);
+    std::vector<float> r_float(size), s_float(size), v_float(size);
+
+    // a. 従来の実装
+    *weights = *initial_weights;
+    std::fill(r.begin(), r.end(), 0.0);
+    std::fill(s.begin(), s.end(), initial_delta);
+    std::fill(v.begin(), v.end(), 0.0);
+    baseline = 0.0;
+    SimpleTimer timer;
+    for (int n = 0; n < num_iterations; ++n) {
+#pragma omp parallel for schedule(static)
+      for (size_t i = 0; i < size; ++i) {
+        r[i] = kDecay * r[i] + (1.0 - kDecay) * (g[i] * g[i]);
+        double eta = std::sqrt(s[i]) / std::sqrt(r[i] + kEpsilon);
+        v[i] = kMomentum * v[i] - (1.0 - kMomentum) * eta * g[i];
+        s[i] = kDecay * s[i] + (1.0 - kDecay) * (v[i] * v[i]);
+        w[i] = w[i] + v[i];
+        double lambda1 = eta * kL1Penalty;
+        double lambda2 = eta * kL2Penalty;
+        w[i] = math::sign(w[i]) * std::max((std::abs(w[i]) - lambda1) / (1.0 + lambda2), 0.0);
+      }
+    }
+    double elapsed = timer.GetElapsedSeconds();
+    *expected = *weights;
+    print_result("Legacy (scalar)", elapsed);
+
+    // b. Optimizerクラスの実装（使用可能な命令セットごとに計測する）
+    Optimizer::AdaDeltaConfig config = {kDecay, kMomentum, kEpsilon, kL1Penalty, kL2Penalty};
+    const Optimizer::InstructionSet best = Optimizer::GetBestInstructionSet();
+    for (int isa = Optimizer::kScalar; isa <= best; ++isa) {
+      Optimizer::set_instruction_set(static_cast<Optimizer::InstructionSet>(isa));
+      const std::string name = Optimizer::GetInstructionSetName(
+          static_cast<Optimizer::InstructionSet>(isa));
+      // 累積値をdouble型で保持する場合
+      *weights = *initial_weights;
+      std::fill(r.begin(), r.end(), 0.0);
+      std::fill(s.begin(), s.end(), initial_delta);
+      std::fill(v.begin(), v.end(), 0.0);
+      timer = SimpleTimer();
+      for (int n = 0; n < num_iterations; ++n) {
+        Optimizer::UpdateAdaDelta(config, g, r.data(), s.data(), v.data(), w, size);
+      }
+      print_result((name + " (double)").c_str(), timer.GetElapsedSeconds());
+      // 累積値をfloat型で保持する場合
+      *weights = *initial_weights;
+      std::fill(r_float.begin(), r_float.end(), 0.0f);
+      std::fill(s_float.begin(), s_float.end(), float(initial_delta));
+      std::fill(v_float.begin(), v_float.end(), 0.0f);
+      timer = SimpleTimer();
+      for (int n = 0; n < num_iterations; ++n) {
+        Optimizer::UpdateAdaDelta(config, g, r_float.data(), s_float.data(),
+                                  v_float.data(), w, size);
+      }
+      print_result((name + " (float)").c_str(), timer.GetElapsedSeconds());
+    }
+    std::printf("\n");
+  }
+
+  // 命令セットを元に戻す
+  Optimizer::set_instruction_set(Optimizer::GetBestInstructionSet());
+}
+
+/**
+ * 指定された命令セットの実装を用いて、棋譜を再生します（ExtendedBoardのベンチマーク用）.
+ * @param games            再生する棋譜
+ * @param compute_checksum trueならば、全マスの利き数からチェックサムを計算する
+ * @return 利き数から計算したチェックサム
+ */
+template<ExtendedBoard::SimdLevel kLevel>
+uint64_t ReplayGames(const std::vector<std::vector<Move>>& games,
+                     const bool compute_checksum) {
+  const Position startpos = Position::CreateStartPosition();
+  uint64_t checksum = 0;
+  for (const std::vector<Move>& game : games) {
+    ExtendedBoard eb;
+    eb.SetAllPieces(startpos);
+    Color side_to_move = kBlack;
+    for (Move move : game) {
+      // a. 利き数を差分更新する
+      if (move.is_drop()) {
+        eb.MakeDropMove(move);
+      } else if (move.is_capture()) {
+        eb.MakeCaptureMoveImpl<kLevel>(move);
+      } else {
+        eb.MakeNonCaptureMoveImpl<kLevel>(move);
+      }
+      side_to_move = ~side_to_move;
+      // b. 全マスの利き数を参照する
+      PsqControlList list = eb.GetPsqControlListImpl<kLevel>();
+      Bitboard controlled = eb.GetControlledSquaresImpl<kLevel>(side_to_move);
+      if (compute_checksum) {
+        for (Square s : Square::all_squares()) {
+          checksum = checksum * 31 + list[s];
+        }
+      } else {
+        checksum += list[move.to()];
+      }
+      checksum = checksum * 31 + controlled.extract64<0>();
+      checksum = checksum * 31 + controlled.extract64<1>();
+    }
+  }
+  return checksum;
+}
+
+/**
+ * ExtendedBoardクラスの利き数更新処理のベンチマークを行います.
+ *
+ * ランダムに指し手を選んで作成した棋譜を、使用可能な命令セットごとに再生して、
+ * 指し手による利き数の更新と、利き数の参照（GetPsqControlList()など）にかかる時間を比較します。
+ * あわせて、各命令セット版の計算結果が一致することも確認します。
+ *
+ * @param num_games 再生する棋譜の数
+ */
+void BenchmarkExtendedBoard(const int num_games) {
+  constexpr int kMaxGamePly = 256;
+
+  std::printf("Start ExtendedBoard Benchmark!\n\n");
+
+  // 1. ランダムな指し手からなる棋譜を作成する
+  std::mt19937 random_engine(20160501);
+  std::vector<std::vector<Move>> games(num_games);
+  size_t num_moves = 0;
+  for (std::vector<Move>& game : games) {
+    Position pos = Position::CreateStartPosition();
+    for (int ply = 0; ply < kMaxGamePly; ++ply) {
+      SimpleMoveList<kAllMoves, true> legal_moves(pos);
+      if (legal_moves.empty()) {
+        break;
+      }
+      std::uniform_int_distribution<size_t> dist(0, legal_moves.size() - 1);
+      Move move = legal_moves[dist(random_engine)].move;
+      game.push_back(move);
+      pos.MakeMove(move);
+    }
+    num_moves += game.size();
+  }
+  std::printf("Games=%d, Moves=%zu\n", num_games, num_moves);
+
+  // 2. 棋譜を再生するための関数を準備する
+  auto replay_games = [&](int level, bool compute_checksum) -> uint64_t {
+    switch (level) {
+      case ExtendedBoard::kAvx512:
+        return ReplayGames<ExtendedBoard::kAvx512>(games, compute_checksum);
+      case ExtendedBoard::kAvx2:
+        return ReplayGames<ExtendedBoard::kAvx2>(games, compute_checksum);
+      default:
+        return ReplayGames<ExtendedBoard::kSse41>(games, compute_checksum);
+    }
+  };
+
+  // 3. 使用可能な命令セットごとに、棋譜を再生する
+  std::printf("Selected=%s\n", ExtendedBoard::GetSimdLevelName(ExtendedBoard::simd_level()));
+  const ExtendedBoard::SimdLevel best = ExtendedBoard::GetBestSimdLevel();
+  uint64_t expected_checksum = 0;
+  for (int level = ExtendedBoard::kSse41; level <= best; ++level) {
+    // 計算結果を確認する（時間は計測しない）
+    uint64_t checksum = replay_games(level, true);
+    if (level == ExtendedBoard::kSse41) {
+      expected_checksum = checksum;
+    }
+    // 実行時間を計測する
+    SimpleTimer timer;
+    volatile uint64_t result = replay_games(level, false); // 最適化で処理が省略されないようにする
+    (void)result;
+    double elapsed = std::max(timer.GetElapsedSeconds(), 0.001);
+    std::printf("%-10s Time=%.3fsec, Speed=%.0fKmoves/sec, Checksum=%016" PRIx64 " %s\n",
+                ExtendedBoard::GetSimdLevelName(static_cast<ExtendedBoard::SimdLevel>(level)),
+                elapsed, (num_moves / elapsed) / 1000, checksum,
+                checksum == expected_checksum ? "OK" : "MISMATCH");
+  }
+}
+
+/**
+ * 角・飛車の利きを求める処理のベンチマークを行います.
+ *
+ * ランダムに作成した駒の配置について、全マスから角・飛車の利きを求める処理を、
+ * Magic BitboardとPEXT命令のそれぞれで実行し、処理速度と計算結果を比較します。
+ *
+ * @param num_iterations 駒の配置パターンを変えて、全マスの利きを求める回数
+ */
+void BenchmarkSlidingAttacks(const int num_iterations) {
+  constexpr int kNumOccupancies = 4096;
+
+  std::printf("Start Sliding Attacks Benchmark!\n\n");
+
+  // 1. 駒の配置パターンをランダムに作成する（実戦に近くなるよう、各マスに1/4の確率で駒を置く）
+  std::mt19937_64 random_engine(20160501);
+  std::vector<Bitboard> occupancies;
+  for (int i = 0; i < kNumOccupancies; ++i) {
+    uint64_t q0 = random_engine() & random_engine();
+    uint64_t q1 = random_engine() & random_engine();
+    occupancies.push_back(Bitboard(q1, q0) & Bitboard::board_bb());
+  }
+
+  // 2. すべての配置パターンとマスについて、両者の計算結果が一致することを確認する
+  const Bitboard::SlidingAttackMethod best = Bitboard::GetBestSlidingAttackMethod();
+  if (Bitboard::set_sliding_attack_method(Bitboard::kPext)) {
+    int num_mismatches = 0;
+    for (const Bitboard& occ : occupancies) {
+      for (Square s : Square::all_squares()) {
+        Bitboard::set_sliding_attack_method(Bitboard::kMagic);
+        Bitboard rook = rook_attacks_bb(s, occ), bishop = bishop_attacks_bb(s, occ);
+        Bitboard::set_sliding_attack_method(Bitboard::kPext);
+        if (rook_attacks_bb(s, occ) != rook || bishop_attacks_bb(s, occ) != bishop) {
+          ++num_mismatches;
+        }
+      }
+    }
+    std::printf("Verification: %d mismatches.\n", num_mismatches);
+  }
+
+  // 3. 利用可能な方法ごとに、利きを求める時間を計測する
+  const Bitboard::SlidingAttackMethod methods[] = {Bitboard::kMagic, Bitboard::kPext};
+  Bitboard expected_result;
+  for (Bitboard::SlidingAttackMethod method : methods) {
+    if (!Bitboard::set_sliding_attack_method(method)) {
+      std::printf("%-6s not supported on this CPU.\n",
+                  Bitboard::GetSlidingAttackMethodName(method));
+      continue;
+    }
+    SimpleTimer timer;
+    Bitboard result;
+    for (int n = 0; n < num_iterations; ++n) {
+      for (const Bitboard& occ : occupancies) {
+        for (Square s : Square::all_squares()) {
+          result ^= rook_attacks_bb(s, occ) ^ bishop_attacks_bb(s, occ);
+        }
+      }
+    }
+    double elapsed = std::max(timer.GetElapsedSeconds(), 0.001);
+    if (method == Bitboard::kMagic) {
+      expected_result = result;
+    }
+    const double num_calls = 2.0 * num_iterations * kNumOccupancies * 81;
+    std::printf("%-6s Time=%.3fsec, Speed=%.1fMcalls/sec, Result=%s%s\n",
+                Bitboard::GetSlidingAttackMethodName(method), elapsed,
+                (num_calls / elapsed) / 1000000,
+                result == expected_result ? "OK" : "MISMATCH",
+                method == best ? " (default)" : "");
+  }
+
+  // 元の方法に戻す
+  Bitboard::set_sliding_attack_method(best);
+}
+
+/**
+ * 駒交換の評価（SEE）のベンチマークを行います.
+ *
+ * ランダムに指し手を選んで作成した局面集について、すべての指し手のSEE値を、
+ * 利き数による早期終了を行わない場合と行う場合のそれぞれで計算して、処理速度と計算結果を比較します。
+ * あわせて、Swap::IsWinning()とSwap::IsLosing()の速度を計測し、SEE値の符号と一致することも確認します。
+ *
+ * @param num_iterations 局面集のすべての指し手について、SEE値を計算する回数
+ */
+void BenchmarkStaticExchange(const int num_iterations) {
+  constexpr int kNumGames = 100, kMaxGamePly = 256, kSamplingInterval = 4;
+
+  std::printf("Start Static Exchange Evaluation Benchmark!\n\n");
+
+  // 評価関数のパラメータが読み込まれておらず、駒の価値がゼロになっている場合は、
+  // SEE値がすべてゼロになってしまうので、学習時の初期値（Bonanza 6.0の駒割）を用いる
+  if (Material::value(kPawn) == kScoreZero) {
+    const std::pair<PieceType, int> default_values[] = {
+      {kPawn  , 100}, {kLance , 267}, {kKnight , 295}, {kSilver , 424},
+      {kGold  , 510}, {kBishop, 654}, {kRook   , 738}, {kPPawn  , 614},
+      {kPLance, 562}, {kPKnight, 586}, {kPSilver, 569}, {kHorse , 951},
+      {kDragon, 1086},
+    };
+    for (const auto& pair : default_values) {
+      g_eval_params->material[pair.first] = static_cast<Score>(pair.second);
+    }
+    Material::UpdateTables();
+    std::printf("Material values are not loaded. Using the default values.\n");
+  }
+
+  // 1. ランダムな指し手からなる棋譜を作成して、その途中の局面と指し手を集める
+  std::mt19937 random_engine(20160501);
+  std::vector<Position> positions;
+  std::vector<std::pair<size_t, Move>> samples;
+  for (int game = 0; game < kNumGames; ++game) {
+    Position pos = Position::CreateStartPosition();
+    for (int ply = 0; ply < kMaxGamePly; ++ply) {
+      SimpleMoveList<kAllMoves, true> legal_moves(pos);
+      if (legal_moves.empty()) {
+        break;
+      }
+      if (ply % kSamplingInterval == 0) {
+        positions.push_back(Position::FromSfen(pos.ToSfen()));
+        for (const ExtMove& em : SimpleMoveList<kAllMoves>(pos)) {
+          samples.emplace_back(positions.size() - 1, em.move);
+        }
+      }
+      std::uniform_int_distribution<size_t> dist(0, legal_moves.size() - 1);
+      pos.MakeMove(legal_moves[dist(random_engine)].move);
+    }
+  }
+  std::printf("Positions=%zu, Moves=%zu\n", positions.size(), samples.size());
+
+  // 2. 各関数の処理時間を計測する
+  auto measure = [&](const char* name, std::function<int(const Position&, Move)> f) {
+    int64_t checksum = 0;
+    SimpleTimer timer;
+    for (int i = 0; i < num_iterations; ++i) {
+      for (const std::pair<size_t, Move>& sample : samples) {
+        checksum += f(positions[sample.first], sample.second);
+      }
+    }
+    double elapsed = std::max(timer.GetElapsedSeconds(), 0.001);
+    const double num_calls = double(num_iterations) * samples.size();
+    std::printf("%-28s Time=%.3fsec, Speed=%.1fMcalls/sec, Checksum=%" PRId64 "\n",
+                name, elapsed, (num_calls / elapsed) / 1000000, checksum);
+  };
+  measure("EvaluateSwapSequence", [](const Position& pos, Move move) {
+    return int(Swap::EvaluateSwapSequence(move, pos));
+  });
+  measure("Evaluate", [](const Position& pos, Move move) {
+    return int(Swap::Evaluate(move, pos));
+  });
+  measure("IsWinning", [](const Position& pos, Move move) {
+    return int(Swap::IsWinning(move, pos));
+  });
+  measure("IsLosing", [](const Position& pos, Move move) {
+    return int(Swap::IsLosing(move, pos));
+  });
+
+  // 3. 計算結果を比較する
+  // （IsWinning()とIsLosing()は、駒の価値だけで判断できる場合にはSEE値を用いないので、
+  //   SEE値を用いて判断する場合に限り、SEE値の符号と比較する）
+  int num_mismatches = 0;
+  for (const std::pair<size_t, Move>& sample : samples) {
+    const Position& pos = positions[sample.first];
+    const Move move = sample.second;
+    const Score expected = Swap::EvaluateSwapSequence(move, pos);
+    const Score gain = Material::value(move.captured_piece_type());
+    const Score loss = Material::value(move.piece_type());
+    const bool opponent_can_promote = move.to().is_promotion_zone_of(~pos.side_to_move());
+    const bool uses_see_for_winning = !(gain > loss && !opponent_can_promote);
+    const bool uses_see_for_losing = !(gain >= loss && !opponent_can_promote);
+    if (   Swap::Evaluate(move, pos) != expected
+        || (   uses_see_for_winning
+            && Swap::IsWinning(move, pos) != (expected > kScoreZero))
+        || (   uses_see_for_losing
+            && Swap::IsLosing(move, pos) != (expected < kScoreZero))) {
+      if (++num_mismatches <= 10) {
+        std::printf("Mismatch: %s %s\n", pos.ToSfen().c_str(),
+                    move.ToSfen().c_str());
+      }
+    }
+  }
+  std::printf("Mismatches=%d\n", num_mismatches);
+}
+
+/**
+ * ワーカーとのパイプ通信のベンチマークを行います.
+ *
+ * 合成したUSIのinfoコマンドを出力し続ける外部プロセスを複数起動し、その出力を、
+ *   (1) ワーカーごとのスレッドで、１バイトずつ読み込む方法（従来のProcess::GetLine()相当）
+ *   (2) ワーカーごとのスレッドで、バッファ付きのProcess::GetLine()で読み込む方法
+ *   (3) ProcessMultiplexerを用いて、１つのスレッドで読み込む方法
+ * のそれぞれで受信して、１行ごとにinfoコマンドを解析する処理の速度を比較します。
+ * あわせて、infoコマンドを、テキスト形式とバイナリ形式（WorkerProtocol）のそれぞれから
+ * 復元する処理の速度を比較します。
+ *
+ * @param num_workers 起動する外部プロセスの数
+ * @param num_lines   各外部プロセスが出力するinfoコマンドの行数
+ */
+void BenchmarkPipeIo(const int num_workers, const int num_lines) {
+  const std::string info_line = "info depth 20 seldepth 32 time 1234 nodes 12345678"
+                                " nps 10000000 score cp 123 hashfull 500"
+                                " pv 7g7f 3c3d 2g2f 8c8d 2f2e 8d8e 6i7h 4a3b";
+  std::string shell_command = "yes '" + info_line + "' | head -n "
+                            + std::to_string(num_lines);
+
+  std::printf("Start Pipe I/O Benchmark!\n");
+  std::printf("Workers=%d, Lines=%d (per worker)\n\n", num_workers, num_lines);
+
+  // infoコマンドを出力する外部プロセスを起動する
+  auto start_workers = [&](std::vector<Process>* workers) -> bool {
+    char* const args[] = {
+        const_cast<char*>("sh"),
+        const_cast<char*>("-c"),
+        const_cast<char*>(shell_command.c_str()),
+        NULL
+    };
+    for (Process& worker : *workers) {
+      if (worker.StartProcess(args[0], args) < 0) {
+        return false;
+      }
+    }
+    return true;
+  };
+
+  // 受信した行を解析し、集計する
+  std::atomic<int64_t> num_received_lines(0), checksum(0);
+  auto process_line = [&](const std::string& line) {
+    std::istringstream is(line);
+    std::string token;
+    is >> token;
+    if (token == "info") {
+      UsiInfo info = UsiProtocol::ParseInfoCommand(is);
+      checksum += info.depth + info.score;
+    }
+    ++num_received_lines;
+  };
+
+  // 受信方法ごとに、すべての行を受信し終えるまでの時間を計測する
+  auto measure = [&](const char* name, int num_threads,
+                     std::function<void(std::vector<Process>&)> receive) {
+    num_received_lines = 0;
+    checksum = 0;
+    std::vector<Process> workers(num_workers);
+    if (!start_workers(&workers)) {
+      std::printf("Failed to start workers.\n");
+      return;
+    }
+    SimpleTimer timer;
+    receive(workers);
+    double elapsed = std::max(timer.GetElapsedSeconds(), 0.001);
+    for (Process& worker : workers) {
+      worker.WaitFor();
+    }
+    const int64_t expected_lines = int64_t(num_workers) * num_lines;
+    std::printf("%-22s Threads=%3d, Time=%.3fsec, Speed=%.1fKlines/sec,"
+                " Lines=%" PRId64 "%s, Checksum=%" PRId64 "\n",
+                name, num_threads, elapsed,
+                (num_received_lines / elapsed) / 1000,
+                num_received_lines.load(),
+                num_received_lines == expected_lines ? "" : " (MISSING)",
+                checksum.load());
+  };
+
+  // (1) ワーカーごとのスレッドで、１バイトずつ読み込む
+  measure("Thread/worker, byte", num_workers, [&](std::vector<Process>& workers) {
+    std::vector<std::thread> threads;
+    for (Process& worker : workers) {
+      threads.emplace_back([&]() {
+        std::string line;
+        for (;;) {
+          char c;
+          ssize_t n = read(worker.output_fd(), &c, 1);
+          if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            pollfd fds = {worker.output_fd(), POLLIN, 0};
+            poll(&fds, 1, -1);
+            continue;
+          } else if (n <= 0) {
+            break;
+          } else if (c == '\n') {
+            process_line(line);
+            line.clear();
+          } else {
+            line.push_back(c);
+          }
+        }
+      });
+    }
+    for (std::thread& thread : threads) {
+      thread.join();
+    }
+  });
+
+  // (2) ワーカーごとのスレッドで、バッファ付きのGetLine()で読み込む
+  measure("Thread/worker, buffer", num_workers, [&](std::vector<Process>& workers) {
+    std::vector<std::thread> threads;
+    for (Process& worker : workers) {
+      threads.emplace_back([&]() {
+        for (std::string line; worker.GetLine(&line); ) {
+          process_line(line);
+        }
+      });
+    }
+    for (std::thread& thread : threads) {
+      thread.join();
+    }
+  });
+
+  // (3) ProcessMultiplexerを用いて、１つのスレッドで読み込む
+  measure("Multiplexer", 1, [&](std::vector<Process>& workers) {
+    std::mutex mutex;
+    std::condition_variable condition;
+    int num_finished = 0;
+    {
+      ProcessMultiplexer multiplexer;
+      for (Process& worker : workers) {
+        auto on_message = [&](const std::string& message, bool) {
+          process_line(message);
+        };
+        multiplexer.Add(&worker, on_message, [&]() {
+          std::unique_lock<std::mutex> lock(mutex);
+          ++num_finished;
+          condition.notify_one();
+        });
+      }
+      std::unique_lock<std::mutex> lock(mutex);
+      condition.wait(lock, [&](){ return num_finished == num_workers; });
+    }
+  });
+
+  // (4) マスター側で、infoコマンド１つを解釈する処理の速度を、テキスト形式とバイナリ形式とで比較する
+  const int kNumDecodes = 200000;
+  std::string frames;
+  {
+    std::istringstream is(info_line.substr(5));
+    UsiInfo info = UsiProtocol::ParseInfoCommand(is);
+    WorkerProtocol::InfoHeader header = WorkerProtocol::InfoHeader();
+    header.time = info.time;
+    header.nodes = info.nodes;
+    header.nps = info.nps;
+    header.depth = info.depth;
+    header.seldepth = info.seldepth;
+    header.hashfull = info.hashfull;
+    header.score = info.score;
+    header.bound = info.bound;
+    Position pos = Position::CreateStartPosition();
+    std::vector<Move> pv;
+    for (const std::string& sfen : info.pv) {
+      pv.push_back(Move::FromSfen(sfen, pos));
+      pos.MakeMove(pv.back());
+    }
+    WorkerProtocol::AppendInfoFrame(header, pv, &frames);
+  }
+  std::printf("\nText line=%zu bytes, Binary frame=%zu bytes\n",
+              info_line.size() + 1, frames.size());
+  auto measure_decode = [&](const char* name, std::function<int64_t()> decode) {
+    int64_t checksum = 0;
+    SimpleTimer timer;
+    for (int i = 0; i < kNumDecodes; ++i) {
+      checksum += decode();
+    }
+    double elapsed = std::max(timer.GetElapsedSeconds(), 0.001);
+    std::printf("%-22s Time=%.3fsec, Speed=%.1fKinfos/sec, Checksum=%" PRId64 "\n",
+                name, elapsed, (kNumDecodes / elapsed) / 1000, checksum);
+  };
+  measure_decode("Decode text", [&]() -> int64_t {
+    std::istringstream is(info_line);
+    std::string token;
+    is >> token;
+    UsiInfo info = UsiProtocol::ParseInfoCommand(is);
+    return info.nodes + int(info.score) + info.pv.size();
+  });
+  const std::string payload = frames.substr(Process::kFrameHeaderSize);
+  measure_decode("Decode binary", [&]() -> int64_t {
+    UsiInfo info;
+    WorkerProtocol::DecodeInfoFrame(payload, &info);
+    return info.nodes + int(info.score) + info.pv.size();
+  });
+}
+
+/**
+ * 疎結合並列探索のクラスタを、ローカルマシン上のワーカーを用いてシミュレーションします.
+ *
+ * いくつかの局面について、探索中の再割り当て（DynamicSchedulingオプション）を無効にした場合と
+ * 有効にした場合のそれぞれで探索を行い、最善手のinfoコマンドが各深さに到達するまでの時間を比較します。
+ * ワーカーは"./release"として起動されるので、実行ファイルのあるディレクトリで実行してください。
+ *
+ * @param search_time 各局面の探索時間（秒）
+ */
+void SimulateCluster(const int search_time) {
+  const std::vector<std::string> positions = {
+      "position startpos",
+      "position sfen l6nl/5+P1gk/2np1S3/p1p4Pp/3P2Sp1/1PPb2P1P/P5GS1/R8/LN4bKL w RGgsn5p 1",
+      "position sfen ln6l/1r4gk1/p1s2gnpp/1pp1p4/9/2PPPP+p2/PPSG3PP/2G1R4/LNK5L w BS3Pbsn 1",
+  };
+  const unsigned num_threads = std::max(1u, std::thread::hardware_concurrency() / 4);
+
+  // 1. クラスタを準備する（ワーカーのスレッド数は、４台のワーカーでCPUを分け合う程度にしておく）
+  Cluster cluster;
+  cluster.ExecuteCommand("setoption name Threads value " + std::to_string(num_threads));
+  cluster.ExecuteCommand("setoption name USI_Hash value 128");
+  cluster.ExecuteCommand("setoption name OwnBook value false");
+
+  // 2. 各局面について、再割り当ての有無を切り替えて探索する
+  std::vector<std::vector<int64_t>> results[2];
+  std::vector<int> num_reassignments;
+  for (const std::string& position : positions) {
+    for (int dynamic = 0; dynamic <= 1; ++dynamic) {
+      cluster.ExecuteCommand(std::string("setoption name DynamicScheduling value ")
+                             + (dynamic ? "true" : "false"));
+      cluster.ExecuteCommand("isready"); // 前回の探索結果が残らないよう、ハッシュテーブルを初期化する
+      cluster.ExecuteCommand(position);
+      cluster.ExecuteCommand("go infinite");
+      std::this_thread::sleep_for(std::chrono::seconds(search_time));
+      cluster.ExecuteCommand("stop");
+      results[dynamic].push_back(cluster.time_to_depth());
+      if (dynamic) {
+        num_reassignments.push_back(cluster.num_reassignments());
+      }
+    }
+  }
+  cluster.ExecuteCommand("quit");
+
+  // 3. 各深さに到達するまでの時間を出力する
+  std::printf("\nTime to depth (msec): static assignment vs. dynamic scheduling\n");
+  for (size_t i = 0; i < positions.size(); ++i) {
+    const std::vector<int64_t>& s = results[0].at(i);
+    const std::vector<int64_t>& d = results[1].at(i);
+    std::printf("[%zu] %s (reassignments: %d)\n", i + 1, positions.at(i).c_str(),
+                num_reassignments.at(i));
+    for (size_t depth = 1; depth <= std::max(s.size(), d.size()); ++depth) {
+      std::printf("  depth %2zu: %8s %8s\n", depth,
+                  depth <= s.size() ? std::to_string(s.at(depth - 1)).c_str() : "-",
+                  depth <= d.size() ? std::to_string(d.at(depth - 1)).c_str() : "-");
+    }
+  }
+}
+
 /**
  * 定跡DBファイルを作成します.
  * @param output_file_name 定跡データの出力先のファイル名
@@ -242,14 +1048,42 @@ void CreateBook(const char* output_file_name) {
   book.WriteToFile(output_file_name);
 }
 
+/**
+ * テキスト形式の棋譜DBファイルを、バイナリ形式の棋譜DBファイルに変換します.
+ * @param input_file_name  変換元のテキスト形式の棋譜DBファイル
+ * @param output_file_name 変換先のバイナリ形式の棋譜DBファイル
+ */
+void ConvertGameDatabase(const char* input_file_name,
+                         const char* output_file_name) {
+  // 1. バイナリ形式に変換する
+  SimpleTimer convert_timer;
+  if (!GameDatabase::ConvertToBinary(input_file_name, output_file_name)) {
+    return;
+  }
+  std::printf("Conversion Time=%.3fsec\n", convert_timer.GetElapsedSeconds());
+
+  // 2. 変換後のファイルの読み込み時間を測定する
+  // （読み込み時間は、学習や定跡作成の際の棋譜読み込み時間の目安となる）
+  if (std::string(output_file_name) == GameDatabase::kDefaultBinaryDatabaseFile) {
+    SimpleTimer read_timer;
+    GameDatabase game_db;
+    int num_games = 0, num_moves = 0;
+    for (Game game; game_db.ReadOneGame(&game); ) {
+      num_games += 1;
+      num_moves += game.moves.size();
+    }
+    std::printf("Read %d games (%d moves) in %.3fsec.\n",
+                num_games, num_moves, read_timer.GetElapsedSeconds());
+  }
+}
+
 /**
  * 棋譜DBファイルの統計データを計算して、画面に表示します.
  * @param event_name 統計データを取得する対象の棋戦名（例："名人戦"など）
  */
 void ComputeStatsOfGameDatabase(const char* event_name) {
   // 1. 棋譜DBファイルを開く
-  std::ifstream game_db_file(GameDatabase::kDefaultDatabaseFile);
-  GameDatabase game_db(game_db_file);
+  GameDatabase game_db;
 
   // 2. 棋譜DBファイルを読み込む準備をする
   struct Stats {
@@ -391,8 +1225,7 @@ void ComputeAllPossibleQuietMoves() {
  */
 void ComputePlayerRatings() {
   // 1. 棋譜DBファイルを開く
-  std::ifstream game_db_file(GameDatabase::kDefaultDatabaseFile);
-  GameDatabase game_db(game_db_file);
+  GameDatabase game_db;
   game_db.set_title_matches_only(true);
 
   // 2. 棋譜DBから全ての対局を読み込む
@@ -33,15 +33,25 @@ class Cli {
    *
    * コマンドの一覧：
    *   - --bench              探索のベンチマークを行う
-   *   - --bench-movegen      指し手生成のベンチマークテストを行う
+   *   - --bench-movegen      指し手生成のベンチマークテストを行う（指し手生成のタイプごとの速度も表示する）
    *   - --bench-mate1        １手詰関数のベンチマークテストを行う
    *   - --bench-mate3        ３手詰関数のベンチマークテストを行う
+   *   - --bench-optimizer    学習時のパラメータ更新処理のベンチマークテストを行う
+   *   - --bench-see          駒交換の評価（SEE）のベンチマークテストを行う
+   *   - --bench-attacks      角・飛車の利きを求める処理のベンチマークテストを行う
+   *   - --bench-extended-board 利き数更新処理のベンチマークテストを行う
+   *   - --bench-pipe         外部プロセスからのinfoコマンドの受信・解析処理のベンチマークテストを行う
+   *   - --perft              指定された深さまでの末端局面数を数える（例: --perft 5 startpos）
    *   - --cluster            疎結合並列探索（GPS将棋風クラスタ）のマスターを起動する
+   *   - --cluster-simulation 疎結合並列探索のクラスタを、ローカルマシン上のワーカーでシミュレーションする
    *   - --compute-all-quiets すべてのquiet movesを列挙する
    *   - --consultation       合議アルゴリズムを用いたクラスタのマスターを起動する
+   *   - --convert-db         テキスト形式の棋譜DBファイルをバイナリ形式に変換する
    *   - --create-book        棋譜DBファイルから定跡DBファイルを作成する
    *   - --db-stats           棋譜DBファイルの統計データを計算して表示する
-   *   - --learn              評価関数の学習を行う
+   *   - --learn              評価関数の学習を行う（"resume"を付けると、チェックポイントから再開する）
+   *   - --learn-distributed  複数のワーカープロセスを用いて、評価関数の学習を行う
+   *   - --learn-worker       評価関数の分散学習のワーカーとして動作する（コーディネータが起動する）
    *   - --learn-progress     進行度推定関数の学習を行う
    *   - --learn-probability  指し手の実現確率の学習を行う
    *   - --compute-ratings    棋譜DBファイルに登場するプレイヤーのレーティングを計算する
@@ -21,8 +21,11 @@
 
 #include "cluster.h"
 
+#include <algorithm>
 #include <sstream>
+#include <unistd.h>
 #include "book.h"
+#include "hash_table.h"
 #include "movegen.h"
 #include "synced_printf.h"
 
@@ -30,85 +33,107 @@ namespace {
 
 Book g_book;
 
+/**
+ * positionコマンドの末尾に、指し手を追加します（"moves"がなければ、それも追加する）.
+ * 比較しやすいように、トークンどうしは空白１文字で区切り直します。
+ */
+std::string AppendMoves(const std::string& position,
+                        const std::vector<std::string>& moves) {
+  std::istringstream is(position);
+  std::string result, token;
+  bool has_moves = false;
+  while (is >> token) {
+    result += (result.empty() ? "" : " ") + token;
+    has_moves |= (token == "moves");
+  }
+  if (!has_moves && !moves.empty()) {
+    result += " moves";
+  }
+  for (const std::string& move : moves) {
+    result += " " + move;
+  }
+  return result;
+}
+
+/**
+ * positionコマンドから、最後の指し手を取り除きます.
+ * @param position  positionコマンド
+ * @param parent    最後の指し手を取り除いたpositionコマンドを保存する変数
+ * @param last_move 最後の指し手を保存する変数
+ * @return 指し手が１手以上含まれていた場合はtrue
+ */
+bool SplitLastMove(const std::string& position, std::string* const parent,
+                   std::string* const last_move) {
+  std::istringstream is(position);
+  std::vector<std::string> tokens;
+  for (std::string token; is >> token; ) {
+    tokens.push_back(token);
+  }
+  if (tokens.size() < 2 || tokens.at(tokens.size() - 2) == "position"
+      || std::find(tokens.begin(), tokens.end(), "moves") >= tokens.end() - 1) {
+    return false;
+  }
+  *last_move = tokens.back();
+  tokens.pop_back();
+  parent->clear();
+  for (const std::string& token : tokens) {
+    *parent += (parent->empty() ? "" : " ") + token;
+  }
+  return true;
+}
+
 }
 
-ClusterWorker::ClusterWorker(size_t worker_id, Cluster& cluster)
-    : worker_id_(worker_id),
+ClusterWorker::ClusterWorker(size_t worker_id, Cluster& cluster,
+                             ProcessMultiplexer& multiplexer)
+    : UsiWorker(multiplexer),
+      worker_id_(worker_id),
       cluster_(cluster) {
 }
 
 ClusterWorker::~ClusterWorker() {
-  // ワーカにquitコマンドを送信
-  SendCommand("quit");
-
-  // 外部プロセスの終了を待つ
-  external_process_.WaitFor();
+  // ワーカにquitコマンドを送信し、外部プロセスの終了を待つ
+  QuitEngine();
 }
 
 void ClusterWorker::Initialize() {
-  // 1. 外部プロセスを使い、USIエンジンを起動する
-  if (worker_id_ == cluster_.master_worker_id()) {
-    // a. マスターの起動
-    char* const args[] = {
-        const_cast<char*>("./release"),
-        NULL
-    };
-    if (external_process_.StartProcess(args[0], args) < 0) {
-      std::perror("StartProcess()\n");
-      return;
-    }
-  } else {
-    // b. ワーカーの起動
-    std::string worker_name = "worker-" + std::to_string(worker_id_);
-    char* const args[] = {
-#if 0
-        // リモートマシンをワーカーとして使用する場合: SSHで通信する
-        const_cast<char*>("ssh"),
-        const_cast<char*>(worker_name.c_str()), // ~/.ssh/configでワーカーのホスト名を設定しておく
-        const_cast<char*>("cd gikou/bin; ./release"), // ディレクトリを移動後、実行する
-#else
-        // ローカルマシンをワーカーとして使用する場合: パイプで通信する
-        const_cast<char*>("./release"),
-#endif
-        NULL
-    };
-    if (external_process_.StartProcess(args[0], args) < 0) {
-      std::perror("StartProcess()\n");
-      return;
-    }
+  // 1. 外部プロセスを使い、USIエンジンを起動する（起動方法は、cluster.txtで変更できる）
+  const WorkerConfig& config = cluster_.topology().at(worker_id_);
+  if (!StartEngine(config)) {
+    std::perror("StartEngine()\n");
+    return;
   }
 
   // 2. 対局準備のため、USIコマンドをエンジンに送信する
-  SendCommand("usi");
-  const UsiOptions& options = cluster_.usi_options(); // オプションの一部を下流に伝達する
-  SendCommand("setoption name USI_Hash value %d", (int)options["USI_Hash"]);
-  SendCommand("setoption name Threads value %d", (int)options["Threads"]);
-  SendCommand("setoption name DrawScore value %d", (int)options["DrawScore"]);
+  if (!NegotiateProtocol()) {
+    return;
+  }
+  SendEngineOptions(config, cluster_.usi_options()); // オプションの一部を下流に伝達する
+  SetSharedHashId(cluster_.shared_hash_id());
   SendCommand("isready");
+}
 
-  // 3. readyokが送られてくるまで待機する
-  for (std::string line; RecieveCommand(&line); ) {
-    if (line == "readyok") break;
-  }
+void ClusterWorker::OnInfoReceived(const UsiInfo& info) {
+  cluster_.UpdateInfo(worker_id_, info);
 }
 
-void ClusterWorker::Run() {
-  // bestmoveコマンドが帰ってくるまで探索する
-  for (std::string line; RecieveCommand(&line); ) {
-    std::istringstream is(line);
-    std::string token;
-    is >> token;
-    if (token == "info") {
-      UsiInfo info = UsiProtocol::ParseInfoCommand(is);
-      cluster_.UpdateInfo(worker_id_, info);
-    } else if (token == "bestmove") {
-      break;
-    }
-  }
+void TimeManagerForCluster::HandleTimeUpEvent() {
+  cluster_.OnTimeUp();
 }
 
 Cluster::Cluster()
-    : UsiProtocol("Gikou Cluster", "Yosuke Demura") {
+    : UsiProtocol("Gikou Cluster", "Yosuke Demura"),
+      topology_(3, WorkerConfig()),
+      time_manager_(usi_options(), *this),
+      worker_monitor_(stop_mutex_) {
+  // 同じマシン上のワーカーどうしで、USI_Hashの大きさのハッシュテーブルを１つ共有する場合はtrue
+  mutable_usi_options()->AddOption("SharedHash", UsiOption(false));
+
+  // 探索中に、ワーカーの担当する手を再割り当てする場合はtrue
+  mutable_usi_options()->AddOption("DynamicScheduling", UsiOption(true));
+
+  // 先読みの際に、予想手を含めて、相手の応手をいくつまで先読みするか（1ならば、予想手のみ）
+  mutable_usi_options()->AddOption("PonderCandidates", UsiOption(1, 1, 8));
 }
 
 void Cluster::OnIsreadyCommandEntered() {
@@ -116,26 +141,47 @@ void Cluster::OnIsreadyCommandEntered() {
   g_book.ReadFromFile("book.bin");
 
   // ワーカを必要なだけ起動する
+  std::unique_lock<std::mutex> stop_lock(stop_mutex_);
   if (workers_.empty()) {
+    // cluster.txtがあれば、ワーカーの構成を読み込む（なければ、ローカルマシン上の４プロセスで構成する）
+    if (topology_.ReadFromFile("cluster.txt")) {
+      SYNCED_PRINTF("info string %zu workers are configured in cluster.txt.\n",
+                    topology_.size());
+    }
+    num_workers_ = topology_.size();
+    // 共有メモリ上のハッシュテーブルを使う場合は、ワーカーを起動する前に作成しておく
+    if (usi_options()["SharedHash"]) {
+      int id = static_cast<int>(getpid());
+      if (HashTable::CreateSharedTable(&shared_hash_, HashTable::SharedTableName(id).c_str(),
+                                       usi_options()["USI_Hash"])) {
+        shared_hash_id_ = id;
+      }
+    }
     // 初回は別プロセスを立ち上げる
     for (size_t worker_id = 0; worker_id < num_workers_; ++worker_id) {
-      ClusterWorker* engine = new ClusterWorker(worker_id, *this);
-      engine->StartNewThread();
+      ClusterWorker* engine = new ClusterWorker(worker_id, *this, multiplexer_);
+      engine->Initialize();
       workers_.emplace_back(engine);
     }
-
-    // ワーカの準備ができるまで待機する
+    // readyokコマンドを送り返して来るまで待機する
+    std::vector<UsiWorker*> workers;
     for (std::unique_ptr<ClusterWorker>& worker : workers_) {
-      worker->WaitForReady();
+      worker->WaitForCommand("readyok");
+      workers.push_back(worker.get());
     }
+    // 以後、応答しなくなったワーカーは、自動的に再起動する
+    worker_monitor_.Start(workers);
   } else {
-    // 次回以降は、既に起動しているプロセスを使い回す
-    SendCommandToAllWorkers("isready");
-
-    // readyokコマンドを送り返して来るまで待機する
+    // 次回以降は、既に起動しているプロセスを使い回す（再起動中のワーカーは除く）
+    const std::chrono::milliseconds timeout(WorkerMonitor::kRestartTimeout);
+    for (std::unique_ptr<ClusterWorker>& worker : workers_) {
+      if (worker->is_available()) {
+        worker->SendCommand("isready");
+      }
+    }
     for (std::unique_ptr<ClusterWorker>& worker : workers_) {
-      for (std::string line; worker->RecieveCommand(&line); ) {
-        if (line == "readyok") break;
+      if (worker->is_available() && !worker->WaitForCommand("readyok", timeout)) {
+        worker->MarkHung();
       }
     }
   }
@@ -145,6 +191,8 @@ void Cluster::OnIsreadyCommandEntered() {
 }
 
 void Cluster::OnUsinewgameCommandEntered() {
+  // 共有メモリ上のハッシュテーブルは、ワーカーが消去しないので、マスターが消去する
+  HashTable::ClearSharedTable(&shared_hash_);
   SendCommandToAllWorkers("usinewgame");
 }
 
@@ -177,60 +225,106 @@ void Cluster::OnGoCommandEntered(const UsiGoOptions& go_options) {
     }
   }
 
+  // 4. 時間管理を開始する
+  // 探索の準備中に時間切れになっても、準備が終わるまでは探索を停止しないようにする
+  time_manager_.WaitUntilTaskIsFinished(); // 時間管理用スレッドが利用可能になるまで待機する
+  std::unique_lock<std::mutex> stop_lock(stop_mutex_);
+  go_options_ = go_options;
+  time_manager_.StartTimeManagement(root_node(), go_options_);
+  thinking_ = true;
+
   std::string ignoremoves = "";
   std::vector<bool> busy_workers(workers_.size(), false);
+  mutex_.lock();
   worker_infos_.clear();
   worker_infos_.resize(workers_.size());
+  best_move_info_ = UsiInfo();
+  bestmove_sent_ = false;
+  best_move_changes_ = 0.0;
+  max_best_move_depth_ = 0;
+  time_to_depth_.clear();
+  speculative_positions_.assign(workers_.size(), std::string());
+  speculative_infos_.assign(workers_.size(), UsiInfo());
+  mutex_.unlock();
+  ponderhit_ = false;
+  assigned_moves_.assign(workers_.size(), std::string());
+  num_legal_moves_ = num_legal_moves;
+  num_reassignments_ = 0;
+  search_start_time_ = std::chrono::steady_clock::now();
+
+  // 再起動中のワーカーには、探索を割り当てない
+  ClusterWorker& master = master_worker();
+  size_t num_available_workers = 0;
+  for (size_t worker_id = 0; worker_id < workers_.size(); ++worker_id) {
+    if (worker_id != master_worker_id() && workers_.at(worker_id)->is_available()) {
+      ++num_available_workers;
+    }
+  }
 
-  // 4. 相手の指し手の予想が当たった場合は、前回のPVの手を優先的にワーカーに割り当てる
-  const bool prediction_hit = (position_sfen() == predicted_position_);
+  // 5. 相手の指し手の予想が当たった場合は、前回のPVの手を優先的にワーカーに割り当てる
+  // 予想局面を先読みしていたワーカー（なるべく前回探索時と同じワーカー）に割り当てる
+  const std::string position = AppendMoves(position_sfen(), {});
+  const Prediction* prediction = nullptr;
+  for (const Prediction& p : predictions_) {
+    if (p.position == position && workers_.at(p.worker_id)->is_available()) {
+      prediction = &p;
+      break;
+    }
+  }
+  const bool prediction_hit = prediction != nullptr;
   if (prediction_hit) {
-    // なるべく前回探索時と同じワーカーに割り当てる
-    size_t worker_id = previous_best_worker_ != master_worker_id() ? previous_best_worker_ : 0;
+    const size_t worker_id = prediction->worker_id;
+    const std::string& predicted_move = prediction->move;
     std::unique_ptr<ClusterWorker>& worker = workers_.at(worker_id);
     SYNCED_PRINTF("info string prediction hit! %zu %s\n", worker_id,
-                  predicted_move_.c_str());
+                  predicted_move.c_str());
     // ワーカーに探索の指示を出す
     worker->SendCommand(position_sfen().c_str());
-    worker->SendCommand("go infinite searchmoves %s", predicted_move_.c_str());
-    worker->ExecuteTask();
+    worker->StartSearch();
+    worker->SendCommand("go infinite searchmoves %s", predicted_move.c_str());
     busy_workers.at(worker_id) = true;
-    ignoremoves += " " + predicted_move_;
+    assigned_moves_.at(worker_id) = predicted_move;
+    ignoremoves += " " + predicted_move;
   }
+  const size_t num_predicted_moves = prediction_hit ? 1 : 0;
 
-  // 5. MultiPV探索を行い、ワーカを割り当てる指し手を決める
-  size_t multipv = std::min(num_legal_moves, workers_.size()) - (prediction_hit ? 2 : 1);
-  std::vector<UsiInfo> presearch_infos(multipv);
-  ClusterWorker& master = master_worker();
+  // 6. 先読み中は、相手の予想手以外の有力な応手についても、ワーカーに先読みさせる
+  if (go_options.ponder) {
+    num_available_workers -= StartSpeculativePonder(num_available_workers - num_predicted_moves,
+                                                    &busy_workers);
+  }
+
+  // 7. MultiPV探索を行い、ワーカを割り当てる指し手を決める
+  size_t multipv = master.is_available()
+      ? std::min(num_legal_moves - 1, num_available_workers) - num_predicted_moves
+      : 0;
+  mutex_.lock();
+  presearch_infos_.assign(multipv, UsiInfo());
+  mutex_.unlock();
   if (multipv > 0) {
     // MultiPV探索の指示を出す
     master.SendCommand("setoption name OwnBook value false");
     master.SendCommand("setoption name MultiPV value %zu", multipv);
     master.SendCommand(position_sfen().c_str());
+    // infoコマンドを受信して、上位の手を調べる（受信したinfoコマンドは、UpdateInfo()で保存される）
+    presearching_ = true;
+    master.StartSearch();
     master.SendCommand("go byoyomi %d ignoremoves%s", kShallowSearchTime, ignoremoves.c_str());
-    // infoコマンドを受信して、上位の手を調べる
-    for (std::string line; master.RecieveCommand(&line); ) {
-      std::istringstream is(line);
-      std::string token;
-      is >> token;
-      if (token == "info") {
-        UsiInfo info = ParseInfoCommand(is);
-        if (info.multipv >= 1) {
-          // presearch_infosは、後でうしろから取り出すので、良い手ほどうしろに保存する
-          presearch_infos.at(multipv - info.multipv) = info;
-        }
-      } else if (token == "bestmove") {
-        break;
-      }
-    }
+    WaitUntilWorkersStop({master_worker_id()});
+    presearching_ = false;
     // MultiPVの設定を元に戻しておく
     master.SendCommand("setoption name MultiPV value 1");
   }
-
-  // 6. MultiPV探索でヒップアップされた上位の手については、それぞれ１台のワーカに割り当てる
-  for (size_t worker_id = 0; !presearch_infos.empty(); ++worker_id) {
-    // マスター及び既に探索中のワーカーはスキップする
-    if (worker_id == master_worker_id() || busy_workers.at(worker_id)) {
+  mutex_.lock();
+  std::vector<UsiInfo> presearch_infos = presearch_infos_;
+  mutex_.unlock();
+
+  // 8. MultiPV探索でヒップアップされた上位の手については、それぞれ１台のワーカに割り当てる
+  for (size_t worker_id = 0; !presearch_infos.empty() && worker_id < workers_.size(); ++worker_id) {
+    // マスター、既に探索中のワーカー及び再起動中のワーカーはスキップする
+    if (   worker_id == master_worker_id()
+        || busy_workers.at(worker_id)
+        || !workers_.at(worker_id)->is_available()) {
       continue;
     }
     // ワーカーに探索の指示を出す
@@ -238,44 +332,75 @@ void Cluster::OnGoCommandEntered(const UsiGoOptions& go_options) {
     std::unique_ptr<ClusterWorker>& worker = workers_.at(worker_id);
     if (!pv.empty()) {
       worker->SendCommand(position_sfen().c_str());
+      worker->StartSearch();
       worker->SendCommand("go infinite searchmoves %s", pv.front().c_str());
-      worker->ExecuteTask();
       busy_workers.at(worker_id) = true;
-      ignoremoves += " " + pv.front();
+      assigned_moves_.at(worker_id) = pv.front();
     }
     presearch_infos.pop_back();
   }
 
-  // 7. 残りの手については、まとめてマスターに割当てる
-  assert(ignoremoves != "");
-  master.SendCommand(position_sfen().c_str());
-  master.SendCommand("go infinite ignoremoves%s", ignoremoves.c_str());
-  master.ExecuteTask();
-
-#define USE_SIMPLE_TIMER
-#ifdef USE_SIMPLE_TIMER
-  if (!go_options.infinite && !go_options.ponder) {
-    std::thread timer_thread{[&](){
-      std::chrono::milliseconds byoyomi(go_options.byoyomi);
-      std::this_thread::sleep_for(byoyomi);
-      OnStopCommandEntered();
-    }};
-    timer_thread.join();
-  }
-#endif
+  // 9. 残りの手については、まとめてマスターに割当てる
+  if (master.is_available()) {
+    StartMasterSearch();
+  } else {
+    // マスターが再起動中の場合は、代わりに空いているワーカーに全ての手を探索させる
+    for (size_t worker_id = 0; worker_id < workers_.size(); ++worker_id) {
+      std::unique_ptr<ClusterWorker>& worker = workers_.at(worker_id);
+      if (   worker_id != master_worker_id()
+          && !busy_workers.at(worker_id)
+          && worker->is_available()) {
+        SYNCED_PRINTF("info string worker %zu searches all moves instead of the master\n",
+                      worker_id);
+        worker->SendCommand(position_sfen().c_str());
+        worker->StartSearch();
+        worker->SendCommand("go infinite");
+        break;
+      }
+    }
+  }
+
+  // 10. 探索中は、スケジューラに担当する手の再割り当てや、異常終了したワーカーの後始末を任せる
+  StartScheduler();
+
+  // 以後、探索はTimeManagerによる時間切れか、stopコマンドによって停止される
 }
 
 void Cluster::OnStopCommandEntered() {
+  // 時間切れとstopコマンドが重なった場合などに、bestmoveコマンドを２回送らないようにする
+  std::unique_lock<std::mutex> stop_lock(stop_mutex_);
+  if (!thinking_) {
+    return;
+  }
+  thinking_ = false;
+
+  // 時間管理を止める
+  time_manager_.StopTimeManagement();
+
+  // 探索中に再割り当てが行われないよう、先にスケジューラを止めておく
+  StopScheduler();
+
   // 下流の各エンジンにstopコマンドを送信する
   SendCommandToAllWorkers("stop");
 
-  // 各エンジンからbestmoveコマンドを受信するまで待機
-  for (std::unique_ptr<ClusterWorker>& worker : workers_) {
-    worker->WaitUntilTaskIsFinished();
-  }
-
   // 最善手を送信する
-  const std::vector<std::string>& pv = best_move_info_.pv;
+  // 応答しないワーカーがあっても秒読みに間に合うよう、各エンジンのbestmoveコマンドは待たずに、
+  // すでに受信しているinfoコマンドから求めた最善手を送信する（infoコマンドをまだ受信していない場合のみ待つ）
+  std::vector<size_t> all_workers;
+  for (size_t worker_id = 0; worker_id < workers_.size(); ++worker_id) {
+    all_workers.push_back(worker_id);
+  }
+  mutex_.lock();
+  const bool waits_for_workers = best_move_info_.pv.empty();
+  mutex_.unlock();
+  if (waits_for_workers) {
+    WaitUntilWorkersStop(all_workers);
+  }
+  mutex_.lock();
+  const std::vector<std::string> pv = best_move_info_.pv;
+  const size_t best_worker_id = previous_best_worker_;
+  bestmove_sent_ = true;
+  mutex_.unlock();
   if (pv.empty()) {
     SYNCED_PRINTF("bestmove resign\n");
   } else if (pv.size() == 1) {
@@ -284,22 +409,44 @@ void Cluster::OnStopCommandEntered() {
     SYNCED_PRINTF("bestmove %s ponder %s\n", pv.at(0).c_str(), pv.at(1).c_str());
   }
 
+  // bestmoveコマンドを送信した後で、各エンジンからbestmoveコマンドを受信するまで待機する
+  // （応答しないワーカーは、WaitUntilWorkersStop()で記録され、以後はWorkerMonitorが再起動する）
+  if (!waits_for_workers) {
+    WaitUntilWorkersStop(all_workers);
+  }
+
   // 次回探索時の探索割当の参考とするため、予想局面及び予想局面における最善手を保存しておく
+  predictions_.clear();
   if (pv.size() >= 3) {
-    predicted_position_ = position_sfen() + " " + pv.at(0) + " " + pv.at(1);
-    predicted_move_ = pv.at(2);
-  } else {
-    predicted_position_.clear();
-    predicted_move_.clear();
+    size_t worker_id = best_worker_id != master_worker_id() ? best_worker_id : 0;
+    predictions_.push_back({AppendMoves(position_sfen(), {pv.at(0), pv.at(1)}), pv.at(2), worker_id});
+  }
+
+  // 相手の別の応手を先読みしていたワーカーの最善手も保存しておく
+  // （先読みが外れて、その応手が指された場合は、そのワーカーの置換表をそのまま活かせる）
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (size_t worker_id = 0; worker_id < speculative_positions_.size(); ++worker_id) {
+    const std::vector<std::string>& speculative_pv = speculative_infos_.at(worker_id).pv;
+    if (!speculative_positions_.at(worker_id).empty() && !speculative_pv.empty()) {
+      predictions_.push_back({speculative_positions_.at(worker_id), speculative_pv.front(), worker_id});
+    }
+    speculative_positions_.at(worker_id).clear();
   }
 }
 
 void Cluster::OnPonderhitCommandEntered() {
+  // TimeManagerに、ponderhitコマンドが来た時間を記録する
+  time_manager_.RecordPonderhitTime();
+
+  // 予想手以外の応手を先読みしていたワーカーは、スケジューラが通常の探索に回す
+  ponderhit_ = true;
+
   SendCommandToAllWorkers("ponderhit");
 }
 
 void Cluster::OnQuitCommandEntered() {
   OnStopCommandEntered();
+  worker_monitor_.Stop(); // ワーカーを終了させる前に、死活監視を止めておく
   workers_.clear(); // WorkerEngineのデストラクタが呼ばれるため、外部プロセスは終了する
 }
 
@@ -311,6 +458,27 @@ void Cluster::UpdateInfo(int worker_id, const UsiInfo& usi_info) {
   // 最善手を特定する際にデータが更新されないように、排他制御を行う
   std::unique_lock<std::mutex> lock(mutex_);
 
+  // MultiPV探索中のマスターのinfoコマンドは、上位の手を調べるためだけに用いる
+  if (presearching_ && size_t(worker_id) == master_worker_id()) {
+    const size_t multipv = presearch_infos_.size();
+    if (usi_info.multipv >= 1 && size_t(usi_info.multipv) <= multipv) {
+      // presearch_infos_は、後でうしろから取り出すので、良い手ほどうしろに保存する
+      presearch_infos_.at(multipv - usi_info.multipv) = usi_info;
+    }
+    return;
+  }
+
+  // 相手の別の応手を先読みしているワーカーのinfoコマンドは、その局面の最善手を記録するためだけに用いる
+  if (!speculative_positions_.at(worker_id).empty()) {
+    speculative_infos_.at(worker_id) = usi_info;
+    return;
+  }
+
+  // bestmoveコマンドを送信した後に届いたinfoコマンドは、出力しない
+  if (bestmove_sent_) {
+    return;
+  }
+
   // 現在の最善手を求める
   int best_worker_id = 0, second_worker_id = 1;
   Score best_score = -kScoreInfinite - 1, second_score = -kScoreInfinite - 2;
@@ -360,12 +528,351 @@ void Cluster::UpdateInfo(int worker_id, const UsiInfo& usi_info) {
     UsiInfo temp = *best_info;
     temp.nps = total_nps;
     temp.nodes = total_nodes;
-    std::printf("%s\n", temp.ToString().c_str());
+    SYNCED_PRINTF("%s\n", temp.ToString().c_str());
+
+    // 最善手が変化した回数を数える（古い変化ほど軽く扱うため、最善手の深さが更新されるたびに半減させる）
+    if (   !best_move_info_.pv.empty() && !temp.pv.empty()
+        && best_move_info_.pv.front() != temp.pv.front()) {
+      best_move_changes_ += 1.0;
+    }
+    if (temp.depth > max_best_move_depth_) {
+      max_best_move_depth_ = temp.depth;
+      best_move_changes_ *= 0.5;
+    }
     best_move_info_ = temp;
+
+    // 最善手の深さが初めて到達した時刻を記録する
+    auto elapsed = std::chrono::steady_clock::now() - search_start_time_;
+    int64_t msec = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+    while (time_to_depth_.size() < size_t(std::max(temp.depth, 0))) {
+      time_to_depth_.push_back(msec);
+    }
   }
 
   // ワーカのinfoコマンドを保存する
   worker_infos_.at(worker_id) = usi_info;
+
+  // 時間管理に必要な情報をTimeManagerに送る
+  UpdateTimeManagementStats();
+}
+
+void Cluster::UpdateTimeManagementStats() {
+  // 最善手と評価値がこの値以内の手は、最善手と競合しているとみなす
+  const Score kCloseMargin = static_cast<Score>(50);
+
+  // 1. 最善手及び次善手を担当しているワーカーを調べる
+  int num_active_workers = 0;
+  size_t best_worker_id = 0;
+  Score best_score = -kScoreInfinite, second_score = -kScoreInfinite;
+  int64_t total_nodes = 0;
+  for (size_t i = 0; i < worker_infos_.size(); ++i) {
+    const UsiInfo& info = worker_infos_.at(i);
+    if (info.depth <= 0) {
+      continue; // まだinfoコマンドを送ってきていない
+    }
+    ++num_active_workers;
+    total_nodes += info.nodes;
+    if (info.score > best_score) {
+      second_score = best_score;
+      best_score = info.score;
+      best_worker_id = i;
+    } else if (info.score > second_score) {
+      second_score = info.score;
+    }
+  }
+  if (num_active_workers == 0) {
+    return;
+  }
+
+  // 2. 最善手と評価値の近い手を探索しているワーカーが多いほど、一致率を低くする
+  int num_competitors = 0;
+  for (size_t i = 0; i < worker_infos_.size(); ++i) {
+    const UsiInfo& info = worker_infos_.at(i);
+    if (   i != best_worker_id && info.depth > 0
+        && info.score + kCloseMargin > best_score) {
+      ++num_competitors;
+    }
+  }
+
+  // 3. 統計データを更新する
+  TimeControl::Stats& stats = time_manager_.stats();
+  const UsiInfo& best_info = worker_infos_.at(best_worker_id);
+  stats.num_iterations_finished = best_move_info_.depth;
+  stats.agreement_rate = double(num_active_workers - num_competitors) / num_active_workers;
+  stats.pv_instability = 1.0 + best_move_changes_;
+  stats.search_insufficiency = best_info.nodes > 0
+      ? std::max(1.0, double(total_nodes) / (double(num_active_workers) * best_info.nodes))
+      : -1.0;
+  stats.singular_margin = second_score > -kScoreInfinite
+      ? static_cast<Score>(best_score - second_score)
+      : -kScoreInfinite;
+}
+
+void Cluster::WaitUntilWorkersStop(const std::vector<size_t>& worker_ids) {
+  // bestmoveコマンドが返ってくるまで待つ最大の時間（ミリ秒）
+  // MultiPV探索（300ミリ秒）の終了待ちにも用いるので、余裕を持たせておく
+  const int kStopTimeout = 3000;
+
+  // 応答しないワーカーが複数あっても、待機時間の合計がkStopTimeoutを超えないようにする
+  const auto deadline = std::chrono::steady_clock::now()
+                      + std::chrono::milliseconds(kStopTimeout);
+  for (size_t worker_id : worker_ids) {
+    ClusterWorker& worker = *workers_.at(worker_id);
+    auto timeout = std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - std::chrono::steady_clock::now());
+    if (!worker.WaitUntilSearchIsFinished(std::max(timeout, std::chrono::milliseconds(0)))) {
+      SYNCED_PRINTF("info string Worker #%zu did not return bestmove.\n", worker_id);
+      worker.MarkHung(); // 以後、WorkerMonitorが再起動する
+    }
+  }
+}
+
+std::vector<int64_t> Cluster::time_to_depth() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  return time_to_depth_;
+}
+
+void Cluster::StartMasterSearch() {
+  // ワーカーが担当している手を除外して探索する
+  std::string ignoremoves;
+  for (const std::string& move : assigned_moves_) {
+    if (!move.empty()) {
+      ignoremoves += " " + move;
+    }
+  }
+
+  // ワーカーが全て再起動中の場合は、マスターが全ての手を探索する
+  ClusterWorker& master = master_worker();
+  master.SendCommand(position_sfen().c_str());
+  master.StartSearch();
+  if (ignoremoves.empty()) {
+    master.SendCommand("go infinite");
+  } else {
+    master.SendCommand("go infinite ignoremoves%s", ignoremoves.c_str());
+  }
+}
+
+void Cluster::StartScheduler() {
+  // 再割り当てを検討する間隔（ミリ秒）
+  const int kSchedulingInterval = 100;
+
+  const std::chrono::milliseconds interval(kSchedulingInterval);
+  scheduler_running_ = true;
+  scheduler_thread_ = std::thread([this, interval]() {
+    std::unique_lock<std::mutex> lock(scheduler_mutex_);
+    while (!scheduler_condition_.wait_for(lock, interval,
+                                          [this]() { return !scheduler_running_; })) {
+      RedistributeWork();
+    }
+  });
+}
+
+void Cluster::StopScheduler() {
+  if (!scheduler_thread_.joinable()) {
+    return;
+  }
+  std::unique_lock<std::mutex> lock(scheduler_mutex_);
+  scheduler_running_ = false;
+  scheduler_condition_.notify_all();
+  lock.unlock();
+  scheduler_thread_.join();
+}
+
+void Cluster::RedistributeWork() {
+  // 再割り当てを検討するために必要な、最低限の探索深さ
+  const int kMinDepth = 8;
+  // 最善手の評価値よりもこの値以上劣る手は、見込みがないとみなす
+  const Score kMargin = static_cast<Score>(200);
+
+  mutex_.lock();
+  const std::vector<UsiInfo> infos = worker_infos_;
+  mutex_.unlock();
+
+  // 0. ponderhitコマンドを受信したら、予想手以外の応手を先読みしていたワーカーを、通常の探索に回す
+  if (ponderhit_ && ReleaseSpeculativeWorker(infos.at(master_worker_id()))) {
+    return;
+  }
+
+  // 1. 異常終了した（または再起動された）ワーカーが担当していた手は、マスターに引き取らせる
+  for (size_t worker_id = 0; worker_id < workers_.size(); ++worker_id) {
+    if (   !assigned_moves_.at(worker_id).empty()
+        && !workers_.at(worker_id)->is_searching()) {
+      ReassignWorker(worker_id, "");
+      return;
+    }
+  }
+
+  // 2. 再起動が終わったマスターには、ワーカーに割り当てられていない手を探索させる
+  ClusterWorker& master = master_worker();
+  if (master.is_available() && !master.is_searching()) {
+    StartMasterSearch();
+    return;
+  }
+
+  // 以下の、評価値に基づく再割り当ては、DynamicSchedulingオプションがtrueの場合に限り行う
+  if (!usi_options()["DynamicScheduling"]) {
+    return;
+  }
+
+  // 3. 勝ちを読み切っている場合や、マスターに割り当てる手がなくなる場合は、再割り当ては行わない
+  Score best_score = -kScoreInfinite;
+  for (const UsiInfo& info : infos) {
+    best_score = std::max(best_score, info.score);
+  }
+  size_t num_assigned_moves = assigned_moves_.size()
+      - std::count(assigned_moves_.begin(), assigned_moves_.end(), std::string());
+  const UsiInfo& master_info = infos.at(master_worker_id());
+  if (   best_score >= kScoreMateInMaxPly
+      || num_legal_moves_ < num_assigned_moves + 2
+      || master_info.depth < kMinDepth
+      || master_info.pv.empty()) {
+    return;
+  }
+
+  // 4. 担当する手の評価値が、最善手よりも大きく劣るワーカーを探す
+  size_t worst_worker_id = master_worker_id();
+  Score worst_score = master_info.score;
+  for (size_t worker_id = 0; worker_id < workers_.size(); ++worker_id) {
+    const UsiInfo& info = infos.at(worker_id);
+    if (   !assigned_moves_.at(worker_id).empty()
+        && workers_.at(worker_id)->is_searching()
+        && info.depth >= kMinDepth
+        && info.score + kMargin <= best_score
+        && info.score < worst_score) {
+      worst_worker_id = worker_id;
+      worst_score = info.score;
+    }
+  }
+
+  // 5. そのワーカーには、マスターが担当している手のうち、最も有望な手を割り当てる
+  if (worst_worker_id != master_worker_id()) {
+    ReassignWorker(worst_worker_id, master_info.pv.front());
+  }
+}
+
+size_t Cluster::StartSpeculativePonder(const size_t num_free_workers,
+                                      std::vector<bool>* const busy_workers) {
+  // 相手の応手を調べるための浅い探索に用いる時間（ミリ秒で指定。上位N手を調べる浅い探索と同じ）
+  const int kShallowSearchTime = 300;
+
+  // 1. 予想手以外に先読みする応手の数を決める（予想手の先読みのために、少なくとも１台は残しておく）
+  const size_t max_candidates = int(usi_options()["PonderCandidates"]) - 1;
+  const size_t num_candidates = std::min(max_candidates,
+                                         num_free_workers > 0 ? num_free_workers - 1 : 0);
+  ClusterWorker& master = master_worker();
+  std::string parent, ponder_move;
+  if (   num_candidates == 0
+      || !master.is_available()
+      || !SplitLastMove(position_sfen(), &parent, &ponder_move)) {
+    return 0;
+  }
+
+  // 2. 相手番の局面でMultiPV探索を行い、予想手以外の有力な応手を調べる
+  mutex_.lock();
+  presearch_infos_.assign(num_candidates, UsiInfo());
+  mutex_.unlock();
+  master.SendCommand("setoption name OwnBook value false");
+  master.SendCommand("setoption name MultiPV value %zu", num_candidates);
+  master.SendCommand(parent.c_str());
+  presearching_ = true;
+  master.StartSearch();
+  master.SendCommand("go byoyomi %d ignoremoves %s", kShallowSearchTime, ponder_move.c_str());
+  WaitUntilWorkersStop({master_worker_id()});
+  presearching_ = false;
+  master.SendCommand("setoption name MultiPV value 1");
+  mutex_.lock();
+  std::vector<UsiInfo> candidates = presearch_infos_;
+  mutex_.unlock();
+
+  // 3. それぞれの応手を指した局面を、１台ずつワーカーに先読みさせる
+  size_t num_started = 0;
+  for (size_t worker_id = 0; worker_id < workers_.size() && !candidates.empty(); ++worker_id) {
+    ClusterWorker& worker = *workers_.at(worker_id);
+    if (   worker_id == master_worker_id()
+        || busy_workers->at(worker_id)
+        || !worker.is_available()) {
+      continue;
+    }
+    const std::vector<std::string>& pv = candidates.back().pv;
+    if (!pv.empty()) {
+      const std::string position = AppendMoves(parent, {pv.front()});
+      mutex_.lock();
+      speculative_positions_.at(worker_id) = position;
+      mutex_.unlock();
+      worker.SendCommand(position.c_str());
+      worker.StartSearch();
+      worker.SendCommand("go infinite");
+      busy_workers->at(worker_id) = true;
+      ++num_started;
+    }
+    candidates.pop_back();
+  }
+  return num_started;
+}
+
+bool Cluster::ReleaseSpeculativeWorker(const UsiInfo& master_info) {
+  // 1. 予想手以外の応手を先読みしているワーカーを探す
+  mutex_.lock();
+  auto it = std::find_if(speculative_positions_.begin(), speculative_positions_.end(),
+                         [](const std::string& position) { return !position.empty(); });
+  const size_t worker_id = it - speculative_positions_.begin();
+  mutex_.unlock();
+  if (worker_id == speculative_positions_.size()) {
+    ponderhit_ = false;
+    return false;
+  }
+
+  // 2. マスターの担当している手が分かるまでは、先読みを続けさせておく
+  if (master_worker().is_searching() && master_info.pv.empty()) {
+    return false;
+  }
+
+  // 3. 先読みを止める
+  ClusterWorker& worker = *workers_.at(worker_id);
+  worker.SendCommand("stop");
+  WaitUntilWorkersStop({worker_id});
+  mutex_.lock();
+  speculative_positions_.at(worker_id).clear();
+  speculative_infos_.at(worker_id) = UsiInfo();
+  mutex_.unlock();
+
+  // 4. マスターが担当している手のうち、最も有望な手を割り当てる
+  size_t num_assigned_moves = assigned_moves_.size()
+      - std::count(assigned_moves_.begin(), assigned_moves_.end(), std::string());
+  if (!master_info.pv.empty() && num_legal_moves_ >= num_assigned_moves + 2) {
+    ReassignWorker(worker_id, master_info.pv.front());
+  }
+  return true;
+}
+
+void Cluster::ReassignWorker(const size_t worker_id, const std::string& new_move) {
+  ClusterWorker& worker = *workers_.at(worker_id);
+  ClusterWorker& master = master_worker();
+
+  // 1. ワーカーとマスターの探索を止める
+  worker.SendCommand("stop");
+  master.SendCommand("stop");
+  WaitUntilWorkersStop({worker_id, master_worker_id()});
+
+  // 2. 古い割り当てに基づくinfoコマンドを消去する
+  mutex_.lock();
+  worker_infos_.at(worker_id) = UsiInfo();
+  worker_infos_.at(master_worker_id()) = UsiInfo();
+  mutex_.unlock();
+  assigned_moves_.at(worker_id) = new_move;
+  ++num_reassignments_;
+
+  // 3. 新しい割り当てで、探索を再開する
+  if (!new_move.empty() && worker.is_available()) {
+    worker.SendCommand(position_sfen().c_str());
+    worker.StartSearch();
+    worker.SendCommand("go infinite searchmoves %s", new_move.c_str());
+  } else {
+    assigned_moves_.at(worker_id).clear();
+  }
+  if (master.is_available()) {
+    StartMasterSearch();
+  }
 }
 
 #endif /* !defined(MINIMUM) */
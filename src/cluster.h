@@ -22,11 +22,18 @@
 
 #if !defined(MINIMUM)
 
+#include <chrono>
+#include <condition_variable>
 #include <memory>
+#include <string>
+#include <thread>
 #include <vector>
 #include "process.h"
-#include "task_thread.h"
+#include "shared_memory.h"
+#include "time_manager.h"
 #include "usi_protocol.h"
+#include "usi_worker.h"
+#include "worker_topology.h"
 
 class Cluster;
 
@@ -40,53 +47,68 @@ class Cluster;
  *     第15回ゲームプログラミングワークショップ, pp.126-133, 2010.
  *   - 山下宏: YSSの16台クラスタ探索について, http://www.yss-aya.com/csa0510.txt, 2014.
  */
-class ClusterWorker : public TaskThread {
+class ClusterWorker : public UsiWorker {
  public:
-  ClusterWorker(size_t worker_id, Cluster& cluster);
+  ClusterWorker(size_t worker_id, Cluster& cluster,
+                ProcessMultiplexer& multiplexer);
   ~ClusterWorker();
 
   /**
-   * 外部プロセス上にUSIエンジンを起動して、初期設定を行います.
+   * 外部プロセス上にUSIエンジンを起動して、初期設定のコマンドを送信します.
+   * 初期設定が終わったかどうかは、readyokコマンドを受信することで確認してください。
    */
   void Initialize();
 
-  /**
-   * bestmoveコマンドを受信するまで、ワーカーから送られてくるコマンドを受信します.
-   */
-  void Run();
+ protected:
+  void OnInfoReceived(const UsiInfo& info);
 
-  /**
-   * 外部プロセスのUSIエンジンに対し、コマンドを送信します.
-   * @param format std::printf()関数と同様のフォーマット
-   * @param args   フォーマットに従って出力したい引数
-   */
-  template<typename... Args>
-  void SendCommand(const char* format, const Args&... args) {
-    std::unique_lock<std::mutex> lock(mutex_);
-    external_process_.Printf(format, args...);
-    external_process_.Printf("\n");
-  }
+ private:
+  const size_t worker_id_;
+  Cluster& cluster_;
+};
 
-  /**
-   * 外部プロセスのUSIエンジンから、コマンドを受信します.
-   * @param line 受信したコマンドを保存するための変数
-   * @return EOFを受信したらfalse。\nを受信したらtrue。
-   */
-  bool RecieveCommand(std::string* line) {
-    return external_process_.GetLine(line);
+/**
+ * 疎結合並列探索時の時間管理を担当するクラスです.
+ */
+class TimeManagerForCluster : public TimeManager {
+ public:
+  TimeManagerForCluster(const UsiOptions& usi_options, Cluster& cluster)
+      : TimeManager(usi_options),
+        cluster_(cluster) {
   }
-
+  void HandleTimeUpEvent();
  private:
-  const size_t worker_id_;
   Cluster& cluster_;
-  std::mutex mutex_;
-  Process external_process_;
 };
 
 /**
  * 疎結合並列探索のクラスタのマスター部分です.
  *
- * 現在の実装は、「ルート局面の上位N手に対し、各1台のワーカーに割り当てる」というシンプルなものです。
+ * 探索開始時には、「ルート局面の上位N手に対し、各1台のワーカーに割り当て、残りの手をマスターに割り当てる」
+ * というシンプルな割り当てを行います。
+ *
+ * DynamicSchedulingオプションがtrueの場合は、探索中もスケジューラのスレッドが各ワーカーのinfoコマンドを監視し、
+ *   - 担当する手の評価値が最善手よりも大きく劣るワーカーには、その手をマスターに戻させ、
+ *     代わりにマスターの担当している手のうち、最も有望な手を割り当てる
+ * という再割り当てを行います。
+ *
+ * また、WorkerMonitorにより各ワーカーの死活監視を行い、応答しなくなったワーカーは再起動します。
+ * 再起動中のワーカーには探索を割り当てず、探索中に異常終了したワーカーが担当していた手は、
+ * スケジューラがマスターに引き取らせます（この処理は、DynamicSchedulingオプションによらず行います）。
+ * マスターが利用できない場合は、代わりに１台のワーカーに全ての手を探索させます。
+ *
+ * PonderCandidatesオプションが2以上の場合は、先読みの際に、相手の予想手（ponderの手）以外の有力な応手も、
+ * マスターの浅いMultiPV探索で調べ、その応手を指した局面を空いているワーカーに１台ずつ先読みさせます。
+ *   - 予想手が指された（ponderhit）場合は、それらのワーカーを、順次通常の探索に回します。
+ *   - 別の応手が指された場合は、その局面を先読みしていたワーカーに、先読みで得た最善手を優先して探索させます
+ *     （ワーカーの置換表に、先読みの結果が残っているため）。
+ *
+ * 思考時間は、TimeManagerによって管理します。各ワーカーのinfoコマンドから、
+ *   - 最善手と評価値の近い手を探索しているワーカーの割合（agreement_rate）
+ *   - 最善手の変化した回数（pv_instability）
+ *   - 最善手を担当するワーカーの探索ノード数の不足具合（search_insufficiency）
+ *   - 最善手と次善手の評価値の差（singular_margin）
+ * を計算してTimeManagerに渡すことで、難しい局面ほど長く考え、易しい局面では早めに指すようにしています。
  *
  * （疎結合並列探索についての参考文献）
  *   - 金子知適, 田中哲朗: 最善手の予測に基づくゲーム木探索の分散並列実行,
@@ -96,7 +118,9 @@ class ClusterWorker : public TaskThread {
 class Cluster : public UsiProtocol {
  public:
   Cluster();
-  ~Cluster() {}
+  ~Cluster() {
+    worker_monitor_.Stop();
+  }
   void OnIsreadyCommandEntered();
   void OnUsinewgameCommandEntered();
   void OnGoCommandEntered(const UsiGoOptions& options);
@@ -105,10 +129,45 @@ class Cluster : public UsiProtocol {
   void OnQuitCommandEntered();
   void OnGameoverCommandEntered(const std::string& result);
   void UpdateInfo(int worker_id, const UsiInfo& worker_info);
+
+  /**
+   * TimeManagerが時間切れと判断した際に呼ばれます（TimeManagerのスレッドから呼ばれます）.
+   */
+  void OnTimeUp() {
+    OnStopCommandEntered();
+  }
+
+  /**
+   * ワーカーの構成を返します（マスターは最後の要素です）.
+   */
+  const WorkerTopology& topology() const {
+    return topology_;
+  }
+
   size_t master_worker_id() const {
     return num_workers_ - 1; // 最後のワーカーをマスターとして扱う
   }
 
+  /**
+   * ワーカーどうしで共有しているハッシュテーブルの番号を返します（共有していない場合は0）.
+   */
+  int shared_hash_id() const {
+    return shared_hash_id_;
+  }
+
+  /**
+   * 直前の探索で、最善手のinfoコマンドが深さdに初めて到達した時刻（探索開始からのミリ秒）を、
+   * d-1番目の要素として返します（シミュレーション用）.
+   */
+  std::vector<int64_t> time_to_depth();
+
+  /**
+   * 直前の探索で、ワーカーの担当する手を再割り当てした回数を返します（シミュレーション用）.
+   */
+  int num_reassignments() const {
+    return num_reassignments_;
+  }
+
  private:
   ClusterWorker& master_worker() {
     return *workers_.back();
@@ -120,29 +179,167 @@ class Cluster : public UsiProtocol {
     }
   }
 
-  /** ワーカー数（現在は4で固定しています）. */
+  /**
+   * 指定されたワーカーが全てbestmoveコマンドを返すまで待機します.
+   * 一定時間内に返ってこないワーカーは、応答しなくなったものとみなします。
+   */
+  void WaitUntilWorkersStop(const std::vector<size_t>& worker_ids);
+
+  /**
+   * ワーカーに割り当てられていない残りの手について、マスターに探索を開始させます.
+   */
+  void StartMasterSearch();
+
+  /**
+   * 探索中に担当する手を再割り当てするための、スケジューラのスレッドを開始します.
+   */
+  void StartScheduler();
+
+  /**
+   * スケジューラのスレッドを終了します（スケジューラが動いていない場合は、何もしません）.
+   */
+  void StopScheduler();
+
+  /**
+   * 各ワーカーのinfoコマンドをもとに、必要であれば、担当する手を再割り当てします.
+   */
+  void RedistributeWork();
+
+  /**
+   * 各ワーカーのinfoコマンドをもとに、時間管理に用いる統計データを更新します（mutex_をロックして呼ぶこと）.
+   */
+  void UpdateTimeManagementStats();
+
+  /**
+   * 先読みの際に、相手の予想手以外の有力な応手を指した局面を、空いているワーカーに先読みさせます.
+   * @param num_free_workers 空いているワーカーの数
+   * @param busy_workers     探索中のワーカー（先読みを始めたワーカーは、trueにする）
+   * @return 先読みを始めたワーカーの数
+   */
+  size_t StartSpeculativePonder(size_t num_free_workers, std::vector<bool>* busy_workers);
+
+  /**
+   * ponderhitコマンドの受信後に、予想手以外の応手を先読みしていたワーカーを１台止めて、
+   * マスターの担当している手を割り当てます.
+   * @param master_info マスターの最新のinfoコマンド
+   * @return ワーカーを止めた場合はtrue
+   */
+  bool ReleaseSpeculativeWorker(const UsiInfo& master_info);
+
+  /**
+   * ワーカーとマスターの探索を一旦止めて、ワーカーに新しい手を割り当てます.
+   * ワーカーが担当していた手は、マスターが引き取ります。
+   * @param worker_id 再割り当てを行うワーカー
+   * @param new_move  新たに割り当てる手（空文字列の場合は、ワーカーには何も割り当てない）
+   */
+  void ReassignWorker(size_t worker_id, const std::string& new_move);
+
+  /** ワーカーの構成（cluster.txtがあれば、最初のisreadyコマンドの際に読み込む）. */
+  WorkerTopology topology_;
+
+  /** マスターを含むワーカー数（ワーカーの構成から決まる）. */
   size_t num_workers_ = 4;
 
+  /** 同じマシン上のワーカーどうしで共有するハッシュテーブル（SharedHashオプションがtrueの場合）. */
+  SharedMemory shared_hash_;
+
+  /** 共有しているハッシュテーブルの番号. */
+  int shared_hash_id_ = 0;
+
+  /** 全ワーカーからの出力を、１つのスレッドで受信するためのマルチプレクサ. */
+  ProcessMultiplexer multiplexer_;
+
   /** 別プロセスで動作しているワーカー. */
   std::vector<std::unique_ptr<ClusterWorker>> workers_;
 
   /** 各ワーカーから送られてきた最新のinfoコマンド. */
   std::vector<UsiInfo> worker_infos_;
 
+  /** 各ワーカーが探索を担当している手（マスター及び何も担当していないワーカーは空文字列）. */
+  std::vector<std::string> assigned_moves_;
+
+  /** ルート局面の合法手の数. */
+  size_t num_legal_moves_ = 0;
+
+  /** スケジューラのスレッド. */
+  std::thread scheduler_thread_;
+
+  /** スケジューラのスレッドを終了させる際の排他制御用. */
+  std::mutex scheduler_mutex_;
+  std::condition_variable scheduler_condition_;
+
+  /** スケジューラが動作している場合はtrue. */
+  bool scheduler_running_ = false;
+
+  /** 探索を開始した時刻. */
+  std::chrono::steady_clock::time_point search_start_time_;
+
+  /** 最善手のinfoコマンドが、各深さに初めて到達した時刻（探索開始からのミリ秒）. */
+  std::vector<int64_t> time_to_depth_;
+
+  /** 再割り当てを行った回数. */
+  std::atomic<int> num_reassignments_{0};
+
   /** 最善手に関するinfoコマンド. */
   UsiInfo best_move_info_;
 
-  /** 前回探索時に予想した、次回探索時のルート局面. */
-  std::string predicted_position_;
+  /** bestmoveコマンドを送信した後は、true（以後に届いたinfoコマンドは、最善手の更新に用いない）. */
+  bool bestmove_sent_ = false;
+
+  /** ワーカーを割り当てる指し手を決めるためのMultiPV探索で、マスターから送られてきたinfoコマンド. */
+  std::vector<UsiInfo> presearch_infos_;
+
+  /** ワーカーを割り当てる指し手を決めるためのMultiPV探索中は、true. */
+  std::atomic_bool presearching_{false};
+
+  /**
+   * 前回探索時に予想した、次回探索時のルート局面と、その局面の最善手です.
+   * 予測があたった場合は、この手を優先して、その局面を先読みしていたワーカーに探索させます。
+   */
+  struct Prediction {
+    std::string position;
+    std::string move;
+    size_t worker_id;
+  };
+
+  /** 前回探索時の予測（予想手の予測に加え、予想手以外の応手を先読みしたワーカーの予測を含む）. */
+  std::vector<Prediction> predictions_;
 
-  /** 前回探索時に予想した、次回探索時の最善手（予測があたった場合は、この手を優先して探索）. */
-  std::string predicted_move_;
+  /** 予想手以外の応手を先読みしているワーカーの、先読み中の局面（それ以外のワーカーは空文字列）. */
+  std::vector<std::string> speculative_positions_;
+
+  /** 予想手以外の応手を先読みしているワーカーから送られてきた、最新のinfoコマンド. */
+  std::vector<UsiInfo> speculative_infos_;
+
+  /** 先読み中にponderhitコマンドを受信した場合はtrue. */
+  std::atomic_bool ponderhit_{false};
 
   /** 最善手を担当していたワーカエンジンのID番号. */
   size_t previous_best_worker_ = 0;
 
   /** 排他制御用 */
   std::mutex mutex_;
+
+  /** 時間管理用 */
+  TimeManagerForCluster time_manager_;
+
+  /** 時間管理に渡すため、goコマンドのオプションを保存しておく（TimeControlは参照を保持するため）. */
+  UsiGoOptions go_options_;
+
+  /** 探索を停止する処理（stopコマンドと時間切れ）と、探索を開始する処理との排他制御用. */
+  std::mutex stop_mutex_;
+
+  /** 探索中（bestmoveコマンドをまだ送っていない）ならばtrue（stop_mutex_で保護）. */
+  bool thinking_ = false;
+
+  /** 最善手が変化した回数（最善手の深さが更新されるたびに半減させる）. */
+  double best_move_changes_ = 0.0;
+
+  /** これまでに出力した最善手の深さの最大値. */
+  int max_best_move_depth_ = 0;
+
+  /** ワーカーの死活監視（ワーカーの利用可否は、stop_mutex_をロックして変更する）. */
+  WorkerMonitor worker_monitor_;
 };
 
 #endif /* !defined(MINIMUM) */
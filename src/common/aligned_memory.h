@@ -0,0 +1,63 @@
+/*
+ * 技巧 (Gikou), a USI shogi (Japanese chess) playing engine.
+ * Copyright (C) 2016 Yosuke Demura
+ * except where otherwise indicated.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COMMON_ALIGNED_MEMORY_H_
+#define COMMON_ALIGNED_MEMORY_H_
+
+#include <memory>
+#include <new>
+#include <utility>
+#include <mm_malloc.h>
+
+/**
+ * アラインメントを指定して確保したオブジェクトを解放するためのデリータです.
+ */
+template<typename T>
+struct AlignedDeleter {
+  void operator()(T* ptr) const {
+    if (ptr != nullptr) {
+      ptr->~T();
+      _mm_free(ptr);
+    }
+  }
+};
+
+/**
+ * アラインメントを指定して確保したオブジェクトを保持するための、スマートポインタです.
+ */
+template<typename T>
+using AlignedPtr = std::unique_ptr<T, AlignedDeleter<T>>;
+
+/**
+ * 型Tのアラインメント要求を満たすメモリを確保して、オブジェクトを構築します.
+ *
+ * C++11のnew演算子は、alignof(std::max_align_t)を超えるアラインメント（例えば、AVX用の32バイト）を
+ * 保証しないため、SIMD演算用の型を含むオブジェクトを動的に確保する場合は、この関数を使ってください。
+ * @return 確保したオブジェクト（メモリの確保に失敗した場合は、nullptr）
+ */
+template<typename T, typename... Args>
+AlignedPtr<T> MakeAligned(Args&&... args) {
+  void* memory = _mm_malloc(sizeof(T), alignof(T));
+  if (memory == nullptr) {
+    return AlignedPtr<T>();
+  }
+  return AlignedPtr<T>(new(memory) T(std::forward<Args>(args)...));
+}
+
+#endif /* COMMON_ALIGNED_MEMORY_H_ */
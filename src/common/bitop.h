@@ -32,6 +32,7 @@ int bsr32(uint32_t);
 int bsr64(uint64_t);
 int popcnt32(uint32_t);
 int popcnt64(uint64_t);
+uint64_t pext64(uint64_t, uint64_t);
 template<typename T> constexpr T reset_first_bit(T value);
 template<typename T> constexpr bool more_than_one_bit(T value);
 } // namespace bitop
@@ -64,6 +65,23 @@ inline int bitop::popcnt64(uint64_t value) {
   return __builtin_popcountll(value);
 }
 
+/**
+ * BMI2のPEXT命令により、maskで指定されたビットをvalueから取り出して、下位ビットに詰めます.
+ *
+ * 実行時にCPUの対応を確認してから使えるように、コンパイル時に-mbmi2が指定されていない場合は、
+ * インラインアセンブラでPEXT命令を直接呼び出します。したがって、BMI2命令に対応していない
+ * CPUで、この関数を呼び出してはいけません（cpu_features::HasBmi2()で確認してください）。
+ */
+inline uint64_t bitop::pext64(uint64_t value, uint64_t mask) {
+#if defined(__BMI2__)
+  return __builtin_ia32_pext_di(value, mask);
+#else
+  uint64_t result;
+  __asm__("pextq %2, %1, %0" : "=r"(result) : "r"(value), "rm"(mask));
+  return result;
+#endif
+}
+
 template<typename T>
 constexpr T bitop::reset_first_bit(T value) {
   static_assert(std::is_signed<T>::value || std::is_unsigned<T>::value, "");
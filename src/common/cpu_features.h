@@ -0,0 +1,98 @@
+/*
+ * 技巧 (Gikou), a USI shogi (Japanese chess) playing engine.
+ * Copyright (C) 2016 Yosuke Demura
+ * except where otherwise indicated.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COMMON_CPU_FEATURES_H_
+#define COMMON_CPU_FEATURES_H_
+
+/**
+ * 実行中のCPUが対応している命令セットを調べるための関数群です.
+ *
+ * コンパイル時の設定（-msse4.2など）とは無関係に、実行時にCPUIDを調べるため、
+ * 拡張命令を用いた実装を、対応しているCPUでのみ選択的に使うことができます。
+ */
+namespace cpu_features {
+
+/**
+ * AVX2命令に対応している場合は、trueを返します.
+ */
+inline bool HasAvx2() {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+#else
+  return false;
+#endif
+}
+
+/**
+ * AVX-512F命令に対応している場合は、trueを返します.
+ */
+inline bool HasAvx512f() {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx512f");
+#else
+  return false;
+#endif
+}
+
+/**
+ * AVX-512BW命令（AVX-512のバイト・ワード単位の演算）に対応している場合は、trueを返します.
+ */
+inline bool HasAvx512bw() {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+#else
+  return false;
+#endif
+}
+
+/**
+ * BMI2命令（PEXT, PDEPなど）に対応している場合は、trueを返します.
+ */
+inline bool HasBmi2() {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("bmi2");
+#else
+  return false;
+#endif
+}
+
+/**
+ * PEXT命令が高速に実行できる場合は、trueを返します.
+ *
+ * Zen2以前のAMD製CPUは、BMI2命令に対応しているものの、PEXT命令がマイクロコードで実行される
+ * ため非常に遅い（数十〜数百サイクル）ので、falseを返します。
+ */
+inline bool HasFastPext() {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  __builtin_cpu_init();
+  return HasBmi2()
+      && !__builtin_cpu_is("amdfam15h")
+      && !__builtin_cpu_is("amdfam17h");
+#else
+  return false;
+#endif
+}
+
+} // namespace cpu_features
+
+#endif /* COMMON_CPU_FEATURES_H_ */
@@ -21,105 +21,75 @@
 
 #include "consultation.h"
 
+#include <algorithm>
 #include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <cstdlib>
 #include <map>
 #include <sstream>
+#include <unistd.h>
 #include "book.h"
+#include "hash_table.h"
 #include "movegen.h"
 #include "synced_printf.h"
 
 namespace {
+
 Book g_book;
+
+/**
+ * consultation.txtがない場合の、マスターの設定を返します.
+ */
+WorkerConfig DefaultMasterConfig() {
+  // マスターのメモリ容量とスレッド数については、マシン固定なのでひとまずベタ打ちしておく
+  WorkerConfig config;
+  config.hash_size = 8192;
+  config.threads = 5;
+  return config;
+}
+
 }
 
 ConsultationWorker::ConsultationWorker(int worker_id,
-                                       Consultation& consultation)
-    : worker_id_(worker_id),
+                                       Consultation& consultation,
+                                       ProcessMultiplexer& multiplexer)
+    : UsiWorker(multiplexer),
+      worker_id_(worker_id),
       consultation_(consultation) {
 }
 
 ConsultationWorker::~ConsultationWorker() {
-  // ワーカにquitコマンドを送信
-  SendCommand("quit");
-
-  // 外部プロセスの終了を待つ
-  external_process_.WaitFor();
+  // ワーカにquitコマンドを送信し、外部プロセスの終了を待つ
+  QuitEngine();
 }
 
 void ConsultationWorker::Initialize() {
-  // 1. 外部プロセスを使い、USIエンジンを起動する
-  if (worker_id() == consultation_.master_worker_id()) {
-    // a. マスターの起動
-    char* const args[] = {
-        const_cast<char*>("./release"),
-        NULL
-    };
-    if (external_process_.StartProcess(args[0], args) < 0) {
-      std::perror("StartProcess()\n");
-      return;
-    }
-  } else {
-    // b. ワーカーの起動
-    std::string worker_name = "cluster-" + std::to_string(worker_id());
-    char* const args[] = {
-#if 0
-        // リモートマシンをワーカーとして使用する場合: SSHで通信する
-        const_cast<char*>("ssh"),
-        const_cast<char*>(worker_name.c_str()), // ~/.ssh/configでワーカーのホスト名を設定しておく
-        const_cast<char*>("cd gikou/bin; ./release --cluster"), // ディレクトリを移動後、実行する
-#else
-        // ローカルマシンをワーカーとして使用する場合: パイプで通信する
-        const_cast<char*>("./release"),
-#endif
-        NULL
-    };
-    if (external_process_.StartProcess(args[0], args) < 0) {
-      std::perror("StartProcess()\n");
-      return;
-    }
+  // 1. 外部プロセスを使い、USIエンジンを起動する（起動方法は、consultation.txtで変更できる）
+  //    リモートマシン上のクラスタを合議に参加させる場合は、コマンドに"./release --cluster"などを指定する
+  const WorkerConfig& config = consultation_.topology().at(worker_id());
+  if (!StartEngine(config)) {
+    std::perror("StartEngine()\n");
+    return;
   }
 
   // 2. 対局準備のため、USIコマンドをエンジンに送信する
-  SendCommand("usi");
-  const UsiOptions& options = consultation_.usi_options();
-  if (worker_id() == consultation_.master_worker_id()) {
-    // ワーカーのメモリ容量とスレッド数については、マシン固定なのでひとまずベタ打ちしておく
-    SendCommand("setoption name USI_Hash value %d", 8192);
-    SendCommand("setoption name Threads value %d", 5);
-    SendCommand("setoption name DrawScore value %d", (int)options["DrawScore"]);
-  } else {
-    // USIオプションを下流に伝達する
-    SendCommand("setoption name USI_Hash value %d", (int)options["USI_Hash"]);
-    SendCommand("setoption name Threads value %d", (int)options["Threads"]);
-    SendCommand("setoption name DrawScore value %d", (int)options["DrawScore"]);
+  if (!NegotiateProtocol()) {
+    return;
   }
+  SendEngineOptions(config, consultation_.usi_options()); // USIオプションを下流に伝達する
+  SetSharedHashId(consultation_.shared_hash_id());
   SendCommand("isready");
-
-  // 3. readyokが送られてくるまで待機する
-  for (std::string line; RecieveCommand(&line); ) {
-    if (line == "readyok") break;
-  }
 }
 
-void ConsultationWorker::Run() {
-  // bestmoveコマンドが帰ってくるまで探索する
-  for (std::string line; RecieveCommand(&line); ) {
-    std::istringstream is(line);
-    std::string token;
-    is >> token;
-    if (token == "info") {
-      // ワーカーとの通信が切断された場合、それ以降そのワーカーからのinfoコマンドは無視される
-      if (is_alive()) {
-        UsiInfo info = UsiProtocol::ParseInfoCommand(is);
-        consultation_.UpdateInfo(worker_id_, info);
-      }
-    } else if (token == "bestmove") {
-      break;
-    }
+void ConsultationWorker::OnInfoReceived(const UsiInfo& info) {
+  // ワーカーとの通信が切断された場合、再起動されるまで、そのワーカーからのinfoコマンドは無視される
+  if (is_available()) {
+    consultation_.UpdateInfo(worker_id_, info);
   }
 }
 
-void ConsultationWorker::OnTaskFinished() {
+void ConsultationWorker::OnSearchFinished() {
   consultation_.NotifySearchIsFinished();
 }
 
@@ -129,33 +99,68 @@ void TimeManagerForConsultation::HandleTimeUpEvent() {
 
 Consultation::Consultation()
     : UsiProtocol("Gikou Hybrid Cluster", "Yosuke Demura"),
-      time_manager_(usi_options(), *this) {
+      topology_(4, DefaultMasterConfig()),
+      time_manager_(usi_options(), *this),
+      worker_monitor_(assignment_mutex_) {
+  // 同じマシン上のワーカーどうしで、USI_Hashの大きさのハッシュテーブルを１つ共有する場合はtrue
+  mutable_usi_options()->AddOption("SharedHash", UsiOption(false));
+
+  // 票に、探索深さと評価値による重みを付ける場合はtrue（falseの場合は、１台１票の多数決合議）
+  mutable_usi_options()->AddOption("WeightedVoting", UsiOption(false));
+
+  // ワーカーの意見が一致したまま、評価値がこの回数の反復にわたって安定していれば、思考を打ち切る（0ならば打ち切らない）
+  mutable_usi_options()->AddOption("ConsensusIterations", UsiOption(0, 0, 100));
+
+  // 意見が一致しているとみなすのに必要な、最善手に投票したワーカーの割合（パーセント）
+  mutable_usi_options()->AddOption("ConsensusMajority", UsiOption(100, 50, 100));
 }
 
 void Consultation::OnIsreadyCommandEntered() {
   // 定跡ファイルを読み込む
   g_book.ReadFromFile("book.bin");
 
+  std::unique_lock<std::mutex> assignment_lock(assignment_mutex_);
   if (workers_.empty()) {
+    // consultation.txtがあれば、ワーカーの構成を読み込む
+    if (topology_.ReadFromFile("consultation.txt")) {
+      SYNCED_PRINTF("info string %zu workers are configured in consultation.txt.\n",
+                    topology_.size());
+    }
+    num_workers_ = topology_.size() - 1; // マスターは合議に参加しないので、数に含めない
+    // 共有メモリ上のハッシュテーブルを使う場合は、ワーカーを起動する前に作成しておく
+    if (usi_options()["SharedHash"]) {
+      int id = static_cast<int>(getpid());
+      if (HashTable::CreateSharedTable(&shared_hash_, HashTable::SharedTableName(id).c_str(),
+                                       usi_options()["USI_Hash"])) {
+        shared_hash_id_ = id;
+      }
+    }
     // 1. 初回は、ワーカーを必要なだけ起動する
     for (size_t worker_id = 0; worker_id < num_workers_ + 1; ++worker_id) {
-      ConsultationWorker* worker = new ConsultationWorker(worker_id, *this);
-      worker->StartNewThread();
+      ConsultationWorker* worker = new ConsultationWorker(worker_id, *this,
+                                                          multiplexer_);
+      worker->Initialize();
       workers_.emplace_back(worker);
     }
-
-    // ワーカーの準備ができるまで待機する
+    // readyokコマンドを送り返して来るまで待機する
+    std::vector<UsiWorker*> workers;
     for (std::unique_ptr<ConsultationWorker>& worker : workers_) {
-      worker->WaitForReady();
+      worker->WaitForCommand("readyok");
+      workers.push_back(worker.get());
     }
+    // 以後、応答しなくなったワーカーは、自動的に再起動する
+    worker_monitor_.Start(workers);
   } else {
-    // 2. 次回以降は、既に起動しているプロセスを使い回す
-    SendCommandToAllWorkers("isready");
-
-    // readyokコマンドを送り返して来るまで待機する
+    // 2. 次回以降は、既に起動しているプロセスを使い回す（再起動中のワーカーは除く）
+    const std::chrono::milliseconds timeout(WorkerMonitor::kRestartTimeout);
     for (std::unique_ptr<ConsultationWorker>& worker : workers_) {
-      for (std::string line; worker->RecieveCommand(&line); ) {
-        if (line == "readyok") break;
+      if (worker->is_available()) {
+        worker->SendCommand("isready");
+      }
+    }
+    for (std::unique_ptr<ConsultationWorker>& worker : workers_) {
+      if (worker->is_available() && !worker->WaitForCommand("readyok", timeout)) {
+        worker->MarkHung();
       }
     }
   }
@@ -165,6 +170,9 @@ void Consultation::OnIsreadyCommandEntered() {
 }
 
 void Consultation::OnUsinewgameCommandEntered() {
+  total_saved_time_ = 0;
+  // 共有メモリ上のハッシュテーブルは、ワーカーが消去しないので、マスターが消去する
+  HashTable::ClearSharedTable(&shared_hash_);
   SendCommandToAllWorkers("usinewgame");
 }
 
@@ -202,20 +210,30 @@ void Consultation::OnGoCommandEntered(const UsiGoOptions& go_options) {
 
   // 時間管理を開始する
   time_manager_.WaitUntilTaskIsFinished(); // 時間管理用スレッドが利用可能になるまで待機する
-  time_manager_.StartTimeManagement(root_node(), go_options);
+  go_options_ = go_options;
+  thinking_ = true;
+  time_manager_.StartTimeManagement(root_node(), go_options_);
 
   // 探索前に、前回の探索情報をクリアしておく
+  info_mutex_.lock();
   best_move_info_ = UsiInfo();
   worker_infos_.clear();
   worker_infos_.resize(workers_.size());
+  agreement_rate_ = 0.0;
+  consensus_move_.clear();
+  consensus_depth_ = 0;
+  consensus_score_ = kScoreZero;
+  consensus_iterations_ = 0;
+  info_mutex_.unlock();
 
-  // 各ワーカーにpositionコマンドを送信する
-  SendCommandToAllWorkers(position_sfen().c_str());
-
-  // 各ワーカーに探索の指示を出す
+  // 各ワーカーに探索の指示を出す（再起動中のワーカーは、次回の探索から合議に参加させる）
+  std::unique_lock<std::mutex> assignment_lock(assignment_mutex_);
   for (std::unique_ptr<ConsultationWorker>& worker : workers_) {
-    worker->SendCommand("go infinite");
-    worker->ExecuteTask();
+    if (worker->is_available()) {
+      worker->SendCommand(position_sfen().c_str());
+      worker->StartSearch();
+      worker->SendCommand("go infinite");
+    }
   }
 }
 
@@ -227,6 +245,11 @@ void Consultation::OnStopCommandEntered() {
     return;
   }
 
+  // 時間切れ（早期合意を含む）とstopコマンドが重なった場合などに、bestmoveコマンドを２回送らないようにする
+  if (!thinking_.exchange(false)) {
+    return;
+  }
+
   // すべてのワーカーにstopコマンドを送信する
   SendCommandToAllWorkers("stop");
 
@@ -240,8 +263,18 @@ void Consultation::OnStopCommandEntered() {
   info_mutex_.lock();
   UpdateInfo();
   const std::vector<std::string>& pv = best_move_info_.pv;
+  const double agreement_rate = agreement_rate_;
   info_mutex_.unlock();
 
+  // 一致率と、早期に合意したことにより節約できた時間を記録する
+  int64_t saved_time = 0;
+  if (time_manager_.stats().consensus) {
+    saved_time = std::max(time_manager_.target_time() - time_manager_.elapsed_time(), int64_t(0));
+    total_saved_time_ += saved_time;
+  }
+  SYNCED_PRINTF("info string agreement %.2f saved %" PRId64 "ms total_saved %" PRId64 "ms\n",
+                agreement_rate, saved_time, total_saved_time_);
+
   // 最善手を送信する
   if (pv.empty()) {
     SYNCED_PRINTF("bestmove resign\n");
@@ -269,6 +302,7 @@ void Consultation::OnPonderhitCommandEntered() {
 
 void Consultation::OnQuitCommandEntered() {
   OnStopCommandEntered();
+  worker_monitor_.Stop(); // ワーカーを終了させる前に、死活監視を止めておく
   workers_.clear(); // ConsultationWorkerクラスのデストラクタが呼ばれる
 }
 
@@ -277,21 +311,25 @@ void Consultation::OnGameoverCommandEntered(const std::string& result) {
 }
 
 void Consultation::UpdateInfo() {
+  // WeightedVotingオプションがtrueの場合は、票に探索深さと評価値による重みを付ける
+  const bool weighted_voting = usi_options()["WeightedVoting"];
+
   // 合議を行う際の「票」を表す構造体
   struct Vote {
     int count = 0;
+    double weight = 0.0;
     int best_score = -kScoreInfinite;
     const UsiInfo* usi_info = nullptr;
     bool operator<(const Vote& rhs) const {
       // 多数決合議
-      if (   count == rhs.count
+      if (   weight == rhs.weight
           || best_score >= kScoreKnownWin
           || rhs.best_score >= kScoreKnownWin) {
         // Rule 1: 投票数が同数の場合、または、必勝手が発見された場合は、評価値が高い指し手が優先する
         return best_score < rhs.best_score;
       } else {
-        // Rule 2: そうでない場合は、投票数が多い指し手を優先する（多数決合議）
-        return count < rhs.count;
+        // Rule 2: そうでない場合は、投票数（重み付きの場合は、重みの合計）が多い指し手を優先する
+        return weight < rhs.weight;
       }
     }
   };
@@ -306,20 +344,35 @@ void Consultation::UpdateInfo() {
     return (id == master_worker_id()) ? 0 : 1;
   };
 
+  // 各ワーカーが投じる票の重みを返す関数
+  auto get_vote_weight = [&](int id, const UsiInfo& info) -> double {
+    const double importance = get_vote_importance(id);
+    if (!weighted_voting) {
+      return importance;
+    }
+    // 深く読んでいるワーカーほど、また、推奨手の評価値（勝率に換算したもの）が高いワーカーほど重く扱う。
+    // 評価値が同程度であれば多数決合議に、票数が同程度であれば楽観合議に近い振る舞いになる。
+    const double win_rate = 1.0 / (1.0 + std::exp(-double(info.score) / 600.0));
+    return importance * std::max(info.depth, 1) * win_rate;
+  };
+
   // どの指し手がよいか、各ワーカーが投票する
   std::map<std::string, Vote> votes;
   uint64_t total_nodes = 0, total_nps = 0;
+  int num_voters = 0;
   for (size_t i = 0; i < worker_infos_.size(); ++i) {
     // ワーカーとの通信が切断されている場合は、その指し手は無視する
-    if (!workers_.at(i)->is_alive()) {
+    if (!workers_.at(i)->is_available()) {
       continue;
     }
+    num_voters += get_vote_importance(i); // まだinfoコマンドを送ってきていないワーカーも数える
     const UsiInfo& info = worker_infos_.at(i);
     if (!info.pv.empty()) {
       const std::string& bestmove = info.pv.front();
       Vote& vote = votes[bestmove];
       // 各ワーカーは、それぞれの推奨手に重み付きで投票する
       vote.count += get_vote_importance(i);
+      vote.weight += get_vote_weight(i, info);
       // 各指し手について、最も高い評価値を記録する
       if (info.score > vote.best_score) {
         vote.best_score = info.score;
@@ -348,14 +401,19 @@ void Consultation::UpdateInfo() {
         || temp.pv.front() != best_move_info_.pv.front()
         || temp.depth > best_move_info_.depth) {
       // 投票数を送信
-      std::printf("info string votes");
+      std::string votes_str = "info string votes";
       for (auto it = votes.begin(); it != votes.end(); ++it) {
-        std::printf(" %s=%d", it->first.c_str(), it->second.count);
+        votes_str += " " + it->first + "=" + std::to_string(it->second.count);
+        if (weighted_voting) {
+          char weight[32];
+          std::snprintf(weight, sizeof(weight), "(%.1f)", it->second.weight);
+          votes_str += weight;
+        }
       }
-      std::printf("\n");
+      SYNCED_PRINTF("%s\n", votes_str.c_str());
 
       // infoコマンドを送信
-      std::printf("%s\n", temp.ToString().c_str());
+      SYNCED_PRINTF("%s\n", temp.ToString().c_str());
     }
 
     best_move_info_ = temp;
@@ -363,7 +421,61 @@ void Consultation::UpdateInfo() {
 
   // 時間管理に必要な情報をTimeManagerに送る
   if (best_vote != votes.end()) {
-    time_manager_.stats().agreement_rate = best_vote->second.count / double(num_workers_);
+    agreement_rate_ = best_vote->second.count / double(num_workers_);
+    time_manager_.stats().agreement_rate = agreement_rate_;
+    if (num_voters > 0 && best_vote->second.usi_info != nullptr) {
+      UpdateConsensus(best_vote->first, best_vote->second.count / double(num_voters));
+    }
+  }
+}
+
+void Consultation::UpdateConsensus(const std::string& best_move,
+                                   const double agreement_rate) {
+  // 評価値の変動がこの値以内であれば、評価値が安定しているとみなす
+  const Score kStableMargin = static_cast<Score>(50);
+
+  const int required_iterations = usi_options()["ConsensusIterations"];
+  const double required_rate = int(usi_options()["ConsensusMajority"]) / 100.0;
+  if (required_iterations == 0 || time_manager_.stats().consensus) {
+    return;
+  }
+
+  // 1. 最善手に投票したワーカーのうち、最も浅い探索深さを調べる
+  int depth = kMaxPly;
+  for (size_t i = 0; i < worker_infos_.size(); ++i) {
+    const UsiInfo& info = worker_infos_.at(i);
+    if (   int(i) != master_worker_id() && workers_.at(i)->is_available()
+        && !info.pv.empty() && info.pv.front() == best_move) {
+      depth = std::min(depth, info.depth);
+    }
+  }
+
+  // 2. 意見が一致していない場合や、最善手が変わった場合は、最初から数え直す
+  const Score score = best_move_info_.score;
+  if (agreement_rate < required_rate || best_move != consensus_move_) {
+    consensus_move_ = agreement_rate < required_rate ? std::string() : best_move;
+    consensus_depth_ = depth;
+    consensus_score_ = score;
+    consensus_iterations_ = 0;
+    return;
+  }
+
+  // 3. 意見が一致したまま、全員の探索が１段深くなるごとに、評価値が安定しているかを調べる
+  if (depth > consensus_depth_) {
+    if (std::abs(int(score) - int(consensus_score_)) <= kStableMargin) {
+      ++consensus_iterations_;
+    } else {
+      consensus_iterations_ = 0;
+    }
+    consensus_depth_ = depth;
+    consensus_score_ = score;
+  }
+
+  // 4. 所定の回数だけ安定していれば、早期に合意したとみなし、TimeManagerに思考を打ち切らせる
+  if (consensus_iterations_ >= required_iterations) {
+    time_manager_.stats().consensus = true;
+    SYNCED_PRINTF("info string consensus on %s (agreement %.2f, depth %d)\n",
+                  best_move.c_str(), agreement_rate, depth);
   }
 }
 
@@ -385,7 +497,7 @@ void Consultation::NotifySearchIsFinished() {
 void Consultation::WaitUntilWorkersFinishSearching() {
   auto predicate = [&]() -> bool {
     for (std::unique_ptr<ConsultationWorker>& worker : workers_) {
-      if (worker->is_alive() && worker->is_running()) {
+      if (worker->is_available() && worker->is_searching()) {
         return false;
       }
     }
@@ -398,10 +510,10 @@ void Consultation::WaitUntilWorkersFinishSearching() {
   lock.unlock();
 
   // 一定時間経過してもbestmoveが返ってこないワーカーがあれば、そのワーカーとの通信が切れたものとみなし、
-  // 通信が切れたことを示すフラグを立てておく。
+  // 通信が切れたことを示すフラグを立てておく（以後、WorkerMonitorが再起動する）。
   for (std::unique_ptr<ConsultationWorker>& worker : workers_) {
-    if (worker->is_running()) {
-      worker->set_alive(false);
+    if (worker->is_available() && worker->is_searching()) {
+      worker->MarkHung();
       SYNCED_PRINTF("info string Worker #%d is dead!\n", worker->worker_id());
     }
   }
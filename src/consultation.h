@@ -23,9 +23,11 @@
 #if !defined(MINIMUM)
 
 #include "process.h"
-#include "task_thread.h"
+#include "shared_memory.h"
 #include "time_manager.h"
 #include "usi_protocol.h"
+#include "usi_worker.h"
+#include "worker_topology.h"
 
 class Consultation;
 
@@ -38,35 +40,17 @@ class Consultation;
  *   - 伊藤毅志: コンピュータ将棋における合議アルゴリズム, 『コンピュータ将棋の進歩６』,
  *     pp.85-103, 共立出版, 2012.
  */
-class ConsultationWorker : public TaskThread {
+class ConsultationWorker : public UsiWorker {
  public:
-  ConsultationWorker(int worker_id, Consultation& consultation);
+  ConsultationWorker(int worker_id, Consultation& consultation,
+                     ProcessMultiplexer& multiplexer);
   ~ConsultationWorker();
 
-  void Initialize();
-  void Run();
-  void OnTaskFinished();
-
-  /**
-   * 外部プロセスのUSIエンジンに対し、コマンドを送信します.
-   * @param format std::printf()関数と同様のフォーマット
-   * @param args   フォーマットに従って出力したい引数
-   */
-  template<typename... Args>
-  void SendCommand(const char* format, const Args&... args) {
-    std::unique_lock<std::mutex> lock(mutex_);
-    external_process_.Printf(format, args...);
-    external_process_.Printf("\n");
-  }
-
   /**
-   * 外部プロセスのUSIエンジンから、コマンドを受信します.
-   * @param line 受信したコマンドを保存するための変数
-   * @return EOFを受信したらfalse。\nを受信したらtrue。
+   * 外部プロセス上にUSIエンジンを起動して、初期設定のコマンドを送信します.
+   * 初期設定が終わったかどうかは、readyokコマンドを受信することで確認してください。
    */
-  bool RecieveCommand(std::string* line) {
-    return external_process_.GetLine(line);
-  }
+  void Initialize();
 
   /**
    * このワーカーのIDです.
@@ -75,29 +59,16 @@ class ConsultationWorker : public TaskThread {
     return worker_id_;
   }
 
-  bool is_alive() const {
-    return alive_;
-  }
-
-  void set_alive(bool alive) {
-    alive_ = alive;
-  }
+ protected:
+  void OnInfoReceived(const UsiInfo& info);
+  void OnSearchFinished();
 
  private:
   /** ワーカーのID（ゼロ以上の整数）. */
   const int worker_id_;
 
-  /** このワーカーとの通信が生きている場合は true、そうでなければ false */
-  std::atomic_bool alive_{true};
-
   /** 合議アルゴリズムのマスターへの参照 */
   Consultation& consultation_;
-
-  /** 排他制御用 */
-  std::mutex mutex_;
-
-  /** ワーカーエンジンを起動するのに用いる、外部プロセス */
-  Process external_process_;
 };
 
 /**
@@ -130,7 +101,9 @@ class TimeManagerForConsultation : public TimeManager {
 class Consultation : public UsiProtocol {
  public:
   Consultation();
-  ~Consultation() {}
+  ~Consultation() {
+    worker_monitor_.Stop();
+  }
   void OnIsreadyCommandEntered();
   void OnUsinewgameCommandEntered();
   void OnGoCommandEntered(const UsiGoOptions& options);
@@ -163,6 +136,7 @@ class Consultation : public UsiProtocol {
    *
    * ただし、一定時間（現在の実装では1000ミリ秒です）を経過してもワーカーからbestmoveコマンドが
    * 返ってこない場合には、マスターとワーカーとの間の通信が切れたとみなし、待機するのを終了します。
+   * 通信が切れたワーカーは、WorkerMonitorによって再起動され、次回の探索から再び合議に参加します。
    */
   void WaitUntilWorkersFinishSearching();
 
@@ -172,11 +146,25 @@ class Consultation : public UsiProtocol {
    * マスターワーカーとは、「通常時は合議に参加しないが、他のすべてのワーカーとの接続が切れた場合に
    * 指し手を決める」ことを目的として、ローカルマシンで走らせておくワーカーのことです。
    */
+  /**
+   * ワーカーの構成を返します（マスターは最後の要素です）.
+   */
+  const WorkerTopology& topology() const {
+    return topology_;
+  }
+
   int master_worker_id() const {
     // マスターはワーカーとは別に用意するので、マスターのIDは、スレーブのIDの最大値に１を加えたものとする
     return num_workers_;
   }
 
+  /**
+   * ワーカーどうしで共有しているハッシュテーブルの番号を返します（共有していない場合は0）.
+   */
+  int shared_hash_id() const {
+    return shared_hash_id_;
+  }
+
  private:
   /**
    * コマンドをすべての合議ワーカーに送信します.
@@ -195,6 +183,23 @@ class Consultation : public UsiProtocol {
    */
   void SendBestmoveCommand(std::string command, const UsiGoOptions& go_options);
 
+  /**
+   * ワーカーの意見が一致し、評価値が安定しているかを調べ、必要であれば思考を早期に打ち切らせます.
+   * UpdateInfo()から、info_mutex_をロックした状態で呼ばれます。
+   * @param best_move      合議で選ばれた最善手
+   * @param agreement_rate 最善手に投票したワーカーの、投票したワーカー全体に対する割合
+   */
+  void UpdateConsensus(const std::string& best_move, double agreement_rate);
+
+  /** 同じマシン上のワーカーどうしで共有するハッシュテーブル（SharedHashオプションがtrueの場合） */
+  SharedMemory shared_hash_;
+
+  /** 共有しているハッシュテーブルの番号 */
+  int shared_hash_id_ = 0;
+
+  /** 全ワーカーからの出力を、１つのスレッドで受信するためのマルチプレクサ */
+  ProcessMultiplexer multiplexer_;
+
   /** 合議アルゴリズムのワーカー */
   std::vector<std::unique_ptr<ConsultationWorker>> workers_;
 
@@ -207,23 +212,56 @@ class Consultation : public UsiProtocol {
   /** 最善手のinfoコマンド */
   UsiInfo best_move_info_;
 
-  /** 合議アルゴリズムのワーカー数 */
+  /** 最善手に投票したワーカーの割合（ログ出力用） */
+  double agreement_rate_ = 0.0;
+
+  /** 早期合意の判定中の最善手（ワーカーの意見が一致していない場合は空文字列） */
+  std::string consensus_move_;
+
+  /** 早期合意の判定に用いる、最善手に投票したワーカーの最小の探索深さ */
+  int consensus_depth_ = 0;
+
+  /** 早期合意の判定に用いる、前回の反復における最善手の評価値 */
+  Score consensus_score_ = kScoreZero;
+
+  /** 意見が一致したまま、評価値が安定していた反復の回数 */
+  int consensus_iterations_ = 0;
+
+  /** 現在の対局で、早期合意により節約できた時間の合計（ミリ秒） */
+  int64_t total_saved_time_ = 0;
+
+  /** ワーカーの構成（consultation.txtがあれば、最初のisreadyコマンドの際に読み込む） */
+  WorkerTopology topology_;
+
+  /** 合議アルゴリズムのワーカー数（マスターは含まない） */
   size_t num_workers_ = 4;
 
   /** USIのbestmoveコマンド */
   std::string bestmove_command_;
 
+  /** 探索中（bestmoveコマンドをまだ送っていない）ならばtrue */
+  std::atomic_bool thinking_{false};
+
   /** trueであれば、bestmoveコマンドを、後で（stop/ponderhitコマンド到着時）に送信する */
   bool send_bestmove_later_ = false;
 
   /** 合議アルゴリズム使用中に、時間管理を行うためのクラス */
   TimeManagerForConsultation time_manager_;
 
+  /** 時間管理に渡すため、goコマンドのオプションを保存しておく（TimeControlは参照を保持するため） */
+  UsiGoOptions go_options_;
+
   /** ワーカーからのコマンドを待機する際の排他制御用 */
   std::mutex wait_mutex_;
 
   /** ワーカーからのコマンドを待機する際に用いる条件 */
   std::condition_variable wait_condition_;
+
+  /** ワーカーに探索を割り当てる処理と、ワーカーの利用可否を変更する処理との排他制御用 */
+  std::mutex assignment_mutex_;
+
+  /** ワーカーの死活監視 */
+  WorkerMonitor worker_monitor_;
 };
 
 #endif /* !defined(MINIMUM) */
@@ -21,7 +21,8 @@
 
 #include <vector>
 #include <utility>
-#include <smmintrin.h> // SSE 4.1
+#include <immintrin.h> // SSE 4.1, AVX2, AVX-512
+#include "common/cpu_features.h"
 #include "position.h"
 
 ArrayMap<ExtendedBoard::AttackPattern, Square> ExtendedBoard::attack_correction_;
@@ -30,6 +31,9 @@ ArrayMap<ExtendedBoard::Control, Direction> ExtendedBoard::direction_to_incremen
 ArrayMap<uint8_t, Square, Direction> ExtendedBoard::max_number_of_long_attacks_;
 ArrayMap<EightNeighborhoods, Square> ExtendedBoard::edge_correction8_;
 ArrayMap<FifteenNeighborhoods, Square> ExtendedBoard::edge_correction15_;
+ArrayMap<ExtendedBoard::WideAttackPattern, Square> ExtendedBoard::wide_attack_correction_;
+ArrayMap<ExtendedBoard::WideAttackPattern, Piece> ExtendedBoard::wide_short_attack_patterns_;
+ExtendedBoard::SimdLevel ExtendedBoard::simd_level_ = ExtendedBoard::kSse41;
 
 const ArrayMap<DirectionSet, Piece> ExtendedBoard::long_attack_patterns_ = {
     {kBlackLance , DirectionSet{kDirN}},
@@ -72,7 +76,12 @@ void ExtendedBoard::SetAllPieces(const Position& pos) {
   }
 }
 
-void ExtendedBoard::MakeCaptureMove(Move move) {
+/*
+ * SSE4.1版の実装.
+ */
+
+template<>
+void ExtendedBoard::MakeCaptureMoveImpl<ExtendedBoard::kSse41>(Move move) {
   assert(move.is_capture());
 
   Square from = move.from();
@@ -89,7 +98,8 @@ void ExtendedBoard::MakeCaptureMove(Move move) {
   AddControls(move.piece_after_move(), to);
 }
 
-void ExtendedBoard::MakeNonCaptureMove(Move move) {
+template<>
+void ExtendedBoard::MakeNonCaptureMoveImpl<ExtendedBoard::kSse41>(Move move) {
   assert(!move.is_capture() && !move.is_drop());
 
   Square from = move.from();
@@ -128,7 +138,8 @@ void ExtendedBoard::MakeDropAndKingRecapture(Square king_from, Square king_to,
   AddControls(piece, king_to);
 }
 
-UNROLL_LOOPS Bitboard ExtendedBoard::GetControlledSquares(const Color color) const {
+template<>
+UNROLL_LOOPS Bitboard ExtendedBoard::GetControlledSquaresImpl<ExtendedBoard::kSse41>(const Color color) const {
   union ControlledSquares {
     ControlledSquares() : qword{0, 0} {}
     uint64_t qword[2];
@@ -156,7 +167,8 @@ UNROLL_LOOPS Bitboard ExtendedBoard::GetControlledSquares(const Color color) con
   return Bitboard(q1, q0);
 }
 
-PsqControlList ExtendedBoard::GetPsqControlList() const {
+template<>
+PsqControlList ExtendedBoard::GetPsqControlListImpl<ExtendedBoard::kSse41>() const {
   PsqControlList list;
 
   constexpr int kShiftBlackControls = PsqControlIndex::kKeyBlackControls.shift;
@@ -195,6 +207,355 @@ PsqControlList ExtendedBoard::GetPsqControlList() const {
   return list;
 }
 
+/*
+ * AVX2版の実装.
+ * 関数単位で命令セットを指定しているので、コンパイル時に-mavx2を指定する必要はありません。
+ */
+#pragma GCC push_options
+#pragma GCC target("avx2")
+
+template<>
+inline void ExtendedBoard::OperateWideShortControls<ExtendedBoard::kAvx2>(
+    Piece piece, Square square, bool add) {
+  // 1. 利き数を操作する範囲（３列分、64バイト）の先頭アドレスを求める
+  uint16_t* u16_ptr = &controls_[piece.color()][square].u16 + AttackPattern::kOffset0;
+  __m256i* ptr = reinterpret_cast<__m256i*>(u16_ptr);
+  // 2. 駒の利きと、端補正用のマスクをテーブルから取得する
+  const __m256i* attacks = reinterpret_cast<const __m256i*>(wide_short_attack_patterns_[piece].controls);
+  const __m256i* mask = reinterpret_cast<const __m256i*>(wide_attack_correction_[square].controls);
+  // 3. 256ビットずつ、利き数を加算 or 減算する
+  for (int i = 0; i < 2; ++i) {
+    __m256i pattern = _mm256_and_si256(_mm256_load_si256(attacks + i),
+                                       _mm256_load_si256(mask + i));
+    __m256i ymm = _mm256_loadu_si256(ptr + i);
+    ymm = add ? _mm256_add_epi8(ymm, pattern) : _mm256_sub_epi8(ymm, pattern);
+    _mm256_storeu_si256(ptr + i, ymm);
+  }
+}
+
+template<>
+void ExtendedBoard::MakeCaptureMoveImpl<ExtendedBoard::kAvx2>(Move move) {
+  assert(move.is_capture());
+
+  Square from = move.from();
+  Square to   = move.to();
+
+  // 1. いったん駒を盤上から取り除く
+  OperateWideShortControls<kAvx2>(move.piece(), from, false);
+  RemoveLongControls(move.piece(), from);
+  OperateWideShortControls<kAvx2>(move.captured_piece(), to, false);
+  RemoveLongControls(move.captured_piece(), to);
+  board_[from] = kNoPiece;
+  ExtendLongControls(from);
+
+  // 2. 駒を移動先のマスに置く
+  board_[to] = move.piece_after_move();
+  OperateWideShortControls<kAvx2>(move.piece_after_move(), to, true);
+  AddLongControls(move.piece_after_move(), to);
+}
+
+template<>
+void ExtendedBoard::MakeNonCaptureMoveImpl<ExtendedBoard::kAvx2>(Move move) {
+  assert(!move.is_capture() && !move.is_drop());
+
+  Square from = move.from();
+  Square to   = move.to();
+
+  // 1. 移動元から駒を取り除く
+  OperateWideShortControls<kAvx2>(move.piece(), from, false);
+  RemoveLongControls(move.piece(), from);
+  ExtendLongControls(from);
+  board_[from] = kNoPiece;
+
+  // 2. 移動先のマスに駒を置く
+  board_[to] = move.piece_after_move();
+  CutLongControls(to);
+  OperateWideShortControls<kAvx2>(move.piece_after_move(), to, true);
+  AddLongControls(move.piece_after_move(), to);
+}
+
+template<>
+Bitboard ExtendedBoard::GetControlledSquaresImpl<ExtendedBoard::kAvx2>(const Color color) const {
+  const __m256i kMaskNumControls = _mm256_set1_epi16(0xff);
+  const __m256i kZero = _mm256_setzero_si256();
+  const __m256i* ptr = reinterpret_cast<const __m256i*>(&controls_[color].xmm(0));
+
+  // 1. 最初の64マスは、32マスずつ処理する
+  uint64_t q0 = 0;
+  for (int i = 0; i < 2; ++i) {
+    // a. 32マス分の利き数を、8ビットずつに詰めて、１つのレジスタに集める
+    __m256i lo = _mm256_and_si256(_mm256_loadu_si256(ptr + 2 * i + 0), kMaskNumControls);
+    __m256i hi = _mm256_and_si256(_mm256_loadu_si256(ptr + 2 * i + 1), kMaskNumControls);
+    __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), 0xd8);
+    // b. 利き数がゼロ以上のマスを調べて、結果をビットセットに保存する
+    __m256i non_zero = _mm256_cmpgt_epi8(packed, kZero);
+    q0 |= uint64_t(uint32_t(_mm256_movemask_epi8(non_zero))) << (32 * i);
+  }
+
+  // 2. 残りの24マスは、SSE4.1版と同様に、８マスずつ処理する
+  constexpr uint8_t r = 0x80;
+  const __m128i kMask = _mm_set_epi8(r, r, r, r, r, r, r, r, 14, 12, 10, 8, 6, 4, 2, 0);
+  uint64_t q1 = 0;
+  for (size_t i = 8; i < 11; ++i) {
+    __m128i shuffled = _mm_shuffle_epi8(controls_[color].xmm(i), kMask);
+    __m128i non_zero = _mm_cmpgt_epi8(shuffled, _mm_setzero_si128());
+    q1 |= uint64_t(_mm_movemask_epi8(non_zero) & 0xff) << (8 * (i - 8));
+  }
+
+  // ビットボードの作成
+  return Bitboard((q1 << 1) | (q0 >> 63), q0 & (UINT64_MAX >> 1));
+}
+
+template<>
+PsqControlList ExtendedBoard::GetPsqControlListImpl<ExtendedBoard::kAvx2>() const {
+  PsqControlList list;
+
+  constexpr int kShiftBlackControls = PsqControlIndex::kKeyBlackControls.shift;
+  constexpr int kShiftWhiteControls = PsqControlIndex::kKeyWhiteControls.shift;
+  constexpr int kShiftSquare = PsqControlIndex::kKeySquare.shift;
+
+  const __m256i kMaskNumControls = _mm256_set1_epi16(0xff);
+  const __m256i kMaxNumOfControls = _mm256_set1_epi16(3);
+  const __m256i kSquareIncrement = _mm256_set1_epi16(16 << kShiftSquare);
+
+  __m256i squares = _mm256_slli_epi16(
+      _mm256_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15),
+      kShiftSquare);
+
+  // 1. 最初の80マスは、16マスずつ処理する
+  for (size_t i = 0; i < 5; ++i) {
+    // a. そのマスにある駒
+    __m256i indices = _mm256_cvtepu8_epi16(board_.xmm(i));
+    // b. 先手の利き数
+    __m256i black_controls = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&controls_[kBlack].xmm(2 * i)));
+    black_controls = _mm256_and_si256(black_controls, kMaskNumControls);
+    black_controls = _mm256_min_epu16(black_controls, kMaxNumOfControls); // 利き数の最大値を３に制限する
+    black_controls = _mm256_slli_epi16(black_controls, kShiftBlackControls);
+    indices = _mm256_or_si256(indices, black_controls);
+    // c. 後手の利き数
+    __m256i white_controls = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&controls_[kWhite].xmm(2 * i)));
+    white_controls = _mm256_and_si256(white_controls, kMaskNumControls);
+    white_controls = _mm256_min_epu16(white_controls, kMaxNumOfControls); // 利き数の最大値を３に制限する
+    white_controls = _mm256_slli_epi16(white_controls, kShiftWhiteControls);
+    indices = _mm256_or_si256(indices, white_controls);
+    // d. マスの位置
+    indices = _mm256_or_si256(indices, squares);
+    squares = _mm256_add_epi16(squares, kSquareIncrement); // 次の16マスへ
+    // インデックスをリストに保存する
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(&list.xmm(2 * i)), indices);
+  }
+
+  // 2. 残りの８マスは、SSE4.1版と同様に処理する
+  {
+    const size_t i = 10;
+    __m128i indices = _mm_cvtepu8_epi16(_mm_movpi64_epi64(board_.mm(i)));
+    __m128i black_controls = _mm_and_si128(controls_[kBlack].xmm(i), _mm256_castsi256_si128(kMaskNumControls));
+    black_controls = _mm_min_epu16(black_controls, _mm256_castsi256_si128(kMaxNumOfControls));
+    black_controls = _mm_slli_epi16(black_controls, kShiftBlackControls);
+    indices = _mm_or_si128(indices, black_controls);
+    __m128i white_controls = _mm_and_si128(controls_[kWhite].xmm(i), _mm256_castsi256_si128(kMaskNumControls));
+    white_controls = _mm_min_epu16(white_controls, _mm256_castsi256_si128(kMaxNumOfControls));
+    white_controls = _mm_slli_epi16(white_controls, kShiftWhiteControls);
+    indices = _mm_or_si128(indices, white_controls);
+    indices = _mm_or_si128(indices, _mm256_castsi256_si128(squares));
+    list.xmm(i) = indices;
+  }
+
+  return list;
+}
+
+#pragma GCC pop_options
+
+/*
+ * AVX-512BW版の実装.
+ */
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx512bw")
+
+template<>
+inline void ExtendedBoard::OperateWideShortControls<ExtendedBoard::kAvx512>(
+    Piece piece, Square square, bool add) {
+  // 1. 利き数を操作する範囲（３列分、64バイト）の先頭アドレスを求める
+  uint16_t* ptr = &controls_[piece.color()][square].u16 + AttackPattern::kOffset0;
+  // 2. 駒の利きと、端補正用のマスクをテーブルから取得する
+  __m512i attacks = _mm512_load_si512(wide_short_attack_patterns_[piece].controls);
+  __m512i mask = _mm512_load_si512(wide_attack_correction_[square].controls);
+  // 3. 512ビットをまとめて、利き数を加算 or 減算する
+  __m512i pattern = _mm512_and_si512(attacks, mask);
+  __m512i zmm = _mm512_loadu_si512(ptr);
+  zmm = add ? _mm512_add_epi8(zmm, pattern) : _mm512_sub_epi8(zmm, pattern);
+  _mm512_storeu_si512(ptr, zmm);
+}
+
+template<>
+void ExtendedBoard::MakeCaptureMoveImpl<ExtendedBoard::kAvx512>(Move move) {
+  assert(move.is_capture());
+
+  Square from = move.from();
+  Square to   = move.to();
+
+  // 1. いったん駒を盤上から取り除く
+  OperateWideShortControls<kAvx512>(move.piece(), from, false);
+  RemoveLongControls(move.piece(), from);
+  OperateWideShortControls<kAvx512>(move.captured_piece(), to, false);
+  RemoveLongControls(move.captured_piece(), to);
+  board_[from] = kNoPiece;
+  ExtendLongControls(from);
+
+  // 2. 駒を移動先のマスに置く
+  board_[to] = move.piece_after_move();
+  OperateWideShortControls<kAvx512>(move.piece_after_move(), to, true);
+  AddLongControls(move.piece_after_move(), to);
+}
+
+template<>
+void ExtendedBoard::MakeNonCaptureMoveImpl<ExtendedBoard::kAvx512>(Move move) {
+  assert(!move.is_capture() && !move.is_drop());
+
+  Square from = move.from();
+  Square to   = move.to();
+
+  // 1. 移動元から駒を取り除く
+  OperateWideShortControls<kAvx512>(move.piece(), from, false);
+  RemoveLongControls(move.piece(), from);
+  ExtendLongControls(from);
+  board_[from] = kNoPiece;
+
+  // 2. 移動先のマスに駒を置く
+  board_[to] = move.piece_after_move();
+  CutLongControls(to);
+  OperateWideShortControls<kAvx512>(move.piece_after_move(), to, true);
+  AddLongControls(move.piece_after_move(), to);
+}
+
+template<>
+Bitboard ExtendedBoard::GetControlledSquaresImpl<ExtendedBoard::kAvx512>(const Color color) const {
+  // 32マスずつ、利き数（各16ビットの下位8ビット）がゼロでないマスを調べる
+  // （最後の読み込みでは、盤外のパディング領域も読み込むが、その部分はマスクで取り除く）
+  const __m512i kMaskNumControls = _mm512_set1_epi16(0xff);
+  const uint16_t* ptr = reinterpret_cast<const uint16_t*>(&controls_[color].xmm(0));
+  uint64_t b0 = _mm512_test_epi16_mask(_mm512_loadu_si512(ptr +  0), kMaskNumControls);
+  uint64_t b1 = _mm512_test_epi16_mask(_mm512_loadu_si512(ptr + 32), kMaskNumControls);
+  uint64_t b2 = _mm512_test_epi16_mask(_mm512_loadu_si512(ptr + 64), kMaskNumControls);
+  uint64_t q0 = b0 | (b1 << 32);
+  uint64_t q1 = b2 & 0xffffff;
+
+  // ビットボードの作成
+  return Bitboard((q1 << 1) | (q0 >> 63), q0 & (UINT64_MAX >> 1));
+}
+
+template<>
+PsqControlList ExtendedBoard::GetPsqControlListImpl<ExtendedBoard::kAvx512>() const {
+  PsqControlList list;
+
+  constexpr int kShiftBlackControls = PsqControlIndex::kKeyBlackControls.shift;
+  constexpr int kShiftWhiteControls = PsqControlIndex::kKeyWhiteControls.shift;
+  constexpr int kShiftSquare = PsqControlIndex::kKeySquare.shift;
+
+  const __m512i kMaskNumControls = _mm512_set1_epi16(0xff);
+  const __m512i kMaxNumOfControls = _mm512_set1_epi16(3);
+  const __m512i kSquareIncrement = _mm512_set1_epi16(32 << kShiftSquare);
+
+  __m512i squares = _mm512_slli_epi16(
+      _mm512_cvtepu8_epi16(_mm256_setr_epi8( 0,  1,  2,  3,  4,  5,  6,  7,
+                                             8,  9, 10, 11, 12, 13, 14, 15,
+                                            16, 17, 18, 19, 20, 21, 22, 23,
+                                            24, 25, 26, 27, 28, 29, 30, 31)),
+      kShiftSquare);
+
+  // 32マスずつ処理する（最後の読み込みでは、盤外のパディング領域も読み込むが、その部分は書き込まない）
+  for (size_t i = 0; i < 3; ++i) {
+    // a. そのマスにある駒
+    __m512i indices = _mm512_cvtepu8_epi16(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&board_.xmm(2 * i))));
+    // b. 先手の利き数
+    __m512i black_controls = _mm512_loadu_si512(&controls_[kBlack].xmm(4 * i));
+    black_controls = _mm512_and_si512(black_controls, kMaskNumControls);
+    black_controls = _mm512_min_epu16(black_controls, kMaxNumOfControls); // 利き数の最大値を３に制限する
+    black_controls = _mm512_slli_epi16(black_controls, kShiftBlackControls);
+    indices = _mm512_or_si512(indices, black_controls);
+    // c. 後手の利き数
+    __m512i white_controls = _mm512_loadu_si512(&controls_[kWhite].xmm(4 * i));
+    white_controls = _mm512_and_si512(white_controls, kMaskNumControls);
+    white_controls = _mm512_min_epu16(white_controls, kMaxNumOfControls); // 利き数の最大値を３に制限する
+    white_controls = _mm512_slli_epi16(white_controls, kShiftWhiteControls);
+    indices = _mm512_or_si512(indices, white_controls);
+    // d. マスの位置
+    indices = _mm512_or_si512(indices, squares);
+    squares = _mm512_add_epi16(squares, kSquareIncrement); // 次の32マスへ
+    // インデックスをリストに保存する（最後は、88マス目までの24マス分のみ）
+    const __mmask32 mask = i < 2 ? 0xffffffff : 0x00ffffff;
+    _mm512_mask_storeu_epi16(&list.xmm(4 * i), mask, indices);
+  }
+
+  return list;
+}
+
+#pragma GCC pop_options
+
+/*
+ * Init()で選択された命令セットの実装の呼び出し.
+ * simd_level_は起動時に一度だけ設定されるので、分岐予測はほぼ確実に当たり、
+ * 関数ポインタを経由せずに、各命令セットの実装を直接呼び出せます。
+ */
+void ExtendedBoard::MakeCaptureMove(Move move) {
+  switch (simd_level_) {
+    case kAvx512: MakeCaptureMoveImpl<kAvx512>(move); break;
+    case kAvx2  : MakeCaptureMoveImpl<kAvx2  >(move); break;
+    default     : MakeCaptureMoveImpl<kSse41 >(move); break;
+  }
+}
+
+void ExtendedBoard::MakeNonCaptureMove(Move move) {
+  switch (simd_level_) {
+    case kAvx512: MakeNonCaptureMoveImpl<kAvx512>(move); break;
+    case kAvx2  : MakeNonCaptureMoveImpl<kAvx2  >(move); break;
+    default     : MakeNonCaptureMoveImpl<kSse41 >(move); break;
+  }
+}
+
+Bitboard ExtendedBoard::GetControlledSquares(const Color color) const {
+  switch (simd_level_) {
+    case kAvx512: return GetControlledSquaresImpl<kAvx512>(color);
+    case kAvx2  : return GetControlledSquaresImpl<kAvx2  >(color);
+    default     : return GetControlledSquaresImpl<kSse41 >(color);
+  }
+}
+
+PsqControlList ExtendedBoard::GetPsqControlList() const {
+  switch (simd_level_) {
+    case kAvx512: return GetPsqControlListImpl<kAvx512>();
+    case kAvx2  : return GetPsqControlListImpl<kAvx2  >();
+    default     : return GetPsqControlListImpl<kSse41 >();
+  }
+}
+
+bool ExtendedBoard::set_simd_level(const SimdLevel level) {
+  if (level > GetBestSimdLevel()) {
+    return false;
+  }
+  simd_level_ = level;
+  return true;
+}
+
+ExtendedBoard::SimdLevel ExtendedBoard::GetBestSimdLevel() {
+  if (cpu_features::HasAvx512bw()) {
+    return kAvx512;
+  } else if (cpu_features::HasAvx2()) {
+    return kAvx2;
+  } else {
+    return kSse41;
+  }
+}
+
+const char* ExtendedBoard::GetSimdLevelName(const SimdLevel level) {
+  switch (level) {
+    case kAvx512: return "AVX-512BW";
+    case kAvx2  : return "AVX2";
+    default     : return "SSE4.1";
+  }
+}
+
 void ExtendedBoard::Init() {
   // 1. short_attack_patterns_を初期化する。
   for (Piece piece : Piece::all_pieces()) {
@@ -271,6 +632,30 @@ void ExtendedBoard::Init() {
       }
     }
   }
+
+  // 7. wide_short_attack_patterns_とwide_attack_correction_を初期化する。
+  //    （AttackPatternの３列分を、盤上と同じ間隔で、連続した64バイトに並べ直す）
+  auto widen = [](const AttackPattern& pattern) {
+    constexpr int kColumnStride = AttackPattern::kOffset1 - AttackPattern::kOffset0;
+    static_assert(2 * kColumnStride == AttackPattern::kOffset2 - AttackPattern::kOffset0, "");
+    WideAttackPattern wide;
+    std::memset(&wide, 0, sizeof(wide));
+    for (int x = 0; x < 3; ++x) {
+      for (int y = 0; y < 8; ++y) {
+        wide.controls[kColumnStride * x + y] = pattern.controls[x][y];
+      }
+    }
+    return wide;
+  };
+  for (Piece piece : Piece::all_pieces()) {
+    wide_short_attack_patterns_[piece] = widen(short_attack_patterns_[piece]);
+  }
+  for (Square s : Square::all_squares()) {
+    wide_attack_correction_[s] = widen(attack_correction_[s]);
+  }
+
+  // 8. 実行中のCPUで最も高速な命令セットを選択する
+  set_simd_level(GetBestSimdLevel());
 }
 
 bool ExtendedBoard::IsOk() const {
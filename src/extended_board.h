@@ -272,9 +272,23 @@ class FifteenNeighborhoods {
 
 /**
  * 将棋盤の機能を拡張し、各マスの利き数等を高速に計算できるようにするためのクラスです.
+ *
+ * 利き数の差分更新（MakeCaptureMove(), MakeNonCaptureMove()）と、全マスを走査する処理
+ * （GetControlledSquares(), GetPsqControlList()）については、SSE4.1版のほかに、AVX2版と
+ * AVX-512BW版の実装があり、Init()の呼び出し時に、実行中のCPUに合わせて最速のものが選ばれます。
+ * このため、同じ実行ファイルのまま、古いCPUと新しいCPUのどちらでも最適な命令を利用できます。
  */
 class ExtendedBoard {
  public:
+  /**
+   * 利き数の計算に用いる命令セットです.
+   */
+  enum SimdLevel {
+    kSse41,  // SSE4.1（128ビット単位で処理する）
+    kAvx2,   // AVX2（256ビット単位で処理する）
+    kAvx512, // AVX-512BW（512ビット単位で処理する）
+  };
+
   ExtendedBoard() {
     Clear(); // 将棋盤・利き数を初期化する
   }
@@ -314,12 +328,12 @@ class ExtendedBoard {
   /**
    * 指し手に沿って将棋盤を動かします（駒を取る手の場合）.
    */
-  void MakeCaptureMove(Move);
+  void MakeCaptureMove(Move move);
 
   /**
    * 指し手に沿って将棋盤を動かします（駒を取らずに動かす手の場合）.
    */
-  void MakeNonCaptureMove(Move);
+  void MakeNonCaptureMove(Move move);
 
   /**
    * 指し手に沿って将棋盤を２手分いっぺんに動かします.
@@ -525,6 +539,39 @@ class ExtendedBoard {
    */
   static void Init();
 
+  /**
+   * 現在使用している命令セットを返します.
+   */
+  static SimdLevel simd_level() {
+    return simd_level_;
+  }
+
+  /**
+   * 使用する命令セットを変更します（ベンチマーク用）.
+   * CPUが対応していない命令セットが指定された場合は、何もせずにfalseを返します。
+   */
+  static bool set_simd_level(SimdLevel level);
+
+  /**
+   * 実行中のCPUで使用可能な、最も高速な命令セットを返します.
+   */
+  static SimdLevel GetBestSimdLevel();
+
+  /**
+   * 命令セットの名前を返します.
+   */
+  static const char* GetSimdLevelName(SimdLevel level);
+
+  /**
+   * 命令セットごとの実装です（extended_board.cc内で、命令セットごとに特殊化されています）.
+   * 通常は、MakeCaptureMove()などを使ってください（命令セットを指定して比較する、ベンチマーク用です）。
+   * なお、実行中のCPUが対応していない命令セットの実装は、呼び出さないでください。
+   */
+  template<SimdLevel kLevel> void MakeCaptureMoveImpl(Move move);
+  template<SimdLevel kLevel> void MakeNonCaptureMoveImpl(Move move);
+  template<SimdLevel kLevel> Bitboard GetControlledSquaresImpl(Color color) const;
+  template<SimdLevel kLevel> PsqControlList GetPsqControlListImpl() const;
+
   /**
    * このクラスの内部状態が正しい場合はtrueを、正しくなければfalseを返します（デバッグ用）.
    */
@@ -541,14 +588,22 @@ class ExtendedBoard {
     OperateShortControls(piece, square, [](__m128i lhs, __m128i rhs) {
       return _mm_add_epi8(lhs, rhs);
     });
-    OperateLongControls(piece.color(), square, long_attack_patterns_[piece],
-                        [](uint16_t& lhs, uint16_t rhs) { lhs += rhs; });
+    AddLongControls(piece, square);
   }
 
   void RemoveControls(Piece piece, Square square) {
     OperateShortControls(piece, square, [](__m128i lhs, __m128i rhs) {
       return _mm_sub_epi8(lhs, rhs);
     });
+    RemoveLongControls(piece, square);
+  }
+
+  void AddLongControls(Piece piece, Square square) {
+    OperateLongControls(piece.color(), square, long_attack_patterns_[piece],
+                        [](uint16_t& lhs, uint16_t rhs) { lhs += rhs; });
+  }
+
+  void RemoveLongControls(Piece piece, Square square) {
     OperateLongControls(piece.color(), square, long_attack_patterns_[piece],
                         [](uint16_t& lhs, uint16_t rhs) { lhs -= rhs; });
   }
@@ -601,6 +656,20 @@ class ExtendedBoard {
     _mm_storeu_si128(ptr2, xmm2);
   }
 
+  /**
+   * 短い利きを操作するためのメソッドです（AVX2版及びAVX-512BW版）.
+   *
+   * 利き数を操作する３列分のマス（縦8マスx横3マス）は、メモリ上で連続した64バイトの範囲に
+   * 収まっているので、WideAttackPatternを用いて、この範囲を256ビットまたは512ビット単位で
+   * まとめて加算または減算します。
+   * 実装は、命令セットごとに、extended_board.cc内で特殊化されています。
+   *
+   * @param add trueならば利き数を加算し、falseならば減算する
+   */
+  template<SimdLevel kLevel>
+  void OperateWideShortControls(Piece piece, Square square, bool add);
+
+
   /**
    * 長い利きを操作するためのメソッドです.
    */
@@ -699,6 +768,10 @@ class ExtendedBoard {
       assert(i < 12);
       return mm_[i];
     }
+    const __m128i& xmm(size_t i) const {
+      assert(i < 6);
+      return xmm_[i];
+    }
    private:
     __m128i padding_head_;
     union {
@@ -745,12 +818,32 @@ class ExtendedBoard {
     };
   };
 
+  /**
+   * 短い利きのパターンを、AttackPatternの３列分を連続した64バイトに並べ直して表したものです.
+   *
+   * 縦１列は将棋盤上で9マス（18バイト）ごとに並んでいるので、各列の間には1マス分の隙間があります。
+   * この隙間と末尾の余りには０が入っているため、64バイトをまとめて加算・減算しても、
+   * 利きのパターン以外のマスの利き数は変化しません。
+   */
+  struct WideAttackPattern {
+    alignas(64) Control controls[32];
+  };
+
   /** 将棋盤の「端」の利きを補正するためのマスク */
   static ArrayMap<AttackPattern, Square> attack_correction_;
 
+  /** 将棋盤の「端」の利きを補正するためのマスク（AVX2/AVX-512BW用） */
+  static ArrayMap<WideAttackPattern, Square> wide_attack_correction_;
+
   /** 各駒ごとの、短い利きのパターン */
   static ArrayMap<AttackPattern, Piece> short_attack_patterns_;
 
+  /** 各駒ごとの、短い利きのパターン（AVX2/AVX-512BW用） */
+  static ArrayMap<WideAttackPattern, Piece> wide_short_attack_patterns_;
+
+  /** 現在使用している命令セット */
+  static SimdLevel simd_level_;
+
   /** 各駒ごとの、長い利きのパターン */
   static const ArrayMap<DirectionSet, Piece> long_attack_patterns_;
 
@@ -773,4 +866,20 @@ class ExtendedBoard {
   PieceBoard board_;
 };
 
+/*
+ * 命令セットごとの実装の特殊化の宣言（定義は、extended_board.cc内にあります）.
+ */
+template<> void ExtendedBoard::MakeCaptureMoveImpl<ExtendedBoard::kSse41>(Move);
+template<> void ExtendedBoard::MakeNonCaptureMoveImpl<ExtendedBoard::kSse41>(Move);
+template<> Bitboard ExtendedBoard::GetControlledSquaresImpl<ExtendedBoard::kSse41>(Color) const;
+template<> PsqControlList ExtendedBoard::GetPsqControlListImpl<ExtendedBoard::kSse41>() const;
+template<> void ExtendedBoard::MakeCaptureMoveImpl<ExtendedBoard::kAvx2>(Move);
+template<> void ExtendedBoard::MakeNonCaptureMoveImpl<ExtendedBoard::kAvx2>(Move);
+template<> Bitboard ExtendedBoard::GetControlledSquaresImpl<ExtendedBoard::kAvx2>(Color) const;
+template<> PsqControlList ExtendedBoard::GetPsqControlListImpl<ExtendedBoard::kAvx2>() const;
+template<> void ExtendedBoard::MakeCaptureMoveImpl<ExtendedBoard::kAvx512>(Move);
+template<> void ExtendedBoard::MakeNonCaptureMoveImpl<ExtendedBoard::kAvx512>(Move);
+template<> Bitboard ExtendedBoard::GetControlledSquaresImpl<ExtendedBoard::kAvx512>(Color) const;
+template<> PsqControlList ExtendedBoard::GetPsqControlListImpl<ExtendedBoard::kAvx512>() const;
+
 #endif /* EXTENDED_BOARD_H_ */
@@ -19,28 +19,218 @@
 
 #include "gamedb.h"
 
+#include <cinttypes>
+#include <cstdint>
+#include <cstring>
 #include <iomanip>
 #include <sstream>
 #include <string>
 #include <unordered_set>
+#include "common/array.h"
 #include "notations.h"
+#include <sys/stat.h>
 
 #if !defined(MINIMUM)
 
 namespace {
+
 const std::unordered_set<std::string> g_title_matches = {
     "竜王戦", "名人戦", "王位戦", "王座戦", "棋王戦", "王将戦", "棋聖戦", "順位戦",
 };
+
+/*
+ * バイナリ形式の棋譜DBファイルの構成は、以下のとおりです.
+ *
+ * <pre>
+ * ファイルヘッダ: BinaryFileHeader
+ * 対局データ    : { BinaryGameHeader, 文字列 x 5, 指し手(uint32_t) x 手数 } x 対局数
+ * </pre>
+ *
+ * 文字列は、対局日・先手名・後手名・棋戦・戦型の順に、終端文字なしで並べています。
+ * 指し手は、Move::ToUint32()で変換した値で、テキスト形式から変換する時点で合法性のチェックが済んでいます。
+ * そのため、読み込みの際には、局面を再生して指し手を検証する必要はありません。
+ * なお、エンディアンの変換は行っていないため、異なるアーキテクチャ間でファイルを共有することはできません。
+ */
+constexpr char kBinaryMagic[4] = {'G', 'K', 'D', 'B'};
+constexpr uint32_t kBinaryVersion = 1;
+constexpr int kNumStringFields = 5;
+
+struct BinaryFileHeader {
+  char magic[4];
+  uint32_t version;
+  uint64_t num_games;
+};
+
+struct BinaryGameHeader {
+  uint16_t num_moves;
+  uint8_t result;
+  uint8_t reserved;
+  uint16_t string_lengths[kNumStringFields];
+};
+
+/**
+ * 対局データの文字列フィールドへのポインタを、保存する順番に並べて返します.
+ */
+Array<std::string*, kNumStringFields> GetStringFields(Game* game) {
+  return {&game->date, &game->players[kBlack], &game->players[kWhite],
+          &game->event, &game->opening};
+}
+
+/**
+ * ファイルの最終更新時刻を取得します.
+ * @return ファイルが存在する場合はtrue
+ */
+bool GetModificationTime(const char* file_name, time_t* const mtime) {
+  struct stat st;
+  if (stat(file_name, &st) != 0) {
+    return false;
+  }
+  *mtime = st.st_mtime;
+  return true;
+}
+
 } // namespace
 
+GameDatabase::GameDatabase() {
+  // 1. バイナリ形式の棋譜DBファイルがテキスト形式のものより古い場合は、変換後に棋譜が更新されたものとみなす
+  time_t binary_mtime, text_mtime;
+  const bool binary_is_outdated = GetModificationTime(kDefaultBinaryDatabaseFile, &binary_mtime)
+                               && GetModificationTime(kDefaultDatabaseFile, &text_mtime)
+                               && text_mtime > binary_mtime;
+  if (binary_is_outdated) {
+    std::printf("info string %s is older than %s. Use %s instead. "
+                "Run --convert-db to update %s.\n",
+                kDefaultBinaryDatabaseFile, kDefaultDatabaseFile, kDefaultDatabaseFile,
+                kDefaultBinaryDatabaseFile);
+  }
+
+  // 2. バイナリ形式の棋譜DBファイルがあれば、そちらを優先して使う
+  if (!binary_is_outdated && mapped_file_.Open(kDefaultBinaryDatabaseFile)) {
+    BinaryFileHeader file_header;
+    std::memset(&file_header, 0, sizeof(file_header));
+    if (mapped_file_.size() >= sizeof(file_header)) {
+      std::memcpy(&file_header, mapped_file_.data(), sizeof(file_header));
+    }
+    if (   std::memcmp(file_header.magic, kBinaryMagic, sizeof(kBinaryMagic)) == 0
+        && file_header.version == kBinaryVersion) {
+      mapped_offset_ = sizeof(file_header);
+      return;
+    }
+    std::printf("info string %s is broken or outdated. Use %s instead.\n",
+                kDefaultBinaryDatabaseFile, kDefaultDatabaseFile);
+    mapped_file_.Close();
+  }
+
+  // 3. バイナリ形式の棋譜DBファイルが使えなければ、テキスト形式の棋譜DBファイルを使う
+  default_file_.reset(new std::ifstream(kDefaultDatabaseFile));
+  input_stream_ = default_file_.get();
+}
+
 bool GameDatabase::ReadOneGame(Game* game) {
   assert(game != nullptr);
+  if (is_binary()) {
+    return ReadOneGameFromBinary(game);
+  } else {
+    return ReadOneGameFromText(game);
+  }
+}
+
+bool GameDatabase::ConvertToBinary(const char* const input_file_name,
+                                   const char* const output_file_name) {
+  // 1. 変換元のテキスト形式の棋譜DBファイルを開く
+  std::ifstream input_file(input_file_name);
+  if (!input_file) {
+    std::printf("Failed to open %s.\n", input_file_name);
+    return false;
+  }
+  GameDatabase game_db(input_file);
+
+  // 2. 変換先のファイルを開く
+  std::FILE* output_file = std::fopen(output_file_name, "wb");
+  if (output_file == nullptr) {
+    std::printf("Failed to open %s.\n", output_file_name);
+    return false;
+  }
+
+  // 書き込みに失敗した場合は、中途半端なファイルを残さないように削除する
+  bool ok = true;
+  auto write = [&](const void* data, size_t size, size_t count) {
+    ok = ok && std::fwrite(data, size, count, output_file) == count;
+  };
+  auto fail = [&](const char* message) {
+    std::printf("%s\n", message);
+    std::fclose(output_file);
+    std::remove(output_file_name);
+    return false;
+  };
+
+  // 3. ファイルヘッダを書き込む（対局数は、最後に書き直す）
+  BinaryFileHeader file_header;
+  std::memcpy(file_header.magic, kBinaryMagic, sizeof(kBinaryMagic));
+  file_header.version = kBinaryVersion;
+  file_header.num_games = 0;
+  write(&file_header, sizeof(file_header), 1);
+
+  // 4. 対局データを１局ずつ変換する
+  std::vector<uint32_t> moves;
+  for (Game game; ok && game_db.ReadOneGame(&game); ) {
+    // 対局ヘッダに収まらない長さの対局データは、切り詰めずに変換を中止する
+    auto fields = GetStringFields(&game);
+    bool too_long = game.moves.size() > UINT16_MAX;
+    for (const std::string* field : fields) {
+      too_long |= field->size() > UINT16_MAX;
+    }
+    if (too_long) {
+      std::printf("Game #%" PRIu64 " is too long to be stored in the binary format.\n",
+                  file_header.num_games + 1);
+      return fail("Conversion aborted.");
+    }
+
+    BinaryGameHeader game_header;
+    game_header.num_moves = static_cast<uint16_t>(game.moves.size());
+    game_header.result = static_cast<uint8_t>(game.result);
+    game_header.reserved = 0;
+    for (int i = 0; i < kNumStringFields; ++i) {
+      game_header.string_lengths[i] = static_cast<uint16_t>(fields[i]->size());
+    }
+    write(&game_header, sizeof(game_header), 1);
+    for (const std::string* field : fields) {
+      write(field->data(), 1, field->size());
+    }
+    moves.clear();
+    for (Move move : game.moves) {
+      moves.push_back(move.ToUint32());
+    }
+    write(moves.data(), sizeof(uint32_t), moves.size());
+    file_header.num_games += 1;
+  }
+
+  // 5. 対局数を書き込んで、ファイルを閉じる
+  std::rewind(output_file);
+  write(&file_header, sizeof(file_header), 1);
+  if (!ok) {
+    return fail("Failed to write the binary database. Conversion aborted.");
+  }
+  if (std::fclose(output_file) != 0) {
+    std::remove(output_file_name);
+    std::printf("Failed to write the binary database. Conversion aborted.\n");
+    return false;
+  }
+
+  std::printf("Converted %" PRIu64 " games from %s to %s.\n",
+              file_header.num_games, input_file_name, output_file_name);
+  return true;
+}
+
+bool GameDatabase::ReadOneGameFromText(Game* game) {
+  assert(game != nullptr);
+  assert(input_stream_ != nullptr);
 
 START:
   std::string line;
 
   // Step 1. ヘッダー部分を１行読み込む
-  if (!std::getline(input_stream_, line)) {
+  if (!std::getline(*input_stream_, line)) {
     return false;
   }
 
@@ -53,7 +243,7 @@ START:
   game->result = static_cast<Game::Result>(game_result);
 
   // Step 3. 指し手が記録されている１行を読み込む
-  if (!std::getline(input_stream_, line)) {
+  if (!std::getline(*input_stream_, line)) {
     return false;
   }
 
@@ -83,4 +273,54 @@ START:
   return true;
 }
 
+bool GameDatabase::ReadOneGameFromBinary(Game* game) {
+  assert(game != nullptr);
+  assert(is_binary());
+
+  const char* const data = mapped_file_.data();
+  const size_t size = mapped_file_.size();
+
+  while (mapped_offset_ + sizeof(BinaryGameHeader) <= size) {
+    // Step 1. 対局ヘッダを読み込む
+    BinaryGameHeader game_header;
+    std::memcpy(&game_header, data + mapped_offset_, sizeof(game_header));
+    size_t record_size = sizeof(game_header);
+    for (uint16_t length : game_header.string_lengths) {
+      record_size += length;
+    }
+    record_size += sizeof(uint32_t) * game_header.num_moves;
+    if (mapped_offset_ + record_size > size) {
+      break; // ファイルが途中で切れている場合は、ここで中断する
+    }
+    const char* p = data + mapped_offset_ + sizeof(game_header);
+    mapped_offset_ += record_size;
+
+    // Step 2. 文字列フィールドを読み込む
+    auto fields = GetStringFields(game);
+    for (int i = 0; i < kNumStringFields; ++i) {
+      fields[i]->assign(p, game_header.string_lengths[i]);
+      p += game_header.string_lengths[i];
+    }
+    game->result = static_cast<Game::Result>(game_header.result);
+
+    // 指定があれば、７大棋戦＋順位戦以外の対局をスキップする
+    if (title_matches_only_ && g_title_matches.count(game->event) == 0) {
+      continue;
+    }
+
+    // Step 3. 指し手を読み込む（合法性はDB変換時にチェック済み）
+    game->moves.resize(game_header.num_moves);
+    for (Move& move : game->moves) {
+      uint32_t u32;
+      std::memcpy(&u32, p, sizeof(u32));
+      move = Move::FromUint32(u32);
+      p += sizeof(u32);
+    }
+
+    return true;
+  }
+
+  return false;
+}
+
 #endif // !defined(MINIMUM)
@@ -20,10 +20,13 @@
 #ifndef GAMEDB_H_
 #define GAMEDB_H_
 
+#include <fstream>
 #include <istream>
+#include <memory>
 #include <string>
 #include <vector>
 #include "common/arraymap.h"
+#include "mapped_file.h"
 #include "move.h"
 
 /**
@@ -74,6 +77,11 @@ struct Game {
  * を対局の数だけ並べたものです。
  *
  * 日本語が含まれる棋譜ファイルの場合は、エンコーディングはUTF-8にしておいてください.
+ *
+ * また、テキスト形式の棋譜DBファイルは、ConvertToBinary()により、あらかじめバイナリ形式に変換しておくことができます。
+ * バイナリ形式では、指し手が合法性チェック済みの32ビット整数として保存されているため、
+ * CSA形式の解析や局面の再生を行わずに済み、読み込みが大幅に高速化されます。
+ * バイナリ形式の詳細については、gamedb.ccを参照してください。
  */
 class GameDatabase {
  public:
@@ -82,14 +90,32 @@ class GameDatabase {
    */
   static constexpr const char* kDefaultDatabaseFile = "kifu.txt";
 
+  /**
+   * デフォルトで読み込むバイナリ形式の棋譜DBファイルの場所.
+   */
+  static constexpr const char* kDefaultBinaryDatabaseFile = "kifu.bin";
+
+  /**
+   * デフォルトの棋譜DBファイルを開きます.
+   *
+   * バイナリ形式の棋譜DBファイル（kifu.bin）が存在する場合はそちらを優先して読み込み、
+   * 存在しない場合は、テキスト形式の棋譜DBファイル（kifu.txt）を読み込みます。
+   * ただし、kifu.txtがkifu.binよりも新しい場合は、kifu.binが古くなっているものとみなし、
+   * 警告を表示したうえで、kifu.txtを読み込みます。
+   */
+  GameDatabase();
+
   /**
    * コンストラクタで、読み出しを行うDBファイルのストリームを指定してください.
    * なお、読み出すファイルは、utf-8でエンコーディングされている必要があります。
    */
   GameDatabase(std::istream& is)
-      : input_stream_(is) {
+      : input_stream_(&is) {
   }
 
+  GameDatabase(const GameDatabase&) = delete;
+  GameDatabase& operator=(const GameDatabase&) = delete;
+
   /**
    * 対局１局分のデータを読み出します.
    * @param game 読み出した対局データの保存先のポインタ
@@ -105,8 +131,30 @@ class GameDatabase {
     title_matches_only_ = title_matches_only;
   }
 
+  /**
+   * バイナリ形式の棋譜DBファイルを読み込んでいる場合は、trueを返します.
+   */
+  bool is_binary() const {
+    return mapped_file_.is_open();
+  }
+
+  /**
+   * テキスト形式の棋譜DBファイルを、バイナリ形式の棋譜DBファイルに変換します.
+   * @param input_file_name  変換元のテキスト形式の棋譜DBファイル
+   * @param output_file_name 変換先のバイナリ形式の棋譜DBファイル
+   * @return 変換に成功した場合はtrue
+   */
+  static bool ConvertToBinary(const char* input_file_name,
+                              const char* output_file_name);
+
  private:
-  std::istream& input_stream_;
+  bool ReadOneGameFromText(Game* game);
+  bool ReadOneGameFromBinary(Game* game);
+
+  std::istream* input_stream_ = nullptr;
+  std::unique_ptr<std::ifstream> default_file_;
+  MappedFile mapped_file_;
+  size_t mapped_offset_ = 0;
   bool title_matches_only_ = false;
 };
 
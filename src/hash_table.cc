@@ -24,17 +24,86 @@
 
 void HashTable::SetSize(size_t megabytes) {
   size_t bytes = megabytes * 1024 * 1024;
-  age_  = 0;
-  size_ = (static_cast<size_t>(1) << bitop::bsr64(bytes)) / sizeof(Bucket);
-  key_mask_ = size_ - 1;
-  hashfull_ = 0;
-  table_.reset(new Bucket[size_]);
+  size_t size = (static_cast<size_t>(1) << bitop::bsr64(bytes)) / sizeof(Bucket);
+
+  // 共有メモリ上のハッシュテーブルを使用していた場合は、その使用をやめる
+#if !defined(MINIMUM)
+  shared_memory_.Close();
+#endif
+
+  private_table_.reset(new Bucket[size]);
   // テーブルのゼロ初期化を行う（省略不可）
   // Moveクラスのデフォルトコンストラクタにはゼロ初期化処理がないので、ここでゼロ初期化を行わないと、
   // ハッシュムーブがおかしな手になってしまい、最悪セグメンテーションフォールトを引き起こす。
-  std::memset(table_.get(), 0, sizeof(Bucket) * size_);
+  std::memset(private_table_.get(), 0, sizeof(Bucket) * size);
+  SetTable(private_table_.get(), size);
+}
+
+void HashTable::SetTable(Bucket* const table, const size_t size) {
+  table_ = table;
+  age_  = 0;
+  size_ = size;
+  key_mask_ = size_ - 1;
+  hashfull_ = 0;
+}
+
+#if !defined(MINIMUM)
+
+bool HashTable::CreateSharedTable(SharedMemory* const memory,
+                                  const char* const name,
+                                  const size_t megabytes) {
+  size_t bytes = megabytes * 1024 * 1024;
+  size_t size = (static_cast<size_t>(1) << bitop::bsr64(bytes)) / sizeof(Bucket);
+
+  // 共有メモリは作成時にゼロ初期化されるので、テーブルのゼロ初期化は不要
+  if (!memory->Create(name, kSharedTableOffset + sizeof(Bucket) * size)) {
+    return false;
+  }
+  SharedTableHeader* header = reinterpret_cast<SharedTableHeader*>(memory->data());
+  header->size = size;
+  header->magic = kSharedTableMagic;
+  return true;
+}
+
+void HashTable::ClearSharedTable(SharedMemory* const memory) {
+  if (!memory->is_open()) {
+    return;
+  }
+  const SharedTableHeader* header =
+      reinterpret_cast<const SharedTableHeader*>(memory->data());
+  std::memset(memory->data() + kSharedTableOffset, 0, sizeof(Bucket) * header->size);
+}
+
+bool HashTable::AttachSharedTable(const char* const name) {
+  // すでに同じ共有メモリを使用している場合は、何もしない
+  if (is_shared() && shared_memory_.name() == name) {
+    return true;
+  }
+
+  SharedMemory memory;
+  if (!memory.Open(name) || memory.size() < kSharedTableOffset) {
+    return false;
+  }
+
+  // ヘッダを確認する
+  const SharedTableHeader* header =
+      reinterpret_cast<const SharedTableHeader*>(memory.data());
+  const size_t size = header->size;
+  if (   header->magic != kSharedTableMagic
+      || size == 0 || (size & (size - 1)) != 0
+      || memory.size() < kSharedTableOffset + sizeof(Bucket) * size) {
+    return false;
+  }
+
+  // プロセス専用のテーブルを解放して、共有メモリ上のテーブルに切り替える
+  private_table_.reset();
+  shared_memory_.Swap(memory);
+  SetTable(reinterpret_cast<Bucket*>(shared_memory_.data() + kSharedTableOffset), size);
+  return true;
 }
 
+#endif /* !defined(MINIMUM) */
+
 HashEntry* HashTable::LookUp(Key64 key64) const {
   const Key32 key32 = key64.ToKey32();
   for (HashEntry& tte : table_[key64 & key_mask_]) {
@@ -81,7 +150,11 @@ void HashTable::Save(Key64 key64, Move move, Score score, Depth depth,
   }
 
   // 2. メモリに保存する
-  replace->Save(key64, score, bound, depth, move, eval, flag, age_);
+  // 他のスレッドやプロセスから、書きかけのエントリが読まれにくくなるよう、
+  // いったん手元で作成したエントリを、まとめてコピーする
+  HashEntry new_entry;
+  new_entry.Save(key64, score, bound, depth, move, eval, flag, age_);
+  std::memcpy(static_cast<void*>(replace), &new_entry, sizeof(HashEntry));
 }
 
 void HashTable::InsertMoves(const Node& root_node,
@@ -187,7 +260,7 @@ Move HashTable::GetPonderMove(const Node& root_node,
 }
 
 void HashTable::Clear() {
-  std::memset(table_.get(), 0, size_ * sizeof(Bucket));
+  std::memset(table_, 0, size_ * sizeof(Bucket));
   age_ = 0;
   hashfull_ = 0;
 }
@@ -20,13 +20,22 @@
 #ifndef HASH_TABLE_H_
 #define HASH_TABLE_H_
 #include <memory>
+#include <string>
 #include <vector>
 #include "common/array.h"
 #include "hash_entry.h"
+#include "shared_memory.h"
 class Node;
 
 /**
  * 探索情報を保存するためのハッシュテーブル（トランスポジションテーブル）です.
+ *
+ * 通常は、プロセスごとに確保したメモリを用いますが、同じマシン上で動作するクラスタのワーカーどうしでは、
+ * マスターが作成した共有メモリ上のテーブルを共有することもできます（AttachSharedTable()を参照）。
+ * 共有メモリ上のテーブルへのアクセスは、スレッド間でテーブルを共有する場合と同様に、ロックを用いずに行います。
+ * エントリは一度にまとめて書き込むようにしていますが、他のプロセスやスレッドの書き込みと競合した場合には、
+ * 読み出したエントリが壊れている可能性があります。このため、ハッシュ手は、使用する前に必ず
+ * 擬似合法手であるかどうかを確認してください（MovePickerで確認しています）。
  */
 class HashTable {
  public:
@@ -88,9 +97,51 @@ class HashTable {
    */
   void SetSize(size_t megabytes);
 
+#if !defined(MINIMUM)
+  /**
+   * 複数のプロセスで共有するハッシュテーブルを、共有メモリ上に作成します（クラスタのマスター側）.
+   * @param memory    作成した共有メモリを保持する変数（共有メモリは、この変数が破棄されるまで有効）
+   * @param name      共有メモリの名前（"/"で始まる文字列）
+   * @param megabytes ハッシュテーブルの大きさ（メガバイト単位で指定）
+   * @return 作成に成功した場合はtrue
+   */
+  static bool CreateSharedTable(SharedMemory* memory, const char* name,
+                                size_t megabytes);
+
+  /**
+   * 共有メモリ上に作成されたハッシュテーブルを、このハッシュテーブルとして使用します（ワーカー側）.
+   * 失敗した場合は、ハッシュテーブルの状態は変わりません。
+   * @param name 共有メモリの名前
+   * @return 共有メモリ上のハッシュテーブルを使用できるようになった場合はtrue
+   */
+  bool AttachSharedTable(const char* name);
+
+  /**
+   * 共有メモリ上に作成したハッシュテーブルの内容を消去します（クラスタのマスター側）.
+   * ワーカーが探索を行っていない時点（新しい対局を始める前など）に呼び出してください。
+   * @param memory CreateSharedTable()で作成した共有メモリ
+   */
+  static void ClearSharedTable(SharedMemory* memory);
+
+  /**
+   * 共有メモリ上のハッシュテーブルの番号（USIオプションのSharedHashId）から、共有メモリの名前を返します.
+   */
+  static std::string SharedTableName(int id) {
+    return "/gikou-hash-" + std::to_string(id);
+  }
+
+  /**
+   * 共有メモリ上のハッシュテーブルを使用している場合は、trueを返します.
+   */
+  bool is_shared() const {
+    return shared_memory_.is_open();
+  }
+#endif
+
   /**
    * ハッシュテーブルの使用率をパーミル（千分率）で返します.
    * USIのinfoコマンドのhashfullにそのまま使うと便利です。
+   * なお、共有メモリ上のハッシュテーブルを使用している場合は、このプロセスが埋めたエントリのみを数えます。
    */
   int hashfull() const {
     return (UINT64_C(1000) * hashfull_) / (kBucketSize * size_);
@@ -106,8 +157,36 @@ class HashTable {
    */
   typedef Array<HashEntry, kBucketSize> Bucket;
 
-  /** ハッシュテーブルのポインタ */
-  std::unique_ptr<Bucket[]> table_;
+#if !defined(MINIMUM)
+  /**
+   * 共有メモリ上のハッシュテーブルの先頭に置くヘッダです.
+   * バケツは、ヘッダの直後（kSharedTableOffsetバイト目）から並べます。
+   */
+  struct SharedTableHeader {
+    uint64_t magic;
+    uint64_t size;
+  };
+  /** 共有メモリ上のハッシュテーブルであることを確認するための値（"GIKOUHT1"） */
+  static constexpr uint64_t kSharedTableMagic = UINT64_C(0x47494b4f55485431);
+  static constexpr size_t kSharedTableOffset = 64;
+  static_assert(sizeof(SharedTableHeader) <= kSharedTableOffset, "");
+#endif
+
+  /**
+   * 指定されたバケツの数に対応するメモリ領域を、ハッシュテーブルとして使用します.
+   */
+  void SetTable(Bucket* table, size_t size);
+
+  /** ハッシュテーブルのポインタ（private_table_または共有メモリの中を指す） */
+  Bucket* table_ = nullptr;
+
+  /** このプロセス専用に確保したハッシュテーブル */
+  std::unique_ptr<Bucket[]> private_table_;
+
+#if !defined(MINIMUM)
+  /** 複数のプロセスで共有しているハッシュテーブル */
+  SharedMemory shared_memory_;
+#endif
 
   /** ハッシュテーブルの要素数 */
   size_t size_;
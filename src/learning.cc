@@ -20,19 +20,32 @@
 #include "learning.h"
 
 #include <cinttypes>
+#include <csignal>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <algorithm>
 #include <fstream>
+#include <iterator>
+#include <memory>
 #include <random>
+#include <string>
 #include <thread>
+#include <type_traits>
+#include <valarray>
 #include <omp.h>
+#include "common/aligned_memory.h"
 #include "common/progress_timer.h"
 #include "evaluation.h"
 #include "gamedb.h"
+#include "mapped_file.h"
 #include "material.h"
 #include "movegen.h"
+#include "optimizer.h"
+#include "process.h"
 #include "progress.h"
 #include "search.h"
+#include "worker_topology.h"
 
 #if !defined(MINIMUM)
 
@@ -51,6 +64,17 @@ constexpr int kBatchSize = 8000;     // 勾配を計算するのに用いる局
 constexpr int kMinSearchDepth = 1; // PVを求めるために行われる探索の、最小深さ
 constexpr int kMaxSearchDepth = 2; // PVを求めるために行われる探索の、最大深さ
 
+// PVリーフの保存に関する設定
+// （kSearchInterval回のイテレーションに１回だけ探索を行い、それ以外のイテレーションでは、
+// 　保存しておいたPVのリーフノードを評価し直して勾配を計算する）
+constexpr int kSearchInterval = 32;                  // 何イテレーションごとにPVを求め直すか
+constexpr int kNumCachedPositions = 4 * kBatchSize;  // １回の探索でPVを求める局面の数
+constexpr const char* kPvLeafCacheFile = "learning_pv_cache.bin"; // PVリーフの保存先
+
+// チェックポイントの設定（学習を中断しても、途中から再開できるようにする）
+constexpr int kCheckpointInterval = 100; // 何イテレーションごとにチェックポイントを保存するか
+constexpr const char* kCheckpointFile = "learning_checkpoint.bin"; // チェックポイントの保存先
+
 // 損失関数の設定
 constexpr double kWinRateCoefficient = 100.0;   // 損失関数の第２項（勝率予測の誤差）に掛ける係数
 constexpr double kOscillationCoefficient = 0.1; // 損失関数の第３項（異なる深さ間の誤差）に掛ける係数
@@ -68,6 +92,251 @@ constexpr double kAveragedSgdDecay = 0.9995; // 指数移動平均の減衰率
 typedef ExtendedParamsBase ExtendedParams;
 typedef ExtendedParamsBase Gradient;
 
+// RMSpropの累積値（勾配の二乗の移動平均）をfloat型で保持する場合はtrue
+// （メモリ使用量とメモリ帯域が半分になる一方、学習結果はdouble型の場合と厳密には一致しなくなります。
+//   また、チェックポイントファイルは、double型とfloat型の間で互換性がありません）
+constexpr bool kUseFloatOptimizerState = false;
+
+// RMSpropの累積値の型を定義
+typedef std::conditional<kUseFloatOptimizerState, float, double>::type OptimizerState;
+
+/**
+ * スレッドごとの勾配を、疎な形式で保持するためのクラスです.
+ *
+ * Gradient（ExtendedParamsBase）を各スレッドで丸ごと確保すると、スレッド数に比例して
+ * 巨大なメモリが必要になるうえ、毎イテレーションのゼロクリアと集計にも時間がかかります。
+ * しかし実際には、１回のミニバッチで勾配がゼロ以外になるのは、パラメータのごく一部にすぎません。
+ * そこで、パラメータ全体を一定の大きさのブロックに分割し、実際に書き込まれたブロックだけを
+ * 割り当て・集計するようにしています。
+ *
+ * ミニバッチごとにブロックを確保・解放し直すと、そのたびにmalloc/freeが発生するため、
+ * 一度確保したブロックは解放せずに、ゼロクリアしたうえで空きブロックのリストに戻し、再利用します。
+ */
+class SparseGradient {
+ public:
+  /** １ブロックあたりの要素数（PackedWeight 256個 = 8KB） */
+  static constexpr size_t kBlockSize = 256;
+
+  typedef Array<PackedWeight, kBlockSize> Block;
+
+  /**
+   * 勾配をSparseGradientに書き込むためのファンクタです.
+   *
+   * ExtendedParamsBase::UpdateParams()のテンプレート引数として渡して使います。
+   * 次元下げ処理から渡されたパラメータへの参照を、レイアウト用のオブジェクト内での位置に変換して、
+   * 対応するブロックに書き込みます（レイアウト用のオブジェクト自体には、一切書き込みを行いません）。
+   */
+  class Updater {
+   public:
+    Updater(PackedWeight inc, const ExtendedParamsBase* layout,
+            SparseGradient* gradient)
+        : increment_(inc),
+          layout_begin_(reinterpret_cast<const PackedWeight*>(layout)),
+          gradient_(gradient) {
+    }
+    void apply(PackedWeight n, const PackedWeight& item) {
+      gradient_->at(&item - layout_begin_) += n * increment_;
+    }
+   private:
+    PackedWeight increment_;
+    const PackedWeight* layout_begin_;
+    SparseGradient* gradient_;
+  };
+
+  explicit SparseGradient(size_t size)
+      : blocks_((size + kBlockSize - 1) / kBlockSize, nullptr) {
+  }
+
+  /**
+   * i番目の要素への参照を返します（ブロックが未割り当ての場合は、ゼロクリア済みのブロックを割り当てます）.
+   */
+  PackedWeight& at(size_t i) {
+    const size_t block_id = i / kBlockSize;
+    assert(block_id < blocks_.size());
+    Block*& block = blocks_[block_id];
+    if (block == nullptr) {
+      block = AllocateBlock();
+      touched_blocks_.push_back(block_id);
+    }
+    return (*block)[i % kBlockSize];
+  }
+
+  /**
+   * 書き込みが行われたブロックだけをゼロクリアして空きブロックのリストに戻し、勾配をゼロに戻します.
+   */
+  void Clear() {
+    for (size_t block_id : touched_blocks_) {
+      Block* block = blocks_[block_id];
+      for (PackedWeight& w : *block) {
+        w = PackedWeight(0.0);
+      }
+      free_blocks_.push_back(block);
+      blocks_[block_id] = nullptr;
+    }
+    touched_blocks_.clear();
+  }
+
+  /**
+   * 指定されたブロックが割り当て済みであれば、そのポインタを返します（未割り当ての場合はnullptr）.
+   */
+  const Block* block(size_t block_id) const {
+    return blocks_[block_id];
+  }
+
+  /**
+   * これまでに書き込みが行われたブロックのIDを返します.
+   */
+  const std::vector<size_t>& touched_blocks() const {
+    return touched_blocks_;
+  }
+
+  size_t num_blocks() const {
+    return blocks_.size();
+  }
+
+ private:
+  /**
+   * ゼロクリア済みのブロックを、空きブロックのリストから取り出します（空きがなければ、新たに確保します）.
+   */
+  Block* AllocateBlock() {
+    if (!free_blocks_.empty()) {
+      Block* block = free_blocks_.back();
+      free_blocks_.pop_back();
+      return block;
+    }
+    // PackedWeightはAVX用に32バイトのアラインメントを要求するので、new演算子ではなくMakeAligned()で確保する
+    allocated_blocks_.push_back(MakeAligned<Block>());
+    Block* block = allocated_blocks_.back().get();
+    for (PackedWeight& w : *block) {
+      w = PackedWeight(0.0);
+    }
+    return block;
+  }
+
+  /** ブロックIDごとの、割り当て済みのブロック（未割り当ての場合はnullptr） */
+  std::vector<Block*> blocks_;
+
+  /** 書き込みが行われたブロックのID */
+  std::vector<size_t> touched_blocks_;
+
+  /** ゼロクリア済みで、再利用可能なブロック */
+  std::vector<Block*> free_blocks_;
+
+  /** これまでに確保したすべてのブロック（ブロックの所有権を持つ） */
+  std::vector<AlignedPtr<Block>> allocated_blocks_;
+};
+
+/**
+ * 各スレッドの疎な勾配を集計して、密な勾配に足し込みます.
+ * 集計するのは、いずれかのスレッドで書き込みが行われたブロックだけです。
+ * @return いずれかのスレッドで書き込みが行われたブロックのID
+ */
+std::vector<size_t> ReduceSparseGradients(const std::vector<SparseGradient>& sparse_gradients,
+                                          Gradient* const gradient) {
+  assert(gradient != nullptr);
+  assert(!sparse_gradients.empty());
+
+  // 1. いずれかのスレッドで書き込まれたブロックを列挙する
+  const size_t num_blocks = sparse_gradients.front().num_blocks();
+  std::vector<bool> is_touched(num_blocks, false);
+  std::vector<size_t> touched_blocks;
+  for (const SparseGradient& g : sparse_gradients) {
+    for (size_t block_id : g.touched_blocks()) {
+      if (!is_touched[block_id]) {
+        is_touched[block_id] = true;
+        touched_blocks.push_back(block_id);
+      }
+    }
+  }
+
+  // 2. ブロック単位で並列に集計する（各ブロックの書き込み先は重ならないので、排他制御は不要）
+  const size_t size = gradient->size();
+#pragma omp parallel for schedule(dynamic, 64)
+  for (size_t n = 0; n < touched_blocks.size(); ++n) {
+    const size_t block_id = touched_blocks[n];
+    const size_t begin = block_id * SparseGradient::kBlockSize;
+    const size_t end = std::min(begin + SparseGradient::kBlockSize, size);
+    for (const SparseGradient& g : sparse_gradients) {
+      const SparseGradient::Block* block = g.block(block_id);
+      if (block == nullptr) {
+        continue;
+      }
+      for (size_t i = begin; i < end; ++i) {
+        (*gradient)[i] += (*block)[i - begin];
+      }
+    }
+  }
+
+  return touched_blocks;
+}
+
+/**
+ * 勾配のうち、指定されたブロックだけを送信します（分散学習用）.
+ * @param gradient 送信する勾配
+ * @param blocks   送信するブロックのID
+ * @param write    データを書き込む関数（引数は、データの先頭へのポインタとバイト数）
+ */
+template<typename WriteFunction>
+void SendGradientBlocks(Gradient& gradient, const std::vector<size_t>& blocks,
+                        WriteFunction write) {
+  for (size_t block_id : blocks) {
+    const size_t begin = block_id * SparseGradient::kBlockSize;
+    const size_t length = std::min(SparseGradient::kBlockSize,
+                                   gradient.size() - begin);
+    const uint32_t header[2] = {static_cast<uint32_t>(block_id),
+                                static_cast<uint32_t>(length)};
+    write(header, sizeof(header));
+    write(&gradient[begin], sizeof(PackedWeight) * length);
+  }
+}
+
+/**
+ * SendGradientBlocks()で送信された勾配を受信して、勾配に足し込みます（分散学習用）.
+ * @param num_blocks 受信するブロックの数
+ * @param read       データを読み込む関数（引数は、読み込み先へのポインタとバイト数。成功時にtrueを返す。）
+ * @param gradient   受信した勾配の足し込み先
+ * @param is_touched 受信したブロックに印をつけるための配列
+ * @param touched    初めて受信したブロックのIDの追加先
+ * @return 受信に成功した場合はtrue
+ */
+template<typename ReadFunction>
+bool ReceiveGradientBlocks(size_t num_blocks, ReadFunction read,
+                           Gradient* const gradient,
+                           std::vector<bool>* const is_touched,
+                           std::vector<size_t>* const touched) {
+  assert(gradient != nullptr);
+  assert(is_touched != nullptr);
+  assert(touched != nullptr);
+
+  SparseGradient::Block buffer;
+  for (size_t n = 0; n < num_blocks; ++n) {
+    uint32_t header[2];
+    if (!read(header, sizeof(header))) {
+      return false;
+    }
+    const size_t block_id = header[0];
+    const size_t length = header[1];
+    const size_t begin = block_id * SparseGradient::kBlockSize;
+    if (   block_id >= is_touched->size()
+        || length > SparseGradient::kBlockSize
+        || begin + length > gradient->size()) {
+      return false;
+    }
+    if (!read(buffer.begin(), sizeof(PackedWeight) * length)) {
+      return false;
+    }
+    for (size_t i = 0; i < length; ++i) {
+      (*gradient)[begin + i] += buffer[i];
+    }
+    if (!(*is_touched)[block_id]) {
+      (*is_touched)[block_id] = true;
+      touched->push_back(block_id);
+    }
+  }
+
+  return true;
+}
+
 /**
  * 学習時の統計データをまとめて保存するためのクラスです.
  */
@@ -137,8 +406,7 @@ void ResetMaterialValues(ParamsType* const params) {
 std::vector<Game> ExtractGamesFromDatabase(const size_t num_games,
                                            const size_t begin = 0) {
   // 1. データベースを準備する
-  std::ifstream db_file(GameDatabase::kDefaultDatabaseFile);
-  GameDatabase game_db(db_file);
+  GameDatabase game_db;
   game_db.set_title_matches_only(true);
 
   // 2. 必要な数だけ、棋譜を抽出する
@@ -156,47 +424,209 @@ std::vector<Game> ExtractGamesFromDatabase(const size_t num_games,
 
 /*
  * 損失関数の勾配を更新します.
+ * @param layout   パラメータの配置を調べるためのオブジェクト（書き込みは行われません）
+ * @param gradient 更新対象の勾配
  */
 void UpdateGradient(const Position& pos, const double delta,
-                    Gradient* const gradient) {
+                    Gradient* const layout, SparseGradient* const gradient) {
+  assert(layout != nullptr);
   assert(gradient != nullptr);
   PsqList psq_list(pos);
   double progress = Progress::EstimateProgress(pos, psq_list);
-  gradient->UpdateParams(pos, psq_list, delta, progress);
+  layout->UpdateParams<SparseGradient::Updater>(pos, psq_list, delta, progress,
+                                                layout, gradient);
 }
 
 /**
- * １つの特定の局面について、損失関数の勾配を計算します.
+ * 学習局面１つ分について、すべての合法手のPV（リーフノードまでの手順）を保持するためのクラスです.
  *
- * なお、現在の実装では、評価関数の学習に用いる損失関数は、
- *    - 第1項: 棋譜の手との不一致率（idea from 激指）
- *    - 第2項: 勝率予測と勝敗との負の対数尤度（idea from 習甦）
- *    - 第3項: 浅い探索結果と深い探索結果との誤差（idea from 習甦）
- * の３つから構成されています。
+ * PVを求めるための探索には非常に時間がかかるので、探索結果はPvLeafCacheに保存しておき、
+ * 次に探索し直すまでの間は、保存されたPVのリーフノードを評価し直すだけで勾配を計算します。
  *
  * （参考文献）
- *   - 鶴岡慶雅: 「激指」の最近の改良について --コンピュータ将棋と機械学習--,
- *     『コンピュータ将棋の進歩６』, pp.77-81, 共立出版, 2012.
- *   - 竹内章: 習甦の誕生, 『人間に勝つコンピュータ将棋の作り方』, pp.184-189, 技術評論社, 2012.
- *   - 佐藤佳州: ゲームにおける棋譜の性質と強さの関係に基づいた学習, pp.66-67, 2014.
+ *   - 保木邦仁: 局面評価の学習を目指した探索結果の最適制御,
+ *     『第11回ゲームプログラミングワークショップ』, pp.78-83, 2006.
+ */
+struct PvLeaves {
+  Move teacher_move = kMoveNone; // 棋譜の手
+  double progress = 0.0;         // 局面の進行度（初期局面が0で、投了局面が1となる値）
+  Color winner = kBlack;         // その対局で勝った側の手番
+  int num_moves = 0;             // 合法手の数
+  std::vector<std::vector<Move>> pv_list; // 各合法手のPV（0番目は棋譜の手。ウィンドウ外の手は空）
+  std::valarray<double> scores;           // 各合法手の評価値（ウィンドウ外の手は-∞）
+};
+
+/**
+ * 探索で求めたPVのリーフノードを、ファイルに保存しておくためのクラスです.
  *
- * @param pos              損失関数の勾配を計算したい局面
+ * 各局面のデータは、
+ * <pre>
+ * RecordHeader, SFEN形式の局面（終端文字なし）, { PvHeader, 指し手(uint32_t) x PVの長さ } x PVの数
+ * </pre>
+ * という形式で、１つのファイルに連続して書き込まれます。
+ * 書き込んだファイルはメモリにマップして読み出すので、保存する局面数が多くてもメモリを圧迫しません。
+ */
+class PvLeafCache {
+ public:
+  /**
+   * 局面とPVを、１局面分のレコードに変換します.
+   */
+  static std::string Serialize(const Position& pos, const PvLeaves& leaves) {
+    const std::string sfen = pos.ToSfen();
+
+    RecordHeader header;
+    header.teacher_move = leaves.teacher_move.ToUint32();
+    header.progress = static_cast<float>(leaves.progress);
+    header.winner = static_cast<uint8_t>(leaves.winner);
+    header.reserved = 0;
+    header.sfen_length = static_cast<uint16_t>(sfen.size());
+    header.num_moves = static_cast<uint16_t>(leaves.num_moves);
+    header.num_pvs = 0;
+    for (const std::vector<Move>& pv : leaves.pv_list) {
+      header.num_pvs += !pv.empty();
+    }
+
+    std::string record;
+    record.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    record.append(sfen);
+    for (size_t i = 0; i < leaves.pv_list.size(); ++i) {
+      const std::vector<Move>& pv = leaves.pv_list.at(i);
+      if (pv.empty()) {
+        continue;
+      }
+      PvHeader pv_header;
+      pv_header.move_index = static_cast<uint16_t>(i);
+      pv_header.length = static_cast<uint16_t>(pv.size());
+      record.append(reinterpret_cast<const char*>(&pv_header), sizeof(pv_header));
+      for (Move move : pv) {
+        uint32_t u32 = move.ToUint32();
+        record.append(reinterpret_cast<const char*>(&u32), sizeof(u32));
+      }
+    }
+    return record;
+  }
+
+  /**
+   * レコードをファイルに書き込んだうえで、メモリにマップします.
+   * @param file_name 保存先のファイル名
+   * @param records   Serialize()で作成したレコードの配列
+   * @return 書き込みに成功した場合はtrue
+   */
+  bool WriteToFile(const char* file_name,
+                   const std::vector<std::string>& records) {
+    file_.Close();
+    offsets_.clear();
+
+    std::FILE* fp = std::fopen(file_name, "wb");
+    if (fp == nullptr) {
+      std::printf("Failed to open %s.\n", file_name);
+      return false;
+    }
+    size_t offset = 0;
+    for (const std::string& record : records) {
+      std::fwrite(record.data(), 1, record.size(), fp);
+      offsets_.push_back(offset);
+      offset += record.size();
+    }
+    std::fclose(fp);
+
+    if (offset != 0 && !file_.Open(file_name)) {
+      std::printf("Failed to map %s.\n", file_name);
+      offsets_.clear();
+      return false;
+    }
+    return true;
+  }
+
+  /**
+   * 保存されている局面の数を返します.
+   */
+  size_t size() const {
+    return offsets_.size();
+  }
+
+  /**
+   * i番目の局面を読み出します.
+   * @param i      読み出す局面の番号
+   * @param leaves PVの保存先（評価値は、すべて-∞に初期化される）
+   * @return 読み出した局面
+   */
+  Position Read(size_t i, PvLeaves* const leaves) const {
+    assert(i < size());
+    assert(leaves != nullptr);
+
+    const char* p = file_.data() + offsets_.at(i);
+    RecordHeader header;
+    std::memcpy(&header, p, sizeof(header));
+    p += sizeof(header);
+    Position pos = Position::FromSfen(std::string(p, header.sfen_length));
+    p += header.sfen_length;
+
+    leaves->teacher_move = Move::FromUint32(header.teacher_move);
+    leaves->progress = header.progress;
+    leaves->winner = static_cast<Color>(header.winner);
+    leaves->num_moves = header.num_moves;
+    leaves->pv_list.assign(header.num_moves, std::vector<Move>());
+    leaves->scores.resize(header.num_moves);
+    leaves->scores = -INFINITY;
+    for (int n = 0; n < header.num_pvs; ++n) {
+      PvHeader pv_header;
+      std::memcpy(&pv_header, p, sizeof(pv_header));
+      p += sizeof(pv_header);
+      std::vector<Move>& pv = leaves->pv_list.at(pv_header.move_index);
+      pv.resize(pv_header.length);
+      for (Move& move : pv) {
+        uint32_t u32;
+        std::memcpy(&u32, p, sizeof(u32));
+        move = Move::FromUint32(u32);
+        p += sizeof(u32);
+      }
+    }
+
+    return pos;
+  }
+
+ private:
+  struct RecordHeader {
+    uint32_t teacher_move;
+    float progress;
+    uint8_t winner;
+    uint8_t reserved;
+    uint16_t sfen_length;
+    uint16_t num_moves;
+    uint16_t num_pvs;
+  };
+
+  struct PvHeader {
+    uint16_t move_index;
+    uint16_t length;
+  };
+
+  MappedFile file_;
+  std::vector<size_t> offsets_;
+};
+
+/**
+ * １つの特定の局面について、すべての合法手を探索して、PVのリーフノードを求めます.
+ *
+ * @param pos              PVを求めたい局面
  * @param shared_data      探索中のデータ
  * @param teacher_move     教師とすべき、棋譜の手
  * @param progress         局面の進行度（初期局面が0で、投了局面が1となる値）
  * @param winner           その対局で勝った側の手番
  * @param mersenne_twister 乱数生成器（メルセンヌ・ツイスタ）
- * @param gradient         損失関数の勾配
- * @return 学習中の統計データ
+ * @param leaves           探索結果の保存先（学習に適さない局面の場合は、pv_listが空になる）
+ * @return 学習中の統計データ（探索ノード数のみ）
  */
-LearningStats ComputeGradient(Position& pos, SharedData& shared_data,
-                              const Move teacher_move, const double progress,
-                              const Color winner,
-                              std::mt19937& mersenne_twister,
-                              Gradient* const gradient) {
-  assert(gradient != nullptr);
+LearningStats SearchPvLeaves(Position& pos, SharedData& shared_data,
+                             const Move teacher_move, const double progress,
+                             const Color winner,
+                             std::mt19937& mersenne_twister,
+                             PvLeaves* const leaves) {
+  assert(leaves != nullptr);
 
   LearningStats stats;
+  leaves->pv_list.clear();
 
   // 棋譜の手が、非合法手または飛角の不成などの場合は、学習の対象としない
   if (!pos.MoveIsLegal(teacher_move) || teacher_move.IsInferior()) {
@@ -236,8 +666,6 @@ LearningStats ComputeGradient(Position& pos, SharedData& shared_data,
   Score alpha = -kScoreKnownWin;
   const Score beta = kScoreKnownWin;
   Score best_score = -kScoreInfinite;
-  Move best_move = kMoveNone;
-  double num_pvs = 0.0;
   for (size_t i = 0; i < legal_moves.size(); ++i) {
     const Move move = legal_moves[i].move;
 
@@ -261,12 +689,7 @@ LearningStats ComputeGradient(Position& pos, SharedData& shared_data,
 
     // 詰みを見つけた場合は探索を打ち切る（学習に適さないと考えられるため）
     if (score >= kScoreKnownWin || (move == teacher_move && score <= alpha)) {
-      stats.loss              = 0.0;
-      stats.num_positions     = 0;
-      stats.num_right_answers = 0;
-      stats.num_moves         = 0;
-      stats.num_samples       = 0;
-      stats.num_nodes         = search.num_nodes_searched();
+      stats.num_nodes = search.num_nodes_searched();
       return stats;
     }
 
@@ -277,7 +700,6 @@ LearningStats ComputeGradient(Position& pos, SharedData& shared_data,
       for (Move m : search.pv_table()) {
         pv_list.at(i).push_back(m);
       }
-      num_pvs += 1.0;
     } else {
       scores[i] = -INFINITY; // ウィンドウを外れたことを示すため、スコアを-∞とする
     }
@@ -288,7 +710,106 @@ LearningStats ComputeGradient(Position& pos, SharedData& shared_data,
         alpha = std::max(score - margin, -kScoreKnownWin);
       }
       best_score = score;
-      best_move = move;
+    }
+  }
+
+  leaves->teacher_move = teacher_move;
+  leaves->progress = progress;
+  leaves->winner = winner;
+  leaves->num_moves = legal_moves.size();
+  leaves->pv_list = std::move(pv_list);
+  leaves->scores = scores;
+  stats.num_nodes = search.num_nodes_searched();
+
+  return stats;
+}
+
+/**
+ * 保存されているPVのリーフノードを、現在のパラメータで評価し直します.
+ *
+ * PVは探索時のものをそのまま使うので、探索し直した場合とは厳密には一致しませんが、
+ * パラメータの変化が小さいうちは、探索結果のよい近似になります。
+ * また、探索時と同様に、棋譜の手の評価値からマージンを引いた値を下回った手は、
+ * αβ探索のウィンドウを外れたものとみなして、PVを取り除きます。
+ *
+ * @param pos    PVの始点となる局面
+ * @param leaves 評価し直す対象のPV（scoresとpv_listが更新される）
+ */
+void ReevaluatePvLeaves(Position& pos, PvLeaves* const leaves) {
+  assert(leaves != nullptr);
+
+  const Color root_side = pos.side_to_move();
+  const int margin = static_cast<int>(10.0 + 256.0 * leaves->progress);
+  for (size_t i = 0; i < leaves->pv_list.size(); ++i) {
+    std::vector<Move>& pv = leaves->pv_list.at(i);
+    if (pv.empty()) {
+      continue;
+    }
+    // リーフノードへ移動する
+    for (Move m : pv) {
+      pos.MakeMove(m);
+    }
+    // ルート局面の手番から見た評価値を求める
+    Score score = Evaluation::Evaluate(pos);
+    leaves->scores[i] = pos.side_to_move() == root_side ? score : -score;
+    // 元の局面に戻る
+    for (auto it = pv.rbegin(); it != pv.rend(); ++it) {
+      pos.UnmakeMove(*it);
+    }
+    // ウィンドウを外れた手は、探索時と同様にPVを持たないものとする（0番目は棋譜の手なので除外しない）
+    if (i != 0 && leaves->scores[i] <= leaves->scores[0] - margin) {
+      leaves->scores[i] = -INFINITY;
+      pv.clear();
+    }
+  }
+}
+
+/**
+ * １つの特定の局面について、損失関数の勾配を計算します.
+ *
+ * なお、現在の実装では、評価関数の学習に用いる損失関数は、
+ *    - 第1項: 棋譜の手との不一致率（idea from 激指）
+ *    - 第2項: 勝率予測と勝敗との負の対数尤度（idea from 習甦）
+ *    - 第3項: 浅い探索結果と深い探索結果との誤差（idea from 習甦）
+ * の３つから構成されています。
+ *
+ * （参考文献）
+ *   - 鶴岡慶雅: 「激指」の最近の改良について --コンピュータ将棋と機械学習--,
+ *     『コンピュータ将棋の進歩６』, pp.77-81, 共立出版, 2012.
+ *   - 竹内章: 習甦の誕生, 『人間に勝つコンピュータ将棋の作り方』, pp.184-189, 技術評論社, 2012.
+ *   - 佐藤佳州: ゲームにおける棋譜の性質と強さの関係に基づいた学習, pp.66-67, 2014.
+ *
+ * @param pos      損失関数の勾配を計算したい局面
+ * @param leaves   その局面におけるすべての合法手のPVと、その評価値
+ * @param layout   パラメータの配置を調べるためのオブジェクト（書き込みは行われません）
+ * @param gradient 損失関数の勾配
+ * @return 学習中の統計データ
+ */
+LearningStats ComputeGradient(Position& pos, const PvLeaves& leaves,
+                              Gradient* const layout,
+                              SparseGradient* const gradient) {
+  assert(layout != nullptr);
+  assert(gradient != nullptr);
+  assert(!leaves.pv_list.empty() && !leaves.pv_list.front().empty());
+
+  LearningStats stats;
+
+  const std::vector<std::vector<Move>>& pv_list = leaves.pv_list;
+  const std::valarray<double>& scores = leaves.scores;
+  const double progress = leaves.progress;
+  const Color winner = leaves.winner;
+  const int margin = static_cast<int>(10.0 + 256.0 * progress);
+  Node node(pos);
+
+  // PVの数と、最善手を求める
+  double num_pvs = 0.0;
+  size_t best_index = 0;
+  for (size_t i = 0; i < pv_list.size(); ++i) {
+    if (!pv_list.at(i).empty()) {
+      num_pvs += 1.0;
+      if (scores[i] > scores[best_index]) {
+        best_index = i;
+      }
     }
   }
 
@@ -338,7 +859,7 @@ LearningStats ComputeGradient(Position& pos, SharedData& shared_data,
           pos.MakeMove(m);
         }
         // 勾配のアップデート
-        UpdateGradient(pos, delta, gradient);
+        UpdateGradient(pos, delta, layout, gradient);
         stats.num_samples += 1;
         // 元の局面に戻る
         for (auto it = pv_list.at(i).rbegin(); it != pv_list.at(i).rend(); ++it) {
@@ -376,7 +897,7 @@ LearningStats ComputeGradient(Position& pos, SharedData& shared_data,
     // 勾配の更新を行う
     double d = c * kGain * (y - t);
     double delta = pos.side_to_move() == kBlack ? d : -d;
-    UpdateGradient(pos, delta, gradient);
+    UpdateGradient(pos, delta, layout, gradient);
 
     // 損失値を計算する
     stats.win_rate_loss = c * -(t * std::log(y) + (1.0 - t) * std::log(1.0 - y));
@@ -425,13 +946,13 @@ LearningStats ComputeGradient(Position& pos, SharedData& shared_data,
 
     // 親局面の勾配のアップデート
     pos.MakeMove(move);
-    UpdateGradient(pos, delta_y, gradient);
+    UpdateGradient(pos, delta_y, layout, gradient);
 
     // 子局面の勾配のアップデート
     for (auto it = pv_list.at(i).begin() + 1; it != pv_list.at(i).end(); ++it) {
       pos.MakeMove(*it);
     }
-    UpdateGradient(pos, delta_t, gradient);
+    UpdateGradient(pos, delta_t, layout, gradient);
     for (auto it = pv_list.at(i).rbegin(); it != pv_list.at(i).rend(); ++it) {
       pos.UnmakeMove(*it);
     }
@@ -443,9 +964,8 @@ LearningStats ComputeGradient(Position& pos, SharedData& shared_data,
   }
 
   stats.num_positions     = 1;
-  stats.num_right_answers = (best_move == teacher_move);
-  stats.num_moves         = legal_moves.size();
-  stats.num_nodes         = search.num_nodes_searched();
+  stats.num_right_answers = (best_index == 0);
+  stats.num_moves         = leaves.num_moves;
 
   return stats;
 }
@@ -461,48 +981,38 @@ LearningStats ComputeGradient(Position& pos, SharedData& shared_data,
  *     http://web.stanford.edu/~jduchi/projects/DuchiSi09c_slides.pdf, p.12, 2009.
  */
 LearningStats UpdateParams(std::unique_ptr<Gradient>& gradient,
-                           std::unique_ptr<Gradient>& accumulated_gradient,
+                           std::vector<OptimizerState>& accumulated_gradient,
                            std::unique_ptr<ExtendedParams>& params) {
   if (kVerboseMessage) {
     std::printf("Update params.\n");
   }
 
-  double l1_penalty = 0.0;
-
-#pragma omp parallel for reduction(+:l1_penalty) schedule(static)
-  for (size_t i = 0; i < gradient->size(); ++i) {
-    auto& v = *(params->begin() + i);
-    auto& a = *(accumulated_gradient->begin() + i);
-    auto g = *(gradient->begin() + i);
-
-    // ペナルティ項の現在の値を計算する（駒割にはペナルティをかけない）
-    if (i >= gradient->size_of_material()) {
-      for (size_t j = 0; j < v.size(); ++j) {
-        l1_penalty += std::abs(v[j]);
-      }
-    }
-
-    // 更新幅の設定（RMSprop）
-    a = a * kRmsPropDecay + (g * g);
-    const Pack<double, 4> eta = kRmsPropStepRate / (a + kRmsPropEpsilon).apply(std::sqrt);
-
-    // パラメータを更新（坂を下る）
-    v -= eta * g;
-
-    // 駒割り以外のパラメータについてのみ、ペナルティをかける（FOBOS）
-    if (i >= gradient->size_of_material()) {
-      auto ramp = [](double x) -> double {
-        return std::max(x, 0.0);
-      };
-      v = v.apply(math::sign) * (v.apply(std::abs) - eta * kL1Penalty).apply(ramp);
-    }
-  }
+  // パラメータを、double型の連続した配列として扱う
+  constexpr size_t kPackSize = sizeof(PackedWeight) / sizeof(double);
+  const size_t size = kPackSize * gradient->size();
+  const size_t size_of_material = kPackSize * gradient->size_of_material();
+  assert(accumulated_gradient.size() == size);
+  const double* g = reinterpret_cast<const double*>(gradient->begin());
+  OptimizerState* a = accumulated_gradient.data();
+  double* v = reinterpret_cast<double*>(params->begin());
+
+  // 駒割り以外のパラメータについてのみ、ペナルティをかける（FOBOS）
+  Optimizer::RmsPropConfig config;
+  config.step_rate = kRmsPropStepRate;
+  config.decay = kRmsPropDecay;
+  config.epsilon = kRmsPropEpsilon;
+  config.l1_penalty = 0.0;
+  Optimizer::UpdateRmsProp(config, g, a, v, size_of_material);
+  config.l1_penalty = kL1Penalty;
+  const Optimizer::Norms norms = Optimizer::UpdateRmsProp(
+      config, g + size_of_material, a + size_of_material,
+      v + size_of_material, size - size_of_material);
 
   // 歩の価値を１００点に固定する
   params->material[kPawn] = 100.0;
 
   LearningStats stats;
-  stats.penalty = kL1Penalty * l1_penalty;
+  stats.penalty = kL1Penalty * norms.l1;
 
   return stats;
 }
@@ -809,241 +1319,830 @@ double ComputeAccuracy(const std::vector<Game>& games) {
   return static_cast<double>(sum_accuracy) / num_positions;
 }
 
-} // namespace
+/**
+ * 標準入力から１行読み込みます（分散学習のワーカー用）.
+ * @return EOFまで読み込んだときは、false。まだ残りの行があるときは、true。
+ */
+bool GetLineFromStdin(std::string* const line) {
+  line->clear();
+  for (int c; (c = std::getchar()) != EOF;) {
+    if (c == '\n') return true;
+    line->push_back(static_cast<char>(c));
+  }
+  return false;
+}
 
-void Learning::LearnEvaluationParameters() {
-  // スレッド数の設定
-  const int num_threads = std::max(1U, std::thread::hardware_concurrency());
-  omp_set_num_threads(num_threads);
-  std::printf("Set num_threads = %d\n", num_threads);
+/**
+ * 評価関数パラメータの学習を行うクラスです.
+ *
+ * 通常の学習（単一プロセス）では、１つのLearnerが、棋譜の読み込みから勾配の計算、
+ * パラメータの更新までのすべてを行います。
+ *
+ * 分散学習（複数プロセス）では、以下のように役割を分担します。
+ *   - コーディネータ: ワーカーから受け取った勾配を集約してパラメータを更新し、
+ *                     ログやチェックポイントを保存する（パラメータサーバ）。
+ *   - ワーカー:       担当する棋譜の局面について勾配を計算して、コーディネータに送る。
+ *                     コーディネータから集約済みの勾配を受け取り、同じ更新を行うことで、
+ *                     コーディネータとパラメータを同期させる。
+ */
+class Learner {
+ public:
+  enum Role {
+    kStandalone,  // 単一プロセスで学習する
+    kCoordinator, // 分散学習のコーディネータ
+    kWorker,      // 分散学習のワーカー
+  };
 
-  // データベースから棋譜を読み込む（学習用と、交差検定用の2つがある）
-  std::printf("Extract the games from the database.\n");
-  const std::vector<Game> games = ExtractGamesFromDatabase(kNumGames, 0);
-  const std::vector<Game> test_set = ExtractGamesFromDatabase(kNumTestSet, kNumGames);
+  /**
+   * @param role        このプロセスの役割
+   * @param num_threads 使用するスレッド数
+   * @param worker_id   ワーカーの番号（0からnum_workers-1まで）
+   * @param num_workers ワーカーの総数
+   */
+  Learner(Role role, int num_threads, int worker_id = 0, int num_workers = 1);
+
+  /**
+   * 棋譜DBから、学習用と交差検定用の棋譜を読み込みます.
+   * ワーカーは、学習用の棋譜のうち、自分の担当する棋譜だけを読み込みます。
+   */
+  void LoadGames();
+
+  /**
+   * 勾配やパラメータを初期化します.
+   */
+  void InitializeParams();
+
+  /**
+   * チェックポイントを読み込み、保存時点のパラメータを復元します.
+   * @param iteration 保存時点で完了していたイテレーション数
+   * @return 読み込みに成功した場合はtrue
+   */
+  bool LoadCheckpoint(int* iteration);
+
+  /**
+   * 現在のパラメータを、チェックポイントとして保存します.
+   * @param iteration 完了したイテレーション数
+   * @return 保存に成功した場合はtrue
+   */
+  bool SaveCheckpoint(int iteration) const;
+
+  /**
+   * ログファイルをクリアします.
+   */
+  void ClearLogFiles() const;
+
+  /**
+   * ミニバッチの勾配を計算して、gradient()に格納します.
+   * @param iteration      現在のイテレーション数
+   * @param batch_size     ミニバッチの大きさ
+   * @param stats          学習時の統計データの足し込み先
+   * @param touched_blocks 勾配に書き込みが行われたブロックのIDの格納先（不要な場合はnullptr）
+   * @return 計算に成功した場合はtrue
+   */
+  bool ComputeMinibatchGradient(int iteration, int batch_size,
+                                LearningStats* stats,
+                                std::vector<size_t>* touched_blocks);
+
+  /**
+   * gradient()に格納された勾配を利用して、パラメータを更新します.
+   */
+  LearningStats ApplyGradient();
+
+  /**
+   * 学習の途中経過を、画面やファイルに出力します.
+   * kCheckpointIntervalごとに、平均化パラメータの保存、交差検定、チェックポイントの保存も行います。
+   * @return 出力に成功した場合はtrue
+   */
+  bool ReportProgress(int iteration, const LearningStats& stats);
+
+  Gradient* gradient() {
+    return gradient_.get();
+  }
 
-  // 全局面にIDを割り振る（あとで局面のシャッフルを行うため）
+ private:
+  /**
+   * 局面のIDです（あとで局面のシャッフルを行うため、全局面にIDを割り振っています）.
+   */
   struct PositionId {
     PositionId(int g, int p) : game_id(g), ply(p) {}
     int game_id;
     int ply;
   };
-  std::vector<PositionId> position_ids;
-  for (size_t i = 0; i < games.size(); ++i) {
-    for (size_t j = 0; j < games.at(i).moves.size(); ++j) {
-      position_ids.emplace_back(i, j);
-    }
+
+  /**
+   * チェックポイントファイルのヘッダです.
+   */
+  struct CheckpointHeader {
+    char magic[4];       // "GKLC"
+    uint32_t version;
+    int32_t iteration;   // 完了したイテレーション数
+    uint32_t state_size; // RMSpropの累積値１要素あたりのバイト数
+    uint64_t params_size; // パラメータ１セットあたりのバイト数
+  };
+
+  static constexpr char kCheckpointMagic[4] = {'G', 'K', 'L', 'C'};
+  static constexpr uint32_t kCheckpointVersion = 1;
+
+  bool SearchPvLeavesOfPositions(LearningStats* stats);
+
+  const Role role_;
+  const int num_threads_;
+  const int worker_id_;
+  const int num_workers_;
+  std::vector<Game> games_;
+  std::vector<Game> test_set_;
+  std::vector<PositionId> position_ids_;
+  std::vector<std::mt19937> mersenne_twisters_;
+  std::unique_ptr<Gradient> gradient_;
+  std::vector<OptimizerState> accumulated_gradient_;
+  std::unique_ptr<ExtendedParams> current_params_;
+  std::unique_ptr<ExtendedParams> accumulated_params_;
+  std::vector<SparseGradient> thread_local_gradient_;
+  std::vector<SharedData> shared_data_;
+  PvLeafCache pv_leaf_cache_;
+  std::string pv_leaf_cache_file_;
+  bool has_pv_leaves_ = false;
+};
+
+constexpr char Learner::kCheckpointMagic[4];
+constexpr uint32_t Learner::kCheckpointVersion;
+
+Learner::Learner(Role role, int num_threads, int worker_id, int num_workers)
+    : role_(role),
+      num_threads_(num_threads),
+      worker_id_(worker_id),
+      num_workers_(num_workers),
+      pv_leaf_cache_file_(kPvLeafCacheFile) {
+  assert(num_threads >= 1);
+  assert(0 <= worker_id && worker_id < num_workers);
+
+  // 複数のワーカーが同じディレクトリで動くため、PVリーフの保存先はワーカーごとに分ける
+  if (role_ == kWorker) {
+    pv_leaf_cache_file_ += "." + std::to_string(worker_id_);
   }
 
   // 乱数発生器（メルセンヌ・ツイスタ）の準備
   std::random_device rd;
-  std::vector<std::mt19937> mersenne_twisters;
-  for (int i = 0; i < num_threads; ++i) {
-    mersenne_twisters.emplace_back(rd());
-  }
-
-  // 勾配やパラメータを初期化する
-  std::unique_ptr<Gradient> gradient(new Gradient);
-  std::unique_ptr<Gradient> accumulated_gradient(new Gradient);
-  std::unique_ptr<ExtendedParams> current_params(new ExtendedParams);
-  std::unique_ptr<ExtendedParams> accumulated_params(new ExtendedParams);
-  std::vector<Gradient> thread_local_gradient(num_threads);
-  std::vector<SharedData> shared_data(num_threads);
+  for (int i = 0; i < num_threads_; ++i) {
+    mersenne_twisters_.emplace_back(rd());
+  }
+}
+
+void Learner::LoadGames() {
+  std::printf("Extract the games from the database.\n");
+
+  // データベースから棋譜を読み込む（学習用と、交差検定用の2つがある）
+  if (role_ != kCoordinator) {
+    std::vector<Game> games = ExtractGamesFromDatabase(kNumGames, 0);
+    for (size_t i = worker_id_; i < games.size(); i += num_workers_) {
+      games_.push_back(std::move(games.at(i)));
+    }
+  }
+  if (role_ != kWorker) {
+    test_set_ = ExtractGamesFromDatabase(kNumTestSet, kNumGames);
+  }
+
+  // 全局面にIDを割り振る（あとで局面のシャッフルを行うため）
+  for (size_t i = 0; i < games_.size(); ++i) {
+    for (size_t j = 0; j < games_.at(i).moves.size(); ++j) {
+      position_ids_.emplace_back(i, j);
+    }
+  }
+}
+
+void Learner::InitializeParams() {
+  gradient_.reset(new Gradient);
+  current_params_.reset(new ExtendedParams);
   g_eval_params->Clear();
-  accumulated_gradient->Clear();
-  current_params->Clear();
-  accumulated_params->Clear();
-  ResetMaterialValues(current_params.get());
-  CopyParams(current_params);
-  for (auto& s : shared_data) {
-    s.hash_table.SetSize(64);
+  accumulated_gradient_.assign(gradient_->size() * sizeof(PackedWeight) / sizeof(double), 0);
+  current_params_->Clear();
+  ResetMaterialValues(current_params_.get());
+  CopyParams(current_params_);
+
+  // 平均化パラメータは、パラメータを保存するプロセスだけが持つ
+  if (role_ != kWorker) {
+    accumulated_params_.reset(new ExtendedParams);
+    accumulated_params_->Clear();
   }
 
-  // ログファイルのクリア
-  {
-    std::FILE* fp = std::fopen("learning_log.txt", "w");
+  // 勾配の計算を行うプロセスだけが、スレッドごとの勾配と置換表を持つ
+  if (role_ != kCoordinator) {
+    shared_data_ = std::vector<SharedData>(num_threads_);
+    for (auto& s : shared_data_) {
+      s.hash_table.SetSize(64);
+    }
+    for (int i = 0; i < num_threads_; ++i) {
+      thread_local_gradient_.emplace_back(gradient_->size());
+    }
+  }
+}
+
+bool Learner::LoadCheckpoint(int* const iteration) {
+  assert(iteration != nullptr);
+
+  std::FILE* fp = std::fopen(kCheckpointFile, "rb");
+  if (fp == nullptr) {
+    std::printf("Failed to open %s.\n", kCheckpointFile);
+    return false;
+  }
+
+  CheckpointHeader header;
+  bool success = std::fread(&header, sizeof(header), 1, fp) == 1
+              && std::memcmp(header.magic, kCheckpointMagic, 4) == 0
+              && header.version == kCheckpointVersion
+              && header.state_size == sizeof(OptimizerState)
+              && header.params_size == sizeof(ExtendedParams)
+              && std::fread(current_params_.get(), sizeof(ExtendedParams), 1, fp) == 1
+              && std::fread(accumulated_gradient_.data(), sizeof(OptimizerState),
+                            accumulated_gradient_.size(), fp) == accumulated_gradient_.size();
+  if (success && accumulated_params_) {
+    success = std::fread(accumulated_params_.get(), sizeof(ExtendedParams), 1, fp) == 1;
+  }
+  std::fclose(fp);
+
+  if (!success) {
+    std::printf("%s is broken or incompatible.\n", kCheckpointFile);
+    return false;
+  }
+
+  *iteration = header.iteration;
+  CopyParams(current_params_);
+  std::printf("Resume learning from iteration %d.\n", header.iteration + 1);
+  return true;
+}
+
+bool Learner::SaveCheckpoint(const int iteration) const {
+  assert(accumulated_params_);
+
+  // 書き込み途中で中断されても前回のチェックポイントが壊れないよう、一時ファイルに書き込んでから置き換える
+  const std::string temp_file = std::string(kCheckpointFile) + ".tmp";
+  std::FILE* fp = std::fopen(temp_file.c_str(), "wb");
+  if (fp == nullptr) {
+    std::printf("Failed to open %s.\n", temp_file.c_str());
+    return false;
+  }
+
+  CheckpointHeader header;
+  std::memcpy(header.magic, kCheckpointMagic, 4);
+  header.version = kCheckpointVersion;
+  header.iteration = iteration;
+  header.state_size = sizeof(OptimizerState);
+  header.params_size = sizeof(ExtendedParams);
+  bool success = std::fwrite(&header, sizeof(header), 1, fp) == 1
+              && std::fwrite(current_params_.get(), sizeof(ExtendedParams), 1, fp) == 1
+              && std::fwrite(accumulated_gradient_.data(), sizeof(OptimizerState),
+                             accumulated_gradient_.size(), fp) == accumulated_gradient_.size()
+              && std::fwrite(accumulated_params_.get(), sizeof(ExtendedParams), 1, fp) == 1;
+  success = (std::fclose(fp) == 0) && success;
+
+  if (!success || std::rename(temp_file.c_str(), kCheckpointFile) != 0) {
+    std::printf("Failed to write %s.\n", kCheckpointFile);
+    return false;
+  }
+
+  std::printf("Wrote checkpoint to %s\n", kCheckpointFile);
+  return true;
+}
+
+void Learner::ClearLogFiles() const {
+  for (const char* file_name : {"learning_log.txt", "learning_material.txt"}) {
+    std::FILE* fp = std::fopen(file_name, "w");
     if (fp == nullptr) {
-      std::printf("Failed to open learning_log.txt.\n");
+      std::printf("Failed to open %s.\n", file_name);
+      continue;
     }
     std::fclose(fp);
   }
+}
+
+bool Learner::SearchPvLeavesOfPositions(LearningStats* const stats) {
+  if (kVerboseMessage) {
+    std::printf("Search PV leaves...\n");
+  }
+
+  // PVを求める局面をシャッフルする（復元抽出）
+  // 分散学習時は、全ワーカー合計でkNumCachedPositions局面になるようにする
+  const size_t num_positions = std::min(size_t(kNumCachedPositions / num_workers_),
+                                        position_ids_.size());
+  for (size_t i = 0; i < num_positions; ++i) {
+    std::uniform_int_distribution<size_t> dis(i, position_ids_.size() - 1);
+    auto begin = position_ids_.begin();
+    std::iter_swap(begin + i, begin + dis(mersenne_twisters_.front()));
+  }
+
+  // 置換表をクリアする
+#pragma omp parallel for schedule(static, 1)
+  for (int i = 0; i < num_threads_; ++i) {
+    shared_data_.at(i).hash_table.Clear();
+  }
+
+  // 各局面のPVを求める
+  const Position kStartPosition = Position::CreateStartPosition();
+  std::vector<std::vector<std::string>> thread_local_records(num_threads_);
+#pragma omp parallel for schedule(dynamic)
+  for (size_t i = 0; i < num_positions; ++i) {
+    const Game& game = games_.at(position_ids_.at(i).game_id);
+    const int ply = position_ids_.at(i).ply;
+
+    // 学習局面に移動する
+    Position pos = kStartPosition;
+    for (int j = 0; j < ply; ++j) {
+      pos.MakeMove(game.moves.at(j));
+    }
+
+    // PVを求める
+    int thread_id = omp_get_thread_num();
+    Move teacher_move = game.moves.at(ply);
+    double progress = double(ply) / double(game.moves.size());
+    Color winner = game.result == Game::kBlackWin ? kBlack : kWhite;
+    PvLeaves leaves;
+    auto temp = SearchPvLeaves(pos, shared_data_.at(thread_id),
+                               teacher_move, progress, winner,
+                               mersenne_twisters_.at(thread_id), &leaves);
+    if (!leaves.pv_list.empty()) {
+      thread_local_records.at(thread_id).push_back(
+          PvLeafCache::Serialize(pos, leaves));
+    }
+#pragma omp critical
+    *stats += temp;
+  }
+
+  // PVをファイルに保存する
+  std::vector<std::string> records;
+  for (std::vector<std::string>& r : thread_local_records) {
+    std::move(r.begin(), r.end(), std::back_inserter(records));
+  }
+  if (!pv_leaf_cache_.WriteToFile(pv_leaf_cache_file_.c_str(), records)) {
+    return false;
+  }
+  std::printf("Cached PV leaves of %d positions.\n",
+              static_cast<int>(pv_leaf_cache_.size()));
+  has_pv_leaves_ = true;
+
+  return true;
+}
+
+bool Learner::ComputeMinibatchGradient(const int iteration,
+                                       const int batch_size,
+                                       LearningStats* const stats,
+                                       std::vector<size_t>* const touched_blocks) {
+  assert(role_ != kCoordinator);
+  assert(stats != nullptr);
+
+  // kSearchInterval回に１回、探索を行ってPVのリーフノードを求め直す
+  // （学習を再開した直後は、PVリーフが保存されていないので、必ず探索を行う）
+  if ((iteration - 1) % kSearchInterval == 0 || !has_pv_leaves_) {
+    if (!SearchPvLeavesOfPositions(stats)) {
+      return false;
+    }
+  }
+
+  // 勾配を計算する準備をする
+#pragma omp parallel for schedule(static, 1)
+  for (int i = 0; i < num_threads_; ++i) {
+    thread_local_gradient_.at(i).Clear();
+  }
+
+  // 保存されたPVリーフを使って、勾配を計算する
+  if (kVerboseMessage) {
+    std::printf("Compute Gradient...\n");
+  }
+  const int num_samples = pv_leaf_cache_.size() != 0 ? batch_size : 0;
+#pragma omp parallel for schedule(dynamic)
+  for (int i = 0; i < num_samples; ++i) {
+    int thread_id = omp_get_thread_num();
+
+    // 学習に使う局面を選ぶ（復元抽出）
+    std::uniform_int_distribution<size_t> dis(0, pv_leaf_cache_.size() - 1);
+    PvLeaves leaves;
+    Position pos = pv_leaf_cache_.Read(dis(mersenne_twisters_.at(thread_id)),
+                                       &leaves);
+
+    // 現在のパラメータで、PVのリーフノードを評価し直す
+    ReevaluatePvLeaves(pos, &leaves);
+
+    // 勾配を計算する
+    auto temp = ComputeGradient(pos, leaves, gradient_.get(),
+                                &thread_local_gradient_.at(thread_id));
+#pragma omp critical
+    *stats += temp;
+  }
+
+  // 各スレッドの勾配を集約する（書き込みのあったブロックのみ）
+  gradient_->Clear();
+  std::vector<size_t> blocks = ReduceSparseGradients(thread_local_gradient_,
+                                                     gradient_.get());
+  if (touched_blocks != nullptr) {
+    *touched_blocks = std::move(blocks);
+  }
+
+  return true;
+}
+
+LearningStats Learner::ApplyGradient() {
+  // 勾配を利用して、パラメータを更新する
+  if (kVerboseMessage) {
+    std::printf("Update the evaluation parameters...\n");
+  }
+  LearningStats stats = UpdateParams(gradient_, accumulated_gradient_,
+                                     current_params_);
+  CopyParams(current_params_);
+
+  // 後で平均化パラメータを求めるために、現在のパラメータを足し込んでおく
+  if (accumulated_params_) {
+#pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < accumulated_params_->size(); ++i) {
+      (*accumulated_params_)[i] *= kAveragedSgdDecay;
+      (*accumulated_params_)[i] += (*current_params_)[i];
+    }
+  }
+
+  return stats;
+}
+
+bool Learner::ReportProgress(const int iteration, const LearningStats& stats) {
+  assert(role_ != kWorker);
+
+  if (iteration % kCheckpointInterval == 0) {
+    // 平均化パラメータを求める
+    // ここでは、より直近のデータを重視するため、「指数移動平均」を使っている。
+    // （参考文献）
+    //     Wikipedia: 移動平均, https://ja.wikipedia.org/wiki/移動平均.
+    std::unique_ptr<ExtendedParams> average(new ExtendedParams);
+    *average = *accumulated_params_;
+    double denominator = (1.0 - std::pow(kAveragedSgdDecay, iteration)) / (1.0 - kAveragedSgdDecay);
+    Pack<double, 4> reciprocal(1.0 / denominator);
+    for (size_t i = 0; i < average->size(); ++i) {
+      (*average)[i] *= reciprocal;
+    }
+
+    // 平均化パラメータの表示
+    PrintParams(average, 0);
+    PrintParams(average, 1);
+    PrintParams(average, 2);
+
+    // ファイル保存＆一致率計算には、平均化パラメータを使用
+    CopyParams(average);
+
+    // 平均化パラメータをファイルに保存する
+    std::FILE* fp_params = std::fopen("params.bin", "wb");
+    if (fp_params == nullptr) {
+      std::printf("Failed to open params.bin.\n");
+      return false;
+    }
+    std::fwrite(g_eval_params.get(), sizeof(EvalParameters), 1, fp_params);
+    std::fclose(fp_params);
+    std::printf("Wrote parameters to params.bin\n");
+
+    // 交差検定を行い、棋譜の手との一致率を計算する
+    std::printf("Perform the cross validation...\n");
+    double accuracy = ComputeAccuracy(test_set_);
+
+    // ファイル保存＆一致率計算後は、元のパラメータに戻す
+    CopyParams(current_params_);
+
+    // 学習を途中から再開できるように、チェックポイントを保存する
+    if (!SaveCheckpoint(iteration)) {
+      return false;
+    }
+
+    // 学習時の統計データをログファイルに出力する
+    std::FILE* fp_log = std::fopen("learning_log.txt", "a");
+    if (fp_log == nullptr) {
+      std::printf("Failed to open learning_log.txt.\n");
+      return false;
+    }
+    std::fprintf(fp_log,
+                 "%d loss=%.0f penalty=%.1f wr_l=%.1f wr_e=%f o_l=%.1f o_e=%.1f o_s=%.0f accuracy=%f prediction=%f pos=%d moves=%d samples=%d nodes=%d\n",
+                 iteration,
+                 stats.loss,
+                 stats.penalty,
+                 stats.win_rate_loss,
+                 std::sqrt(stats.win_rate_error / stats.win_rate_samples),
+                 stats.oscillation_loss,
+                 std::sqrt(stats.oscillation_error / stats.oscillation_samples),
+                 stats.oscillation_samples,
+                 accuracy,
+                 (double)stats.num_right_answers / stats.num_positions,
+                 stats.num_positions,
+                 stats.num_moves,
+                 stats.num_samples,
+                 stats.num_nodes);
+    std::fclose(fp_log);
+  }
+
+  // 学習途中の駒割りの値をファイルに出力する
   {
-    std::FILE* fp = std::fopen("learning_material.txt", "w");
+    std::FILE* fp = std::fopen("learning_material.txt", "a");
     if (fp == nullptr) {
       std::printf("Failed to open learning_material.txt.\n");
+      return false;
+    }
+    std::fprintf(fp, "%d", iteration);
+    for (PieceType pt : Piece::all_piece_types()) {
+      std::fprintf(fp, " %d", static_cast<int>(Material::value(pt)));
     }
+    std::fprintf(fp, "\n");
     std::fclose(fp);
   }
 
+  // 学習中の統計データを画面に表示する
+  std::printf("%d loss=%.0f penalty=%.1f wr_l=%.1f wr_e=%f o_l=%.1f o_e=%.1f o_s=%.0f prediction=%f pos=%d moves=%d samples=%d nodes=%d\n",
+              iteration,
+              stats.loss,
+              stats.penalty,
+              stats.win_rate_loss,
+              std::sqrt(stats.win_rate_error / stats.win_rate_samples),
+              stats.oscillation_loss,
+              std::sqrt(stats.oscillation_error / stats.oscillation_samples),
+              stats.oscillation_samples,
+              (double)stats.num_right_answers / stats.num_positions,
+              stats.num_positions,
+              stats.num_moves,
+              stats.num_samples,
+              stats.num_nodes);
+
+  return true;
+}
+
+/**
+ * ワーカーから、指定された文字列で始まる行を受信するまで読み込みます.
+ * それ以外の行は、ワーカーからのメッセージとして画面に表示します。
+ * @return 受信に成功した場合はtrue。ワーカーが終了していた場合はfalse。
+ */
+bool WaitForWorker(Process& worker, const int worker_id,
+                   const std::string& prefix, std::string* const line) {
+  while (worker.GetLine(line)) {
+    if (line->compare(0, prefix.size(), prefix) == 0) {
+      return true;
+    }
+    std::printf("worker%d: %s\n", worker_id, line->c_str());
+  }
+  std::printf("Worker %d terminated unexpectedly.\n", worker_id);
+  return false;
+}
+
+} // namespace
+
+void Learning::LearnEvaluationParameters(const bool resume) {
+  // スレッド数の設定
+  const int num_threads = std::max(1U, std::thread::hardware_concurrency());
+  omp_set_num_threads(num_threads);
+  std::printf("Set num_threads = %d\n", num_threads);
+
+  Learner learner(Learner::kStandalone, num_threads);
+  learner.LoadGames();
+  learner.InitializeParams();
+
+  // チェックポイントから再開する場合は、保存時点のパラメータを復元する
+  int last_iteration = 0;
+  if (resume) {
+    if (!learner.LoadCheckpoint(&last_iteration)) {
+      return;
+    }
+  } else {
+    learner.ClearLogFiles();
+  }
+
   // 学習のイテレーションを開始する
-  for (int iteration = 1; iteration <= kNumIteration; ++iteration) {
+  for (int iteration = last_iteration + 1; iteration <= kNumIteration; ++iteration) {
     if (kVerboseMessage) {
       std::printf("Start new iteration: %d\n", iteration);
     }
 
-    // 学習に使う局面をシャッフルする（復元抽出）
-    for (int i = 0; i < kBatchSize; ++i) {
-      std::uniform_int_distribution<size_t> dis(i, position_ids.size() - 1);
-      auto begin = position_ids.begin();
-      std::iter_swap(begin + i, begin + dis(mersenne_twisters.front()));
+    LearningStats stats;
+    if (!learner.ComputeMinibatchGradient(iteration, kBatchSize, &stats, nullptr)) {
+      break;
+    }
+    stats += learner.ApplyGradient();
+    if (!learner.ReportProgress(iteration, stats)) {
+      break;
     }
+  }
 
-    // 勾配を計算する準備をする
-#pragma omp parallel for schedule(static, 1)
-    for (int i = 0; i < num_threads; ++i) {
-      thread_local_gradient.at(i).Clear();
-      shared_data.at(i).hash_table.Clear();
+  std::printf("Congratulations! Learning is successfully finished!\n");
+}
+
+void Learning::LearnEvaluationParametersDistributed(const char* const program_name,
+                                                    int num_workers,
+                                                    const bool resume) {
+  assert(num_workers >= 1);
+
+  // learning.txtがあれば、ワーカーの構成を読み込む（ワーカーの数は、ファイルの記述に従う）
+  std::vector<WorkerConfig> topology;
+  WorkerConfig coordinator;
+  coordinator.role = WorkerConfig::kMaster;
+  WorkerTopology worker_topology(num_workers, coordinator);
+  if (worker_topology.ReadFromFile("learning.txt")) {
+    for (size_t i = 0; i + 1 < worker_topology.size(); ++i) {
+      topology.push_back(worker_topology.at(i));
     }
+    num_workers = static_cast<int>(topology.size());
+    std::printf("%d workers are configured in learning.txt.\n", num_workers);
+  }
 
-    // 勾配を計算する
-    if (kVerboseMessage) {
-      std::printf("Compute Gradient...\n");
+  // スレッド数の設定（ワーカーには、スレッドを均等に割り当てる）
+  const int num_threads = std::max(1U, std::thread::hardware_concurrency());
+  const int num_worker_threads = std::max(1, num_threads / num_workers);
+  omp_set_num_threads(num_threads);
+  std::printf("Set num_workers = %d, num_threads = %d (per worker)\n",
+              num_workers, num_worker_threads);
+
+  // ワーカーが異常終了した場合に、書き込みエラーでコーディネータが終了しないようにする
+  std::signal(SIGPIPE, SIG_IGN);
+
+  Learner learner(Learner::kCoordinator, num_threads, 0, num_workers);
+  learner.LoadGames();
+  learner.InitializeParams();
+
+  // チェックポイントから再開する場合は、保存時点のパラメータを復元する
+  int last_iteration = 0;
+  if (resume) {
+    if (!learner.LoadCheckpoint(&last_iteration)) {
+      return;
     }
-    const Position kStartPosition = Position::CreateStartPosition();
-    LearningStats stats;
-#pragma omp parallel for schedule(dynamic)
-    for (int i = 0; i < kBatchSize; ++i) {
-      const Game& game = games.at(position_ids.at(i).game_id);
-      const int ply = position_ids.at(i).ply;
-
-      // 学習局面に移動する
-      Position pos = kStartPosition;
-      for (int j = 0; j < ply; ++j) {
-        pos.MakeMove(game.moves.at(j));
+  } else {
+    learner.ClearLogFiles();
+  }
+
+  // ワーカーを起動する
+  // learning.txtがあれば、そこに記述されたコマンドでワーカーを起動する（ssh経由でリモートマシン上に起動できる）
+  // なければ、ローカルマシン上で、このプログラム自身をワーカーとして起動する
+  std::vector<Process> workers(num_workers);
+  for (int i = 0; i < num_workers; ++i) {
+    const bool use_topology = !topology.empty();
+    const int threads = use_topology && topology.at(i).threads > 0
+                      ? topology.at(i).threads : num_worker_threads;
+    std::vector<std::string> args = {"--learn-worker",
+                                     std::to_string(i),
+                                     std::to_string(num_workers),
+                                     std::to_string(threads)};
+    if (resume) {
+      args.push_back("resume");
+    }
+    if (use_topology) {
+      // シェルを経由して起動する（execにより、シェルのプロセスはワーカーに置き換えられる）
+      std::string command = "exec " + topology.at(i).command;
+      for (const std::string& arg : args) {
+        command += " " + arg;
       }
+      args = {"/bin/sh", "-c", command};
+    } else {
+      args.insert(args.begin(), program_name);
+    }
+    std::vector<char*> argv;
+    for (std::string& arg : args) {
+      argv.push_back(&arg[0]);
+    }
+    argv.push_back(nullptr);
+    const std::vector<int> cpus = use_topology ? topology.at(i).cpus : std::vector<int>();
+    if (workers.at(i).StartProcess(argv.front(), argv.data(), cpus) < 0) {
+      std::printf("Failed to start worker %d.\n", i);
+      return;
+    }
+  }
 
-      // 勾配を計算する
-      int thread_id = omp_get_thread_num();
-      Move teacher_move = game.moves.at(ply);
-      double progress = double(ply) / double(game.moves.size());
-      Color winner = game.result == Game::kBlackWin ? kBlack : kWhite;
-      auto temp = ComputeGradient(pos, shared_data.at(thread_id),
-                                  teacher_move, progress, winner,
-                                  mersenne_twisters.at(thread_id),
-                                  &thread_local_gradient.at(thread_id));
-#pragma omp critical
-      stats += temp;
+  // 全ワーカーの準備が整うまで待つ
+  bool success = true;
+  for (int i = 0; i < num_workers && success; ++i) {
+    std::string line;
+    success = WaitForWorker(workers.at(i), i, "ready", &line);
+  }
+
+  // 学習のイテレーションを開始する
+  Gradient* const gradient = learner.gradient();
+  const size_t num_blocks = (gradient->size() + SparseGradient::kBlockSize - 1)
+                          / SparseGradient::kBlockSize;
+  std::vector<bool> is_touched(num_blocks, false);
+  for (int iteration = last_iteration + 1;
+       iteration <= kNumIteration && success;
+       ++iteration) {
+    if (kVerboseMessage) {
+      std::printf("Start new iteration: %d\n", iteration);
+    }
+
+    // 1. 各ワーカーに、ミニバッチを分割して勾配の計算を依頼する
+    for (int i = 0; i < num_workers; ++i) {
+      int batch_size = kBatchSize / num_workers + (i < kBatchSize % num_workers);
+      workers.at(i).Printf("gradient %d %d\n", iteration, batch_size);
     }
 
-    // 各スレッドの勾配を集約する
+    // 2. 各ワーカーから勾配を受け取り、集約する（集約の順序はワーカーの番号順で固定）
+    LearningStats stats;
+    std::vector<size_t> touched_blocks;
     gradient->Clear();
-#pragma omp parallel for schedule(static)
-    for (size_t i = 0; i < gradient->size(); ++i) {
-      for (int j = 0; j < num_threads; ++j) {
-        (*gradient)[i] += thread_local_gradient[j][i];
-      }
+    std::fill(is_touched.begin(), is_touched.end(), false);
+    for (int i = 0; i < num_workers && success; ++i) {
+      Process& worker = workers.at(i);
+      std::string line;
+      LearningStats worker_stats;
+      auto read = [&](void* data, size_t size) {
+        return worker.Read(data, size);
+      };
+      success = WaitForWorker(worker, i, "gradient ", &line)
+             && worker.Read(&worker_stats, sizeof(worker_stats))
+             && ReceiveGradientBlocks(std::strtoul(line.c_str() + 9, nullptr, 10),
+                                      read, gradient, &is_touched,
+                                      &touched_blocks);
+      stats += worker_stats;
+    }
+    if (!success) {
+      std::printf("Failed to receive the gradient.\n");
+      break;
     }
 
-    // 勾配を利用して、パラメータを更新する
-    if (kVerboseMessage) {
-      std::printf("Update the evaluation parameters...\n");
+    // 3. 集約した勾配を全ワーカーに送る（ワーカーも同じ更新を行い、パラメータを同期させる）
+    std::sort(touched_blocks.begin(), touched_blocks.end());
+    std::string message;
+    SendGradientBlocks(*gradient, touched_blocks,
+                       [&](const void* data, size_t size) {
+      message.append(static_cast<const char*>(data), size);
+    });
+    for (Process& worker : workers) {
+      worker.Printf("update %d\n", static_cast<int>(touched_blocks.size()));
+      worker.Write(message.data(), message.size());
     }
-    stats += UpdateParams(gradient, accumulated_gradient, current_params);
-    CopyParams(current_params);
 
-    // 後で平均化パラメータを求めるために、現在のパラメータを足し込んでおく
-#pragma omp parallel for schedule(static)
-    for (size_t i = 0; i < accumulated_params->size(); ++i) {
-      (*accumulated_params)[i] *= kAveragedSgdDecay;
-      (*accumulated_params)[i] += (*current_params)[i];
-    }
-
-    if (iteration % 100 == 0) {
-      // 平均化パラメータを求める
-      // ここでは、より直近のデータを重視するため、「指数移動平均」を使っている。
-      // （参考文献）
-      //     Wikipedia: 移動平均, https://ja.wikipedia.org/wiki/移動平均.
-      std::unique_ptr<ExtendedParams> average(new ExtendedParams);
-      *average = *accumulated_params;
-      double denominator = (1.0 - std::pow(kAveragedSgdDecay, iteration)) / (1.0 - kAveragedSgdDecay);
-      Pack<double, 4> reciprocal(1.0 / denominator);
-      for (size_t i = 0; i < average->size(); ++i) {
-        (*average)[i] *= reciprocal;
-      }
+    // 4. パラメータを更新し、途中経過を出力する
+    stats += learner.ApplyGradient();
+    if (!learner.ReportProgress(iteration, stats)) {
+      break;
+    }
+  }
 
-      // 平均化パラメータの表示
-      PrintParams(average, 0);
-      PrintParams(average, 1);
-      PrintParams(average, 2);
+  // ワーカーを終了させる
+  for (Process& worker : workers) {
+    worker.PrintLine("quit");
+  }
+  for (Process& worker : workers) {
+    worker.WaitFor();
+  }
 
-      // ファイル保存＆一致率計算には、平均化パラメータを使用
-      CopyParams(average);
+  if (success) {
+    std::printf("Congratulations! Learning is successfully finished!\n");
+  }
+}
 
-      // 平均化パラメータをファイルに保存する
-      std::FILE* fp_params = std::fopen("params.bin", "wb");
-      if (fp_params == nullptr) {
-        std::printf("Failed to open params.bin.\n");
-        break;
-      }
-      std::fwrite(g_eval_params.get(), sizeof(EvalParameters), 1, fp_params);
-      std::fclose(fp_params);
-      std::printf("Wrote parameters to params.bin\n");
+void Learning::RunLearningWorker(const int worker_id, const int num_workers,
+                                 const int num_threads, const bool resume) {
+  omp_set_num_threads(num_threads);
+
+  Learner learner(Learner::kWorker, num_threads, worker_id, num_workers);
+  learner.LoadGames();
+  learner.InitializeParams();
+  if (resume) {
+    int last_iteration;
+    if (!learner.LoadCheckpoint(&last_iteration)) {
+      return;
+    }
+  }
 
-      // 交差検定を行い、棋譜の手との一致率を計算する
-       std::printf("Perform the cross validation...\n");
-      double accuracy = ComputeAccuracy(test_set);
+  // 準備ができたことを、コーディネータに伝える
+  std::printf("ready\n");
+  std::fflush(stdout);
 
-      // ファイル保存＆一致率計算後は、元のパラメータに戻す
-      CopyParams(current_params);
+  auto read = [](void* data, size_t size) {
+    return std::fread(data, 1, size, stdin) == size;
+  };
+  auto write = [](const void* data, size_t size) {
+    std::fwrite(data, 1, size, stdout);
+  };
 
-      // 学習時の統計データをログファイルに出力する
-      std::FILE* fp_log = std::fopen("learning_log.txt", "a");
-      if (fp_log == nullptr) {
-        std::printf("Failed to open learning_log.txt.\n");
+  Gradient* const gradient = learner.gradient();
+  const size_t num_blocks = (gradient->size() + SparseGradient::kBlockSize - 1)
+                          / SparseGradient::kBlockSize;
+  std::vector<bool> is_touched(num_blocks, false);
+  std::vector<size_t> touched_blocks;
+
+  for (std::string line; GetLineFromStdin(&line);) {
+    int iteration, batch_size, num_updated_blocks;
+    if (std::sscanf(line.c_str(), "gradient %d %d", &iteration, &batch_size) == 2) {
+      // 勾配を計算して、コーディネータに送る
+      LearningStats stats;
+      std::vector<size_t> blocks;
+      if (!learner.ComputeMinibatchGradient(iteration, batch_size, &stats, &blocks)) {
         break;
       }
-      std::fprintf(fp_log,
-                   "%d loss=%.0f penalty=%.1f wr_l=%.1f wr_e=%f o_l=%.1f o_e=%.1f o_s=%.0f accuracy=%f prediction=%f pos=%d moves=%d samples=%d nodes=%d\n",
-                   iteration,
-                   stats.loss,
-                   stats.penalty,
-                   stats.win_rate_loss,
-                   std::sqrt(stats.win_rate_error / stats.win_rate_samples),
-                   stats.oscillation_loss,
-                   std::sqrt(stats.oscillation_error / stats.oscillation_samples),
-                   stats.oscillation_samples,
-                   accuracy,
-                   (double)stats.num_right_answers / stats.num_positions,
-                   stats.num_positions,
-                   stats.num_moves,
-                   stats.num_samples,
-                   stats.num_nodes);
-      std::fclose(fp_log);
-    }
-
-    // 学習途中の駒割りの値をファイルに出力する
-    {
-      std::FILE* fp = std::fopen("learning_material.txt", "a");
-      if (fp == nullptr) {
-        std::printf("Failed to open learning_material.txt.\n");
-        break;
+      std::printf("gradient %d\n", static_cast<int>(blocks.size()));
+      write(&stats, sizeof(stats));
+      SendGradientBlocks(*gradient, blocks, write);
+      std::fflush(stdout);
+    } else if (std::sscanf(line.c_str(), "update %d", &num_updated_blocks) == 1) {
+      // 集約済みの勾配を受け取り、パラメータを更新する
+      gradient->Clear();
+      for (size_t block_id : touched_blocks) {
+        is_touched[block_id] = false;
       }
-      std::fprintf(fp, "%d", iteration);
-      for (PieceType pt : Piece::all_piece_types()) {
-        std::fprintf(fp, " %d", static_cast<int>(Material::value(pt)));
+      touched_blocks.clear();
+      if (!ReceiveGradientBlocks(num_updated_blocks, read, gradient,
+                                 &is_touched, &touched_blocks)) {
+        break;
       }
-      std::fprintf(fp, "\n");
-      std::fclose(fp);
-    }
-
-    // 学習中の統計データを画面に表示する
-    std::printf("%d loss=%.0f penalty=%.1f wr_l=%.1f wr_e=%f o_l=%.1f o_e=%.1f o_s=%.0f prediction=%f pos=%d moves=%d samples=%d nodes=%d\n",
-                iteration,
-                stats.loss,
-                stats.penalty,
-                stats.win_rate_loss,
-                std::sqrt(stats.win_rate_error / stats.win_rate_samples),
-                stats.oscillation_loss,
-                std::sqrt(stats.oscillation_error / stats.oscillation_samples),
-                stats.oscillation_samples,
-                (double)stats.num_right_answers / stats.num_positions,
-                stats.num_positions,
-                stats.num_moves,
-                stats.num_samples,
-                stats.num_nodes);
+      learner.ApplyGradient();
+    } else if (line == "quit") {
+      break;
+    }
   }
-
-  std::printf("Congratulations! Learning is successfully finished!\n");
 }
 
 #endif // !defined(MINIMUM)
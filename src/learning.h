@@ -37,8 +37,39 @@ class Learning {
  public:
   /**
    * 評価関数パラメータの学習を開始します.
+   * @param resume trueの場合は、保存されたチェックポイントから学習を再開する
    */
-  static void LearnEvaluationParameters();
+  static void LearnEvaluationParameters(bool resume = false);
+
+  /**
+   * 複数のプロセスを用いて、評価関数パラメータの学習を開始します（分散学習）.
+   *
+   * このプロセスはコーディネータ（パラメータサーバ）となり、num_workers個のワーカープロセスを起動します。
+   * 各ワーカーは、棋譜を分担してミニバッチの勾配を計算し、コーディネータはそれらを集約して
+   * パラメータを更新します。
+   *
+   * カレントディレクトリにlearning.txtがある場合は、クラスタのcluster.txtと同じ形式
+   * （WorkerTopologyクラスを参照）で記述されたワーカーの構成に従って、ワーカーを起動します。
+   * 各ワーカーは、記述されたコマンドの末尾に"--learn-worker"以下の引数を付けて起動されるので、
+   * ssh host1 "cd gikou/bin && ./release"のようにすれば、リモートマシン上でワーカーを動かせます
+   * （ワーカーの作業ディレクトリにも、同じ棋譜と初期パラメータを置いておく必要があります）。
+   * なお、通信はワーカーの標準入出力のパイプを介して行われます。
+   * また、ハッシュの欄は無視され、masterの行は、コーディネータ自身を表すものとして読み飛ばされます。
+   *
+   * @param program_name ワーカーとして起動するプログラムのファイル名（通常は、このプログラム自身）
+   * @param num_workers  ワーカーの数（learning.txtがある場合は、その記述が優先されます）
+   * @param resume       trueの場合は、保存されたチェックポイントから学習を再開する
+   */
+  static void LearnEvaluationParametersDistributed(const char* program_name,
+                                                   int num_workers,
+                                                   bool resume = false);
+
+  /**
+   * 分散学習のワーカーとして動作します.
+   * 標準入出力を介して、コーディネータと通信します。
+   */
+  static void RunLearningWorker(int worker_id, int num_workers, int num_threads,
+                                bool resume);
 };
 
 /**
@@ -622,17 +653,22 @@ struct ExtendedParamsBase {
   /**
    * パラメータをdelta分だけ更新します.
    * 具体的には、損失関数の勾配の計算等に使用されます。
+   *
+   * テンプレート引数で更新用のファンクタを指定すると、このオブジェクト自体を書き換える代わりに、
+   * そのファンクタに更新を委ねることができます（例えば、疎な勾配へ書き込む場合など）。
+   * その場合、ファンクタのコンストラクタには、更新幅に続けて、argsがそのまま渡されます。
    */
+  template<typename UpdaterType = Updater, typename... Args>
   void UpdateParams(const Position& pos, const PsqList& list,
-                    const double delta, const double progress) {
+                    const double delta, const double progress, Args... args) {
     const Color stm = pos.side_to_move();
     const Square bk = pos.king_square(kBlack);
     const Square wk = Square::rotate180(pos.king_square(kWhite));
 
     PackedWeight coefficient3x1 = GetProgressCoefficient3x1(progress);
     PackedWeight coefficient2x2 = GetProgressCoefficient2x2(progress, stm);
-    Updater updater3x1(coefficient3x1 * delta);
-    Updater updater2x2(coefficient2x2 * delta);
+    UpdaterType updater3x1(coefficient3x1 * delta, args...);
+    UpdaterType updater2x2(coefficient2x2 * delta, args...);
 
     // 1. ２駒の関係
     for (const PsqPair* i = list.begin(); i != list.end(); ++i) {
@@ -660,7 +696,7 @@ struct ExtendedParamsBase {
     // 5. 手番
     // 注：手番の価値は、実際には２倍されるので、ここでは半分にしておく。
     // 　　EvalDetail::ComputeFinalScore()も参照。
-    Updater tempo_updater(coefficient3x1 * delta);
+    UpdaterType tempo_updater(coefficient3x1 * delta, args...);
     PackedWeight sign(stm == kBlack ? 0.5 : -0.5);
     tempo_updater.apply(sign, tempo);
   }
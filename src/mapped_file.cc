@@ -0,0 +1,75 @@
+/*
+ * 技巧 (Gikou), a USI shogi (Japanese chess) playing engine.
+ * Copyright (C) 2016 Yosuke Demura
+ * except where otherwise indicated.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#if !defined(MINIMUM)
+
+#include "mapped_file.h"
+
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::~MappedFile() {
+  Close();
+}
+
+bool MappedFile::Open(const char* const file_name) {
+  Close();
+
+  // 1. ファイルを開く
+  int fd = open(file_name, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+
+  // 2. ファイルサイズを調べる
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) < 0 || file_stat.st_size == 0) {
+    close(fd);
+    return false;
+  }
+
+  // 3. メモリにマップする（マップ後は、ファイルディスクリプタを閉じてもよい）
+  size_t size = static_cast<size_t>(file_stat.st_size);
+  void* addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    std::perror("mmap() failed.\n");
+    return false;
+  }
+
+  // 4. 先頭から順番に読み出すことが多いので、先読みを促しておく
+  madvise(addr, size, MADV_SEQUENTIAL);
+
+  data_ = static_cast<const char*>(addr);
+  size_ = size;
+  return true;
+}
+
+void MappedFile::Close() {
+  if (data_ != nullptr) {
+    munmap(const_cast<char*>(data_), size_);
+    data_ = nullptr;
+    size_ = 0;
+  }
+}
+
+#endif /* !defined(MINIMUM) */
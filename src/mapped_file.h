@@ -0,0 +1,78 @@
+/*
+ * 技巧 (Gikou), a USI shogi (Japanese chess) playing engine.
+ * Copyright (C) 2016 Yosuke Demura
+ * except where otherwise indicated.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MAPPED_FILE_H_
+#define MAPPED_FILE_H_
+
+#include <cstddef>
+
+/**
+ * ファイルを読み込み専用でメモリにマップするためのクラスです.
+ *
+ * 棋譜DBや学習データなど、サイズの大きなバイナリファイルを、
+ * ストリームを経由せずに直接メモリ上のデータとして読み出すために使用します。
+ * mmap()を利用しているため、原則としてUNIX系OSでのみ使用可能です。
+ */
+class MappedFile {
+ public:
+  MappedFile() {}
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  /**
+   * ファイルを開いて、メモリにマップします.
+   * @param file_name マップするファイルの名前
+   * @return マップに成功した場合はtrue
+   */
+  bool Open(const char* file_name);
+
+  /**
+   * マップを解除して、ファイルを閉じます.
+   */
+  void Close();
+
+  /**
+   * ファイルがマップされている場合は、trueを返します.
+   */
+  bool is_open() const {
+    return data_ != nullptr;
+  }
+
+  /**
+   * マップされたデータの先頭を返します.
+   */
+  const char* data() const {
+    return data_;
+  }
+
+  /**
+   * マップされたデータのサイズ（バイト数）を返します.
+   */
+  size_t size() const {
+    return size_;
+  }
+
+ private:
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+};
+
+#endif /* MAPPED_FILE_H_ */
@@ -29,6 +29,7 @@
 #include "gamedb.h"
 #include "movegen.h"
 #include "move_feature.h"
+#include "optimizer.h"
 #include "position.h"
 #include "progress.h"
 #include "search.h"
@@ -119,8 +120,7 @@ void ExtractGamesFromDatabase(std::vector<Game>* teacher_data,
   assert(test_data != nullptr);
 
   // 1. データベースファイルを開く
-  std::ifstream game_db_file(GameDatabase::kDefaultDatabaseFile);
-  GameDatabase game_db(game_db_file);
+  GameDatabase game_db;
 
   // 2. テストデータの読み込み
   // （まずテストデータから読み込むことで、教師データの数に関わらずテストデータを統一することができる）
@@ -286,43 +286,35 @@ void UpdateWeights(const Weights& gradients, Weights& accumulated_gradients,
                    LearningStats* const stats) {
   assert(stats != nullptr);
 
-  double lasso = 0.0;
-  double tikhonov = 0.0;
-
-#pragma omp parallel for reduction(+:lasso, tikhonov) schedule(static)
-  for (size_t i = 0; i < gradients.size(); ++i) {
-    PackedWeight& w = g_weights[i];
-    PackedWeight& r = accumulated_gradients[i];
-    PackedWeight& s = accumulated_deltas[i];
-    PackedWeight& v = momentum[i];
-    PackedWeight gradient = gradients[i];
-
-    // 損失を計算する
-    lasso    += kL1Penalty * HorizontalAdd(w.apply(std::abs));
-    tikhonov += kL2Penalty * HorizontalAdd(w * w);
-
-    // 勾配方向に移動する（AdaDelta + Momentum）
-    r = kDecay * r + (1.0 - kDecay) * (gradient * gradient);
-    PackedWeight eta = s.apply(std::sqrt) / (r + kEpsilon).apply(std::sqrt);
-    v = kMomentum * v - (1.0 - kMomentum) * eta * gradient;
-    s = kDecay * s + (1.0 - kDecay) * (v * v);
-    w = w + v;
-
-    // ペナルティをかける（FOBOS）
-    // （参考文献）
-    //   - John Duchi, Yoram Singer: Efficient Learning with Forward-Backward Splitting,
-    //     http://web.stanford.edu/~jduchi/projects/DuchiSi09c_slides.pdf,
-    //     pp.12-13, 2009.
-    //   - Zachary C. Lipton, Charles Elkan: Efficient Elastic Net Regularization for Sparse Linear Models,
-    //     http://zacklipton.com/media/papers/lazy-updates-elastic-net-lipton2015_1.pdf,
-    //     p.9, 2015.
-    auto ramp = [](double x) -> double {
-      return std::max(x, 0.0);
-    };
-    PackedWeight lambda1 = eta * kL1Penalty;
-    PackedWeight lambda2 = eta * kL2Penalty;
-    w = w.apply(math::sign) * ((w.apply(std::abs) - lambda1) / (1.0 + lambda2)).apply(ramp);
-  }
+  // 重みを、double型の連続した配列として扱う
+  constexpr size_t kPackSize = sizeof(PackedWeight) / sizeof(double);
+  auto data = [](const Weights& w) -> const double* {
+    return reinterpret_cast<const double*>(&w[0]);
+  };
+  auto mutable_data = [](Weights& w) -> double* {
+    return reinterpret_cast<double*>(&w[0]);
+  };
+
+  // 勾配方向に移動し（AdaDelta + Momentum）、ペナルティをかける（FOBOS）
+  // （参考文献）
+  //   - John Duchi, Yoram Singer: Efficient Learning with Forward-Backward Splitting,
+  //     http://web.stanford.edu/~jduchi/projects/DuchiSi09c_slides.pdf,
+  //     pp.12-13, 2009.
+  //   - Zachary C. Lipton, Charles Elkan: Efficient Elastic Net Regularization for Sparse Linear Models,
+  //     http://zacklipton.com/media/papers/lazy-updates-elastic-net-lipton2015_1.pdf,
+  //     p.9, 2015.
+  Optimizer::AdaDeltaConfig config;
+  config.decay = kDecay;
+  config.momentum = kMomentum;
+  config.epsilon = kEpsilon;
+  config.l1_penalty = kL1Penalty;
+  config.l2_penalty = kL2Penalty;
+  const Optimizer::Norms norms = Optimizer::UpdateAdaDelta(
+      config, data(gradients), mutable_data(accumulated_gradients),
+      mutable_data(accumulated_deltas), mutable_data(momentum),
+      mutable_data(g_weights), kPackSize * gradients.size());
+  const double lasso = kL1Penalty * norms.l1;
+  const double tikhonov = kL2Penalty * norms.l2;
 
   // 統計情報の記録
   stats->lasso_loss = lasso;
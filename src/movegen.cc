@@ -43,6 +43,12 @@ template<Color kColor> struct Generator<kCaptures, kColor> {
 template<Color kColor> struct Generator<kQuiets, kColor> {
   static ExtMove* GenerateMoves(const Position&, ExtMove*);
 };
+template<Color kColor> struct Generator<kNonDropQuiets, kColor> {
+  static ExtMove* GenerateMoves(const Position&, ExtMove*);
+};
+template<Color kColor> struct Generator<kDrops, kColor> {
+  static ExtMove* GenerateMoves(const Position&, ExtMove*);
+};
 template<Color kColor> struct Generator<kEvasions, kColor> {
   static ExtMove* GenerateMoves(const Position&, ExtMove*);
 };
@@ -941,13 +947,13 @@ ExtMove* Generator<kCaptures, kColor>::GenerateMoves(const Position& pos,
 }
 
 /**
- * 静かな手を生成します.
+ * 静かな手のうち、盤上の駒を動かす手を生成します.
  * 基本的には、取る手と成る手は生成されませんが、「銀が駒を取らずに成る手」はここで生成されます。
  * これは、銀は、成る前後で駒の価値があまり変動しないので、例外的に静かな手と扱っているためです。
  */
 template<Color kColor>
-ExtMove* Generator<kQuiets, kColor>::GenerateMoves(const Position& pos,
-                                                   ExtMove* stack) {
+ExtMove* Generator<kNonDropQuiets, kColor>::GenerateMoves(const Position& pos,
+                                                          ExtMove* stack) {
   assert(!pos.in_check());
   assert(stack != nullptr);
 
@@ -1028,9 +1034,31 @@ ExtMove* Generator<kQuiets, kColor>::GenerateMoves(const Position& pos,
   // 9. 玉
   stack = GenNonPromotions<kColor, kKing>(pos, empty_squares, stack);
 
-  // 10. 打つ手
-  stack = GenDrops<kColor>(pos, empty_squares, stack);
+  return stack;
+}
+
+/**
+ * 打つ手を生成します（王手がかかっていない場合のみ利用可）.
+ * kLegalMovesでは、盤上の駒を動かす手についてのみ自殺手のチェックを行うため、打つ手を別に生成しています。
+ */
+template<Color kColor>
+ExtMove* Generator<kDrops, kColor>::GenerateMoves(const Position& pos,
+                                                  ExtMove* stack) {
+  assert(!pos.in_check());
+  assert(stack != nullptr);
+
+  const Bitboard empty_squares = rank_bb<1, 9>().andnot(pos.pieces());
+  return GenDrops<kColor>(pos, empty_squares, stack);
+}
 
+/**
+ * 静かな手（打つ手を含む）を生成します.
+ */
+template<Color kColor>
+ExtMove* Generator<kQuiets, kColor>::GenerateMoves(const Position& pos,
+                                                   ExtMove* stack) {
+  stack = Generator<kNonDropQuiets, kColor>::GenerateMoves(pos, stack);
+  stack = Generator<kDrops, kColor>::GenerateMoves(pos, stack);
   return stack;
 }
 
@@ -1377,6 +1405,46 @@ struct Generator<kAllMoves, kColor> {
   }
 };
 
+/**
+ * 自殺手（玉を相手の利きに移動する手と、ピンされた駒をピンの方向以外に動かす手）を取り除きます.
+ *
+ * RemoveIllegalMoves()とは異なり、すべての手についてPseudoLegalMoveIsLegal()を呼ぶのではなく、
+ * 玉とピンされている駒を動かす手に限って、合法性をチェックします。
+ * なお、[begin, end)には、打つ手が含まれていても構いません（打つ手は自殺手にならないため）。
+ */
+template<Color kColor>
+ExtMove* RemoveSuicideMoves(const Position& pos, ExtMove* begin, ExtMove* end) {
+  if (!pos.king_exists(kColor)) {
+    return end;
+  }
+  const Bitboard suspects = pos.pinned_pieces() | square_bb(pos.king_square(kColor));
+  return std::remove_if(begin, end, [&](const ExtMove& em) {
+    return   !em.move.is_drop()
+          && suspects.test(em.move.from())
+          && !pos.NonDropMoveIsLegal(em.move);
+  });
+}
+
+/**
+ * 合法手をすべて生成します.
+ *
+ * 王手がかかっていない場合は、盤上の駒を動かす手についてのみ自殺手を取り除き、打つ手はその後に追加します。
+ * 指し手の順序は、kAllMovesで生成した手からRemoveIllegalMoves()で非合法手を取り除いた場合と同じです。
+ */
+template<Color kColor>
+struct Generator<kLegalMoves, kColor> {
+  static ExtMove* GenerateMoves(const Position& pos, ExtMove* stack) {
+    if (pos.in_check()) {
+      ExtMove* end = Generator<kEvasions, kColor>::GenerateMoves(pos, stack);
+      return RemoveSuicideMoves<kColor>(pos, stack, end);
+    }
+    ExtMove* end = Generator<kCaptures, kColor>::GenerateMoves(pos, stack);
+    end = Generator<kNonDropQuiets, kColor>::GenerateMoves(pos, end);
+    end = RemoveSuicideMoves<kColor>(pos, stack, end);
+    return Generator<kDrops, kColor>::GenerateMoves(pos, end);
+  }
+};
+
 } // namespace
 
 /**
@@ -1393,12 +1461,15 @@ ExtMove* GenerateMoves(const Position& pos, ExtMove* stack) {
 template ExtMove* GenerateMoves<kRecaptures    >(const Position&, ExtMove*);
 template ExtMove* GenerateMoves<kCaptures      >(const Position&, ExtMove*);
 template ExtMove* GenerateMoves<kQuiets        >(const Position&, ExtMove*);
+template ExtMove* GenerateMoves<kNonDropQuiets >(const Position&, ExtMove*);
+template ExtMove* GenerateMoves<kDrops         >(const Position&, ExtMove*);
 template ExtMove* GenerateMoves<kEvasions      >(const Position&, ExtMove*);
 template ExtMove* GenerateMoves<kChecks        >(const Position&, ExtMove*);
 template ExtMove* GenerateMoves<kQuietChecks   >(const Position&, ExtMove*);
 template ExtMove* GenerateMoves<kAdjacentChecks>(const Position&, ExtMove*);
 template ExtMove* GenerateMoves<kNonEvasions   >(const Position&, ExtMove*);
 template ExtMove* GenerateMoves<kAllMoves      >(const Position&, ExtMove*);
+template ExtMove* GenerateMoves<kLegalMoves    >(const Position&, ExtMove*);
 
 /**
  * 特定のマスに駒を動かす手を生成します.
@@ -21,6 +21,7 @@
 #define MOVEGEN_H_
 
 #include "common/array.h"
+#include "bitboard.h"
 #include "move.h"
 
 class Position;
@@ -32,12 +33,15 @@ enum GeneratorType {
   kRecaptures,     /**< 取り返しの手 */
   kCaptures,       /**< 取る手 */
   kQuiets,         /**< 静かな手 */
+  kNonDropQuiets,  /**< 静かな手（打つ手を除く） */
+  kDrops,          /**< 打つ手（kQuiets = kNonDropQuiets + kDrops） */
   kEvasions,       /**< 王手回避手 */
   kChecks,         /**< 王手 */
   kQuietChecks,    /**< 王手（静かな手のみ） */
   kAdjacentChecks, /**< 近接王手（合駒が効かない王手） */
   kNonEvasions,    /**< すべての手（王手がかかっていない場合のみ利用可） */
   kAllMoves,       /**< すべての手 */
+  kLegalMoves,     /**< すべての合法手（RemoveIllegalMoves()による絞り込みが不要です） */
 };
 
 /**
@@ -75,6 +79,11 @@ template<GeneratorType kGt, bool kRemoveIllegalMoves = false>
 class SimpleMoveList {
  public:
   SimpleMoveList(const Position& pos) {
+    // すべての合法手が必要な場合は、合法手のみを直接生成する
+    if (kGt == kAllMoves && kRemoveIllegalMoves) {
+      end_ = GenerateMoves<kLegalMoves>(pos, moves_.begin());
+      return;
+    }
     end_ = GenerateMoves<kGt>(pos, moves_.begin());
     if (kRemoveIllegalMoves) {
       end_ = RemoveIllegalMoves(pos, moves_.begin(), end_);
@@ -59,8 +59,19 @@ inline ExtMove* PickBest(ExtMove* begin, ExtMove* end) {
   return begin;
 }
 
+/**
+ * 得点が最も高い指し手のうち、最も前にある手を先頭に移します（他の手の順序は変えません）.
+ * 同点の手をSortMoves()と同じく生成順に取り出すので、途中でSortMoves()に切り替えても、指し手の順序は変わりません。
+ */
+inline ExtMove* PickFirstBest(ExtMove* begin, ExtMove* end) {
+  ExtMove* best = std::max_element(begin, end, is_less); // 最大値が複数あれば、最初のものを返す
+  std::rotate(begin, best, best + 1);
+  return begin;
+}
+
 inline void SortMoves(ExtMove* begin, ExtMove* end) {
-  return std::sort(begin, end, is_greater); // 降順でソートする
+  // 同点の手は生成順に並べる（PickFirstBest()と同じ順序にするため、安定ソートを用いる）
+  return std::stable_sort(begin, end, is_greater); // 降順でソートする
 }
 
 inline Score GetMvvLvaScore(Move move) {
@@ -188,9 +199,9 @@ Move MovePicker::NextMove(double* const probability) {
         return hash_move_;
 
       case kProbability0: {
-        move = cur_->move;
-        int32_t score = cur_->score;
-        cur_++;
+        ExtMove* best = PickSorted();
+        move = best->move;
+        int32_t score = best->score;
         if (move != hash_move_) {
           if (probability != nullptr) {
             *probability = double(score) / double(1 << 30);
@@ -223,7 +234,7 @@ Move MovePicker::NextMove(double* const probability) {
 
       case kGoodQuiets1:
       case kQuiets1:
-        move = (cur_++)->move;
+        move = PickSorted()->move;
         if (   move != hash_move_
             && move != killers_[0].move
             && move != killers_[1].move
@@ -312,12 +323,30 @@ void MovePicker::ScoreMoves<kEvasions>() {
   }
 }
 
+void MovePicker::BeginSortedPicks() {
+  if (kMaxLazyPicks > 0) {
+    lazy_picks_ = kMaxLazyPicks;
+  } else {
+    SortMoves(cur_, end_);
+  }
+}
+
+ExtMove* MovePicker::PickSorted() {
+  if (lazy_picks_ > 0) {
+    PickFirstBest(cur_, end_);
+    // 選択ソートを規定の手数だけ行ったら、残りの手はまとめてソートする
+    if (--lazy_picks_ == 0) {
+      SortMoves(cur_ + 1, end_);
+    }
+  }
+  return cur_++;
+}
+
 void MovePicker::GenerateNext() {
   switch (++stage_) {
     case kProbability0: {
       cur_ = moves_.begin();
-      end_ = GenerateMoves<kAllMoves>(pos_, cur_);
-      end_ = RemoveIllegalMoves(pos_, cur_, end_);
+      end_ = GenerateMoves<kLegalMoves>(pos_, cur_);
       // 指し手の実現確率を計算する
       auto probabilities = MoveProbability::ComputeProbabilities(pos_, history_,
                                                                  gains_);
@@ -326,7 +355,7 @@ void MovePicker::GenerateNext() {
         double p = probabilities[it->move.ToUint32()];
         it->score = static_cast<int>(double(1 << 30) * p);
       }
-      SortMoves(cur_, end_);
+      BeginSortedPicks();
       return;
     }
 
@@ -372,14 +401,15 @@ void MovePicker::GenerateNext() {
       end_ = end_quiets_ = GenerateMoves<kQuiets>(pos_, cur_);
       ScoreMoves<kQuiets>();
       end_ = std::partition(cur_, end_, has_good_score);
-      SortMoves(cur_, end_);
+      BeginSortedPicks();
       return;
 
     case kQuiets1:
       cur_ = end_;
       end_ = end_quiets_;
+      lazy_picks_ = 0;
       if (depth_ >= 3 * kOnePly) {
-        SortMoves(cur_, end_);
+        BeginSortedPicks();
       }
       return;
 
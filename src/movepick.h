@@ -38,6 +38,15 @@ class MovePicker {
   static constexpr Depth kDepthQsNoChecks   =  0 * kOnePly;
   static constexpr Depth kDepthQsRecaptures = -5 * kOnePly;
 
+  /**
+   * ソートが必要なステージで、選択ソートにより1手ずつ取り出す手数の上限です.
+   *
+   * 指し手の数が数百手になっても、βカットが起きれば、先頭の数手しか使われないことが多いので、
+   * 最初のうちは最善の手を1手ずつ選び出し、この手数を超えた時点で、残りの手をまとめてソートします。
+   * 0にすると、ステージの開始時にすべての手をソートするようになります。
+   */
+  static constexpr int kMaxLazyPicks = 8;
+
   /**
    * 通常探索用のコンストラクタです.
    */
@@ -77,6 +86,16 @@ class MovePicker {
    */
   void GenerateNext();
 
+  /**
+   * [cur_, end_) の範囲の指し手を、得点が高い順に取り出すための準備をします.
+   */
+  void BeginSortedPicks();
+
+  /**
+   * [cur_, end_) の範囲から得点が最も高い指し手を取り出して、cur_を1つ進めます.
+   */
+  ExtMove* PickSorted();
+
   const Position& pos_;
   const HistoryStats& history_;
   const GainsStats& gains_;
@@ -86,6 +105,7 @@ class MovePicker {
   ExtMove* end_quiets_;
   ExtMove *end_bad_captures_;
   int stage_;
+  int lazy_picks_ = 0;
   Score capture_threshold_;
   Depth depth_;
   Move hash_move_ = kMoveNone;
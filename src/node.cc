@@ -24,14 +24,16 @@
 void Node::Initialize() {
   // メモリの再確保による速度低下を防止する
   stack_.reserve(kMaxPly);
+  eval_states_.resize(kMaxPly);
 
   // 後に(current-2)を参照するため、size() >= 3の必要がある
   assert(stack_.size() >= 3);
   auto current = stack_.end() - 1;
 
   // 現局面の評価値を保存
-  current->psq_control_list = extended_board().GetPsqControlList();
-  current->eval_detail = Evaluation::EvaluateAll(*this, psq_list_);
+  EvalState& eval_state = current_eval_state();
+  eval_state.psq_control_list = extended_board().GetPsqControlList();
+  eval_state.eval_detail = Evaluation::EvaluateAll(*this, psq_list_);
   current->eval_is_updated = true;
 
   // 現局面のハッシュキーを保存
@@ -41,6 +43,8 @@ void Node::Initialize() {
   current->board_key = ComputeBoardKey();
   current->hand      = stm_hand();
   current->continuous_checks = static_cast<int>(in_check());
+  board_key_counts_.clear();
+  board_key_counts_[repetition_table_index(current->board_key)] = 1;
   current->plies_from_null   = 0;
   assert((current-1)->plies_from_null == 0);
   assert((current-2)->continuous_checks == 0);
@@ -51,10 +55,19 @@ bool Node::DetectRepetition(Score* score) const {
   assert(stack_.size() >= 3); // (stack_.end()-3)を参照するため
 
   // 設定（何手まで遡って千日手の検出を行うか）
-  const int kMaxDetectionPly = 32;
+  // 過去の局面を遡るのは、現局面と同じ盤面がこれまでに現れている可能性がある場合のみなので、
+  // 長手数の千日手も検出できるよう、十分に長くとっている
+  const int kMaxDetectionPly = 256;
 
   auto current = stack_.end() - 1;
   assert(current->plies_from_null >= 0);
+
+  // 現局面と同じ盤面がこれまでに一度も現れていなければ、千日手にも優越・劣等局面にもならない
+  assert(board_key_counts_[repetition_table_index(current->board_key)] >= 1);
+  if (board_key_counts_[repetition_table_index(current->board_key)] == 1) {
+    return false;
+  }
+
   const int end = std::min(current->plies_from_null, kMaxDetectionPly);
 
   for (int i = 4; i <= end; i += 2) {
@@ -91,23 +104,32 @@ bool Node::DetectRepetition(Score* score) const {
   return false;
 }
 
+Node::EvalState& Node::current_eval_state() {
+  // 開始局面までの棋譜が長い場合には、スタックがeval_states_の大きさを超えることがある
+  if (stack_.size() > eval_states_.size()) {
+    eval_states_.resize(stack_.size() + kMaxPly);
+  }
+  return eval_states_[stack_.size() - 1];
+}
+
 Score Node::Evaluate(double* const progress) {
   auto current = stack_.end() - 1;
+  EvalState& eval_state = current_eval_state();
 
   // 必要に応じて評価値の差分計算を行う
   if (!current->eval_is_updated) {
-    const auto previous = current - 1;
-    current->psq_control_list = extended_board().GetPsqControlList();
+    const EvalState& previous = *(&eval_state - 1);
+    eval_state.psq_control_list = extended_board().GetPsqControlList();
     EvalDetail diff = Evaluation::EvaluateDifference(*this,
-                                                     previous->eval_detail,
-                                                     previous->psq_control_list,
-                                                     current->psq_control_list,
+                                                     previous.eval_detail,
+                                                     previous.psq_control_list,
+                                                     eval_state.psq_control_list,
                                                      &psq_list_);
-    current->eval_detail = previous->eval_detail + diff;
+    eval_state.eval_detail = previous.eval_detail + diff;
     current->eval_is_updated = true;
   }
 
-  Score score = current->eval_detail.ComputeFinalScore(side_to_move(), progress);
+  Score score = eval_state.eval_detail.ComputeFinalScore(side_to_move(), progress);
 
 #ifndef NDEBUG
   // 双方の玉がある場合のみ、評価関数の差分計算結果のチェックを行う
@@ -154,6 +176,7 @@ void Node::MakeMove(Move move, bool move_gives_check, Key64 key_after_move) {
     current->continuous_checks = 0;
   }
   current->plies_from_null = (current-1)->plies_from_null + 1;
+  ++board_key_counts_[repetition_table_index(current->board_key)];
 
   // ハッシュキーが正しくセットされているかチェック
   assert(current->board_key == ComputeBoardKey());
@@ -172,6 +195,7 @@ void Node::UnmakeMove(Move move) {
   Position::UnmakeMove(move);
 
   // スタックを１つ前にもどす
+  --board_key_counts_[repetition_table_index(stack_.back().board_key)];
   stack_.pop_back();
 }
 
@@ -186,8 +210,8 @@ void Node::MakeNullMove() {
   current->board_key    = (current-1)->board_key    + null_move_key;
 
   // 現在の評価関数の実装では、１手パスをしても評価値を再計算する必要はない
-  current->psq_control_list = (current-1)->psq_control_list;
-  current->eval_detail = (current-1)->eval_detail;
+  EvalState& eval_state = current_eval_state();
+  eval_state = *(&eval_state - 1);
   current->eval_is_updated = true;
 
   // １手パスする
@@ -198,6 +222,7 @@ void Node::MakeNullMove() {
   assert(!in_check());
   current->continuous_checks = 0;
   current->plies_from_null = 0;
+  ++board_key_counts_[repetition_table_index(current->board_key)];
 
   // ハッシュキーが正しくセットされているかチェック
   assert(current->board_key == ComputeBoardKey());
@@ -207,6 +232,7 @@ void Node::MakeNullMove() {
 void Node::UnmakeNullMove() {
   assert(last_move() == kMoveNull);
   Position::UnmakeNullMove();
+  --board_key_counts_[repetition_table_index(stack_.back().board_key)];
   stack_.pop_back();
 }
 
@@ -21,6 +21,7 @@
 #define NODE_H_
 
 #include <vector>
+#include "common/array.h"
 #include "evaluation.h"
 #include "position.h"
 #include "psq.h"
@@ -41,6 +42,7 @@ class Node : public Position {
   Node(const Position& pos)
       : Position(pos),
         stack_(3), // (stack_.back() - 2)を参照可能にする
+        eval_states_(3),
         psq_list_(pos) {
     Initialize();
   }
@@ -52,6 +54,7 @@ class Node : public Position {
   Node(Position&& pos)
       : Position(pos),
         stack_(3), // (stack_.back() - 2)を参照可能にする
+        eval_states_(3),
         psq_list_(pos) {
     Initialize();
   }
@@ -67,6 +70,9 @@ class Node : public Position {
    *   - 盤上の駒はそのままに、手番側の持ち駒が減少する局面: -kScoreSuperior
    *
    * 最後の2つは、Strong Horizon Effect Killer (SHEK) に関するものです。
+   *
+   * 開始局面以前の棋譜を含め、これまでに現れた盤面のハッシュキーの出現回数を表で管理しているので、
+   * 現局面と同じ盤面が一度も現れていない場合（大半の局面）は、過去の局面を遡ることなく、直ちにfalseを返します。
    * これは、千日手処理そのものではなく、明らかに得な局面・明らかに損な局面への遷移を検出するための処理です。
    * （参考文献）
    *   - 橋本剛: 将棋プログラムTACOSのアルゴリズム, 『コンピュータ将棋の進歩５』, pp.56-60,
@@ -162,10 +168,22 @@ class Node : public Position {
   void UnmakeNullMove();
 
  private:
+  /**
+   * 盤面の出現回数表のサイズです（2のべき乗）.
+   * 出現回数は、ハッシュキーの下位ビットごとにまとめて数えるので、別の盤面と衝突することがありますが、
+   * その場合でも、実際に過去の局面と比較して千日手を判定するので、結果が誤ることはありません。
+   */
+  static constexpr size_t kRepetitionTableSize = 4096;
+
+  static size_t repetition_table_index(Key64 board_key) {
+    return static_cast<uint64_t>(int64_t(board_key)) & (kRepetitionTableSize - 1);
+  }
 
+  /**
+   * 局面ごとに保存する情報です.
+   * MakeMove()のたびに書き込まれるので、評価値の差分計算に用いる大きなデータ（EvalState）は含めていません。
+   */
   struct Stack {
-    PsqControlList psq_control_list;
-    EvalDetail eval_detail;
     Key64 board_key;
     Key64 position_key;
     Hand hand;
@@ -174,12 +192,26 @@ class Node : public Position {
     bool eval_is_updated = false;
   };
 
+  /**
+   * 評価値の差分計算に用いる情報です.
+   * Evaluate()が呼ばれた局面についてのみ、stack_と同じ添字の位置に書き込まれます。
+   */
+  struct EvalState {
+    PsqControlList psq_control_list;
+    EvalDetail eval_detail;
+  };
+
+  // 現局面の EvalState を返します（必要に応じて、eval_states_を拡張します）
+  EvalState& current_eval_state();
+
   void Initialize();
 
   Key64 ComputeKey(Move move) const;
 
   std::vector<Stack> stack_;
+  std::vector<EvalState> eval_states_;
   PsqList psq_list_;
+  Array<uint16_t, kRepetitionTableSize> board_key_counts_;
 };
 
 #endif /* NODE_H_ */
@@ -0,0 +1,490 @@
+/*
+ * 技巧 (Gikou), a USI shogi (Japanese chess) playing engine.
+ * Copyright (C) 2016 Yosuke Demura
+ * except where otherwise indicated.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#if !defined(MINIMUM)
+
+#include "optimizer.h"
+
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <immintrin.h>
+#include "common/cpu_features.h"
+
+namespace {
+
+typedef Optimizer::RmsPropConfig RmsPropConfig;
+typedef Optimizer::AdaDeltaConfig AdaDeltaConfig;
+typedef Optimizer::Norms Norms;
+
+/** OpenMPで並列化する際の、１回の処理単位となる要素数（SIMDの幅の倍数にする） */
+constexpr size_t kChunkSize = 8192;
+
+/** 現在使用している命令セット */
+Optimizer::InstructionSet g_instruction_set = Optimizer::GetBestInstructionSet();
+
+/**
+ * RMSprop + FOBOS（L1正則化）で、１つのパラメータを更新します.
+ * SIMD版の実装で、端数の要素を処理するためにも使われます。
+ */
+template<typename StateType>
+inline void UpdateRmsPropScalar(const RmsPropConfig& c, const double g,
+                                StateType* const a, double* const w,
+                                Norms* const norms) {
+  norms->l1 += std::abs(*w);
+  norms->l2 += *w * *w;
+
+  // 更新幅の設定（RMSprop）
+  const double r = c.decay * *a + g * g;
+  *a = static_cast<StateType>(r);
+  const double eta = c.step_rate / std::sqrt(r + c.epsilon);
+
+  // パラメータを更新（坂を下る）した後、ペナルティをかける（FOBOS）
+  const double v = *w - eta * g;
+  *w = std::copysign(std::max(std::abs(v) - eta * c.l1_penalty, 0.0), v);
+}
+
+/**
+ * AdaDelta + Momentum + FOBOS（L1正則化及びL2正則化）で、１つのパラメータを更新します.
+ * SIMD版の実装で、端数の要素を処理するためにも使われます。
+ */
+template<typename StateType>
+inline void UpdateAdaDeltaScalar(const AdaDeltaConfig& c, const double g,
+                                 StateType* const r, StateType* const s,
+                                 StateType* const v, double* const w,
+                                 Norms* const norms) {
+  norms->l1 += std::abs(*w);
+  norms->l2 += *w * *w;
+
+  // 勾配方向に移動する（AdaDelta + Momentum）
+  const double new_r = c.decay * *r + (1.0 - c.decay) * (g * g);
+  const double eta = std::sqrt(double(*s)) / std::sqrt(new_r + c.epsilon);
+  const double new_v = c.momentum * *v - (1.0 - c.momentum) * eta * g;
+  const double new_s = c.decay * *s + (1.0 - c.decay) * (new_v * new_v);
+  const double new_w = *w + new_v;
+  *r = static_cast<StateType>(new_r);
+  *s = static_cast<StateType>(new_s);
+  *v = static_cast<StateType>(new_v);
+
+  // ペナルティをかける（FOBOS）
+  const double lambda1 = eta * c.l1_penalty;
+  const double lambda2 = eta * c.l2_penalty;
+  *w = std::copysign(std::max((std::abs(new_w) - lambda1) / (1.0 + lambda2), 0.0),
+                     new_w);
+}
+
+template<typename StateType>
+Norms UpdateRmsPropWithoutSimd(const RmsPropConfig& c, const double* g,
+                               StateType* a, double* w, size_t size) {
+  Norms norms;
+  for (size_t i = 0; i < size; ++i) {
+    UpdateRmsPropScalar(c, g[i], a + i, w + i, &norms);
+  }
+  return norms;
+}
+
+template<typename StateType>
+Norms UpdateAdaDeltaWithoutSimd(const AdaDeltaConfig& c, const double* g,
+                                StateType* r, StateType* s, StateType* v,
+                                double* w, size_t size) {
+  Norms norms;
+  for (size_t i = 0; i < size; ++i) {
+    UpdateAdaDeltaScalar(c, g[i], r + i, s + i, v + i, w + i, &norms);
+  }
+  return norms;
+}
+
+/*
+ * AVX2版の実装.
+ * 関数単位で命令セットを指定しているので、コンパイル時に-mavx2を指定する必要はありません。
+ */
+#pragma GCC push_options
+#pragma GCC target("avx2")
+
+namespace avx2 {
+
+inline __m256d Load(const double* p) { return _mm256_loadu_pd(p); }
+inline __m256d Load(const float* p) { return _mm256_cvtps_pd(_mm_loadu_ps(p)); }
+inline void Store(double* p, __m256d x) { _mm256_storeu_pd(p, x); }
+inline void Store(float* p, __m256d x) { _mm_storeu_ps(p, _mm256_cvtpd_ps(x)); }
+
+inline __m256d Abs(__m256d x) {
+  return _mm256_andnot_pd(_mm256_set1_pd(-0.0), x);
+}
+
+inline __m256d CopySign(__m256d magnitude, __m256d sign) {
+  const __m256d mask = _mm256_set1_pd(-0.0);
+  return _mm256_or_pd(_mm256_andnot_pd(mask, magnitude),
+                      _mm256_and_pd(mask, sign));
+}
+
+inline double HorizontalAdd(__m256d x) {
+  __m128d sum = _mm_add_pd(_mm256_castpd256_pd128(x),
+                           _mm256_extractf128_pd(x, 1));
+  return _mm_cvtsd_f64(_mm_add_sd(sum, _mm_unpackhi_pd(sum, sum)));
+}
+
+template<typename StateType>
+Norms UpdateRmsProp(const RmsPropConfig& c, const double* g, StateType* a,
+                    double* w, size_t size) {
+  const __m256d zero = _mm256_setzero_pd();
+  const __m256d decay = _mm256_set1_pd(c.decay);
+  const __m256d step_rate = _mm256_set1_pd(c.step_rate);
+  const __m256d epsilon = _mm256_set1_pd(c.epsilon);
+  const __m256d l1_penalty = _mm256_set1_pd(c.l1_penalty);
+  __m256d l1 = zero, l2 = zero;
+
+  size_t i = 0;
+  for (; i + 4 <= size; i += 4) {
+    const __m256d gi = Load(g + i);
+    const __m256d wi = Load(w + i);
+    l1 = _mm256_add_pd(l1, Abs(wi));
+    l2 = _mm256_add_pd(l2, _mm256_mul_pd(wi, wi));
+
+    const __m256d r = _mm256_add_pd(_mm256_mul_pd(decay, Load(a + i)),
+                                    _mm256_mul_pd(gi, gi));
+    Store(a + i, r);
+    const __m256d eta = _mm256_div_pd(step_rate,
+                                      _mm256_sqrt_pd(_mm256_add_pd(r, epsilon)));
+
+    const __m256d v = _mm256_sub_pd(wi, _mm256_mul_pd(eta, gi));
+    const __m256d shrunk = _mm256_max_pd(
+        _mm256_sub_pd(Abs(v), _mm256_mul_pd(eta, l1_penalty)), zero);
+    Store(w + i, CopySign(shrunk, v));
+  }
+
+  Norms norms;
+  norms.l1 = HorizontalAdd(l1);
+  norms.l2 = HorizontalAdd(l2);
+  for (; i < size; ++i) {
+    UpdateRmsPropScalar(c, g[i], a + i, w + i, &norms);
+  }
+  return norms;
+}
+
+template<typename StateType>
+Norms UpdateAdaDelta(const AdaDeltaConfig& c, const double* g, StateType* r,
+                     StateType* s, StateType* v, double* w, size_t size) {
+  const __m256d zero = _mm256_setzero_pd();
+  const __m256d one = _mm256_set1_pd(1.0);
+  const __m256d decay = _mm256_set1_pd(c.decay);
+  const __m256d decay_c = _mm256_set1_pd(1.0 - c.decay);
+  const __m256d momentum = _mm256_set1_pd(c.momentum);
+  const __m256d momentum_c = _mm256_set1_pd(1.0 - c.momentum);
+  const __m256d epsilon = _mm256_set1_pd(c.epsilon);
+  const __m256d l1_penalty = _mm256_set1_pd(c.l1_penalty);
+  const __m256d l2_penalty = _mm256_set1_pd(c.l2_penalty);
+  __m256d l1 = zero, l2 = zero;
+
+  size_t i = 0;
+  for (; i + 4 <= size; i += 4) {
+    const __m256d gi = Load(g + i);
+    const __m256d wi = Load(w + i);
+    l1 = _mm256_add_pd(l1, Abs(wi));
+    l2 = _mm256_add_pd(l2, _mm256_mul_pd(wi, wi));
+
+    const __m256d ri = _mm256_add_pd(_mm256_mul_pd(decay, Load(r + i)),
+                                     _mm256_mul_pd(decay_c, _mm256_mul_pd(gi, gi)));
+    const __m256d eta = _mm256_div_pd(_mm256_sqrt_pd(Load(s + i)),
+                                      _mm256_sqrt_pd(_mm256_add_pd(ri, epsilon)));
+    const __m256d vi = _mm256_sub_pd(_mm256_mul_pd(momentum, Load(v + i)),
+                                     _mm256_mul_pd(_mm256_mul_pd(momentum_c, eta), gi));
+    const __m256d si = _mm256_add_pd(_mm256_mul_pd(decay, Load(s + i)),
+                                     _mm256_mul_pd(decay_c, _mm256_mul_pd(vi, vi)));
+    const __m256d new_w = _mm256_add_pd(wi, vi);
+    Store(r + i, ri);
+    Store(s + i, si);
+    Store(v + i, vi);
+
+    const __m256d lambda1 = _mm256_mul_pd(eta, l1_penalty);
+    const __m256d lambda2 = _mm256_mul_pd(eta, l2_penalty);
+    const __m256d shrunk = _mm256_max_pd(
+        _mm256_div_pd(_mm256_sub_pd(Abs(new_w), lambda1),
+                      _mm256_add_pd(one, lambda2)),
+        zero);
+    Store(w + i, CopySign(shrunk, new_w));
+  }
+
+  Norms norms;
+  norms.l1 = HorizontalAdd(l1);
+  norms.l2 = HorizontalAdd(l2);
+  for (; i < size; ++i) {
+    UpdateAdaDeltaScalar(c, g[i], r + i, s + i, v + i, w + i, &norms);
+  }
+  return norms;
+}
+
+} // namespace avx2
+
+#pragma GCC pop_options
+
+/*
+ * AVX-512版の実装.
+ */
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+// AVX-512FはFMAを含むため、積和演算への融合を禁止して、他の実装と計算結果を一致させる
+#pragma GCC optimize("fp-contract=off")
+// GCC 12のAVX-512ヘッダ内部（_mm512_undefined_pd()）に対する誤検知の警告を抑制する
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+namespace avx512 {
+
+inline __m512d Load(const double* p) { return _mm512_loadu_pd(p); }
+inline __m512d Load(const float* p) { return _mm512_cvtps_pd(_mm256_loadu_ps(p)); }
+inline void Store(double* p, __m512d x) { _mm512_storeu_pd(p, x); }
+inline void Store(float* p, __m512d x) { _mm256_storeu_ps(p, _mm512_cvtpd_ps(x)); }
+
+inline __m512d Abs(__m512d x) {
+  return _mm512_abs_pd(x);
+}
+
+inline __m512d CopySign(__m512d magnitude, __m512d sign) {
+  const __m512i mask = _mm512_set1_epi64(INT64_MIN);
+  return _mm512_castsi512_pd(_mm512_or_si512(
+      _mm512_andnot_si512(mask, _mm512_castpd_si512(magnitude)),
+      _mm512_and_si512(mask, _mm512_castpd_si512(sign))));
+}
+
+template<typename StateType>
+Norms UpdateRmsProp(const RmsPropConfig& c, const double* g, StateType* a,
+                    double* w, size_t size) {
+  const __m512d zero = _mm512_setzero_pd();
+  const __m512d decay = _mm512_set1_pd(c.decay);
+  const __m512d step_rate = _mm512_set1_pd(c.step_rate);
+  const __m512d epsilon = _mm512_set1_pd(c.epsilon);
+  const __m512d l1_penalty = _mm512_set1_pd(c.l1_penalty);
+  __m512d l1 = zero, l2 = zero;
+
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    const __m512d gi = Load(g + i);
+    const __m512d wi = Load(w + i);
+    l1 = _mm512_add_pd(l1, Abs(wi));
+    l2 = _mm512_add_pd(l2, _mm512_mul_pd(wi, wi));
+
+    const __m512d r = _mm512_add_pd(_mm512_mul_pd(decay, Load(a + i)),
+                                    _mm512_mul_pd(gi, gi));
+    Store(a + i, r);
+    const __m512d eta = _mm512_div_pd(step_rate,
+                                      _mm512_sqrt_pd(_mm512_add_pd(r, epsilon)));
+
+    const __m512d v = _mm512_sub_pd(wi, _mm512_mul_pd(eta, gi));
+    const __m512d shrunk = _mm512_max_pd(
+        _mm512_sub_pd(Abs(v), _mm512_mul_pd(eta, l1_penalty)), zero);
+    Store(w + i, CopySign(shrunk, v));
+  }
+
+  Norms norms;
+  norms.l1 = _mm512_reduce_add_pd(l1);
+  norms.l2 = _mm512_reduce_add_pd(l2);
+  for (; i < size; ++i) {
+    UpdateRmsPropScalar(c, g[i], a + i, w + i, &norms);
+  }
+  return norms;
+}
+
+template<typename StateType>
+Norms UpdateAdaDelta(const AdaDeltaConfig& c, const double* g, StateType* r,
+                     StateType* s, StateType* v, double* w, size_t size) {
+  const __m512d zero = _mm512_setzero_pd();
+  const __m512d one = _mm512_set1_pd(1.0);
+  const __m512d decay = _mm512_set1_pd(c.decay);
+  const __m512d decay_c = _mm512_set1_pd(1.0 - c.decay);
+  const __m512d momentum = _mm512_set1_pd(c.momentum);
+  const __m512d momentum_c = _mm512_set1_pd(1.0 - c.momentum);
+  const __m512d epsilon = _mm512_set1_pd(c.epsilon);
+  const __m512d l1_penalty = _mm512_set1_pd(c.l1_penalty);
+  const __m512d l2_penalty = _mm512_set1_pd(c.l2_penalty);
+  __m512d l1 = zero, l2 = zero;
+
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    const __m512d gi = Load(g + i);
+    const __m512d wi = Load(w + i);
+    l1 = _mm512_add_pd(l1, Abs(wi));
+    l2 = _mm512_add_pd(l2, _mm512_mul_pd(wi, wi));
+
+    const __m512d ri = _mm512_add_pd(_mm512_mul_pd(decay, Load(r + i)),
+                                     _mm512_mul_pd(decay_c, _mm512_mul_pd(gi, gi)));
+    const __m512d eta = _mm512_div_pd(_mm512_sqrt_pd(Load(s + i)),
+                                      _mm512_sqrt_pd(_mm512_add_pd(ri, epsilon)));
+    const __m512d vi = _mm512_sub_pd(_mm512_mul_pd(momentum, Load(v + i)),
+                                     _mm512_mul_pd(_mm512_mul_pd(momentum_c, eta), gi));
+    const __m512d si = _mm512_add_pd(_mm512_mul_pd(decay, Load(s + i)),
+                                     _mm512_mul_pd(decay_c, _mm512_mul_pd(vi, vi)));
+    const __m512d new_w = _mm512_add_pd(wi, vi);
+    Store(r + i, ri);
+    Store(s + i, si);
+    Store(v + i, vi);
+
+    const __m512d lambda1 = _mm512_mul_pd(eta, l1_penalty);
+    const __m512d lambda2 = _mm512_mul_pd(eta, l2_penalty);
+    const __m512d shrunk = _mm512_max_pd(
+        _mm512_div_pd(_mm512_sub_pd(Abs(new_w), lambda1),
+                      _mm512_add_pd(one, lambda2)),
+        zero);
+    Store(w + i, CopySign(shrunk, new_w));
+  }
+
+  Norms norms;
+  norms.l1 = _mm512_reduce_add_pd(l1);
+  norms.l2 = _mm512_reduce_add_pd(l2);
+  for (; i < size; ++i) {
+    UpdateAdaDeltaScalar(c, g[i], r + i, s + i, v + i, w + i, &norms);
+  }
+  return norms;
+}
+
+} // namespace avx512
+
+#pragma GCC diagnostic pop
+#pragma GCC pop_options
+
+template<typename StateType>
+using RmsPropKernel = Norms (*)(const RmsPropConfig&, const double*,
+                                StateType*, double*, size_t);
+
+template<typename StateType>
+using AdaDeltaKernel = Norms (*)(const AdaDeltaConfig&, const double*,
+                                 StateType*, StateType*, StateType*, double*,
+                                 size_t);
+
+template<typename StateType>
+RmsPropKernel<StateType> GetRmsPropKernel(Optimizer::InstructionSet isa) {
+  switch (isa) {
+    case Optimizer::kAvx512: return avx512::UpdateRmsProp<StateType>;
+    case Optimizer::kAvx2  : return avx2::UpdateRmsProp<StateType>;
+    default                : return UpdateRmsPropWithoutSimd<StateType>;
+  }
+}
+
+template<typename StateType>
+AdaDeltaKernel<StateType> GetAdaDeltaKernel(Optimizer::InstructionSet isa) {
+  switch (isa) {
+    case Optimizer::kAvx512: return avx512::UpdateAdaDelta<StateType>;
+    case Optimizer::kAvx2  : return avx2::UpdateAdaDelta<StateType>;
+    default                : return UpdateAdaDeltaWithoutSimd<StateType>;
+  }
+}
+
+} // namespace
+
+template<typename StateType>
+Optimizer::Norms Optimizer::UpdateRmsProp(const RmsPropConfig& config,
+                                          const double* const gradient,
+                                          StateType* const accumulated_gradient,
+                                          double* const weights,
+                                          const size_t size) {
+  const RmsPropKernel<StateType> kernel = GetRmsPropKernel<StateType>(g_instruction_set);
+  const size_t num_chunks = (size + kChunkSize - 1) / kChunkSize;
+  double l1 = 0.0, l2 = 0.0;
+
+#pragma omp parallel for reduction(+:l1, l2) schedule(static)
+  for (size_t n = 0; n < num_chunks; ++n) {
+    const size_t begin = n * kChunkSize;
+    const size_t length = std::min(kChunkSize, size - begin);
+    const Norms norms = kernel(config, gradient + begin,
+                               accumulated_gradient + begin, weights + begin,
+                               length);
+    l1 += norms.l1;
+    l2 += norms.l2;
+  }
+
+  Norms norms;
+  norms.l1 = l1;
+  norms.l2 = l2;
+  return norms;
+}
+
+template<typename StateType>
+Optimizer::Norms Optimizer::UpdateAdaDelta(const AdaDeltaConfig& config,
+                                           const double* const gradient,
+                                           StateType* const accumulated_gradient,
+                                           StateType* const accumulated_delta,
+                                           StateType* const momentum,
+                                           double* const weights,
+                                           const size_t size) {
+  const AdaDeltaKernel<StateType> kernel = GetAdaDeltaKernel<StateType>(g_instruction_set);
+  const size_t num_chunks = (size + kChunkSize - 1) / kChunkSize;
+  double l1 = 0.0, l2 = 0.0;
+
+#pragma omp parallel for reduction(+:l1, l2) schedule(static)
+  for (size_t n = 0; n < num_chunks; ++n) {
+    const size_t begin = n * kChunkSize;
+    const size_t length = std::min(kChunkSize, size - begin);
+    const Norms norms = kernel(config, gradient + begin,
+                               accumulated_gradient + begin,
+                               accumulated_delta + begin, momentum + begin,
+                               weights + begin, length);
+    l1 += norms.l1;
+    l2 += norms.l2;
+  }
+
+  Norms norms;
+  norms.l1 = l1;
+  norms.l2 = l2;
+  return norms;
+}
+
+template Optimizer::Norms Optimizer::UpdateRmsProp<double>(
+    const RmsPropConfig&, const double*, double*, double*, size_t);
+template Optimizer::Norms Optimizer::UpdateRmsProp<float>(
+    const RmsPropConfig&, const double*, float*, double*, size_t);
+template Optimizer::Norms Optimizer::UpdateAdaDelta<double>(
+    const AdaDeltaConfig&, const double*, double*, double*, double*, double*,
+    size_t);
+template Optimizer::Norms Optimizer::UpdateAdaDelta<float>(
+    const AdaDeltaConfig&, const double*, float*, float*, float*, double*,
+    size_t);
+
+Optimizer::InstructionSet Optimizer::instruction_set() {
+  return g_instruction_set;
+}
+
+bool Optimizer::set_instruction_set(const InstructionSet instruction_set) {
+  if (instruction_set > GetBestInstructionSet()) {
+    return false;
+  }
+  g_instruction_set = instruction_set;
+  return true;
+}
+
+const char* Optimizer::GetInstructionSetName(const InstructionSet instruction_set) {
+  switch (instruction_set) {
+    case kAvx512: return "AVX-512";
+    case kAvx2  : return "AVX2";
+    default     : return "Scalar";
+  }
+}
+
+Optimizer::InstructionSet Optimizer::GetBestInstructionSet() {
+  if (cpu_features::HasAvx512f()) {
+    return kAvx512;
+  } else if (cpu_features::HasAvx2()) {
+    return kAvx2;
+  } else {
+    return kScalar;
+  }
+}
+
+#endif /* !defined(MINIMUM) */
@@ -0,0 +1,136 @@
+/*
+ * 技巧 (Gikou), a USI shogi (Japanese chess) playing engine.
+ * Copyright (C) 2016 Yosuke Demura
+ * except where otherwise indicated.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OPTIMIZER_H_
+#define OPTIMIZER_H_
+
+#if !defined(MINIMUM)
+
+#include <cstddef>
+
+/**
+ * 学習時に、勾配を使ってパラメータを更新するためのクラスです（RMSprop, AdaDelta）.
+ *
+ * パラメータ・勾配・累積値をそれぞれ連続した配列として受け取り、パラメータの更新と
+ * 正則化（FOBOS）を１回のループでまとめて行います。
+ * 実行中のCPUがAVX2やAVX-512に対応している場合は、それらの命令を用いた実装を自動的に選択します。
+ *
+ * 累積値（勾配の二乗の移動平均など）は、double型のほか、float型で保持することもできます。
+ * float型を用いると、累積値の読み書きに必要なメモリ帯域とメモリ使用量が半分になります
+ * （累積値は学習率の調整にのみ使われるため、精度の低下はほとんど問題になりません）。
+ */
+class Optimizer {
+ public:
+  /**
+   * パラメータ更新に用いる命令セットです.
+   */
+  enum InstructionSet {
+    kScalar, // 拡張命令を使わない実装
+    kAvx2,   // AVX2を用いた実装
+    kAvx512, // AVX-512Fを用いた実装
+  };
+
+  /**
+   * RMSpropの設定です.
+   */
+  struct RmsPropConfig {
+    double step_rate;  // １回の更新で、最大何点まで各パラメータを動かすか
+    double decay;      // どの程度過去の勾配を重視するか
+    double epsilon;    // ゼロ除算を防止するために分母に加算される、非常に小さな数
+    double l1_penalty; // L1正則化の係数（0の場合は、正則化を行わない）
+  };
+
+  /**
+   * AdaDelta + Momentumの設定です.
+   */
+  struct AdaDeltaConfig {
+    double decay;      // AdaDelta原論文のρ
+    double momentum;   // モーメンタムの強さ
+    double epsilon;    // AdaDelta原論文のε
+    double l1_penalty; // L1正則化の係数
+    double l2_penalty; // L2正則化の係数
+  };
+
+  /**
+   * 更新前のパラメータについての統計量です（正則化項の値を計算するために用います）.
+   */
+  struct Norms {
+    double l1 = 0.0; // パラメータの絶対値の総和
+    double l2 = 0.0; // パラメータの二乗和
+  };
+
+  /**
+   * RMSpropでパラメータを更新し、L1正則化（FOBOS）を適用します.
+   * @param config               RMSpropの設定
+   * @param gradient             勾配
+   * @param accumulated_gradient 勾配の二乗の移動平均（更新されます）
+   * @param weights              パラメータ（更新されます）
+   * @param size                 各配列の要素数
+   * @return 更新前のパラメータの統計量
+   */
+  template<typename StateType>
+  static Norms UpdateRmsProp(const RmsPropConfig& config,
+                             const double* gradient,
+                             StateType* accumulated_gradient,
+                             double* weights, size_t size);
+
+  /**
+   * AdaDelta + Momentumでパラメータを更新し、L1正則化及びL2正則化（FOBOS）を適用します.
+   * @param config               AdaDeltaの設定
+   * @param gradient             勾配
+   * @param accumulated_gradient 勾配の二乗の移動平均（更新されます）
+   * @param accumulated_delta    更新幅の二乗の移動平均（更新されます）
+   * @param momentum             モーメンタム（更新されます）
+   * @param weights              パラメータ（更新されます）
+   * @param size                 各配列の要素数
+   * @return 更新前のパラメータの統計量
+   */
+  template<typename StateType>
+  static Norms UpdateAdaDelta(const AdaDeltaConfig& config,
+                              const double* gradient,
+                              StateType* accumulated_gradient,
+                              StateType* accumulated_delta,
+                              StateType* momentum,
+                              double* weights, size_t size);
+
+  /**
+   * 現在使用している命令セットを返します.
+   */
+  static InstructionSet instruction_set();
+
+  /**
+   * 使用する命令セットを変更します（ベンチマーク用）.
+   * CPUが対応していない命令セットが指定された場合は、何もせずにfalseを返します。
+   */
+  static bool set_instruction_set(InstructionSet instruction_set);
+
+  /**
+   * 命令セットの名前を返します.
+   */
+  static const char* GetInstructionSetName(InstructionSet instruction_set);
+
+  /**
+   * 実行中のCPUで使用可能な、最も高速な命令セットを返します.
+   */
+  static InstructionSet GetBestInstructionSet();
+};
+
+#endif /* !defined(MINIMUM) */
+
+#endif /* OPTIMIZER_H_ */
@@ -0,0 +1,301 @@
+/*
+ * 技巧 (Gikou), a USI shogi (Japanese chess) playing engine.
+ * Copyright (C) 2016 Yosuke Demura
+ * except where otherwise indicated.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "perft.h"
+
+#if !defined(MINIMUM)
+
+#include <omp.h>
+#include <atomic>
+#include <cinttypes>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "common/array.h"
+#include "common/simple_timer.h"
+#include "movegen.h"
+#include "position.h"
+#include "zobrist.h"
+
+namespace {
+
+/**
+ * perftの計数結果を保存するための置換表です.
+ *
+ * 複数のスレッドから、ロックを用いずに読み書きします。
+ * エントリには、キーと計数結果のXORを保存しておくことで、書き込み途中のエントリを読んだ場合にも、
+ * キーが一致しなくなるため、誤った計数結果を使うことはありません。
+ */
+class PerftTable {
+ public:
+  /** 置換表のエントリ数（2のべき乗）です. */
+  static constexpr size_t kNumEntries = size_t(1) << 22;
+
+  PerftTable()
+      : entries_(new Entry[kNumEntries]()) {
+  }
+
+  bool Probe(Key64 key, int depth, uint64_t* nodes) const {
+    const uint64_t k = ComputeEntryKey(key, depth);
+    const Entry& entry = entries_[k & (kNumEntries - 1)];
+    const uint64_t data = entry.data.load(std::memory_order_relaxed);
+    const uint64_t check = entry.check.load(std::memory_order_relaxed);
+    if ((check ^ data) == k && data != 0) {
+      *nodes = data;
+      return true;
+    }
+    return false;
+  }
+
+  void Store(Key64 key, int depth, uint64_t nodes) {
+    const uint64_t k = ComputeEntryKey(key, depth);
+    Entry& entry = entries_[k & (kNumEntries - 1)];
+    entry.check.store(k ^ nodes, std::memory_order_relaxed);
+    entry.data.store(nodes, std::memory_order_relaxed);
+  }
+
+ private:
+  struct Entry {
+    std::atomic<uint64_t> check;
+    std::atomic<uint64_t> data;
+  };
+
+  static uint64_t ComputeEntryKey(Key64 key, int depth) {
+    // 深さが異なる同一局面を区別するため、深さをキーに混ぜ込む
+    return static_cast<uint64_t>(int64_t(key))
+         ^ (static_cast<uint64_t>(depth) * UINT64_C(0x9e3779b97f4a7c15));
+  }
+
+  std::unique_ptr<Entry[]> entries_;
+};
+
+/**
+ * 指し手 move で１手進めたときの、ハッシュ値の差分を返します（Node::ComputeKey()と同じ計算です）.
+ */
+Key64 ComputeKeyDifference(const Position& pos, Move move) {
+  Piece piece = move.piece();
+  Key64 result = Zobrist::null_move(pos.side_to_move());
+  if (move.is_drop()) {
+    result -= Zobrist::hand(piece);
+    result += Zobrist::psq(piece, move.to());
+  } else {
+    result -= Zobrist::psq(piece, move.from());
+    result += Zobrist::psq(move.piece_after_move(), move.to());
+    Piece captured = move.captured_piece();
+    result -= Zobrist::psq(captured, move.to());
+    result += Zobrist::hand(captured.opponent_hand_piece());
+  }
+  return result;
+}
+
+/**
+ * 打ち歩詰めであれば、trueを返します.
+ */
+bool IsPawnDropMate(Position& pos, Move move) {
+  if (   !move.is_drop()
+      || move.piece_type() != kPawn
+      || !pos.MoveGivesCheck(move)) {
+    return false;
+  }
+  pos.MakeMove(move, true);
+  Array<ExtMove, Move::kMaxLegalMoves> evasions;
+  ExtMove* end = GenerateMoves<kEvasions>(pos, evasions.begin());
+  bool has_legal_evasion = false;
+  for (ExtMove* it = evasions.begin(); it != end; ++it) {
+    if (pos.PseudoLegalMoveIsLegal(it->move)) {
+      has_legal_evasion = true;
+      break;
+    }
+  }
+  pos.UnmakeMove(move);
+  return !has_legal_evasion;
+}
+
+/**
+ * 合法手をすべて生成します（打ち歩詰めも取り除きます）.
+ */
+ExtMove* GenerateLegalMoves(Position& pos, ExtMove* const begin) {
+  ExtMove* end = GenerateMoves<kLegalMoves>(pos, begin);
+  return std::remove_if(begin, end, [&](const ExtMove& em) {
+    return IsPawnDropMate(pos, em.move);
+  });
+}
+
+uint64_t CountLeafNodes(Position& pos, Key64 key, int depth,
+                        PerftTable* table) {
+  assert(depth >= 1);
+
+  uint64_t nodes = 0;
+  if (depth >= 2 && table->Probe(key, depth, &nodes)) {
+    return nodes;
+  }
+
+  Array<ExtMove, Move::kMaxLegalMoves> moves;
+  ExtMove* end = GenerateLegalMoves(pos, moves.begin());
+
+  // 末端の１手前では、合法手の数をそのまま末端局面数とする（bulk counting）
+  if (depth == 1) {
+    return static_cast<uint64_t>(end - moves.begin());
+  }
+
+  for (ExtMove* it = moves.begin(); it != end; ++it) {
+    Key64 key_after_move = key + ComputeKeyDifference(pos, it->move);
+    pos.MakeMove(it->move);
+    nodes += CountLeafNodes(pos, key_after_move, depth - 1, table);
+    pos.UnmakeMove(it->move);
+  }
+
+  table->Store(key, depth, nodes);
+  return nodes;
+}
+
+/**
+ * 指し手生成関数を num_calls 回呼び出して、その結果を表の１行として表示します.
+ */
+template<GeneratorType kGt>
+void PrintGeneratorThroughput(const char* name, const Position& pos,
+                              bool applicable, int num_calls) {
+  if (!applicable) {
+    std::printf("  %-24s %8s %10s %14s\n", name, "-", "-", "-");
+    return;
+  }
+  Array<ExtMove, Move::kMaxLegalMoves> stack;
+  ExtMove* end = stack.begin();
+  SimpleTimer timer;
+  for (int i = 0; i < num_calls; ++i) {
+    end = GenerateMoves<kGt>(pos, stack.begin());
+  }
+  double elapsed = std::max(timer.GetElapsedSeconds(), 0.001);
+  std::printf("  %-24s %8d %10.3f %14.0f\n", name,
+              static_cast<int>(end - stack.begin()), elapsed,
+              (num_calls / elapsed) / 1000);
+}
+
+} // namespace
+
+uint64_t Perft::Count(const Position& pos, int depth) {
+  if (depth <= 0) {
+    return 1;
+  }
+  Position root(pos);
+  std::unique_ptr<PerftTable> table(new PerftTable);
+  return CountLeafNodes(root, root.ComputePositionKey(), depth, table.get());
+}
+
+void Perft::Divide(const Position& pos, int depth) {
+  const int num_threads = std::max(1U, std::thread::hardware_concurrency());
+  omp_set_num_threads(num_threads);
+  std::printf("Perft: depth=%d threads=%d\n", depth, num_threads);
+  std::printf("Position=%s\n\n", pos.ToSfen().c_str());
+
+  SimpleTimer timer;
+
+  // 1. ルートの合法手を生成する
+  Position root(pos);
+  Array<ExtMove, Move::kMaxLegalMoves> moves;
+  ExtMove* end = GenerateLegalMoves(root, moves.begin());
+  const int num_moves = static_cast<int>(end - moves.begin());
+
+  // 2. ルートの指し手ごとに、複数のスレッドで分担して末端局面数を数える
+  // （置換表は、すべてのスレッドで共有する）
+  std::unique_ptr<PerftTable> table(new PerftTable);
+  const Key64 root_key = root.ComputePositionKey();
+  std::vector<uint64_t> results(num_moves, 0);
+#pragma omp parallel for schedule(dynamic)
+  for (int i = 0; i < num_moves; ++i) {
+    const Move move = moves[i].move;
+    if (depth <= 1) {
+      results[i] = 1;
+      continue;
+    }
+    Position child(root);
+    Key64 key = root_key + ComputeKeyDifference(child, move);
+    child.MakeMove(move);
+    results[i] = CountLeafNodes(child, key, depth - 1, table.get());
+  }
+
+  // 3. 結果を表示する
+  uint64_t total = 0;
+  for (int i = 0; i < num_moves; ++i) {
+    std::printf("%s: %" PRIu64 "\n", moves[i].move.ToSfen().c_str(), results[i]);
+    total += results[i];
+  }
+  double elapsed = std::max(timer.GetElapsedSeconds(), 0.001);
+  std::printf("\nMoves=%d Nodes=%" PRIu64 " Time=%.3fsec Speed=%.0fKnodes/sec\n",
+              num_moves, total, elapsed, (total / elapsed) / 1000);
+}
+
+void Perft::BenchmarkGenerators(const int num_calls) {
+  std::printf("Start Move Generator Throughput Benchmark!\n\n");
+
+  // 1. テスト局面を準備する
+  // a. 初期局面
+  Position startpos = Position::CreateStartPosition();
+  // b. いわゆる「指し手生成祭り」局面
+  Position festivalpos = Position::FromSfen(
+      "l6nl/5+P1gk/2np1S3/p1p4Pp/3P2Sp1/1PPb2P1P/P5GS1/R8/LN4bKL w RGgsn5p 1");
+  // c. 王手がかかった局面（指し手生成祭り局面から、最初に生成される王手を指した局面）
+  Position evasionpos = festivalpos;
+  {
+    Array<ExtMove, Move::kMaxLegalMoves> checks;
+    ExtMove* end = GenerateMoves<kChecks>(evasionpos, checks.begin());
+    end = RemoveIllegalMoves(evasionpos, checks.begin(), end);
+    if (end != checks.begin()) {
+      evasionpos.MakeMove(checks[0].move);
+    }
+  }
+
+  // 2. 各テスト局面について、指し手生成のタイプごとにスループットを計測する
+  for (const Position& pos : {startpos, festivalpos, evasionpos}) {
+    const bool in_check = pos.in_check();
+    std::printf("Position=%s\n", pos.ToSfen().c_str());
+    std::printf("  %-24s %8s %10s %14s\n",
+                "GeneratorType", "Moves", "Time(sec)", "Speed(Kcalls/s)");
+    PrintGeneratorThroughput<kCaptures>("kCaptures", pos, !in_check, num_calls);
+    PrintGeneratorThroughput<kQuiets>("kQuiets", pos, !in_check, num_calls);
+    PrintGeneratorThroughput<kNonDropQuiets>("kNonDropQuiets", pos, !in_check, num_calls);
+    PrintGeneratorThroughput<kDrops>("kDrops", pos, !in_check, num_calls);
+    PrintGeneratorThroughput<kEvasions>("kEvasions", pos, in_check, num_calls);
+    PrintGeneratorThroughput<kChecks>("kChecks", pos, !in_check, num_calls);
+    PrintGeneratorThroughput<kQuietChecks>("kQuietChecks", pos, !in_check, num_calls);
+    PrintGeneratorThroughput<kAdjacentChecks>("kAdjacentChecks", pos, !in_check, num_calls);
+    PrintGeneratorThroughput<kNonEvasions>("kNonEvasions", pos, !in_check, num_calls);
+    PrintGeneratorThroughput<kAllMoves>("kAllMoves", pos, true, num_calls);
+
+    // 合法手の生成（生成後にRemoveIllegalMoves()で絞り込む方法）
+    Array<ExtMove, Move::kMaxLegalMoves> stack;
+    ExtMove* end = stack.begin();
+    SimpleTimer timer;
+    for (int i = 0; i < num_calls; ++i) {
+      end = GenerateMoves<kAllMoves>(pos, stack.begin());
+      end = RemoveIllegalMoves(pos, stack.begin(), end);
+    }
+    double elapsed = std::max(timer.GetElapsedSeconds(), 0.001);
+    std::printf("  %-24s %8d %10.3f %14.0f\n", "kAllMoves+RemoveIllegal",
+                static_cast<int>(end - stack.begin()), elapsed,
+                (num_calls / elapsed) / 1000);
+
+    // 合法手の生成（合法手のみを直接生成する方法）
+    PrintGeneratorThroughput<kLegalMoves>("kLegalMoves", pos, true, num_calls);
+    std::printf("\n");
+  }
+}
+
+#endif // !defined(MINIMUM)
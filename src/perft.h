@@ -0,0 +1,68 @@
+/*
+ * 技巧 (Gikou), a USI shogi (Japanese chess) playing engine.
+ * Copyright (C) 2016 Yosuke Demura
+ * except where otherwise indicated.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PERFT_H_
+#define PERFT_H_
+
+#include <cstdint>
+class Position;
+
+/**
+ * perft（指定された深さまでの、合法手による末端局面数の計数）を行うためのクラスです.
+ *
+ * 指し手生成部の正しさの検証と、速度の計測に用います。
+ *
+ * なお、本ソフトの指し手生成部は、歩・角・飛の不成を生成しないため、末端局面数は一般に知られている値よりも
+ * 少なくなります。例えば、平手初期局面からの末端局面数は、深さ1から順に
+ * 30, 900, 25440, 718565, 19778301, 544123956 となります
+ * （不成を含めた場合の値は、30, 900, 25470, 719731, 19861490, 547581517 です）。
+ */
+class Perft {
+ public:
+  /**
+   * 指定された局面から、指定された深さまでの末端局面数を数えます.
+   *
+   * 末端の１手前の局面では、合法手の数をそのまま末端局面数とします（bulk counting）。
+   * また、深さ2以上の局面については、置換表を用いて、同一局面の再計算を省略します。
+   *
+   * @param pos   計数を開始する局面
+   * @param depth 末端局面までの深さ（1以上）
+   * @return 末端局面数
+   */
+  static uint64_t Count(const Position& pos, int depth);
+
+  /**
+   * 指定された局面について、ルートの指し手ごとの末端局面数（divide）を表示します.
+   *
+   * ルートの指し手は、複数のスレッドで分担して計数します。
+   * 最後に、末端局面数の合計、計算時間及び１秒あたりの末端局面数を表示します。
+   *
+   * @param pos   計数を開始する局面
+   * @param depth 末端局面までの深さ（1以上）
+   */
+  static void Divide(const Position& pos, int depth);
+
+  /**
+   * 指し手生成のタイプごとに、指し手生成関数のスループットを表にして表示します.
+   * @param num_calls 各指し手生成関数を呼び出す回数
+   */
+  static void BenchmarkGenerators(int num_calls);
+};
+
+#endif /* PERFT_H_ */
@@ -19,36 +19,144 @@
 
 #if !defined(MINIMUM)
 
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
 #include <signal.h>
 #include <sys/wait.h>
+#if defined(__linux__)
+#include <sched.h>
+#include <sys/epoll.h>
+#endif
 
 #include "process.h"
 
+namespace {
+
+/**
+ * ファイルディスクリプタに、指定されたフラグを追加します.
+ */
+void AddFileDescriptorFlags(int fd, int fd_flags, int status_flags) {
+  fcntl(fd, F_SETFD, fcntl(fd, F_GETFD) | fd_flags);
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | status_flags);
+}
+
+} // namespace
+
 bool Process::GetLine(std::string* const line) {
-  line->clear();
-  for (char c; (c = std::fgetc(stream_from_child_)) != EOF;) {
-    // 改行コードが来たら終了する
-    if (c == '\n') return true;
-    // 末尾に一文字ずつ付け足していく
-    line->push_back(c);
+  while (!PopLine(line)) {
+    if (!WaitAndFillBuffer()) {
+      // EOFに達した場合、改行で終わっていない最後の行は捨てる
+      line->clear();
+      return false;
+    }
   }
-  return false;
+  return true;
+}
+
+bool Process::PopLine(std::string* const line) {
+  const char* begin = read_buffer_.data() + read_position_;
+  const size_t size = read_buffer_.size() - read_position_;
+  const void* newline = std::memchr(begin, '\n', size);
+  if (newline == nullptr) {
+    return false;
+  }
+  const char* end = static_cast<const char*>(newline);
+  line->assign(begin, end);
+  read_position_ += (end - begin) + 1;
+  return true;
 }
 
-int Process::StartProcess(const char* const file, char* const argv[]) {
+bool Process::PopMessage(std::string* const message, bool* const is_binary) {
+  const size_t size = read_buffer_.size() - read_position_;
+  if (size == 0) {
+    return false;
+  }
+
+  // 1. テキストの行の場合
+  const char* begin = read_buffer_.data() + read_position_;
+  if (*begin != kFrameMarker) {
+    *is_binary = false;
+    return PopLine(message);
+  }
+
+  // 2. バイナリ形式のフレームの場合
+  if (size < kFrameHeaderSize) {
+    return false;
+  }
+  const size_t payload_size = static_cast<uint8_t>(begin[1])
+                            | (static_cast<uint8_t>(begin[2]) << 8);
+  if (size < kFrameHeaderSize + payload_size) {
+    return false;
+  }
+  message->assign(begin + kFrameHeaderSize, payload_size);
+  read_position_ += kFrameHeaderSize + payload_size;
+  *is_binary = true;
+  return true;
+}
+
+bool Process::Read(void* const data, const size_t size) {
+  while (read_buffer_.size() - read_position_ < size) {
+    if (!WaitAndFillBuffer()) {
+      return false;
+    }
+  }
+  std::memcpy(data, read_buffer_.data() + read_position_, size);
+  read_position_ += size;
+  return true;
+}
+
+bool Process::FillBuffer() {
+  // 取り出し済みのデータを捨てて、バッファを詰める
+  if (read_position_ > 0) {
+    read_buffer_.erase(0, read_position_);
+    read_position_ = 0;
+  }
+
+  // 読み込めるだけ読み込む
+  const size_t old_size = read_buffer_.size();
+  read_buffer_.resize(old_size + kReadChunkSize);
+  ssize_t n;
+  do {
+    n = read(fd_from_child_, &read_buffer_[old_size], kReadChunkSize);
+  } while (n < 0 && errno == EINTR);
+  read_buffer_.resize(old_size + std::max(n, ssize_t(0)));
+
+  if (n < 0) {
+    // まだデータが届いていない場合は、エラーではない
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+  }
+  return n > 0;
+}
+
+bool Process::WaitAndFillBuffer() {
+  pollfd fds = {fd_from_child_, POLLIN, 0};
+  if (poll(&fds, 1, -1) < 0 && errno != EINTR) {
+    return false;
+  }
+  return FillBuffer();
+}
+
+int Process::StartProcess(const char* const file, char* const argv[],
+                          const std::vector<int>& cpus) {
   const int kRead = 0, kWrite = 1;
 
   int pipe_from_child[2];
   int pipe_to_child[2];
 
   // パイプの作成（親プロセス->子プロセス）
-  if (pipe(pipe_from_child) < 0) {
+  // （後から起動する子プロセスに、このパイプが引き継がれないように、作成時にFD_CLOEXECを設定しておく。
+  //   標準入出力にdup2()したファイルディスクリプタでは、FD_CLOEXECが外れるので、子プログラムには引き継がれる）
+  if (pipe2(pipe_from_child, O_CLOEXEC) < 0) {
     std::perror("failed to create pipe_from_chlid.\n");
     return -1;
   }
 
   // パイプの作成（子プロセス->親プロセス）
-  if (pipe(pipe_to_child) < 0) {
+  if (pipe2(pipe_to_child, O_CLOEXEC) < 0) {
     std::perror("failed to create pipe_to_child.\n");
     close(pipe_from_child[kRead]);
     close(pipe_from_child[kWrite]);
@@ -82,32 +190,61 @@ int Process::StartProcess(const char* const file, char* const argv[]) {
     close(pipe_to_child[kRead]);
     close(pipe_from_child[kWrite]);
 
+#if defined(__linux__)
+    // 指定されたCPUでのみ実行されるようにする（設定は、子プログラムにも引き継がれる）
+    if (!cpus.empty()) {
+      cpu_set_t cpu_set;
+      CPU_ZERO(&cpu_set);
+      for (int cpu : cpus) {
+        if (cpu < CPU_SETSIZE) {
+          CPU_SET(cpu, &cpu_set);
+        }
+      }
+      if (sched_setaffinity(0, sizeof(cpu_set), &cpu_set) < 0) {
+        std::perror("sched_setaffinity() failed\n");
+      }
+    }
+#endif
+
     // 子プロセスにおいて、子プログラムを起動する
     if (execvp(file, argv) < 0) {
       // プロセス起動時にエラーが発生した場合
       std::perror("execvp() failed\n");
-      close(pipe_to_child[kRead]);
-      close(pipe_from_child[kWrite]);
-      return -1;
+      _exit(EXIT_FAILURE);
     }
   }
 
   // プロセスIDを記憶させる
   process_id_ = process_id;
 
-  // パイプをファイルストリームとして開く
+  // 親プロセス側で使わないパイプを閉じる
+  // （閉じておかないと、子プロセスが終了しても、EOFを検出できない）
+  close(pipe_to_child[kRead]);
+  close(pipe_from_child[kWrite]);
+
+  // 受信側のパイプを、ノンブロッキングモードにする
+  AddFileDescriptorFlags(pipe_from_child[kRead], 0, O_NONBLOCK);
+
+  // 送信側は、パイプをファイルストリームとして開き、行バッファリングを行う
+  // （改行ごとにまとめて送信されるので、１コマンドにつき１回のシステムコールで済む）
   stream_to_child_ = fdopen(pipe_to_child[kWrite], "w");
-  stream_from_child_ = fdopen(pipe_from_child[kRead], "r");
+  std::setvbuf(stream_to_child_, NULL, _IOLBF, BUFSIZ);
 
-  // バッファリングをオフにする
-  // 注意：バッファリングをオフにしないと、外部プロセスとの通信が即時に行われない場合がある
-  std::setvbuf(stream_to_child_, NULL, _IONBF, 0);
-  std::setvbuf(stream_from_child_, NULL, _IONBF, 0);
+  // 受信側は、ノンブロッキングモードのファイルディスクリプタから、内部バッファにまとめて読み込む
+  fd_from_child_ = pipe_from_child[kRead];
+  read_buffer_.clear();
+  read_position_ = 0;
 
   return process_id;
 }
 
 int Process::WaitFor() {
+  // 子プロセスを起動していない場合（または、すでに終了状態を回収した場合）は、何もしない
+  // （waitpid()に-1を渡すと、無関係な子プロセスを待ってしまうため）
+  if (process_id_ <= 0) {
+    return -1;
+  }
+
   // 子プロセスの終了を待つ
   int status;
   pid_t process_id = waitpid(process_id_, &status, 0);
@@ -117,6 +254,7 @@ int Process::WaitFor() {
     std::perror("waitpid\n");
     return -1;
   }
+  process_id_ = -1; // 終了状態を回収済み
 
   if (WIFEXITED(status)) {
     // 子プロセスが正常に終了した場合
@@ -127,4 +265,200 @@ int Process::WaitFor() {
   }
 }
 
+bool Process::WaitFor(const std::chrono::milliseconds timeout) {
+  if (process_id_ <= 0) {
+    return true;
+  }
+  const auto deadline = std::chrono::steady_clock::now() + timeout;
+  do {
+    // 子プロセスが終了していれば、その終了状態を回収する
+    int status;
+    pid_t process_id = waitpid(process_id_, &status, WNOHANG);
+    if (process_id != 0) {
+      process_id_ = -1; // 終了した（またはエラーが発生した）
+      return true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  } while (std::chrono::steady_clock::now() < deadline);
+  return false;
+}
+
+void Process::Kill() {
+  if (process_id_ > 0) {
+    kill(process_id_, SIGKILL);
+    WaitFor();
+    process_id_ = -1;
+  }
+}
+
+void Process::Close() {
+  if (stream_to_child_ != nullptr) {
+    std::fclose(stream_to_child_);
+    stream_to_child_ = nullptr;
+  }
+  if (fd_from_child_ >= 0) {
+    close(fd_from_child_);
+    fd_from_child_ = -1;
+  }
+  read_buffer_.clear();
+  read_position_ = 0;
+}
+
+ProcessMultiplexer::ProcessMultiplexer() {
+  if (pipe2(wakeup_pipe_, O_CLOEXEC | O_NONBLOCK) < 0) {
+    std::perror("failed to create wakeup_pipe.\n");
+  }
+
+#if defined(__linux__)
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd_ < 0) {
+    std::perror("epoll_create1() failed.\n");
+  }
+  // IDがゼロのイベントは、待機解除用のパイプを表す
+  epoll_event event = {};
+  event.events = EPOLLIN;
+  event.data.u64 = 0;
+  epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wakeup_pipe_[0], &event);
+#endif
+
+  thread_ = std::thread([this](){ EventLoop(); });
+}
+
+ProcessMultiplexer::~ProcessMultiplexer() {
+  // EventLoop()を終了させる
+  exit_ = true;
+  const char c = 0;
+  ssize_t n = write(wakeup_pipe_[1], &c, 1);
+  (void)n;
+  thread_.join();
+
+#if defined(__linux__)
+  close(epoll_fd_);
+#endif
+  close(wakeup_pipe_[0]);
+  close(wakeup_pipe_[1]);
+}
+
+bool ProcessMultiplexer::Add(Process* const process, MessageHandler on_message,
+                             EofHandler on_eof) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  const uint64_t id = next_id_++;
+
+#if defined(__linux__)
+  epoll_event event = {};
+  event.events = EPOLLIN;
+  event.data.u64 = id;
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, process->output_fd(), &event) < 0) {
+    std::perror("epoll_ctl() failed.\n");
+    return false;
+  }
+#endif
+  entries_[id] = Entry{process, std::move(on_message), std::move(on_eof)};
+
+#if !defined(__linux__)
+  // 監視対象のリストを作り直させるため、poll()の待機を解除する
+  const char c = 0;
+  ssize_t n = write(wakeup_pipe_[1], &c, 1);
+  (void)n;
+#endif
+
+  // 登録前にすでに届いていたデータを処理する
+  ServiceEntry(id);
+  return true;
+}
+
+void ProcessMultiplexer::Remove(const Process* const process) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (const auto& pair : entries_) {
+    if (pair.second.process == process) {
+      RemoveEntry(pair.first);
+      return;
+    }
+  }
+}
+
+void ProcessMultiplexer::ServiceEntry(const uint64_t id) {
+  auto it = entries_.find(id);
+  if (it == entries_.end()) {
+    return; // すでに削除されたエントリ
+  }
+  Entry& entry = it->second;
+
+  // 読み込めるだけ読み込んでから、届いた行（またはフレーム）ごとにハンドラを呼ぶ
+  const bool eof = !entry.process->FillBuffer();
+  std::string message;
+  for (bool is_binary; entry.process->PopMessage(&message, &is_binary); ) {
+    entry.on_message(message, is_binary);
+  }
+
+  // EOFに達した場合は、監視対象から外してから、ハンドラを呼ぶ
+  if (eof) {
+    EofHandler on_eof = std::move(entry.on_eof);
+    RemoveEntry(id);
+    if (on_eof) {
+      on_eof();
+    }
+  }
+}
+
+void ProcessMultiplexer::RemoveEntry(const uint64_t id) {
+  auto it = entries_.find(id);
+  if (it == entries_.end()) {
+    return;
+  }
+#if defined(__linux__)
+  epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, it->second.process->output_fd(), nullptr);
+#endif
+  entries_.erase(it);
+}
+
+void ProcessMultiplexer::EventLoop() {
+  const int kMaxEvents = 64;
+  std::vector<uint64_t> ready_ids;
+
+  while (!exit_) {
+    ready_ids.clear();
+
+#if defined(__linux__)
+    // 1. Linuxの場合: epollで、データが届いたプロセスを待ち受ける
+    epoll_event events[kMaxEvents];
+    int num_events = epoll_wait(epoll_fd_, events, kMaxEvents, -1);
+    for (int i = 0; i < num_events; ++i) {
+      ready_ids.push_back(events[i].data.u64);
+    }
+#else
+    // 2. それ以外の場合: pollで、データが届いたプロセスを待ち受ける
+    std::vector<pollfd> fds;
+    std::vector<uint64_t> ids;
+    fds.push_back(pollfd{wakeup_pipe_[0], POLLIN, 0});
+    ids.push_back(0);
+    mutex_.lock();
+    for (const auto& pair : entries_) {
+      fds.push_back(pollfd{pair.second.process->output_fd(), POLLIN, 0});
+      ids.push_back(pair.first);
+    }
+    mutex_.unlock();
+    if (poll(fds.data(), fds.size(), -1) > 0) {
+      for (size_t i = 0; i < fds.size() && ready_ids.size() < kMaxEvents; ++i) {
+        if (fds[i].revents != 0) {
+          ready_ids.push_back(ids[i]);
+        }
+      }
+    }
+#endif
+
+    // 3. データが届いたプロセスごとに、ハンドラを呼ぶ
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (uint64_t id : ready_ids) {
+      if (id == 0) {
+        // 待機解除用のパイプを空にする
+        char buffer[64];
+        while (read(wakeup_pipe_[0], buffer, sizeof(buffer)) > 0) {}
+      } else {
+        ServiceEntry(id);
+      }
+    }
+  }
+}
+
 #endif /* !defined(MINIMUM) */
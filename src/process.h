@@ -22,31 +22,80 @@
 
 #if !defined(MINIMUM)
 
+#include <atomic>
+#include <chrono>
 #include <cstdio>
+#include <functional>
+#include <map>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 #include <unistd.h>
 
 /**
  * プロセス間通信を行うためのクラスです.
  * unistd.hヘッダを利用しているため、原則としてUNIX系OSでのみ使用可能です。
+ *
+ * 外部プロセスの標準出力は、ノンブロッキングモードのパイプから、まとめて内部バッファに読み込みます。
+ * このため、１バイトごとにシステムコールを発行することはなく、また、ProcessMultiplexerを用いれば、
+ * 複数の外部プロセスからの出力を１つのスレッドで受信することができます。
+ *
+ * 外部プロセスの標準出力には、テキストの行に加えて、バイナリ形式のフレーム
+ * （kFrameMarkerで始まり、16ビットのペイロード長とペイロードが続くもの）を混在させることができます。
  */
 class Process {
  public:
+  /** バイナリ形式のフレームの先頭を表すバイト */
+  static constexpr char kFrameMarker = '\x02';
+
+  /** バイナリ形式のフレームのヘッダ（先頭のバイトとペイロード長）のバイト数 */
+  static constexpr size_t kFrameHeaderSize = 3;
+
+  /** バイナリ形式のフレームのペイロードの最大バイト数 */
+  static constexpr size_t kMaxFramePayloadSize = 65535;
+
   /**
    * 外部プロセスを起動します.
    * @param file 外部プロセスのファイル名
    * @param argv 外部プロセスに渡す引数の配列（配列の最後の要素は必ずNULLにする。execvp()のマニュアル参照。）
+   * @param cpus 外部プロセスを実行するCPUの番号（空ならば指定しない。Linux以外では無視される。）
    * @return 外部プロセスの起動に成功したときは、プロセスID。失敗したときは、-1。
    */
-  int StartProcess(const char* file, char* const argv[]);
+  int StartProcess(const char* file, char* const argv[],
+                   const std::vector<int>& cpus = std::vector<int>());
 
   /**
    * 外部プロセスの標準出力から１行読み込みます.
+   * 読み込める行がまだ届いていない場合は、届くまで待機します。
    * @param line 外部プロセスの標準出力から読み込んだ行
    * @return EOFまで読み込んだときは、false。まだ残りの行があるときは、true。
    */
   bool GetLine(std::string* line);
 
+  /**
+   * 内部バッファに、改行まで届いている行があれば、それを１行取り出します.
+   * GetLine()とは異なり、待機はしません。
+   * @param line 取り出した行（改行コードは含みません）
+   * @return 行を取り出せた場合はtrue
+   */
+  bool PopLine(std::string* line);
+
+  /**
+   * 内部バッファに、すべて届いている行またはフレームがあれば、それを１つ取り出します.
+   * @param message   取り出した行（改行コードは含みません）、またはフレームのペイロード
+   * @param is_binary フレームを取り出した場合はtrue、行を取り出した場合はfalse
+   * @return 行またはフレームを取り出せた場合はtrue
+   */
+  bool PopMessage(std::string* message, bool* is_binary);
+
+  /**
+   * 外部プロセスの標準出力から、現在読み込めるだけのデータを内部バッファに読み込みます.
+   * まだデータが届いていない場合は、何も読み込まずに直ちに戻ります。
+   * @return EOFに達した場合、または読み込みエラーが発生した場合はfalse
+   */
+  bool FillBuffer();
+
   /**
    * 外部プロセスの標準入力に対し、フォーマット指定して書き込みます.
    */
@@ -55,6 +104,16 @@ class Process {
     std::fprintf(stream_to_child_, format, args...);
   }
 
+  /**
+   * 外部プロセスの標準入力へのストリームに溜まっているデータを、直ちに送信します.
+   *
+   * 標準入力へのストリームは行バッファリングされているため、改行で終わるコマンドは自動的に送信されます。
+   * 改行を含まないデータを送信する場合に、このメソッドを呼んでください。
+   */
+  void Flush() {
+    std::fflush(stream_to_child_);
+  }
+
   /**
    * 外部プロセスの標準入力に対し、１行書き込みます.
    */
@@ -62,12 +121,45 @@ class Process {
     std::fprintf(stream_to_child_, "%s\n", str);
   }
 
+  /**
+   * 外部プロセスの標準入力に対し、バイナリデータを書き込みます.
+   * @return 全てのデータを書き込めた場合はtrue
+   */
+  bool Write(const void* data, size_t size) {
+    bool success = std::fwrite(data, 1, size, stream_to_child_) == size;
+    return std::fflush(stream_to_child_) == 0 && success;
+  }
+
+  /**
+   * 外部プロセスの標準出力から、バイナリデータを読み込みます.
+   * @return 指定されたサイズのデータを全て読み込めた場合はtrue
+   */
+  bool Read(void* data, size_t size);
+
   /**
    * 外部プロセスが終了するまで待機します.
    * @return 正常終了した場合は0を、異常終了した場合は-1を返します。
    */
   int WaitFor();
 
+  /**
+   * 外部プロセスが終了するまで、指定された時間だけ待機します.
+   * @param timeout 待機する最大の時間
+   * @return 時間内に外部プロセスが終了した場合はtrue
+   */
+  bool WaitFor(std::chrono::milliseconds timeout);
+
+  /**
+   * 外部プロセスを強制終了させ、終了するまで待機します（応答しなくなった外部プロセス用）.
+   */
+  void Kill();
+
+  /**
+   * 外部プロセスとの間のパイプを閉じます.
+   * 同じProcessオブジェクトで別の外部プロセスを起動し直す前に、呼んでください。
+   */
+  void Close();
+
   /**
    * 起動している外部プロセスのプロセスIDを返します.
    */
@@ -75,15 +167,119 @@ class Process {
     return process_id_;
   }
 
+  /**
+   * 外部プロセスの標準出力につながれたファイルディスクリプタを返します.
+   */
+  int output_fd() const {
+    return fd_from_child_;
+  }
+
  private:
+  /**
+   * 外部プロセスの標準出力にデータが届くまで待機してから、内部バッファに読み込みます.
+   * @return EOFに達した場合、または読み込みエラーが発生した場合はfalse
+   */
+  bool WaitAndFillBuffer();
+
+  /** １回のread()で読み込む最大のバイト数 */
+  static constexpr size_t kReadChunkSize = 64 * 1024;
+
   /** 外部プロセスのプロセスID */
-  pid_t process_id_;
+  pid_t process_id_ = -1;
 
   /** 外部プロセスの標準入力につながれたストリーム（外部プロセスへの送信用） */
-  std::FILE* stream_to_child_;
+  std::FILE* stream_to_child_ = nullptr;
+
+  /** 外部プロセスの標準出力につながれたファイルディスクリプタ（外部プロセスからの受信用） */
+  int fd_from_child_ = -1;
+
+  /** 外部プロセスの標準出力から読み込んだ、まだ取り出していないデータ */
+  std::string read_buffer_;
+
+  /** read_buffer_のうち、すでに取り出したデータのバイト数 */
+  size_t read_position_ = 0;
+};
+
+/**
+ * 複数の外部プロセスの標準出力を、１つのスレッドで受信するためのクラスです.
+ *
+ * 登録された外部プロセスの標準出力をepoll（Linux以外ではpoll）で監視し、データが届いたプロセスから
+ * まとめて読み込んで、届いた行（またはバイナリ形式のフレーム）ごとにハンドラを呼び出します。
+ * ワーカーごとに受信専用のスレッドを用意する必要がないので、多数のワーカーを使う場合に有効です。
+ *
+ * ハンドラは、このクラスが内部で起動するスレッドから呼び出されます（ただし、Add()の時点ですでに
+ * 内部バッファに溜まっていた行については、Add()の呼び出し元のスレッドから呼び出されます）。
+ * なお、ハンドラの内部からAdd()やRemove()を呼び出すことはできません。
+ */
+class ProcessMultiplexer {
+ public:
+  /** １行（またはフレームを１つ）受信するたびに呼ばれるハンドラ */
+  typedef std::function<void(const std::string& message, bool is_binary)> MessageHandler;
+
+  /** 外部プロセスの標準出力がEOFに達したときに呼ばれるハンドラ */
+  typedef std::function<void()> EofHandler;
+
+  ProcessMultiplexer();
+  ~ProcessMultiplexer();
+
+  ProcessMultiplexer(const ProcessMultiplexer&) = delete;
+  ProcessMultiplexer& operator=(const ProcessMultiplexer&) = delete;
+
+  /**
+   * 外部プロセスを、監視対象に追加します.
+   * @param process 監視する外部プロセス（起動済みのもの）
+   * @param on_message １行（またはフレームを１つ）受信するたびに呼ばれるハンドラ
+   * @param on_eof     EOFに達したときに呼ばれるハンドラ（EOFに達したプロセスは、自動的に監視対象から外れます）
+   * @return 追加に成功した場合はtrue
+   */
+  bool Add(Process* process, MessageHandler on_message, EofHandler on_eof);
+
+  /**
+   * 外部プロセスを、監視対象から外します.
+   * このメソッドが戻った後は、そのプロセスについてのハンドラが呼ばれることはありません。
+   */
+  void Remove(const Process* process);
+
+ private:
+  struct Entry {
+    Process* process;
+    MessageHandler on_message;
+    EofHandler on_eof;
+  };
+
+  /**
+   * 外部プロセスからの出力を待ち受けて、ハンドラを呼び出すループです.
+   */
+  void EventLoop();
+
+  /**
+   * 指定されたエントリの外部プロセスから読み込めるだけ読み込み、ハンドラを呼び出します.
+   * EOFに達した場合は、エントリを削除します（mutex_をロックした状態で呼ぶこと）。
+   */
+  void ServiceEntry(uint64_t id);
+
+  /**
+   * 指定されたエントリを、監視対象から外します（mutex_をロックした状態で呼ぶこと）.
+   */
+  void RemoveEntry(uint64_t id);
+
+  /** epollのファイルディスクリプタ（Linux以外では使用しない） */
+  int epoll_fd_ = -1;
+
+  /** EventLoop()の待機を解除するためのパイプ */
+  int wakeup_pipe_[2] = {-1, -1};
+
+  /** 監視対象のエントリ（キーは、登録時に割り当てたID） */
+  std::map<uint64_t, Entry> entries_;
+
+  /** 次に登録するエントリのID */
+  uint64_t next_id_ = 1;
+
+  /** entries_とハンドラの呼び出しを排他制御するためのmutex */
+  std::mutex mutex_;
 
-  /** 外部プロセスの標準出力につながれたストリーム（外部プロセスからの受信用） */
-  std::FILE* stream_from_child_;
+  std::atomic_bool exit_{false};
+  std::thread thread_;
 };
 
 #endif /* !defined(MINIMUM) */
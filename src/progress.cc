@@ -24,6 +24,7 @@
 #include <omp.h>
 #include "common/math.h"
 #include "gamedb.h"
+#include "optimizer.h"
 #include "position.h"
 
 ArrayMap<int32_t, Square, PsqIndex> Progress::weights;
@@ -116,8 +117,7 @@ void Progress::LearnParameters() {
   const Position startpos = Position::CreateStartPosition();
 
   // 棋譜データの準備
-  std::ifstream game_db_file(GameDatabase::kDefaultDatabaseFile);
-  GameDatabase game_db(game_db_file);
+  GameDatabase game_db;
   std::vector<Game> games, samples;
   std::printf("start reading games.\n");
   for (int i = 0; i < kNumGames; ++i) {
@@ -187,36 +187,26 @@ void Progress::LearnParameters() {
       }
     }
 
-    // 3. 重みを更新する
-    double lasso = 0, tikhonov = 0;
-#pragma omp parallel for reduction(+:lasso, tikhonov) schedule(static)
-    for (size_t i = 0; i < gradients.size(); ++i) {
-      double& w = current_weights[i];
-      double& r = accumulated_gradients[i];
-      double& s = accumulated_deltas[i];
-      double& v = momentum[i];
-      double gradient = gradients[i];
-      // 損失を計算する
-      lasso    += kL1Penalty * std::abs(w);
-      tikhonov += kL2Penalty * (w * w);
-      // 勾配方向に移動する（AdaDelta + Momentum）
-      r = kDecay * r + (1.0 - kDecay) * (gradient * gradient);
-      double eta = std::sqrt(s) / std::sqrt(r + kEpsilon);
-      v = kMomentum * v - (1.0 - kMomentum) * eta * gradient;
-      s = kDecay * s + (1.0 - kDecay) * (v * v);
-      w = w + v;
-      // ペナルティをかける（FOBOS）
-      // （参考文献）
-      //   - John Duchi, Yoram Singer: Efficient Learning with Forward-Backward Splitting,
-      //     http://web.stanford.edu/~jduchi/projects/DuchiSi09c_slides.pdf,
-      //     pp.12-13, 2009.
-      //   - Zachary C. Lipton, Charles Elkan: Efficient Elastic Net Regularization for Sparse Linear Models,
-      //     http://zacklipton.com/media/papers/lazy-updates-elastic-net-lipton2015_1.pdf,
-      //     p.9, 2015.
-      double lambda1 = eta * kL1Penalty;
-      double lambda2 = eta * kL2Penalty;
-      w = math::sign(w) * std::max((std::abs(w) - lambda1) / (1.0 + lambda2), 0.0);
-    }
+    // 3. 重みを更新する（AdaDelta + Momentum + FOBOS）
+    // （参考文献）
+    //   - John Duchi, Yoram Singer: Efficient Learning with Forward-Backward Splitting,
+    //     http://web.stanford.edu/~jduchi/projects/DuchiSi09c_slides.pdf,
+    //     pp.12-13, 2009.
+    //   - Zachary C. Lipton, Charles Elkan: Efficient Elastic Net Regularization for Sparse Linear Models,
+    //     http://zacklipton.com/media/papers/lazy-updates-elastic-net-lipton2015_1.pdf,
+    //     p.9, 2015.
+    Optimizer::AdaDeltaConfig config;
+    config.decay = kDecay;
+    config.momentum = kMomentum;
+    config.epsilon = kEpsilon;
+    config.l1_penalty = kL1Penalty;
+    config.l2_penalty = kL2Penalty;
+    const Optimizer::Norms norms = Optimizer::UpdateAdaDelta(
+        config, gradients.begin(), accumulated_gradients.begin(),
+        accumulated_deltas.begin(), momentum.begin(), current_weights.begin(),
+        gradients.size());
+    const double lasso = kL1Penalty * norms.l1;
+    const double tikhonov = kL2Penalty * norms.l2;
 
     // 4. 計算用の重みにコピーする
     for (Square king_sq : Square::all_squares()) {
@@ -21,6 +21,7 @@
 #define PSQ_H_
 
 #include <cstdlib>
+#include <smmintrin.h> // SSE 4.1
 #include "common/array.h"
 #include "common/arraymap.h"
 #include "common/sequence.h"
@@ -40,6 +40,8 @@
 #include "thread.h"
 #include "time_manager.h"
 #include "usi.h"
+#include "usi_output.h"
+#include "worker_protocol.h"
 #include "zobrist.h"
 
 namespace {
@@ -1203,6 +1205,39 @@ void Search::SendUsiInfo(const Node& node, int depth, int64_t time,
   // infoコマンドを一時的に貯めておくためのバッファ
   std::string buf;
 
+#if !defined(MINIMUM)
+  // クラスタのマスターから要求された場合は、infoコマンドをバイナリ形式で送信する
+  if (WorkerProtocol::binary_info_enabled()) {
+    for (int pv_index = 0; pv_index < multipv_; ++pv_index) {
+      const std::vector<Move>& pv = root_moves_.at(pv_index).pv;
+      Score score = root_moves_.at(pv_index).score;
+      WorkerProtocol::InfoHeader header = WorkerProtocol::InfoHeader();
+      header.time = time;
+      header.nodes = nodes;
+      header.nps = (1000 * nodes) / time;
+      header.depth = depth;
+      header.seldepth = max_reach_ply_ + 1;
+      header.hashfull = shared_.hash_table.hashfull();
+      header.multipv = pv_index + 1;
+      header.score = score;
+      header.bound = (kScoreMatedInMaxPly < score && score < kScoreMateInMaxPly)
+                   ? bound : kBoundExact;
+      // PVの長さが短すぎる場合は、置換表から残りの読み筋を取得する
+      if (depth >= 3 && pv.size() <= 2U) {
+        std::vector<Move> extended_pv = pv;
+        for (Move move : shared_.hash_table.ExtractMoves(node, pv)) {
+          extended_pv.push_back(move);
+        }
+        WorkerProtocol::AppendInfoFrame(header, extended_pv, &buf);
+      } else {
+        WorkerProtocol::AppendInfoFrame(header, pv, &buf);
+      }
+    }
+    WorkerProtocol::SendFrames(buf);
+    return;
+  }
+#endif
+
   // マルチPVのループ
   for (int pv_index = 0; pv_index < multipv_; ++pv_index) {
     Score score = root_moves_.at(pv_index).score;
@@ -1256,5 +1291,5 @@ void Search::SendUsiInfo(const Node& node, int depth, int64_t time,
   }
 
   // infoコマンドをまとめて標準出力へ出力する
-  SYNCED_PRINTF("%s", buf.c_str());
+  g_usi_output.Write(std::move(buf));
 }
@@ -0,0 +1,121 @@
+/*
+ * 技巧 (Gikou), a USI shogi (Japanese chess) playing engine.
+ * Copyright (C) 2016 Yosuke Demura
+ * except where otherwise indicated.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#if !defined(MINIMUM)
+
+#include "shared_memory.h"
+
+#include <cstdio>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+SharedMemory::~SharedMemory() {
+  Close();
+}
+
+bool SharedMemory::Create(const char* const name, const size_t size) {
+  Close();
+
+  // 1. 共有メモリを作成する（同名の共有メモリが残っている場合は、古いものを削除してから作り直す）
+  shm_unlink(name);
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0) {
+    std::perror("shm_open() failed.\n");
+    return false;
+  }
+
+  // 2. サイズを設定する（新たに確保された領域は、ゼロで埋められる）
+  if (ftruncate(fd, static_cast<off_t>(size)) < 0) {
+    std::perror("ftruncate() failed.\n");
+    close(fd);
+    shm_unlink(name);
+    return false;
+  }
+
+  // 3. メモリにマップする
+  if (!Map(fd, size)) {
+    shm_unlink(name);
+    return false;
+  }
+  name_ = name;
+  created_ = true;
+  return true;
+}
+
+bool SharedMemory::Open(const char* const name) {
+  Close();
+
+  // 1. 共有メモリを開く
+  int fd = shm_open(name, O_RDWR, 0600);
+  if (fd < 0) {
+    return false;
+  }
+
+  // 2. サイズを調べる
+  struct stat shm_stat;
+  if (fstat(fd, &shm_stat) < 0 || shm_stat.st_size == 0) {
+    close(fd);
+    return false;
+  }
+
+  // 3. メモリにマップする
+  if (!Map(fd, static_cast<size_t>(shm_stat.st_size))) {
+    return false;
+  }
+  name_ = name;
+  return true;
+}
+
+void SharedMemory::Close() {
+  if (data_ != nullptr) {
+    munmap(data_, size_);
+    data_ = nullptr;
+    size_ = 0;
+  }
+  if (created_) {
+    shm_unlink(name_.c_str());
+    created_ = false;
+  }
+  name_.clear();
+}
+
+void SharedMemory::Swap(SharedMemory& other) {
+  std::swap(data_, other.data_);
+  std::swap(size_, other.size_);
+  std::swap(name_, other.name_);
+  std::swap(created_, other.created_);
+}
+
+bool SharedMemory::Map(const int fd, const size_t size) {
+  // マップ後は、ファイルディスクリプタを閉じてもよい
+  void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    std::perror("mmap() failed.\n");
+    return false;
+  }
+  data_ = static_cast<char*>(addr);
+  size_ = size;
+  return true;
+}
+
+#endif /* !defined(MINIMUM) */
@@ -0,0 +1,112 @@
+/*
+ * 技巧 (Gikou), a USI shogi (Japanese chess) playing engine.
+ * Copyright (C) 2016 Yosuke Demura
+ * except where otherwise indicated.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SHARED_MEMORY_H_
+#define SHARED_MEMORY_H_
+
+#if !defined(MINIMUM)
+
+#include <cstddef>
+#include <string>
+
+/**
+ * 複数のプロセスから読み書きできる、名前付きの共有メモリを扱うためのクラスです.
+ *
+ * 同じマシン上で動作するクラスタのワーカーどうしで、ハッシュテーブルを共有するために使用します。
+ * shm_open()及びmmap()を利用しているため、原則としてUNIX系OSでのみ使用可能です。
+ */
+class SharedMemory {
+ public:
+  SharedMemory() {}
+  ~SharedMemory();
+
+  SharedMemory(const SharedMemory&) = delete;
+  SharedMemory& operator=(const SharedMemory&) = delete;
+
+  /**
+   * 共有メモリを新規に作成して、メモリにマップします.
+   * 作成した共有メモリはゼロ初期化されています。また、Close()時に、共有メモリの名前が削除されます。
+   * @param name 共有メモリの名前（"/"で始まる文字列）
+   * @param size 共有メモリのサイズ（バイト数）
+   * @return 作成に成功した場合はtrue
+   */
+  bool Create(const char* name, size_t size);
+
+  /**
+   * 他のプロセスが作成した共有メモリを開いて、メモリにマップします.
+   * @param name 共有メモリの名前（"/"で始まる文字列）
+   * @return マップに成功した場合はtrue
+   */
+  bool Open(const char* name);
+
+  /**
+   * マップを解除します.
+   * この共有メモリを作成したプロセスの場合は、共有メモリの名前も削除します
+   * （すでにマップしている他のプロセスは、マップを解除するまで引き続き使用できます）。
+   */
+  void Close();
+
+  /**
+   * 他のSharedMemoryオブジェクトと、保持している共有メモリを交換します.
+   */
+  void Swap(SharedMemory& other);
+
+  /**
+   * 共有メモリがマップされている場合は、trueを返します.
+   */
+  bool is_open() const {
+    return data_ != nullptr;
+  }
+
+  /**
+   * マップされている共有メモリの名前を返します.
+   */
+  const std::string& name() const {
+    return name_;
+  }
+
+  /**
+   * マップされたデータの先頭を返します.
+   */
+  char* data() const {
+    return data_;
+  }
+
+  /**
+   * マップされたデータのサイズ（バイト数）を返します.
+   */
+  size_t size() const {
+    return size_;
+  }
+
+ private:
+  bool Map(int fd, size_t size);
+
+  char* data_ = nullptr;
+  size_t size_ = 0;
+
+  /** 共有メモリの名前 */
+  std::string name_;
+
+  /** この共有メモリを作成した場合はtrue（Close()時に名前を削除する） */
+  bool created_ = false;
+};
+
+#endif /* !defined(MINIMUM) */
+#endif /* SHARED_MEMORY_H_ */
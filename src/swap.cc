@@ -55,20 +55,88 @@ PieceType FindLeastValuableAttacker(const Position& pos, Bitboard pieces,
   return kKing;
 }
 
+/**
+ * 駒を動かすことにより、移動元のマスで止まっていた色cの長い利きが、移動先のマスまで届くようになる場合に、
+ * trueを返します.
+ */
+inline bool DiscoversLongControl(const Position& pos, Color c, Move move) {
+  if (move.is_drop()) {
+    return false;
+  }
+  DirectionSet long_controls = pos.long_controls(c, move.from());
+  if (long_controls.none()) {
+    return false;
+  }
+  // 長い利きの方向にある隣のマスが、移動元から移動先までの間（移動先を含む）にあるか否かを調べる
+  Bitboard path = between_bb(move.from(), move.to()) | square_bb(move.to());
+  return direction_bb(move.from(), long_controls).test(path);
+}
+
+/**
+ * 移動先のマスで、相手の駒に取り返される可能性がない場合に、trueを返します.
+ */
+inline bool CannotBeRecaptured(const Position& pos, Move move) {
+  const Color opponent = ~pos.side_to_move();
+  return   !pos.square_is_attacked(opponent, move.to())
+        && !DiscoversLongControl(pos, opponent, move);
+}
+
+/**
+ * 移動先のマスで、動かした駒を取り返されても、味方の駒で取り返すことができない場合に、trueを返します.
+ */
+inline bool CannotBeDefended(const Position& pos, Move move) {
+  const Color side = pos.side_to_move();
+  const Square to = move.to();
+
+  // 動かす駒自身の利きは、移動先のマスを守る利きには数えない
+  const int moving_piece_control = move.is_drop() ? 0 : 1;
+  if (pos.num_controls(side, to) != moving_piece_control) {
+    return false;
+  }
+
+  // 取り合いの途中で、間にある駒がどいて、味方の飛び駒の利きが通る可能性がないことを確かめる
+  Bitboard lines = max_attacks_bb(Piece(kBlack, kDragon), to)
+                 | max_attacks_bb(Piece(kBlack, kHorse), to);
+  Bitboard sliders = pos.pieces(side, kLance, kBishop, kRook, kHorse, kDragon);
+  if (!move.is_drop()) {
+    sliders.reset(move.from());
+  }
+  return (sliders & lines).none();
+}
+
+/**
+ * 最初の１手による、駒割りの増分を返します.
+ */
+inline Score GetFirstGain(Move move) {
+  Score gain = Material::exchange_value(move.captured_piece_type());
+  if (move.is_promotion()) {
+    gain += Material::promotion_value(move.piece_type());
+  }
+  return gain;
+}
+
 } // namespace
 
 Score Swap::Evaluate(const Move move, const Position& pos) {
   assert(pos.MoveIsPseudoLegal(move));
 
+  // 移動先のマスに相手の利きがなければ、取り合いは起こらないので、直ちにリターンする
+  if (CannotBeRecaptured(pos, move)) {
+    return GetFirstGain(move);
+  }
+
+  return EvaluateSwapSequence(move, pos);
+}
+
+Score Swap::EvaluateSwapSequence(const Move move, const Position& pos) {
+  assert(pos.MoveIsPseudoLegal(move));
+
   Array<Score, 40> gain;
   const Square to = move.to();
   Square from = move.is_drop() ? move.to() : move.from();
 
   // 最初の１手について、駒割りの増分を求める
-  gain[0] = Material::exchange_value(move.captured_piece_type());
-  if (move.is_promotion()) {
-    gain[0] += Material::promotion_value(move.piece_type());
-  }
+  gain[0] = GetFirstGain(move);
 
   // 移動先のマスに利いている相手の駒を求める
   Color stm = ~pos.side_to_move();
@@ -77,7 +145,6 @@ Score Swap::Evaluate(const Move move, const Position& pos) {
   Bitboard stm_attackers = attackers & pos.pieces(stm);
 
   // 移動先のマスに相手の駒が利いていなければ、直ちにリターンする
-  // TODO 利きデータを使って高速化
   if (stm_attackers.none()) {
     return gain[0];
   }
@@ -138,7 +205,10 @@ bool Swap::IsWinning(Move move, const Position& pos) {
   if (gain > loss && !opponent_can_promote) {
     return true;
   }
-  return Evaluate(move, pos) > kScoreZero;
+  if (CannotBeRecaptured(pos, move)) {
+    return GetFirstGain(move) > kScoreZero;
+  }
+  return EvaluateSwapSequence(move, pos) > kScoreZero;
 }
 
 bool Swap::IsLosing(Move move, const Position& pos) {
@@ -149,5 +219,17 @@ bool Swap::IsLosing(Move move, const Position& pos) {
   if (gain >= loss && !opponent_can_promote) {
     return false;
   }
-  return Evaluate(move, pos) < kScoreZero;
+  if (CannotBeRecaptured(pos, move)) {
+    return GetFirstGain(move) < kScoreZero;
+  }
+  // 味方の駒で取り返せない場合、相手に取り返されたときの損得は、相手の成りを考慮しなくても、
+  // それ以上にはならないので、その時点で損であれば、取り合いを調べるまでもなく損であるとわかる
+  if (CannotBeDefended(pos, move)) {
+    Score first_gain = GetFirstGain(move);
+    Score lost_piece = Material::exchange_value(move.piece_type_after_move());
+    if (first_gain - lost_piece < kScoreZero) {
+      return true;
+    }
+  }
+  return EvaluateSwapSequence(move, pos) < kScoreZero;
 }
@@ -30,9 +30,18 @@ class Swap {
  public:
   /**
    * 駒交換の損得（SEE値）を計算します.
+   *
+   * 移動先のマスに相手の利きがない場合は、ExtendedBoardの利き数を参照するだけで、
+   * 駒の取り合いを調べることなく、直ちに値を返します。
    */
   static Score Evaluate(Move move, const Position& pos);
 
+  /**
+   * 利き数による早期終了を行わずに、駒交換の損得（SEE値）を計算します.
+   * Evaluate()の結果と一致することを確かめるため、ベンチマークなどで用います。
+   */
+  static Score EvaluateSwapSequence(Move move, const Position& pos);
+
   /**
    * 駒交換が得になる場合（SEE値 > 0 の場合）に、trueを返します.
    */
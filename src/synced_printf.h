@@ -10,6 +10,7 @@
 
 #include <cstdio>
 #include <mutex>
+#include "usi_output.h"
 
 /**
  * SYNCED_PRINTFマクロの内部実装で使用されている、mutexです.
@@ -18,10 +19,9 @@ extern std::mutex g_synced_printf_mutex;
 
 /**
  * 排他制御された、printf()関数です.
+ * 実際の出力は、UsiOutputクラスの出力用のスレッドがまとめて行います。
  */
 #define SYNCED_PRINTF(...) { \
-  g_synced_printf_mutex.lock();      \
-  std::printf(__VA_ARGS__);  \
-  g_synced_printf_mutex.unlock(); }
+  g_usi_output.Printf(__VA_ARGS__); }
 
 #endif /* SYNCED_PRINTF_H_ */
@@ -41,12 +41,39 @@ Thinking::Thinking(const UsiOptions& usi_options)
 }
 
 void Thinking::Initialize() {
-  book_.ReadFromFile(kBookFile);
-  shared_data_.hash_table.SetSize(usi_options_["USI_Hash"]);
+  if (!book_is_loaded_) {
+    book_.ReadFromFile(kBookFile);
+    book_is_loaded_ = true;
+  }
+
+#if !defined(MINIMUM)
+  // クラスタのマスターから指定された場合は、共有メモリ上のハッシュテーブルを使用する
+  // （SharedHashIdオプションは、単独のエンジンとして起動した場合にのみ存在する）
+  const int shared_hash_id =
+      usi_options_.HasOption("SharedHashId") ? int(usi_options_["SharedHashId"]) : 0;
+  if (shared_hash_id != 0) {
+    const std::string name = HashTable::SharedTableName(shared_hash_id);
+    if (shared_data_.hash_table.AttachSharedTable(name.c_str())) {
+      hash_size_ = 0;
+      return;
+    }
+    SYNCED_PRINTF("info string Failed to attach shared hash table %s.\n", name.c_str());
+  }
+#endif
+
+  // 置換表の大きさが変わらない場合は、確保し直さない（内容の消去は、StartNewGame()で行う）
+  const size_t hash_size = usi_options_["USI_Hash"];
+  if (hash_size != hash_size_) {
+    shared_data_.hash_table.SetSize(hash_size);
+    hash_size_ = hash_size;
+  }
 }
 
 void Thinking::StartNewGame() {
-  // 現在のところ、特に行う処理はない
+  // 前の対局の置換表を消去する（共有メモリ上の置換表は、マスターがusinewgameの受信時に消去する）
+  if (hash_size_ != 0) {
+    shared_data_.hash_table.Clear();
+  }
 }
 
 void Thinking::ResetSignals() {
@@ -61,6 +61,8 @@ class Thinking {
 
   /**
    * 定跡の読み込みや、置換表の確保など、思考部の初期化処理を行います.
+   * 何度呼んでもよく、２回目以降は、置換表の大きさが変更された場合などを除き、ほとんど何もしません
+   * （クラスタのマスターは、ワーカーの死活監視のため、isreadyコマンドを定期的に送るため）。
    */
   void Initialize();
 
@@ -94,6 +96,8 @@ class Thinking {
   std::mutex mutex_;
   std::condition_variable sleep_condition_;
   Book book_;
+  bool book_is_loaded_ = false;
+  size_t hash_size_ = 0; // 専用の置換表を確保した際の大きさ（MB）。共有メモリを使っている場合は0。
   SharedData shared_data_;
   SimpleTimeManager time_manager_;
   ThreadManager thread_manager_;
@@ -87,7 +87,18 @@ int64_t DynamicTimeControl::target_time() const {
     target /= stats.agreement_rate;
   }
 
-  // 3. 先読み中は、思考時間を25%延長する
+  // 3. 最善手が不安定な場合は、最善手が１回変化するごとに思考時間を25%延長する（最大で２倍まで）
+  if (stats.pv_instability > 0.0) {
+    target *= std::min(1.0 + 0.25 * (stats.pv_instability - 1.0), 2.0);
+  }
+
+  // 4. 最善手が次善手よりも明らかに優れている場合は、思考時間を半分にする
+  const Score kEasyMoveMargin = static_cast<Score>(400);
+  if (stats.singular_margin >= kEasyMoveMargin) {
+    target *= 0.5;
+  }
+
+  // 5. 先読み中は、思考時間を25%延長する
   if (go_options_.ponder) {
     target += target * 0.25;
   }
@@ -47,6 +47,7 @@ class TimeControl {
       agreement_rate = -1.0;
       pv_instability = -1.0;
       search_insufficiency = -1.0;
+      consensus = false;
     }
 
     /**
@@ -57,7 +58,8 @@ class TimeControl {
     /**
      * 最善手の評価値と、次善手の評価値の差を表します.
      *
-     * TODO 今後実装する
+     * 現在は、クラスタのマスターが、各ワーカーの評価値から計算してセットしています。
+     * 差が十分に大きい場合は、最善手が明らかであるとみなして、思考時間を短縮します。
      *
      * 値域は、0 <= x <= 2 * kScoreInfinite です。
      * なお、負の値がセットされていると、この統計データは無視されます。
@@ -86,9 +88,8 @@ class TimeControl {
     /**
      * PVの不安定性を表します.
      *
-     * TODO 今後実装する
-     *
      * pv_instability = 1.0 + (最善手が変化した回数) と定義されます。
+     * ただし、最善手が変化した回数は、探索が深くなるたびに半減させてもかまいません（古い変化ほど軽く扱うため）。
      * 値域は、1.0 <= x です。
      *
      * なお、負の値がセットされていると、この統計データは無視されます。
@@ -109,6 +110,14 @@ class TimeControl {
      *     pp.29-31, 共立出版, 2005.
      */
     double search_insufficiency = -1.0;
+
+    /**
+     * 合議を行っているときに、ワーカーの意見が一致し、それ以上考える必要がなくなった場合はtrueです.
+     *
+     * trueがセットされると、TimeManagerは、最小思考時間を消費した時点で思考を打ち切ります。
+     * 目標思考時間との差は、残り時間として、以降の指し手に回されます。
+     */
+    bool consensus = false;
   };
 
   TimeControl(const Position& position, const UsiGoOptions& go_options,
@@ -151,14 +151,21 @@ void TimeManager::Run() {
       goto sleep;
     }
 
-    // Step 2. 消費時間ベースの打ち切り
+    // Step 2. 合議で意見が一致した場合の打ち切り
+    // 最小思考時間を消費していれば、目標時間に達していなくても、思考を終了する
+    if (time_control_->stats.consensus) {
+      HandleTimeUpEvent();
+      break;
+    }
+
+    // Step 3. 消費時間ベースの打ち切り
     // 消費時間が最大思考時間を上回ったら思考を直ちに終了する
     if (expended_time() >= time_control_->maximum_time()) {
       HandleTimeUpEvent();
       break;
     }
 
-    // Step 3. 経過時間ベースの打ち切り
+    // Step 4. 経過時間ベースの打ち切り
     // 経過時間が、目標時間を上回ったら思考を終了する（fail-low時を除く）
     if (   !panic_mode_
         && elapsed_time() >= time_control_->target_time()) {
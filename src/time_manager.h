@@ -88,6 +88,14 @@ class TimeManager : public TaskThread {
     panic_mode_ = panic_mode;
   }
 
+  /**
+   * 今回の思考における「目標思考時間」をミリ秒で返します.
+   * StartTimeManagement()を呼んだ後にのみ使用してください。
+   */
+  int64_t target_time() const {
+    return time_control_->target_time();
+  }
+
   TimeControl::Stats& stats() {
     return time_control_->stats;
   }
@@ -21,6 +21,7 @@
 
 #include <cstdio>
 #include <cinttypes>
+#include <climits>
 #include <condition_variable>
 #include <iostream>
 #include <mutex>
@@ -34,6 +35,7 @@
 #include "synced_printf.h"
 #include "thinking.h"
 #include "usi_protocol.h"
+#include "worker_protocol.h"
 
 namespace {
 
@@ -212,12 +214,23 @@ void ExecuteCommand(const std::string& command, Node* const node,
     SYNCED_PRINTF("usiok\n");
 
   } else if (type == "isready") {
+    // 評価関数のパラメータは、最初のisreadyコマンドの際にだけ読み込む
+    // （クラスタのマスターは、死活監視のため、isreadyコマンドを定期的に送ってくるため）
+    static bool parameters_are_loaded = false;
     thinking->Initialize();
-    Evaluation::ReadParametersFromFile("params.bin");
+    if (!parameters_are_loaded) {
+      Evaluation::ReadParametersFromFile("params.bin");
+      parameters_are_loaded = true;
+    }
     SYNCED_PRINTF("readyok\n");
 
   } else if (type == "setoption") {
     SetUsiOption(is, usi_options);
+    g_usi_output.set_info_interval((*usi_options)["InfoInterval"]);
+#ifndef MINIMUM
+    // クラスタのマスターから要求された場合は、infoコマンドをバイナリ形式で送信する
+    WorkerProtocol::set_binary_info_enabled((*usi_options)[WorkerProtocol::kOptionName]);
+#endif
 
   } else if (type == "usinewgame") {
     thinking->StartNewGame();
@@ -260,12 +273,19 @@ void Usi::Start() {
   // http://www.geocities.jp/shogidokoro/enginecaution.html
   std::setvbuf(stdout, NULL, _IONBF, 0);
   std::setvbuf(stdin, NULL, _IONBF, 0);
+  g_usi_output.Start();
 
   // 2. 変数を準備する
   CommandQueue command_queue;
   Node node(Position::CreateStartPosition());
   UsiOptions usi_options;
   Thinking thinking(usi_options);
+#ifndef MINIMUM
+  // クラスタのワーカーとして使われる場合に備え、バイナリ形式のinfoコマンドに対応していることを通知する
+  usi_options.AddOption(WorkerProtocol::kOptionName, UsiOption(false));
+  // クラスタのマスターが作成した、共有メモリ上のハッシュテーブルの番号（0ならば、共有しない）
+  usi_options.AddOption("SharedHashId", UsiOption(0, 0, INT_MAX));
+#endif
 
   // 3. コマンドの待受を別スレッドで開始する
   std::thread receiving_command_thread([&](){
@@ -287,6 +307,7 @@ void Usi::Start() {
   }
 
   receiving_command_thread.join();
+  g_usi_output.Stop();
 }
 
 UsiOptions::UsiOptions() {
@@ -314,6 +335,9 @@ UsiOptions::UsiOptions() {
   // 切れ負け対局のときに、安全のために予備的に残しておく時間（単位は秒）
   map_.emplace("SuddenDeathMargin", UsiOption(60, 0, 600));
 
+  // 読み筋を含むinfoコマンドを出力する最小の間隔（単位はミリ秒）（0ならば、間引かない）
+  map_.emplace("InfoInterval", UsiOption(0, 0, 1000));
+
   // 最小思考時間（実際には、ここから安全マージンを引いた時間だけ思考する）（単位はミリ秒）
   map_.emplace("MinThinkingTime", UsiOption(1000, 1, 60000));
 
@@ -334,6 +358,7 @@ UsiOptions::UsiOptions() {
 
   // 勝ち数が少ない定跡を除外する場合はtrue
   map_.emplace("TinyBook", UsiOption(false));
+
 }
 
 void UsiOptions::PrintListOfOptions() {
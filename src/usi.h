@@ -154,6 +154,24 @@ class UsiOptions {
    */
   void PrintListOfOptions();
 
+  /**
+   * USIオプションを追加します.
+   * 特定のエンジンでのみ使用するオプションを、後から追加するために用います。
+   * @param name   USIオプション名
+   * @param option USIオプションの初期値など
+   */
+  void AddOption(const std::string& name, const UsiOption& option) {
+    map_.emplace(name, option);
+  }
+
+  /**
+   * 指定された名前のUSIオプションが存在する場合は、trueを返します.
+   * @param name USIオプション名
+   */
+  bool HasOption(const std::string& name) const {
+    return map_.find(name) != map_.end();
+  }
+
   /**
    * USIオプション名からUSIオプション値を参照します.
    * @param key USIオプション名
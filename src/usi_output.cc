@@ -0,0 +1,312 @@
+/*
+ * 技巧 (Gikou), a USI shogi (Japanese chess) playing engine.
+ * Copyright (C) 2016 Yosuke Demura
+ * except where otherwise indicated.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "usi_output.h"
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "synced_printf.h"
+
+UsiOutput g_usi_output;
+
+namespace {
+
+/** 出力用のスレッドが、起こされなくても目を覚ます最大の間隔（ミリ秒） */
+constexpr int kMaxSleepTime = 1000;
+
+/**
+ * 読み筋を含むinfoコマンド（間引いてもよいinfoコマンド）であれば、trueを返します.
+ */
+bool IsSearchInfo(const std::string& line) {
+  return line.compare(0, 5, "info ") == 0
+      && line.compare(0, 12, "info string ") != 0
+      && line.find(" pv ") != std::string::npos;
+}
+
+/**
+ * infoコマンドのmultipvの番号を返します（指定されていない場合は1）.
+ */
+int GetMultipv(const std::string& line) {
+  const size_t pv = line.find(" pv ");
+  const size_t multipv = line.rfind(" multipv ", pv);
+  if (multipv == std::string::npos) {
+    return 1;
+  }
+  return static_cast<int>(std::strtol(line.c_str() + multipv + 9, nullptr, 10));
+}
+
+/**
+ * 文字列をそのまま標準出力へ書き込みます.
+ */
+void WriteToStdout(const std::string& text) {
+  g_synced_printf_mutex.lock();
+  std::fwrite(text.data(), 1, text.size(), stdout);
+  std::fflush(stdout);
+  g_synced_printf_mutex.unlock();
+}
+
+} // namespace
+
+UsiOutput::UsiOutput()
+    : slots_(new Slot[kCapacity]),
+      enqueue_position_(0),
+      dequeue_position_(0),
+      running_(false),
+      stop_(false),
+      info_interval_(0),
+      wake_up_(false),
+      num_writers_(0),
+      stopping_(false) {
+  static_assert((kCapacity & (kCapacity - 1)) == 0, "");
+  for (size_t i = 0; i < kCapacity; ++i) {
+    slots_[i].sequence = i;
+  }
+}
+
+UsiOutput::~UsiOutput() {
+  Stop();
+}
+
+void UsiOutput::Start() {
+  if (running_) {
+    return;
+  }
+  stop_ = false;
+  wake_up_ = false;
+  last_info_time_ = std::chrono::steady_clock::now();
+  thread_ = std::thread([this]() {
+    Run();
+  });
+  running_ = true;
+}
+
+void UsiOutput::Stop() {
+  if (!running_) {
+    return;
+  }
+
+  // 1. これ以降に出力される文字列は、この関数が終わった後で、呼び出したスレッドで直接出力させる
+  stopping_ = true;
+  running_ = false;
+
+  // 2. リングバッファに文字列を積んでいる途中のスレッドがあれば、積み終わるまで待つ
+  while (num_writers_ > 0) {
+    std::this_thread::yield();
+  }
+
+  // 3. 出力用のスレッドに、残りの文字列を出力させてから終了させる
+  mutex_.lock();
+  stop_ = true;
+  mutex_.unlock();
+  sleep_condition_.notify_one();
+  thread_.join();
+
+  // 4. 出力用のスレッドが終了する直前に積まれた文字列があれば、ここで出力する
+  Drain();
+  FlushPendingInfos();
+  WriteBuffer();
+  stopping_ = false;
+}
+
+void UsiOutput::Printf(const char* format, ...) {
+  char buf[1024];
+  va_list args;
+  va_start(args, format);
+  const int length = std::vsnprintf(buf, sizeof(buf), format, args);
+  va_end(args);
+  if (length < 0) {
+    return;
+  }
+
+  // スタック上のバッファに収まらない場合は、改めて必要な大きさのバッファを確保する
+  if (size_t(length) < sizeof(buf)) {
+    Write(std::string(buf, length));
+  } else {
+    std::vector<char> large_buf(length + 1);
+    va_start(args, format);
+    std::vsnprintf(large_buf.data(), large_buf.size(), format, args);
+    va_end(args);
+    Write(std::string(large_buf.data(), length));
+  }
+}
+
+void UsiOutput::Write(std::string text, bool raw) {
+  // Stop()が最後に文字列を取り出す前に積み終わるよう、積んでいる途中であることを先に示しておく
+  ++num_writers_;
+  if (!running_) {
+    --num_writers_;
+    // Stop()の実行中は、リングバッファに残っている文字列より先に出力しないよう、終わるまで待つ
+    while (stopping_) {
+      std::this_thread::yield();
+    }
+    WriteToStdout(text);
+    return;
+  }
+
+  // infoコマンド以外（bestmoveコマンドなど）は、出力用のスレッドを起こして直ちに出力させる
+  const bool urgent = raw || info_interval_ == 0 || text.compare(0, 4, "info") != 0;
+  Push(std::move(text), raw);
+  if (urgent) {
+    WakeUp();
+  }
+  --num_writers_;
+}
+
+void UsiOutput::Push(std::string&& text, bool raw) {
+  size_t position = enqueue_position_.load(std::memory_order_relaxed);
+  Slot* slot;
+  while (true) {
+    slot = &slots_[position & (kCapacity - 1)];
+    const size_t sequence = slot->sequence.load(std::memory_order_acquire);
+    const intptr_t diff = intptr_t(sequence) - intptr_t(position);
+    if (diff == 0) {
+      // a. 空いているスロットが見つかったので、他のスレッドと競合しなければ、このスロットを確保する
+      if (enqueue_position_.compare_exchange_weak(position, position + 1,
+                                                  std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      // b. リングバッファが一杯なので、出力用のスレッドに取り出してもらう
+      WakeUp();
+      std::this_thread::yield();
+      position = enqueue_position_.load(std::memory_order_relaxed);
+    } else {
+      // c. 他のスレッドに先にスロットを確保されたので、やり直す
+      position = enqueue_position_.load(std::memory_order_relaxed);
+    }
+  }
+  slot->text = std::move(text);
+  slot->raw = raw;
+  slot->sequence.store(position + 1, std::memory_order_release);
+}
+
+bool UsiOutput::Pop(std::string* const text, bool* const raw) {
+  Slot& slot = slots_[dequeue_position_ & (kCapacity - 1)];
+  const size_t sequence = slot.sequence.load(std::memory_order_acquire);
+  if (sequence != dequeue_position_ + 1) {
+    return false;
+  }
+  *text = std::move(slot.text);
+  *raw = slot.raw;
+  slot.sequence.store(dequeue_position_ + kCapacity, std::memory_order_release);
+  ++dequeue_position_;
+  return true;
+}
+
+void UsiOutput::Run() {
+  using namespace std::chrono;
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    // 1. 起こされるか、保留中のinfoコマンドを出力する時刻になるまでスリープする
+    const int interval = info_interval_;
+    milliseconds timeout(interval > 0 ? interval : kMaxSleepTime);
+    if (interval > 0 && !pending_infos_.empty()) {
+      timeout = duration_cast<milliseconds>(last_info_time_ + milliseconds(interval)
+                                            - steady_clock::now());
+    }
+    sleep_condition_.wait_for(lock, std::max(timeout, milliseconds(0)), [this]() {
+      return wake_up_ || stop_;
+    });
+    const bool stop = stop_;
+    lock.unlock();
+
+    // 取り出す前に戻しておけば、以後に積まれた文字列を取りこぼすことはない（改めて起こされる）
+    wake_up_.exchange(false);
+
+    // 2. 溜まっている文字列を取り出し、まとめて出力する
+    Drain();
+    if (   stop
+        || interval == 0
+        || steady_clock::now() - last_info_time_ >= milliseconds(interval)) {
+      FlushPendingInfos();
+    }
+    WriteBuffer();
+
+    lock.lock();
+    if (stop) {
+      break;
+    }
+  }
+}
+
+void UsiOutput::Drain() {
+  std::string text;
+  bool raw;
+  while (Pop(&text, &raw)) {
+    // a. バイナリ形式のフレームは、そのまま出力する
+    if (raw) {
+      FlushPendingInfos();
+      buffer_ += text;
+      continue;
+    }
+
+    // b. テキストは、１行ずつ処理する
+    for (size_t begin = 0; begin < text.size(); ) {
+      const size_t newline = text.find('\n', begin);
+      const size_t end = newline == std::string::npos ? text.size() : newline + 1;
+      std::string line = text.substr(begin, end - begin);
+      begin = end;
+
+      if (IsSearchInfo(line)) {
+        // 読み筋を含むinfoコマンドは、同じmultipvの番号の古いinfoコマンドを置き換えて、出力を保留する
+        pending_infos_[GetMultipv(line)] = std::move(line);
+      } else {
+        // info stringコマンドやbestmoveコマンドなどは、間引かずに出力する
+        // （出力の順序が入れ替わらないよう、保留中のinfoコマンドを先に出力する）
+        FlushPendingInfos();
+        buffer_ += line;
+      }
+    }
+  }
+}
+
+void UsiOutput::FlushPendingInfos() {
+  if (pending_infos_.empty()) {
+    return;
+  }
+  for (const auto& element : pending_infos_) {
+    buffer_ += element.second;
+  }
+  pending_infos_.clear();
+  last_info_time_ = std::chrono::steady_clock::now();
+}
+
+void UsiOutput::WriteBuffer() {
+  if (buffer_.empty()) {
+    return;
+  }
+  WriteToStdout(buffer_);
+  buffer_.clear();
+}
+
+void UsiOutput::WakeUp() {
+  // 出力用のスレッドが文字列を取り出すまでの間は、最初に起こしたスレッドだけがロックする
+  if (wake_up_.exchange(true)) {
+    return;
+  }
+  // 出力用のスレッドが条件を確認してから眠るまでの間に通知しても取りこぼさないよう、ロックを経由する
+  mutex_.lock();
+  mutex_.unlock();
+  sleep_condition_.notify_one();
+}
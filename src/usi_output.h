@@ -0,0 +1,169 @@
+/*
+ * 技巧 (Gikou), a USI shogi (Japanese chess) playing engine.
+ * Copyright (C) 2016 Yosuke Demura
+ * except where otherwise indicated.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef USI_OUTPUT_H_
+#define USI_OUTPUT_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/**
+ * USIコマンドの標準出力を、専用のスレッドにまとめて行わせるためのクラスです.
+ *
+ * 標準出力はバッファリングをオフにしているため、printf()を呼ぶたびにシステムコールが発行されます。
+ * 秒読みの短い対局やMultiPV探索では、infoコマンドの出力がプロファイル上で無視できない時間を占めるので、
+ * 各スレッドは出力したい文字列をロックフリーのリングバッファに積むだけにとどめ、
+ * 出力用のスレッドが、溜まった文字列を１回の書き込みでまとめて出力するようにしています。
+ *
+ * さらに、読み筋を含むinfoコマンドについては、以下のように間引いて出力します。
+ *   - 同じmultipvの番号のinfoコマンドが出力前に複数溜まった場合は、最新のものだけを出力する
+ *   - InfoIntervalオプションで指定した間隔（ミリ秒）よりも短い間隔では出力しない
+ * ただし、bestmoveコマンドなど、infoコマンド以外の行が積まれた場合は、出力用のスレッドを直ちに起こし、
+ * 溜まっているinfoコマンドを出力した後で、その行をすぐに出力します。
+ * info stringコマンドなど、間引けない行の前でも、溜まっているinfoコマンドを先に出力するので、
+ * 間引かれた行を除けば、出力の順序は積まれた順序と変わりません。
+ *
+ * 出力用のスレッドを開始する前と終了した後は、呼び出したスレッドで直接出力します。
+ */
+class UsiOutput {
+ public:
+  /** リングバッファに積める文字列の数（2のべき乗にする） */
+  static constexpr size_t kCapacity = 1024;
+
+  UsiOutput();
+
+  ~UsiOutput();
+
+  /**
+   * 出力用のスレッドを開始します.
+   */
+  void Start();
+
+  /**
+   * リングバッファに残っている文字列をすべて出力したうえで、出力用のスレッドを終了します.
+   */
+  void Stop();
+
+  /**
+   * printf()と同じ書式で、文字列を出力します.
+   */
+  void Printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+  /**
+   * 文字列を出力します.
+   * @param text 出力する文字列（１行以上のUSIコマンド）
+   * @param raw  バイナリ形式のフレームなど、行単位で解釈してはいけない文字列の場合はtrue
+   */
+  void Write(std::string text, bool raw = false);
+
+  /**
+   * 読み筋を含むinfoコマンドを出力する最小の間隔を設定します.
+   * @param interval 出力の間隔（ミリ秒）。0ならば、間引かずに出力する。
+   */
+  void set_info_interval(int interval) {
+    info_interval_ = interval;
+  }
+
+ private:
+  struct Slot {
+    std::atomic<size_t> sequence;
+    std::string text;
+    bool raw;
+  };
+
+  /**
+   * リングバッファに文字列を積みます（複数のスレッドから同時に呼び出してもよい）.
+   * リングバッファが一杯の場合は、出力用のスレッドが文字列を取り出すまで待機します。
+   */
+  void Push(std::string&& text, bool raw);
+
+  /**
+   * リングバッファから文字列を１つ取り出します（出力用のスレッドからのみ呼び出す）.
+   * @return リングバッファが空の場合はfalse
+   */
+  bool Pop(std::string* text, bool* raw);
+
+  /**
+   * 出力用のスレッドの本体です.
+   */
+  void Run();
+
+  /**
+   * リングバッファに溜まっている文字列を取り出し、出力用のバッファに移します.
+   */
+  void Drain();
+
+  /**
+   * 保留中のinfoコマンドを、出力用のバッファに移します.
+   */
+  void FlushPendingInfos();
+
+  /**
+   * 出力用のバッファの内容を、標準出力へ書き込みます.
+   */
+  void WriteBuffer();
+
+  /**
+   * 出力用のスレッドを起こします.
+   * すでに他のスレッドが起こしている場合は、ミューテックスをロックせずに戻ります。
+   */
+  void WakeUp();
+
+  std::unique_ptr<Slot[]> slots_;
+  std::atomic<size_t> enqueue_position_;
+  size_t dequeue_position_;
+
+  std::thread thread_;
+  std::mutex mutex_;
+  std::condition_variable sleep_condition_;
+  std::atomic_bool running_;
+  bool stop_;
+  std::atomic<int> info_interval_;
+
+  /** 出力用のスレッドを起こす必要がある場合はtrue（trueの間は、他のスレッドは起こさなくてよい） */
+  std::atomic_bool wake_up_;
+
+  /** リングバッファに文字列を積んでいる途中のスレッドの数（Stop()は、これが0になるまで待つ） */
+  std::atomic<int> num_writers_;
+
+  /** Stop()の実行中はtrue（その間に直接出力しようとしたスレッドは、Stop()の終了を待つ） */
+  std::atomic_bool stopping_;
+
+  /** 出力を保留しているinfoコマンド（multipvの番号ごとに、最新のものだけを保持する） */
+  std::map<int, std::string> pending_infos_;
+
+  /** 最後にinfoコマンドを出力した時刻 */
+  std::chrono::steady_clock::time_point last_info_time_;
+
+  /** 標準出力へまとめて書き込む文字列 */
+  std::string buffer_;
+};
+
+/**
+ * USIコマンドの出力に用いる、唯一のインスタンスです.
+ */
+extern UsiOutput g_usi_output;
+
+#endif /* USI_OUTPUT_H_ */
@@ -88,54 +88,66 @@ void UsiProtocol::Start() {
   // http://www.geocities.jp/shogidokoro/enginecaution.html
   std::setvbuf(stdout, NULL, _IONBF, 0);
   std::setvbuf(stdin, NULL, _IONBF, 0);
+  g_usi_output.Start();
 
   for (std::string line; std::getline(std::cin, line); ) {
-    std::istringstream is(line);
-    std::string type;
-    is >> type;
+    if (!ExecuteCommand(line)) {
+      break; // quitコマンドが来たら終了する
+    }
+  }
 
-    if (type == "usi") {
-      SYNCED_PRINTF("id name %s\n", program_name_);
-      SYNCED_PRINTF("id author %s\n", author_name_);
-      usi_options_.PrintListOfOptions();
-      SYNCED_PRINTF("usiok\n");
+  g_usi_output.Stop();
+}
 
-    } else if (type == "isready") {
-      OnIsreadyCommandEntered();
+bool UsiProtocol::ExecuteCommand(const std::string& line) {
+  std::istringstream is(line);
+  std::string type;
+  is >> type;
 
-    } else if (type == "setoption") {
-      ParseSetoptionCommand(is, &usi_options_);
+  if (type == "usi") {
+    SYNCED_PRINTF("id name %s\n", program_name_);
+    SYNCED_PRINTF("id author %s\n", author_name_);
+    usi_options_.PrintListOfOptions();
+    SYNCED_PRINTF("usiok\n");
 
-    } else if (type == "usinewgame") {
-      OnUsinewgameCommandEntered();
+  } else if (type == "isready") {
+    OnIsreadyCommandEntered();
 
-    } else if (type == "position") {
-      position_sfen_ = line;
-      ParsePositionCommand(is, &root_node_);
+  } else if (type == "setoption") {
+    ParseSetoptionCommand(is, &usi_options_);
+    g_usi_output.set_info_interval(usi_options_["InfoInterval"]);
 
-    } else if (type == "go") {
-      UsiGoOptions options = ParseGoCommand(is, root_node());
-      OnGoCommandEntered(options);
+  } else if (type == "usinewgame") {
+    OnUsinewgameCommandEntered();
 
-    } else if (type == "stop") {
-      OnStopCommandEntered();
+  } else if (type == "position") {
+    position_sfen_ = line;
+    ParsePositionCommand(is, &root_node_);
 
-    } else if (type == "ponderhit") {
-      OnPonderhitCommandEntered();
+  } else if (type == "go") {
+    UsiGoOptions options = ParseGoCommand(is, root_node());
+    OnGoCommandEntered(options);
 
-    } else if (type == "quit") {
-      OnQuitCommandEntered();
-      return; // quitコマンドが来たら終了する
+  } else if (type == "stop") {
+    OnStopCommandEntered();
 
-    } else if (type == "gameover") {
-      std::string result;
-      is >> result;
-      OnGameoverCommandEntered(result);
+  } else if (type == "ponderhit") {
+    OnPonderhitCommandEntered();
 
-    } else if (type == "d") {
-      root_node_.Print(root_node_.last_move());
-    }
+  } else if (type == "quit") {
+    OnQuitCommandEntered();
+    return false;
+
+  } else if (type == "gameover") {
+    std::string result;
+    is >> result;
+    OnGameoverCommandEntered(result);
+
+  } else if (type == "d") {
+    root_node_.Print(root_node_.last_move());
   }
+
+  return true;
 }
 
 void UsiProtocol::ParseSetoptionCommand(std::istringstream& is,
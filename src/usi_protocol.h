@@ -115,6 +115,14 @@ class UsiProtocol {
    */
   virtual void Start();
 
+  /**
+   * USIのコマンドを１行実行します.
+   * 標準入力の代わりに、プログラムからコマンドを送る場合（シミュレーションなど）にも使用できます。
+   * @param line 実行するコマンド
+   * @return quitコマンドの場合はfalse、それ以外はtrue
+   */
+  bool ExecuteCommand(const std::string& line);
+
   /**
    * isreadyコマンドを受信した際の処理です.
    * 具体的な処理は、子クラスで実装してください。
@@ -192,6 +200,14 @@ class UsiProtocol {
     return position_sfen_;
   }
 
+ protected:
+  /**
+   * 子クラスで独自のUSIオプションを追加する際に用いる、USIオプションへのポインタです.
+   */
+  UsiOptions* mutable_usi_options() {
+    return &usi_options_;
+  }
+
  private:
   const char* const program_name_;
   const char* const author_name_;
@@ -0,0 +1,369 @@
+/*
+ * 技巧 (Gikou), a USI shogi (Japanese chess) playing engine.
+ * Copyright (C) 2016 Yosuke Demura
+ * except where otherwise indicated.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#if !defined(MINIMUM)
+
+#include "usi_worker.h"
+
+#include <algorithm>
+#include <csignal>
+#include <sstream>
+#include "synced_printf.h"
+#include "worker_protocol.h"
+
+UsiWorker::~UsiWorker() {
+  QuitEngine();
+}
+
+bool UsiWorker::StartEngine(const WorkerConfig& config) {
+  // ワーカーが異常終了した場合に、書き込みエラーでマスターが終了しないようにする
+  std::signal(SIGPIPE, SIG_IGN);
+
+  // シェルを経由して起動する（execにより、シェルのプロセスはワーカーに置き換えられる）
+  std::string command = "exec " + config.command;
+  char* const argv[] = {
+      const_cast<char*>("/bin/sh"),
+      const_cast<char*>("-c"),
+      const_cast<char*>(command.c_str()),
+      NULL
+  };
+
+  std::unique_lock<std::mutex> lock(send_mutex_);
+  if (external_process_.StartProcess(argv[0], argv, config.cpus) < 0) {
+    return false;
+  }
+  started_ = true;
+  lock.unlock();
+
+  // 外部プロセスからの出力は、マルチプレクサのスレッドで受信する
+  return multiplexer_.Add(&external_process_,
+                          [this](const std::string& message, bool is_binary) {
+                            OnMessageReceived(message, is_binary);
+                          },
+                          [this]() { OnEndOfFile(); });
+}
+
+void UsiWorker::QuitEngine() {
+  std::unique_lock<std::mutex> lock(send_mutex_);
+  if (!started_) {
+    return;
+  }
+  started_ = false;
+
+  // ワーカにquitコマンドを送信
+  external_process_.Printf("quit\n");
+
+  // 外部プロセスの終了を待つ（応答しない場合は、強制終了させる）
+  if (!external_process_.WaitFor(std::chrono::milliseconds(1000))) {
+    external_process_.Kill();
+  }
+
+  // 以後、このワーカーのハンドラが呼ばれないようにする
+  multiplexer_.Remove(&external_process_);
+  external_process_.Close();
+}
+
+bool UsiWorker::Restart(const std::chrono::milliseconds timeout) {
+  // 1. 古い外部プロセスを強制終了させる
+  std::unique_lock<std::mutex> send_lock(send_mutex_);
+  if (started_) {
+    started_ = false;
+    multiplexer_.Remove(&external_process_);
+    external_process_.Kill();
+    external_process_.Close();
+  }
+  send_lock.unlock();
+
+  // 2. 受信状態を初期化する
+  std::unique_lock<std::mutex> receive_lock(receive_mutex_);
+  received_lines_.clear();
+  eof_ = false;
+  searching_ = false;
+  heartbeat_pending_ = false;
+  hung_ = false;
+  binary_info_ = false;
+  receive_deadline_ = std::chrono::steady_clock::now() + timeout;
+  receive_condition_.notify_all(); // 探索の終了を待っているスレッドを起こす
+  receive_lock.unlock();
+
+  // 3. 外部プロセスを起動し直し、isreadyコマンドへの応答を待つ
+  Initialize();
+  const bool succeeded = WaitForCommand("readyok");
+
+  receive_lock.lock();
+  receive_deadline_ = std::chrono::steady_clock::time_point::max();
+  idle_since_ = std::chrono::steady_clock::now();
+  if (!succeeded) {
+    hung_ = true;
+  }
+  return succeeded;
+}
+
+void UsiWorker::SendEngineOptions(const WorkerConfig& config,
+                                  const UsiOptions& options) {
+  int hash_size = config.hash_size != 0 ? config.hash_size : (int)options["USI_Hash"];
+  int threads = config.threads != 0 ? config.threads : (int)options["Threads"];
+  SendCommand("setoption name USI_Hash value %d", hash_size);
+  SendCommand("setoption name Threads value %d", threads);
+  SendCommand("setoption name DrawScore value %d", (int)options["DrawScore"]);
+}
+
+bool UsiWorker::NegotiateProtocol() {
+  SendCommand("usi");
+
+  // ワーカーが通知してきたオプションの名前を記録しておく
+  options_.clear();
+  for (std::string line; RecieveCommand(&line); ) {
+    std::istringstream is(line);
+    std::string token, name;
+    is >> token;
+    if (token == "option") {
+      is >> token >> name;
+      if (token == "name") {
+        options_.insert(name);
+      }
+    } else if (token == "usiok") {
+      // BinaryInfoオプションに対応している場合は、バイナリ形式のinfoコマンドを有効にする
+      if (has_option(WorkerProtocol::kOptionName)) {
+        SendCommand("setoption name %s value true", WorkerProtocol::kOptionName);
+        binary_info_ = true;
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+void UsiWorker::SetSharedHashId(const int shared_hash_id) {
+  // リモートマシン上のワーカーは、共有メモリを開けないので、自動的に専用のハッシュテーブルを使う
+  if (shared_hash_id != 0 && has_option("SharedHashId")) {
+    SendCommand("setoption name SharedHashId value %d", shared_hash_id);
+  }
+}
+
+bool UsiWorker::RecieveCommand(std::string* const line) {
+  return RecieveCommand(line, std::chrono::steady_clock::time_point::max());
+}
+
+bool UsiWorker::RecieveCommand(std::string* const line,
+                               std::chrono::steady_clock::time_point deadline) {
+  std::unique_lock<std::mutex> lock(receive_mutex_);
+  auto has_line = [&](){ return eof_ || !received_lines_.empty(); };
+  deadline = std::min(deadline, receive_deadline_);
+  if (deadline == std::chrono::steady_clock::time_point::max()) {
+    receive_condition_.wait(lock, has_line);
+  } else {
+    receive_condition_.wait_until(lock, deadline, has_line);
+  }
+  if (received_lines_.empty()) {
+    return false;
+  }
+  *line = std::move(received_lines_.front());
+  received_lines_.pop_front();
+  return true;
+}
+
+bool UsiWorker::WaitForCommand(const std::string& command) {
+  for (std::string line; RecieveCommand(&line); ) {
+    if (line == command) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool UsiWorker::WaitForCommand(const std::string& command,
+                               const std::chrono::milliseconds timeout) {
+  const auto deadline = std::chrono::steady_clock::now() + timeout;
+  for (std::string line; RecieveCommand(&line, deadline); ) {
+    if (line == command) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void UsiWorker::StartSearch() {
+  std::unique_lock<std::mutex> lock(receive_mutex_);
+  searching_ = !eof_;
+}
+
+void UsiWorker::WaitUntilSearchIsFinished() {
+  std::unique_lock<std::mutex> lock(receive_mutex_);
+  receive_condition_.wait(lock, [&](){ return !searching_; });
+}
+
+bool UsiWorker::WaitUntilSearchIsFinished(const std::chrono::milliseconds timeout) {
+  std::unique_lock<std::mutex> lock(receive_mutex_);
+  return receive_condition_.wait_for(lock, timeout, [&](){ return !searching_; });
+}
+
+void UsiWorker::SendHeartbeat() {
+  std::unique_lock<std::mutex> lock(receive_mutex_);
+  if (searching_ || heartbeat_pending_ || eof_) {
+    return;
+  }
+  heartbeat_pending_ = true;
+  heartbeat_time_ = std::chrono::steady_clock::now();
+  lock.unlock();
+
+  SendCommand("isready");
+}
+
+bool UsiWorker::IsHung(const std::chrono::milliseconds timeout) const {
+  if (eof_ || hung_) {
+    return true;
+  }
+  std::unique_lock<std::mutex> lock(receive_mutex_);
+  if (!heartbeat_pending_ || searching_) {
+    return false;
+  }
+  // 探索終了直後のワーカーは、まだ前のisreadyコマンドを処理していない可能性があるので、
+  // isreadyコマンドの送信時刻と探索の終了時刻の遅い方から、経過時間を計る
+  const auto since = std::max(heartbeat_time_, idle_since_);
+  return std::chrono::steady_clock::now() - since > timeout;
+}
+
+void UsiWorker::OnMessageReceived(const std::string& message,
+                                  const bool is_binary) {
+  // バイナリ形式のinfoコマンドは、探索中のものだけを処理する
+  if (is_binary) {
+    UsiInfo info;
+    if (searching_ && WorkerProtocol::DecodeInfoFrame(message, &info)) {
+      OnInfoReceived(info);
+    }
+    return;
+  }
+
+  // 探索中のinfoコマンドとbestmoveコマンドは、ここで処理する
+  const std::string& line = message;
+  if (searching_) {
+    std::istringstream is(line);
+    std::string token;
+    is >> token;
+    if (token == "info") {
+      OnInfoReceived(UsiProtocol::ParseInfoCommand(is));
+      return;
+    } else if (token == "bestmove") {
+      FinishSearch();
+      return;
+    }
+  }
+
+  // 死活監視のためのisreadyコマンドへの応答は、キューに保存せずに処理する
+  std::unique_lock<std::mutex> lock(receive_mutex_);
+  if (heartbeat_pending_ && line == "readyok") {
+    heartbeat_pending_ = false;
+    return;
+  }
+
+  // それ以外のコマンドは、RecieveCommand()で読み出せるように、キューに保存しておく
+  received_lines_.push_back(line);
+  receive_condition_.notify_all();
+}
+
+void UsiWorker::OnEndOfFile() {
+  std::unique_lock<std::mutex> lock(receive_mutex_);
+  eof_ = true;
+  receive_condition_.notify_all();
+  lock.unlock();
+
+  // 探索中に外部プロセスが終了した場合は、探索が終了したものとして扱う
+  if (searching_) {
+    FinishSearch();
+  }
+}
+
+void UsiWorker::FinishSearch() {
+  std::unique_lock<std::mutex> lock(receive_mutex_);
+  searching_ = false;
+  idle_since_ = std::chrono::steady_clock::now();
+  receive_condition_.notify_all();
+  lock.unlock();
+
+  OnSearchFinished();
+}
+
+void WorkerMonitor::Start(const std::vector<UsiWorker*>& workers) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (running_) {
+    return;
+  }
+  workers_ = workers;
+  next_restart_times_.assign(workers.size(), std::chrono::steady_clock::time_point());
+  running_ = true;
+  thread_ = std::thread([this]() { Run(); });
+}
+
+void WorkerMonitor::Stop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (!running_) {
+    return;
+  }
+  running_ = false;
+  condition_.notify_all();
+  lock.unlock();
+  thread_.join();
+}
+
+void WorkerMonitor::Run() {
+  const std::chrono::milliseconds interval(kHeartbeatInterval);
+  const std::chrono::milliseconds response_timeout(kResponseTimeout);
+  const std::chrono::milliseconds restart_timeout(kRestartTimeout);
+  const std::chrono::milliseconds retry_interval(kRetryInterval);
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!condition_.wait_for(lock, interval, [&](){ return !running_; })) {
+    lock.unlock();
+    for (size_t i = 0; i < workers_.size(); ++i) {
+      UsiWorker* worker = workers_[i];
+
+      // 1. 応答するワーカーには、次のisreadyコマンドを送る
+      if (!worker->IsHung(response_timeout)) {
+        worker->SendHeartbeat();
+        continue;
+      }
+
+      // 2. 応答しなくなったワーカーは、探索の割り当て対象から外して、再起動する
+      // （起動直後に異常終了するワーカーを再起動し続けないよう、失敗した場合は間隔を空ける）
+      if (std::chrono::steady_clock::now() < next_restart_times_[i]) {
+        continue;
+      }
+      {
+        std::unique_lock<std::mutex> assignment_lock(assignment_mutex_);
+        worker->set_available(false);
+      }
+      SYNCED_PRINTF("info string Worker #%zu is not responding. Restarting.\n", i);
+      const bool succeeded = worker->Restart(restart_timeout);
+      {
+        std::unique_lock<std::mutex> assignment_lock(assignment_mutex_);
+        worker->set_available(succeeded);
+      }
+      if (succeeded) {
+        SYNCED_PRINTF("info string Worker #%zu has been restarted.\n", i);
+      } else {
+        SYNCED_PRINTF("info string Failed to restart worker #%zu.\n", i);
+        next_restart_times_[i] = std::chrono::steady_clock::now() + retry_interval;
+      }
+    }
+    lock.lock();
+  }
+}
+
+#endif /* !defined(MINIMUM) */
@@ -0,0 +1,349 @@
+/*
+ * 技巧 (Gikou), a USI shogi (Japanese chess) playing engine.
+ * Copyright (C) 2016 Yosuke Demura
+ * except where otherwise indicated.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef USI_WORKER_H_
+#define USI_WORKER_H_
+
+#if !defined(MINIMUM)
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include "process.h"
+#include "usi_protocol.h"
+#include "worker_topology.h"
+
+/**
+ * 外部プロセス上で動作するUSIエンジンを、ワーカーとして利用するためのクラスです.
+ *
+ * ワーカーからの出力は、ProcessMultiplexerのスレッドでまとめて受信します。
+ *   - 探索中（StartSearch()からbestmoveを受信するまで）のinfoコマンドは、OnInfoReceived()に渡されます。
+ *   - bestmoveを受信すると、探索が終了したものとして、OnSearchFinished()が呼ばれます。
+ *   - それ以外の行は、キューに保存され、RecieveCommand()で読み出すことができます。
+ * このため、ワーカーごとに受信専用のスレッドを用意する必要はありません。
+ *
+ * また、ワーカーが対応している場合は、infoコマンドをバイナリ形式で受信します（WorkerProtocolクラスを参照）。
+ *
+ * ワーカーの死活監視のため、探索中でないワーカーにはisreadyコマンドを送り、readyokコマンドが返ってくるまでの
+ * 時間を調べることができます（SendHeartbeat()及びIsHung()を参照）。応答しなくなったワーカーは、
+ * Restart()により、外部プロセスを起動し直すことができます。
+ */
+class UsiWorker {
+ public:
+  explicit UsiWorker(ProcessMultiplexer& multiplexer)
+      : multiplexer_(multiplexer) {
+  }
+  virtual ~UsiWorker();
+
+  UsiWorker(const UsiWorker&) = delete;
+  UsiWorker& operator=(const UsiWorker&) = delete;
+
+  /**
+   * 外部プロセス上にUSIエンジンを起動して、初期設定のコマンド（最後はisready）を送信します.
+   * 具体的な処理は、子クラスで実装してください。
+   */
+  virtual void Initialize() = 0;
+
+  /**
+   * 外部プロセス上にUSIエンジンを起動して、ProcessMultiplexerの監視対象に加えます.
+   * @param config ワーカーの設定（コマンドは/bin/shで実行し、CPUが指定されていれば、そのCPUに固定する）
+   * @return 起動に成功した場合はtrue
+   */
+  bool StartEngine(const WorkerConfig& config);
+
+  /**
+   * ワーカーの設定と、マスターのUSIオプションをもとに、スレッド数などのUSIオプションをワーカーに送信します.
+   */
+  void SendEngineOptions(const WorkerConfig& config, const UsiOptions& options);
+
+  /**
+   * USIエンジンにquitコマンドを送信して、外部プロセスが終了するまで待機します.
+   * 派生クラスのデストラクタから呼んでください（２回目以降の呼び出しでは、何もしません）。
+   */
+  void QuitEngine();
+
+  /**
+   * 外部プロセスを強制終了させてから、Initialize()により起動し直し、readyokコマンドを受信するまで待機します.
+   * @param timeout readyokコマンドを受信するまで待機する最大の時間
+   * @return 時間内にreadyokコマンドを受信した場合はtrue
+   */
+  bool Restart(std::chrono::milliseconds timeout);
+
+  /**
+   * usiコマンドを送信して、usiokコマンドを受信するまで待機します.
+   * ワーカーがバイナリ形式のinfoコマンドに対応している場合は、それを有効にします。
+   * @return usiokコマンドを受信した場合はtrue
+   */
+  bool NegotiateProtocol();
+
+  /**
+   * ワーカーが対応している場合は、共有メモリ上のハッシュテーブルを使用するように設定します.
+   * isreadyコマンドを送信する前に呼んでください。
+   * @param shared_hash_id 共有メモリ上のハッシュテーブルの番号（0ならば、何もしない）
+   */
+  void SetSharedHashId(int shared_hash_id);
+
+  /**
+   * 外部プロセスのUSIエンジンに対し、コマンドを送信します.
+   * @param format std::printf()関数と同様のフォーマット
+   * @param args   フォーマットに従って出力したい引数
+   */
+  template<typename... Args>
+  void SendCommand(const char* format, const Args&... args) {
+    std::unique_lock<std::mutex> lock(send_mutex_);
+    if (!started_) {
+      return; // 起動し直している途中の場合
+    }
+    external_process_.Printf(format, args...);
+    external_process_.Printf("\n");
+  }
+
+  /**
+   * 外部プロセスのUSIエンジンから、コマンドを受信します.
+   * 探索中のinfoコマンド及びbestmoveコマンドは、ここでは受信できません。
+   * @param line 受信したコマンドを保存するための変数
+   * @return EOFを受信したらfalse。\nを受信したらtrue。
+   */
+  bool RecieveCommand(std::string* line);
+
+  /**
+   * 指定されたコマンドを受信するまで、受信したコマンドを読み捨てます.
+   * @return 指定されたコマンドを受信した場合はtrue。途中でEOFを受信した場合はfalse。
+   */
+  bool WaitForCommand(const std::string& command);
+
+  /**
+   * 指定されたコマンドを受信するまで、指定された時間だけ、受信したコマンドを読み捨てます.
+   * @return 時間内に指定されたコマンドを受信した場合はtrue
+   */
+  bool WaitForCommand(const std::string& command, std::chrono::milliseconds timeout);
+
+  /**
+   * 探索を開始したことを記録します.
+   * goコマンドを送信する直前に呼んでください。
+   */
+  void StartSearch();
+
+  /**
+   * bestmoveコマンドを受信する（またはEOFに達する）まで、待機します.
+   */
+  void WaitUntilSearchIsFinished();
+
+  /**
+   * bestmoveコマンドを受信する（またはEOFに達する）まで、指定された時間だけ待機します.
+   * @return 時間内に探索が終了した場合はtrue
+   */
+  bool WaitUntilSearchIsFinished(std::chrono::milliseconds timeout);
+
+  /**
+   * 死活監視のため、探索中でなければ、isreadyコマンドを送信します.
+   * すでに送信したisreadyコマンドへの応答を待っている場合は、何もしません。
+   * なお、応答のreadyokコマンドは、RecieveCommand()では受信できません。
+   */
+  void SendHeartbeat();
+
+  /**
+   * ワーカーが応答しなくなっている場合は、trueを返します.
+   * 外部プロセスが終了した場合や、MarkHung()が呼ばれた場合のほか、探索中でない状態で、
+   * isreadyコマンドへの応答が指定された時間以上返ってこない場合も、応答しなくなったとみなします。
+   */
+  bool IsHung(std::chrono::milliseconds timeout) const;
+
+  /**
+   * ワーカーが応答しなくなったことを記録し、以後、このワーカーを利用しないようにします.
+   * stopコマンドを送ってもbestmoveコマンドが返ってこない場合などに呼んでください。
+   */
+  void MarkHung() {
+    hung_ = true;
+    available_ = false;
+  }
+
+  /**
+   * このワーカーに、探索を割り当ててもよい場合は、trueを返します.
+   */
+  bool is_available() const {
+    return available_;
+  }
+
+  void set_available(bool available) {
+    available_ = available;
+  }
+
+  /**
+   * 探索中（goコマンドを送信した後、bestmoveコマンドをまだ受信していない）である場合は、trueを返します.
+   */
+  bool is_searching() const {
+    return searching_;
+  }
+
+  /**
+   * 外部プロセスが終了した（標準出力がEOFに達した）場合は、trueを返します.
+   */
+  bool has_exited() const {
+    return eof_;
+  }
+
+  /**
+   * NegotiateProtocol()の際に、ワーカーが指定された名前のオプションを通知していた場合は、trueを返します.
+   */
+  bool has_option(const std::string& name) const {
+    return options_.count(name) != 0;
+  }
+
+  /**
+   * ワーカーとの間で、バイナリ形式のinfoコマンドを用いている場合は、trueを返します.
+   */
+  bool binary_info() const {
+    return binary_info_;
+  }
+
+ protected:
+  /**
+   * 探索中に、infoコマンドを受信した際に呼ばれるコールバック関数です.
+   * ProcessMultiplexerのスレッドから呼ばれます。
+   */
+  virtual void OnInfoReceived(const UsiInfo&) {}
+
+  /**
+   * 探索中に、bestmoveコマンドを受信した（またはEOFに達した）際に呼ばれるコールバック関数です.
+   * ProcessMultiplexerのスレッドから呼ばれます。
+   */
+  virtual void OnSearchFinished() {}
+
+ private:
+  bool RecieveCommand(std::string* line, std::chrono::steady_clock::time_point deadline);
+  void OnMessageReceived(const std::string& message, bool is_binary);
+  void OnEndOfFile();
+  void FinishSearch();
+
+  /** 外部プロセスからの出力を受信するためのマルチプレクサ */
+  ProcessMultiplexer& multiplexer_;
+
+  /** ワーカーエンジンを起動するのに用いる、外部プロセス */
+  Process external_process_;
+
+  /** 外部プロセスが起動している場合はtrue（send_mutex_で保護） */
+  bool started_ = false;
+
+  /** コマンド送信時及び外部プロセスの起動・終了時の排他制御用 */
+  std::mutex send_mutex_;
+
+  /** 受信したコマンドのキュー、探索状態及び死活監視の状態の排他制御用 */
+  mutable std::mutex receive_mutex_;
+
+  /** コマンドを受信した際や、探索が終了した際に通知するための条件変数 */
+  std::condition_variable receive_condition_;
+
+  /** 受信したが、まだ読み出されていないコマンド */
+  std::deque<std::string> received_lines_;
+
+  /** 外部プロセスの標準出力がEOFに達した場合はtrue */
+  std::atomic_bool eof_{false};
+
+  /** 探索中である場合はtrue */
+  std::atomic_bool searching_{false};
+
+  /** RecieveCommand()で待機する期限（Restart()中のみ設定する） */
+  std::chrono::steady_clock::time_point receive_deadline_ = std::chrono::steady_clock::time_point::max();
+
+  /** 死活監視のためのisreadyコマンドへの応答を待っている場合はtrue */
+  bool heartbeat_pending_ = false;
+
+  /** 死活監視のためのisreadyコマンドを送信した時刻 */
+  std::chrono::steady_clock::time_point heartbeat_time_;
+
+  /** 最後に探索が終了した時刻 */
+  std::chrono::steady_clock::time_point idle_since_;
+
+  /** 応答しなくなったことが確認された場合はtrue */
+  std::atomic_bool hung_{false};
+
+  /** 探索を割り当ててもよい場合はtrue */
+  std::atomic_bool available_{true};
+
+  /** ワーカーが通知してきたオプションの名前 */
+  std::set<std::string> options_;
+
+  /** バイナリ形式のinfoコマンドを用いている場合はtrue */
+  bool binary_info_ = false;
+};
+
+/**
+ * 複数のUsiWorkerの死活監視を行い、応答しなくなったワーカーを再起動するためのクラスです.
+ *
+ * 専用のスレッドで、一定間隔ごとに、
+ *   - 探索中でないワーカーには、isreadyコマンドを送る
+ *   - 応答しなくなったワーカーは、探索の割り当て対象から外したうえで、再起動する
+ * という処理を行います。再起動は、マスターのgoコマンドの処理とは別のスレッドで行われるので、
+ * 再起動に時間がかかっても、その間、他のワーカーだけで探索を続けることができます。
+ */
+class WorkerMonitor {
+ public:
+  /** 探索中でないワーカーに、isreadyコマンドを送る間隔（ミリ秒） */
+  static constexpr int kHeartbeatInterval = 2000;
+
+  /** isreadyコマンドへの応答を待つ最大の時間（ミリ秒） */
+  static constexpr int kResponseTimeout = 10000;
+
+  /** 再起動の際に、readyokコマンドを待つ最大の時間（ミリ秒） */
+  static constexpr int kRestartTimeout = 30000;
+
+  /** 再起動に失敗したワーカーを、再び再起動するまでの間隔（ミリ秒） */
+  static constexpr int kRetryInterval = 30000;
+
+  /**
+   * @param assignment_mutex マスターが、ワーカーに探索を割り当てる際にロックするmutex
+   *                         （ワーカーの利用可否は、このmutexをロックして変更する）
+   */
+  explicit WorkerMonitor(std::mutex& assignment_mutex)
+      : assignment_mutex_(assignment_mutex) {
+  }
+  ~WorkerMonitor() {
+    Stop();
+  }
+
+  /**
+   * 死活監視を開始します（すでに開始している場合は、何もしません）.
+   */
+  void Start(const std::vector<UsiWorker*>& workers);
+
+  /**
+   * 死活監視を終了します.
+   */
+  void Stop();
+
+ private:
+  void Run();
+  std::mutex& assignment_mutex_;
+  std::vector<UsiWorker*> workers_;
+  std::vector<std::chrono::steady_clock::time_point> next_restart_times_;
+  std::thread thread_;
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  bool running_ = false;
+};
+
+#endif /* !defined(MINIMUM) */
+#endif /* USI_WORKER_H_ */
@@ -0,0 +1,99 @@
+/*
+ * 技巧 (Gikou), a USI shogi (Japanese chess) playing engine.
+ * Copyright (C) 2016 Yosuke Demura
+ * except where otherwise indicated.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#if !defined(MINIMUM)
+
+#include "worker_protocol.h"
+
+#include <algorithm>
+#include <cstring>
+#include "process.h"
+#include "usi_output.h"
+#include "usi_protocol.h"
+
+std::atomic_bool WorkerProtocol::binary_info_enabled_{false};
+
+void WorkerProtocol::AppendInfoFrame(const InfoHeader& header,
+                                     const std::vector<Move>& pv,
+                                     std::string* const buffer) {
+  const size_t pv_size = std::min(pv.size(), size_t(Process::kMaxFramePayloadSize
+                                                     - 1 - sizeof(InfoHeader))
+                                             / sizeof(uint32_t));
+  const size_t payload_size = 1 + sizeof(InfoHeader) + pv_size * sizeof(uint32_t);
+
+  // 1. フレームのヘッダ
+  buffer->push_back(Process::kFrameMarker);
+  buffer->push_back(static_cast<char>(payload_size & 0xff));
+  buffer->push_back(static_cast<char>(payload_size >> 8));
+
+  // 2. ペイロード（フレームの種類、PV以外の情報、PV）
+  buffer->push_back(static_cast<char>(kInfoFrame));
+  InfoHeader temp = header;
+  temp.pv_size = static_cast<uint32_t>(pv_size);
+  temp.padding = 0;
+  buffer->append(reinterpret_cast<const char*>(&temp), sizeof(temp));
+  for (size_t i = 0; i < pv_size; ++i) {
+    uint32_t u32 = pv[i].ToUint32();
+    buffer->append(reinterpret_cast<const char*>(&u32), sizeof(u32));
+  }
+}
+
+void WorkerProtocol::SendFrames(const std::string& buffer) {
+  // フレームにはヌル文字や改行コードが含まれるので、行単位で解釈させずに、そのまま出力させる
+  g_usi_output.Write(buffer, true);
+}
+
+bool WorkerProtocol::DecodeInfoFrame(const std::string& payload,
+                                     UsiInfo* const info) {
+  // 1. フレームの種類とサイズを確認する
+  if (   payload.size() < 1 + sizeof(InfoHeader)
+      || static_cast<uint8_t>(payload[0]) != kInfoFrame) {
+    return false;
+  }
+  InfoHeader header;
+  std::memcpy(&header, payload.data() + 1, sizeof(header));
+  if (payload.size() != 1 + sizeof(InfoHeader) + header.pv_size * sizeof(uint32_t)) {
+    return false;
+  }
+
+  // 2. PV以外の情報を復元する
+  *info = UsiInfo();
+  info->depth = header.depth;
+  info->seldepth = header.seldepth;
+  info->time = header.time;
+  info->nodes = header.nodes;
+  info->nps = header.nps;
+  info->hashfull = header.hashfull;
+  info->multipv = header.multipv;
+  info->score = static_cast<Score>(header.score);
+  info->bound = static_cast<Bound>(header.bound);
+
+  // 3. PVを復元する
+  const char* moves = payload.data() + 1 + sizeof(InfoHeader);
+  info->pv.reserve(header.pv_size);
+  for (uint32_t i = 0; i < header.pv_size; ++i) {
+    uint32_t u32;
+    std::memcpy(&u32, moves + i * sizeof(u32), sizeof(u32));
+    info->pv.push_back(Move::FromUint32(u32).ToSfen());
+  }
+
+  return true;
+}
+
+#endif /* !defined(MINIMUM) */
@@ -0,0 +1,123 @@
+/*
+ * 技巧 (Gikou), a USI shogi (Japanese chess) playing engine.
+ * Copyright (C) 2016 Yosuke Demura
+ * except where otherwise indicated.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WORKER_PROTOCOL_H_
+#define WORKER_PROTOCOL_H_
+
+#if !defined(MINIMUM)
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "move.h"
+#include "types.h"
+
+struct UsiInfo;
+
+/**
+ * クラスタのマスターとワーカーとの間で、infoコマンドをバイナリ形式でやりとりするためのクラスです.
+ *
+ * 探索中のワーカーは大量のinfoコマンドを送ってくるため、テキスト形式のままだと、
+ * マスター側で文字列の解析に多くの時間を取られてしまいます。
+ * そこで、ワーカーのinfoコマンドの内容（評価値、ノード数、PVなど）を固定長のヘッダと
+ * 32ビットに詰めた指し手の列に変換し、フレームとして送信します。
+ *
+ * バイナリ形式を用いるかどうかは、usiコマンドの時点で、以下のように取り決めます。
+ *   1. ワーカーは、usiコマンドへの応答として、BinaryInfoオプション（check）を通知する
+ *   2. マスターは、BinaryInfoオプションが通知された場合に限り、その値をtrueに設定する
+ * BinaryInfoオプションを持たないエンジンに対しては、従来どおりテキスト形式で通信します。
+ * また、bestmoveコマンドなど、info以外のコマンドは、常にテキスト形式で送信されます。
+ *
+ * フレームの形式は、以下のとおりです（数値はリトルエンディアン）。
+ * <pre>
+ * [0x02] [ペイロード長: 16ビット] [ペイロード: フレームの種類(8ビット) + 本体]
+ * </pre>
+ * USIのコマンドは0x02で始まることはないので、テキストの行と混在させても区別できます。
+ * なお、ヘッダは構造体をそのまま送信するため、マスターとワーカーのバイトオーダーは同じである必要があります。
+ */
+class WorkerProtocol {
+ public:
+  /** バイナリ形式のinfoコマンドを有効にするためのUSIオプションの名前 */
+  static constexpr const char* kOptionName = "BinaryInfo";
+
+  /** フレームの種類 */
+  enum FrameType : uint8_t {
+    kInfoFrame = 1,
+  };
+
+  /**
+   * infoコマンドのうち、PV以外の部分です.
+   */
+  struct InfoHeader {
+    int64_t time;
+    int64_t nodes;
+    int64_t nps;
+    int32_t depth;
+    int32_t seldepth;
+    int32_t hashfull;
+    int32_t multipv;
+    int32_t score;
+    int32_t bound;
+    uint32_t pv_size;
+    uint32_t padding;
+  };
+
+  /**
+   * バイナリ形式のinfoコマンドを送信する設定になっている場合は、trueを返します（ワーカー側）.
+   */
+  static bool binary_info_enabled() {
+    return binary_info_enabled_;
+  }
+
+  /**
+   * バイナリ形式のinfoコマンドを送信するか否かを設定します（ワーカー側）.
+   */
+  static void set_binary_info_enabled(bool enabled) {
+    binary_info_enabled_ = enabled;
+  }
+
+  /**
+   * infoコマンドをフレームに変換し、バッファの末尾に追加します（ワーカー側）.
+   * @param header PV以外の情報
+   * @param pv     読み筋
+   * @param buffer フレームを追加するバッファ
+   */
+  static void AppendInfoFrame(const InfoHeader& header, const std::vector<Move>& pv,
+                              std::string* buffer);
+
+  /**
+   * バッファに溜めたフレームを、標準出力へ送信します（ワーカー側）.
+   */
+  static void SendFrames(const std::string& buffer);
+
+  /**
+   * フレームのペイロードから、infoコマンドを復元します（マスター側）.
+   * @param payload フレームのペイロード
+   * @param info    復元したinfoコマンドを保存する変数
+   * @return 復元に成功した場合はtrue
+   */
+  static bool DecodeInfoFrame(const std::string& payload, UsiInfo* info);
+
+ private:
+  static std::atomic_bool binary_info_enabled_;
+};
+
+#endif /* !defined(MINIMUM) */
+#endif /* WORKER_PROTOCOL_H_ */
@@ -0,0 +1,140 @@
+/*
+ * 技巧 (Gikou), a USI shogi (Japanese chess) playing engine.
+ * Copyright (C) 2016 Yosuke Demura
+ * except where otherwise indicated.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#if !defined(MINIMUM)
+
+#include "worker_topology.h"
+
+#include <climits>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include "synced_printf.h"
+
+namespace {
+
+/**
+ * 0以上の整数を読み取ります（"-"の場合は、0とします）.
+ */
+bool ParseNumber(const std::string& token, int* const value) {
+  if (token == "-") {
+    *value = 0;
+    return true;
+  }
+  char* end = nullptr;
+  long number = std::strtol(token.c_str(), &end, 10);
+  if (token.empty() || *end != '\0' || number < 0 || number > INT_MAX) {
+    return false;
+  }
+  *value = static_cast<int>(number);
+  return true;
+}
+
+/**
+ * "0-3,8,10-11"のような形式で指定されたCPUの番号を読み取ります（"-"の場合は、空とします）.
+ */
+bool ParseCpus(const std::string& token, std::vector<int>* const cpus) {
+  cpus->clear();
+  if (token == "-") {
+    return true;
+  }
+  std::istringstream is(token);
+  for (std::string range; std::getline(is, range, ','); ) {
+    size_t hyphen = range.find('-');
+    int first, last;
+    if (hyphen == std::string::npos) {
+      if (!ParseNumber(range, &first)) {
+        return false;
+      }
+      last = first;
+    } else if (   !ParseNumber(range.substr(0, hyphen), &first)
+               || !ParseNumber(range.substr(hyphen + 1), &last)
+               || first > last) {
+      return false;
+    }
+    for (int cpu = first; cpu <= last; ++cpu) {
+      cpus->push_back(cpu);
+    }
+  }
+  return !cpus->empty();
+}
+
+} // namespace
+
+WorkerTopology::WorkerTopology(const size_t num_workers,
+                               const WorkerConfig& master)
+    : configs_(num_workers) {
+  configs_.push_back(master);
+  configs_.back().role = WorkerConfig::kMaster;
+}
+
+bool WorkerTopology::ReadFromFile(const char* const file_name) {
+  std::ifstream file(file_name);
+  if (!file) {
+    return false;
+  }
+
+  std::vector<WorkerConfig> workers;
+  std::vector<WorkerConfig> masters;
+  int line_number = 0;
+  for (std::string line; std::getline(file, line); ) {
+    ++line_number;
+
+    // 1. コメント及び空行を読み飛ばす
+    std::istringstream is(line);
+    std::string role, threads, hash_size, cpus;
+    if (!(is >> role) || role[0] == '#') {
+      continue;
+    }
+
+    // 2. ワーカーの設定を読み取る
+    WorkerConfig config;
+    is >> threads >> hash_size >> cpus >> std::ws;
+    std::getline(is, config.command);
+    if (   (role != "worker" && role != "master")
+        || !ParseNumber(threads, &config.threads)
+        || !ParseNumber(hash_size, &config.hash_size)
+        || !ParseCpus(cpus, &config.cpus)
+        || config.command.empty()) {
+      SYNCED_PRINTF("info string %s:%d: Invalid worker configuration.\n",
+                    file_name, line_number);
+      return false;
+    }
+    if (role == "master") {
+      config.role = WorkerConfig::kMaster;
+      masters.push_back(config);
+    } else {
+      workers.push_back(config);
+    }
+  }
+
+  // 3. マスターがちょうど１台、ワーカーが１台以上あることを確認する
+  if (masters.size() != 1 || workers.empty()) {
+    SYNCED_PRINTF("info string %s: Exactly one master and at least one worker are required.\n",
+                  file_name);
+    return false;
+  }
+
+  // マスターは、常に最後の要素として保持する
+  configs_ = workers;
+  configs_.push_back(masters.front());
+  return true;
+}
+
+#endif /* !defined(MINIMUM) */
@@ -0,0 +1,109 @@
+/*
+ * 技巧 (Gikou), a USI shogi (Japanese chess) playing engine.
+ * Copyright (C) 2016 Yosuke Demura
+ * except where otherwise indicated.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WORKER_TOPOLOGY_H_
+#define WORKER_TOPOLOGY_H_
+
+#if !defined(MINIMUM)
+
+#include <string>
+#include <vector>
+
+/**
+ * クラスタや合議で用いる、１台のワーカーの設定です.
+ */
+struct WorkerConfig {
+  /** ワーカーの役割 */
+  enum Role {
+    kWorker, kMaster,
+  };
+
+  Role role = kWorker;
+
+  /** スレッド数（0ならば、マスターのThreadsオプションの値を用いる） */
+  int threads = 0;
+
+  /** ハッシュテーブルの大きさ（MB単位。0ならば、マスターのUSI_Hashオプションの値を用いる） */
+  int hash_size = 0;
+
+  /** ワーカーを実行するCPUの番号（空ならば、指定しない） */
+  std::vector<int> cpus;
+
+  /** ワーカーを起動するコマンド（/bin/shで実行される） */
+  std::string command = "./release";
+};
+
+/**
+ * クラスタや合議で用いる、ワーカーの構成です.
+ *
+ * 構成は、テキストファイルに、１行につき１台ずつ、以下の形式で記述します。
+ * <pre>
+ * # 役割  スレッド数  ハッシュ(MB)  CPU    コマンド
+ * worker  16          4096          0-15   ./release
+ * worker  16          4096          16-31  ./release
+ * worker  16          4096          32-47  ssh worker-3 "cd gikou/bin; taskset -c 0-15 ./release"
+ * master  16          4096          48-63  ./release
+ * </pre>
+ *   - 役割は、worker又はmasterのいずれかです（masterはちょうど１台、workerは１台以上必要です）。
+ *   - スレッド数、ハッシュ及びCPUは、"-"とすると、マスターのUSIオプションの値（CPUは指定なし）を用います。
+ *   - CPUは、"0-15"や"0,2,4,6"のように、Linuxのtasksetコマンドと同じ形式で指定します。
+ *     指定したCPUは、ローカルマシン上の外部プロセスにのみ適用されるので、リモートマシン上のワーカーの
+ *     CPUを指定したい場合は、上の例のように、コマンドの中でtasksetを用いてください。
+ *   - コマンドは、行末までが"exec"を付けて/bin/shに渡されます。ワーカーのプロセスを強制終了できるよう、
+ *     単一のコマンドを指定してください（"cd dir && ./release"のような場合は、sh -c '...'で囲みます）。
+ *   - "#"で始まる行と空行は、無視されます。
+ *
+ * マスターの設定は、常に最後の要素として保持されます。
+ */
+class WorkerTopology {
+ public:
+  /**
+   * マスター１台と、デフォルトの設定のワーカーからなる構成を作成します.
+   * @param num_workers マスター以外のワーカーの数
+   * @param master      マスターの設定
+   */
+  WorkerTopology(size_t num_workers, const WorkerConfig& master);
+
+  /**
+   * ファイルから構成を読み込みます.
+   * ファイルが存在しない場合や、書式に誤りがある場合は、構成は変更されません。
+   * @return 読み込みに成功した場合はtrue
+   */
+  bool ReadFromFile(const char* file_name);
+
+  /**
+   * マスターを含む、全てのワーカーの数を返します.
+   */
+  size_t size() const {
+    return configs_.size();
+  }
+
+  /**
+   * i番目のワーカーの設定を返します（最後の要素がマスターです）.
+   */
+  const WorkerConfig& at(size_t i) const {
+    return configs_.at(i);
+  }
+
+ private:
+  std::vector<WorkerConfig> configs_;
+};
+
+#endif /* !defined(MINIMUM) */
+#endif /* WORKER_TOPOLOGY_H_ */